@@ -0,0 +1,135 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/blob_file.h"
+
+#include "leveldb/env.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+
+namespace leveldb {
+
+void BlobIndex::EncodeTo(std::string* dst) const {
+  PutVarint64(dst, file_number);
+  PutVarint64(dst, offset);
+  PutVarint64(dst, size);
+}
+
+Status BlobIndex::DecodeFrom(const Slice& input) {
+  Slice in = input;
+  if (GetVarint64(&in, &file_number) &&
+      GetVarint64(&in, &offset) &&
+      GetVarint64(&in, &size) &&
+      in.empty()) {
+    return Status::OK();
+  } else {
+    return Status::Corruption("bad blob index");
+  }
+}
+
+BlobFileBuilder::BlobFileBuilder(WritableFile* file, uint64_t file_number)
+    : file_(file),
+      file_number_(file_number),
+      offset_(0),
+      num_entries_(0) {
+}
+
+Status BlobFileBuilder::Add(const Slice& user_key, const Slice& value,
+                            BlobIndex* index) {
+  assert(status_.ok());
+  header_.clear();
+  PutFixed32(&header_, 0);      // Checksum, filled in below
+  PutFixed32(&header_, static_cast<uint32_t>(user_key.size()));
+  PutFixed32(&header_, static_cast<uint32_t>(value.size()));
+  uint32_t crc = crc32c::Value(header_.data() + 4, header_.size() - 4);
+  crc = crc32c::Extend(crc, user_key.data(), user_key.size());
+  crc = crc32c::Extend(crc, value.data(), value.size());
+  EncodeFixed32(&header_[0], crc32c::Mask(crc));
+
+  status_ = file_->Append(header_);
+  if (status_.ok()) {
+    status_ = file_->Append(user_key);
+  }
+  if (status_.ok()) {
+    status_ = file_->Append(value);
+  }
+  if (status_.ok()) {
+    index->file_number = file_number_;
+    index->offset = offset_;
+    index->size = value.size();
+    offset_ += BlobRecordSize(user_key.size(), value.size());
+    num_entries_++;
+  }
+  return status_;
+}
+
+Status ReadBlobValue(RandomAccessFile* file,
+                     const BlobIndex& index,
+                     const Slice& user_key,
+                     bool verify_checksums,
+                     std::string* value) {
+  const size_t n = static_cast<size_t>(
+      BlobRecordSize(user_key.size(), index.size));
+  std::string scratch;
+  scratch.resize(n);
+  Slice contents;
+  Status s = file->Read(index.offset, n, &contents, &scratch[0]);
+  if (!s.ok()) {
+    return s;
+  }
+  if (contents.size() != n) {
+    return Status::Corruption("truncated blob record");
+  }
+
+  const char* data = contents.data();
+  const uint32_t key_size = DecodeFixed32(data + 4);
+  const uint32_t value_size = DecodeFixed32(data + 8);
+  const Slice key(data + kBlobRecordHeaderSize, key_size);
+  if (key_size != user_key.size() || value_size != index.size ||
+      key != user_key) {
+    return Status::Corruption("blob record does not match its index");
+  }
+  if (verify_checksums) {
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(data));
+    const uint32_t actual = crc32c::Value(data + 4, n - 4);
+    if (actual != crc) {
+      return Status::Corruption("blob record checksum mismatch");
+    }
+  }
+  value->assign(data + kBlobRecordHeaderSize + key_size, value_size);
+  return Status::OK();
+}
+
+Status ScanBlobFile(SequentialFile* file,
+                    uint64_t file_size,
+                    uint64_t* count,
+                    uint64_t* bytes) {
+  *count = 0;
+  *bytes = 0;
+  char header[kBlobRecordHeaderSize];
+  while (*bytes + kBlobRecordHeaderSize <= file_size) {
+    Slice result;
+    Status s = file->Read(kBlobRecordHeaderSize, &result, header);
+    if (!s.ok()) {
+      return s;
+    }
+    if (result.size() != kBlobRecordHeaderSize) {
+      break;
+    }
+    const uint64_t record_size = BlobRecordSize(
+        DecodeFixed32(result.data() + 4), DecodeFixed32(result.data() + 8));
+    if (*bytes + record_size > file_size) {
+      break;                    // Truncated record at the end of the file
+    }
+    s = file->Skip(record_size - kBlobRecordHeaderSize);
+    if (!s.ok()) {
+      return s;
+    }
+    (*count)++;
+    *bytes += record_size;
+  }
+  return Status::OK();
+}
+
+}  // namespace leveldb
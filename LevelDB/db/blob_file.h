@@ -0,0 +1,101 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Values of at least Options::min_blob_size bytes are kept out of the
+// tables in append-only blob files.  The table then holds a kTypeBlobIndex
+// entry whose value is an encoded BlobIndex that points at the record.
+//
+// A blob file is a plain sequence of records:
+//    checksum:   fixed32   masked crc32c of the rest of the record
+//    key_size:   fixed32
+//    value_size: fixed32
+//    key:        char[key_size]     user key the value was written for
+//    value:      char[value_size]
+
+#ifndef STORAGE_LEVELDB_DB_BLOB_FILE_H_
+#define STORAGE_LEVELDB_DB_BLOB_FILE_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class RandomAccessFile;
+class SequentialFile;
+class WritableFile;
+
+static const size_t kBlobRecordHeaderSize = 12;
+
+// Returns the number of bytes a record for the given key and value sizes
+// occupies in a blob file.
+inline uint64_t BlobRecordSize(size_t key_size, uint64_t value_size) {
+  return kBlobRecordHeaderSize + key_size + value_size;
+}
+
+struct BlobIndex {
+  uint64_t file_number;
+  uint64_t offset;            // Offset of the record in the blob file
+  uint64_t size;              // Size of the value
+
+  BlobIndex() : file_number(0), offset(0), size(0) { }
+
+  void EncodeTo(std::string* dst) const;
+  Status DecodeFrom(const Slice& input);
+};
+
+// Appends records to a blob file.  The caller owns the file and must
+// Sync() and Close() it once it is done adding records.
+class BlobFileBuilder {
+ public:
+  BlobFileBuilder(WritableFile* file, uint64_t file_number);
+
+  // Append a record for "value" and store its location in *index.
+  // REQUIRES: status().ok()
+  Status Add(const Slice& user_key, const Slice& value, BlobIndex* index);
+
+  uint64_t file_number() const { return file_number_; }
+
+  // Number of records added so far.
+  uint64_t NumEntries() const { return num_entries_; }
+
+  // Size of the file generated so far.
+  uint64_t FileSize() const { return offset_; }
+
+  Status status() const { return status_; }
+
+ private:
+  WritableFile* file_;
+  uint64_t file_number_;
+  uint64_t offset_;
+  uint64_t num_entries_;
+  Status status_;
+  std::string header_;
+
+  // No copying allowed
+  BlobFileBuilder(const BlobFileBuilder&);
+  void operator=(const BlobFileBuilder&);
+};
+
+// Read the value "index" points to from "file" into *value.  Returns a
+// corruption error if the record was not written for "user_key" or, when
+// verify_checksums is set, if its checksum does not match.
+extern Status ReadBlobValue(RandomAccessFile* file,
+                            const BlobIndex& index,
+                            const Slice& user_key,
+                            bool verify_checksums,
+                            std::string* value);
+
+// Count the complete records at the start of "file", whose size is
+// "file_size", without verifying their contents.  Stores the number of
+// records in *count and the number of bytes they occupy in *bytes.
+extern Status ScanBlobFile(SequentialFile* file,
+                           uint64_t file_size,
+                           uint64_t* count,
+                           uint64_t* bytes);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_BLOB_FILE_H_
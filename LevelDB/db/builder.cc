@@ -4,6 +4,8 @@
 
 #include "db/builder.h"
 
+#include <algorithm>
+#include "db/blob_file.h"
 #include "db/filename.h"
 #include "db/dbformat.h"
 #include "db/table_cache.h"
@@ -14,30 +16,179 @@
 
 namespace leveldb {
 
+namespace {
+class RateLimitedFile : public WritableFile {
+ public:
+  RateLimitedFile(WritableFile* base, RateLimiter* limiter,
+                  RateLimiter::Priority priority)
+      : base_(base), limiter_(limiter), priority_(priority) { }
+  virtual ~RateLimitedFile() { delete base_; }
+
+  virtual Status Append(const Slice& data) {
+    limiter_->Request(data.size(), priority_);
+    return base_->Append(data);
+  }
+  virtual Status Close() { return base_->Close(); }
+  virtual Status Flush() { return base_->Flush(); }
+  virtual Status Sync() { return base_->Sync(); }
+
+ private:
+  WritableFile* const base_;
+  RateLimiter* const limiter_;
+  const RateLimiter::Priority priority_;
+};
+}  // namespace
+
+WritableFile* NewRateLimitedFile(WritableFile* base,
+                                 RateLimiter* limiter,
+                                 RateLimiter::Priority priority) {
+  return new RateLimitedFile(base, limiter, priority);
+}
+
+CompressionType CompressionForLevel(const Options& options, int level) {
+  const std::vector<CompressionType>& per_level =
+      options.compression_per_level;
+  if (per_level.empty()) {
+    return options.compression;
+  }
+  if (level >= static_cast<int>(per_level.size())) {
+    return per_level.back();
+  }
+  return per_level[level];
+}
+
 Status BuildTable(const std::string& dbname,
                   Env* env,
                   const Options& options,
                   TableCache* table_cache,
                   Iterator* iter,
-                  FileMetaData* meta) {
+                  Iterator* range_del_iter,
+                  FileMetaData* meta,
+                  BlobFileMetaData* blob_meta) {
   Status s;
   meta->file_size = 0;
+  meta->has_range_deletions = false;
+  meta->num_entries = 0;
+  meta->num_deletions = 0;
+  meta->largest_seqno = 0;
+  meta->oldest_blob_file = 0;
+  if (blob_meta != NULL) {
+    blob_meta->total_count = 0;
+    blob_meta->total_bytes = 0;
+  }
   iter->SeekToFirst();
+  if (range_del_iter != NULL) {
+    range_del_iter->SeekToFirst();
+  }
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() ||
+      (range_del_iter != NULL && range_del_iter->Valid())) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
       return s;
     }
+    if (options.rate_limiter != NULL) {
+      file = NewRateLimitedFile(file, options.rate_limiter,
+                                RateLimiter::kHighPriority);
+    }
 
-    TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
-    for (; iter->Valid(); iter->Next()) {
+    meta->creation_time = env->NowMicros() / 1000000;
+    Options table_options = options;
+    table_options.compression = CompressionForLevel(options, 0);
+    table_options.compression_dictionary_bytes = 0;
+    TableBuilder* builder = new TableBuilder(table_options, file);
+    bool empty = !iter->Valid();
+    if (!empty) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
+    WritableFile* blob_file = NULL;
+    BlobFileBuilder* blob_builder = NULL;
+    std::string blob_key, blob_index;
+    for (; s.ok() && iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
-      builder->Add(key, iter->value());
+      if (blob_meta != NULL && options.min_blob_size > 0 &&
+          iter->value().size() >= options.min_blob_size &&
+          ExtractValueType(key) == kTypeValue) {
+        // Move the value to the blob file
+        if (blob_builder == NULL) {
+          s = env->NewWritableFile(BlobFileName(dbname, blob_meta->number),
+                                   &blob_file);
+          if (!s.ok()) {
+            break;
+          }
+          if (options.rate_limiter != NULL) {
+            blob_file = NewRateLimitedFile(blob_file, options.rate_limiter,
+                                           RateLimiter::kHighPriority);
+          }
+          blob_builder = new BlobFileBuilder(blob_file, blob_meta->number);
+          meta->oldest_blob_file = blob_meta->number;
+        }
+        BlobIndex index;
+        s = blob_builder->Add(ExtractUserKey(key), iter->value(), &index);
+        if (!s.ok()) {
+          break;
+        }
+        blob_index.clear();
+        index.EncodeTo(&blob_index);
+        blob_key.clear();
+        AppendInternalKey(&blob_key,
+                          ParsedInternalKey(ExtractUserKey(key),
+                                            ExtractSequence(key),
+                                            kTypeBlobIndex));
+        builder->Add(blob_key, blob_index);
+      } else {
+        builder->Add(key, iter->value());
+      }
+      meta->num_entries++;
+      if (ExtractValueType(key) == kTypeDeletion) {
+        meta->num_deletions++;
+      }
+      meta->largest_seqno = std::max(meta->largest_seqno,
+                                     ExtractSequence(key));
+    }
+
+    // The key range of the table also covers its range tombstones.  The
+    // end of a tombstone is exclusive, so the largest key is made to sort
+    // before all entries for the end key.
+    for (; range_del_iter != NULL && range_del_iter->Valid();
+         range_del_iter->Next()) {
+      Slice key = range_del_iter->key();
+      InternalKey begin, end(range_del_iter->value(), kMaxSequenceNumber,
+                             kTypeRangeDeletion);
+      begin.DecodeFrom(key);
+      if (empty ||
+          options.comparator->Compare(key, meta->smallest.Encode()) < 0) {
+        meta->smallest = begin;
+      }
+      if (empty ||
+          options.comparator->Compare(end.Encode(),
+                                      meta->largest.Encode()) > 0) {
+        meta->largest = end;
+      }
+      empty = false;
+      builder->AddRangeDeletion(key, range_del_iter->value());
+      meta->has_range_deletions = true;
+      meta->num_entries++;
+      meta->num_deletions++;
+      meta->largest_seqno = std::max(meta->largest_seqno,
+                                     ExtractSequence(key));
+    }
+
+    // Finish the blob file before the table that references it
+    if (blob_builder != NULL) {
+      if (s.ok()) {
+        blob_meta->total_count = blob_builder->NumEntries();
+        blob_meta->total_bytes = blob_builder->FileSize();
+        s = blob_file->Sync();
+      }
+      if (s.ok()) {
+        s = blob_file->Close();
+      }
+      delete blob_builder;
+      delete blob_file;
     }
 
     // Finish and check for builder errors
@@ -75,12 +226,19 @@ Status BuildTable(const std::string& dbname,
   // Check for input iterator errors
   if (!iter->status().ok()) {
     s = iter->status();
+  } else if (range_del_iter != NULL && !range_del_iter->status().ok()) {
+    s = range_del_iter->status();
   }
 
   if (s.ok() && meta->file_size > 0) {
     // Keep it
   } else {
     env->DeleteFile(fname);
+    if (meta->oldest_blob_file != 0) {
+      env->DeleteFile(BlobFileName(dbname, meta->oldest_blob_file));
+      blob_meta->total_count = 0;
+      blob_meta->total_bytes = 0;
+    }
   }
   return s;
 }
@@ -5,29 +5,50 @@
 #ifndef STORAGE_LEVELDB_DB_BUILDER_H_
 #define STORAGE_LEVELDB_DB_BUILDER_H_
 
+#include "leveldb/options.h"
+#include "leveldb/rate_limiter.h"
 #include "leveldb/status.h"
 
 namespace leveldb {
 
-struct Options;
+struct BlobFileMetaData;
 struct FileMetaData;
 
 class Env;
 class Iterator;
 class TableCache;
 class VersionEdit;
+class WritableFile;
 
 // Build a Table file from the contents of *iter.  The generated file
 // will be named according to meta->number.  On success, the rest of
 // *meta will be filled with metadata about the generated table.
 // If no data is present in *iter, meta->file_size will be set to
-// zero, and no Table file will be produced.
+// zero, and no Table file will be produced.  The table is compressed
+// as level-0 files are, without a dictionary.
+//
+// If "blob_meta" is non-NULL and Options::min_blob_size is set, large
+// values are written to the blob file named according to
+// blob_meta->number, whose record count and size are stored in
+// *blob_meta.  No blob file is produced if blob_meta->total_count is
+// zero.
 extern Status BuildTable(const std::string& dbname,
                          Env* env,
                          const Options& options,
                          TableCache* table_cache,
                          Iterator* iter,
-                         FileMetaData* meta);
+                         Iterator* range_del_iter,
+                         FileMetaData* meta,
+                         BlobFileMetaData* blob_meta);
+
+// Return the compression used for table files written to "level".
+extern CompressionType CompressionForLevel(const Options& options, int level);
+
+// Return a file that passes every write to "base" through "limiter"
+// first.  The result takes ownership of "base".
+extern WritableFile* NewRateLimitedFile(WritableFile* base,
+                                        RateLimiter* limiter,
+                                        RateLimiter::Priority priority);
 
 }  // namespace leveldb
 
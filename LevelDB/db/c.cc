@@ -185,6 +185,17 @@ void leveldb_delete(
   SaveError(errptr, db->rep->Delete(options->rep, Slice(key, keylen)));
 }
 
+void leveldb_delete_range(
+    leveldb_t* db,
+    const leveldb_writeoptions_t* options,
+    const char* begin_key, size_t begin_keylen,
+    const char* end_key, size_t end_keylen,
+    char** errptr) {
+  SaveError(errptr, db->rep->DeleteRange(options->rep,
+                                         Slice(begin_key, begin_keylen),
+                                         Slice(end_key, end_keylen)));
+}
+
 
 void leveldb_write(
     leveldb_t* db,
@@ -275,6 +286,19 @@ void leveldb_compact_range(
       (limit_key ? (b = Slice(limit_key, limit_key_len), &b) : NULL));
 }
 
+void leveldb_delete_files_in_range(
+    leveldb_t* db,
+    const char* start_key, size_t start_key_len,
+    const char* limit_key, size_t limit_key_len,
+    unsigned char ignore_snapshots,
+    char** errptr) {
+  Slice a, b;
+  SaveError(errptr, db->rep->DeleteFilesInRange(
+      (start_key ? (a = Slice(start_key, start_key_len), &a) : NULL),
+      (limit_key ? (b = Slice(limit_key, limit_key_len), &b) : NULL),
+      ignore_snapshots));
+}
+
 void leveldb_destroy_db(
     const leveldb_options_t* options,
     const char* name,
@@ -359,6 +383,13 @@ void leveldb_writebatch_delete(
   b->rep.Delete(Slice(key, klen));
 }
 
+void leveldb_writebatch_delete_range(
+    leveldb_writebatch_t* b,
+    const char* begin_key, size_t begin_klen,
+    const char* end_key, size_t end_klen) {
+  b->rep.DeleteRange(Slice(begin_key, begin_klen), Slice(end_key, end_klen));
+}
+
 void leveldb_writebatch_iterate(
     leveldb_writebatch_t* b,
     void* state,
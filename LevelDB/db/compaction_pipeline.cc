@@ -0,0 +1,382 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/compaction_pipeline.h"
+
+#include <assert.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// Entries are handed over in batches of about this many bytes, and at
+// most this many batches wait to be consumed.
+static const size_t kBatchBytes = 64 << 10;
+static const size_t kMaxQueuedBatches = 8;
+
+// Likewise for the data appended to the files of a writer.
+static const size_t kChunkBytes = 64 << 10;
+static const size_t kMaxQueuedChunks = 16;
+
+class PrefetchingIterator : public Iterator {
+ public:
+  PrefetchingIterator(Iterator* base, Env* env)
+      : base_(base),
+        cv_(&mu_),
+        stop_(false),
+        done_(false),
+        current_(NULL),
+        pos_(0),
+        index_(0) {
+    env->StartThread(&PrefetchingIterator::Run, this);
+    NextBatch();
+  }
+
+  virtual ~PrefetchingIterator() {
+    {
+      MutexLock l(&mu_);
+      stop_ = true;
+      cv_.SignalAll();
+      while (!done_) {
+        cv_.Wait();
+      }
+    }
+    delete current_;
+    for (size_t i = 0; i < queue_.size(); i++) {
+      delete queue_[i];
+    }
+    delete base_;
+  }
+
+  virtual bool Valid() const { return current_ != NULL; }
+  virtual void SeekToFirst() { Unsupported(); }
+  virtual void SeekToLast() { Unsupported(); }
+  virtual void Seek(const Slice& target) { Unsupported(); }
+  virtual void Prev() { Unsupported(); }
+
+  virtual void Next() {
+    assert(Valid());
+    pos_ += current_->sizes[index_] + current_->sizes[index_ + 1];
+    index_ += 2;
+    if (index_ == current_->sizes.size()) {
+      NextBatch();
+    }
+  }
+
+  virtual Slice key() const {
+    assert(Valid());
+    return Slice(current_->data.data() + pos_, current_->sizes[index_]);
+  }
+
+  virtual Slice value() const {
+    assert(Valid());
+    return Slice(current_->data.data() + pos_ + current_->sizes[index_],
+                 current_->sizes[index_ + 1]);
+  }
+
+  virtual Status status() const {
+    if (!unsupported_.ok()) {
+      return unsupported_;
+    }
+    MutexLock l(&mu_);
+    return status_;
+  }
+
+ private:
+  struct Batch {
+    std::string data;            // Keys and values, back to back
+    std::vector<size_t> sizes;   // Key size and value size of each entry
+  };
+
+  static void Run(void* arg) {
+    reinterpret_cast<PrefetchingIterator*>(arg)->Prefetch();
+  }
+
+  // Runs in the prefetching thread
+  void Prefetch() {
+    Batch* batch = new Batch;
+    bool stopped = false;
+    while (base_->Valid()) {
+      const Slice key = base_->key();
+      const Slice value = base_->value();
+      batch->data.append(key.data(), key.size());
+      batch->data.append(value.data(), value.size());
+      batch->sizes.push_back(key.size());
+      batch->sizes.push_back(value.size());
+      base_->Next();
+      if (batch->data.size() >= kBatchBytes) {
+        if (!Push(batch)) {
+          stopped = true;
+          break;
+        }
+        batch = new Batch;
+      }
+    }
+    if (!stopped) {
+      if (batch->sizes.empty()) {
+        delete batch;
+      } else {
+        Push(batch);
+      }
+    }
+
+    MutexLock l(&mu_);
+    status_ = base_->status();
+    done_ = true;
+    cv_.SignalAll();
+  }
+
+  // Queue "batch" once there is room.  Returns false, deleting "batch",
+  // if the iterator is being destroyed.
+  bool Push(Batch* batch) {
+    MutexLock l(&mu_);
+    while (queue_.size() >= kMaxQueuedBatches && !stop_) {
+      cv_.Wait();
+    }
+    if (stop_) {
+      delete batch;
+      return false;
+    }
+    queue_.push_back(batch);
+    cv_.SignalAll();
+    return true;
+  }
+
+  // Move on to the next batch, waiting for it if necessary
+  void NextBatch() {
+    delete current_;
+    current_ = NULL;
+    pos_ = 0;
+    index_ = 0;
+    MutexLock l(&mu_);
+    while (queue_.empty() && !done_) {
+      cv_.Wait();
+    }
+    if (!queue_.empty()) {
+      current_ = queue_.front();
+      queue_.pop_front();
+      cv_.SignalAll();
+    }
+  }
+
+  void Unsupported() {
+    unsupported_ = Status::NotSupported("prefetching iterator only moves "
+                                        "forward");
+    delete current_;
+    current_ = NULL;
+  }
+
+  Iterator* const base_;  // Only used by the prefetching thread
+
+  // State shared with the prefetching thread
+  mutable port::Mutex mu_;
+  port::CondVar cv_;
+  std::deque<Batch*> queue_;
+  bool stop_;     // The iterator is being destroyed
+  bool done_;     // The prefetching thread has finished
+  Status status_;
+
+  Batch* current_;   // NULL once all entries have been consumed
+  size_t pos_;       // Offset of the current entry in current_->data
+  size_t index_;     // Index of its key size in current_->sizes
+  Status unsupported_;
+};
+
+class BackgroundWriterFile;
+
+// Data appended to a file, waiting to be handed to its base file
+struct Chunk {
+  BackgroundWriterFile* file;
+  std::string data;
+};
+
+class WriterThread : public BackgroundWriter {
+ public:
+  explicit WriterThread(Env* env)
+      : cv(&mu),
+        stop_(false),
+        done_(false) {
+    env->StartThread(&WriterThread::Run, this);
+  }
+
+  virtual ~WriterThread() {
+    MutexLock l(&mu);
+    assert(queue.empty());
+    stop_ = true;
+    cv.SignalAll();
+    while (!done_) {
+      cv.Wait();
+    }
+  }
+
+  // State shared with the files using the writer
+  port::Mutex mu;
+  port::CondVar cv;
+  std::deque<Chunk> queue;
+
+ private:
+  static void Run(void* arg) {
+    reinterpret_cast<WriterThread*>(arg)->Write();
+  }
+
+  void Write();
+
+  bool stop_;     // The writer is being destroyed
+  bool done_;     // The writing thread has finished
+};
+
+class BackgroundWriterFile : public WritableFile {
+ public:
+  BackgroundWriterFile(WritableFile* base, WriterThread* writer)
+      : base_(base),
+        writer_(writer),
+        queued_(0) {
+  }
+
+  virtual ~BackgroundWriterFile() {
+    HandOff();
+    {
+      MutexLock l(&writer_->mu);
+      while (queued_ > 0) {
+        writer_->cv.Wait();
+      }
+    }
+    delete base_;
+  }
+
+  virtual Status Append(const Slice& data) {
+    buffer_.append(data.data(), data.size());
+    if (buffer_.size() >= kChunkBytes) {
+      return HandOff();
+    }
+    MutexLock l(&writer_->mu);
+    return status_;
+  }
+
+  virtual Status Flush() {
+    return HandOff();
+  }
+
+  virtual Status Sync() {
+    Status s = Drain();
+    if (s.ok()) {
+      s = base_->Sync();
+    }
+    return s;
+  }
+
+  virtual Status Close() {
+    Status s = Drain();
+    if (s.ok()) {
+      s = base_->Close();
+    }
+    return s;
+  }
+
+ private:
+  friend class WriterThread;
+
+  // Queue the buffered data once there is room
+  Status HandOff() {
+    MutexLock l(&writer_->mu);
+    if (!buffer_.empty()) {
+      while (writer_->queue.size() >= kMaxQueuedChunks && status_.ok()) {
+        writer_->cv.Wait();
+      }
+      Chunk chunk;
+      chunk.file = this;
+      writer_->queue.push_back(chunk);
+      writer_->queue.back().data.swap(buffer_);
+      queued_++;
+      writer_->cv.SignalAll();
+    }
+    return status_;
+  }
+
+  // Wait until all data has been handed to base_, and flush it
+  Status Drain() {
+    HandOff();
+    Status s;
+    {
+      MutexLock l(&writer_->mu);
+      while (queued_ > 0) {
+        writer_->cv.Wait();
+      }
+      s = status_;
+    }
+    if (s.ok()) {
+      s = base_->Flush();
+    }
+    return s;
+  }
+
+  WritableFile* const base_;
+  WriterThread* const writer_;
+  std::string buffer_;  // Appended data not yet handed off
+
+  // Guarded by writer_->mu
+  int queued_;          // Chunks queued or being appended to base_
+  Status status_;
+};
+
+// Runs in the writing thread.  Chunks queued for a file after an error
+// are dropped.
+void WriterThread::Write() {
+  MutexLock l(&mu);
+  while (true) {
+    while (queue.empty() && !stop_) {
+      cv.Wait();
+    }
+    if (queue.empty()) {
+      break;
+    }
+    BackgroundWriterFile* file = queue.front().file;
+    std::string data;
+    data.swap(queue.front().data);
+    queue.pop_front();
+    cv.SignalAll();
+    const bool ok = file->status_.ok();
+
+    mu.Unlock();
+    Status s;
+    if (ok) {
+      s = file->base_->Append(data);
+    }
+    mu.Lock();
+
+    if (!s.ok() && file->status_.ok()) {
+      file->status_ = s;
+    }
+    file->queued_--;
+    cv.SignalAll();
+  }
+  done_ = true;
+  cv.SignalAll();
+}
+
+}  // namespace
+
+Iterator* NewPrefetchingIterator(Iterator* base, Env* env) {
+  return new PrefetchingIterator(base, env);
+}
+
+BackgroundWriter::~BackgroundWriter() { }
+
+BackgroundWriter* NewBackgroundWriter(Env* env) {
+  return new WriterThread(env);
+}
+
+WritableFile* NewBackgroundWriterFile(WritableFile* base,
+                                      BackgroundWriter* writer) {
+  return new BackgroundWriterFile(base, static_cast<WriterThread*>(writer));
+}
+
+}  // namespace leveldb
@@ -0,0 +1,49 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Stages that let a compaction read its input, merge it, and write its
+// output on separate threads, connected by bounded queues.
+
+#ifndef STORAGE_LEVELDB_DB_COMPACTION_PIPELINE_H_
+#define STORAGE_LEVELDB_DB_COMPACTION_PIPELINE_H_
+
+namespace leveldb {
+
+class Env;
+class Iterator;
+class WritableFile;
+
+// Return an iterator that yields the entries of "base" from its current
+// position onwards.  "base" is advanced in a thread of its own, which
+// reads and decompresses the blocks of the input ahead of the caller and
+// buffers a bounded number of entries.  The result only supports Valid(),
+// key(), value(), Next() and status().  It takes ownership of "base".
+extern Iterator* NewPrefetchingIterator(Iterator* base, Env* env);
+
+// A thread that appends the data of the files created for it by
+// NewBackgroundWriterFile() to their base files.  A compaction uses a
+// single writer for all of its output files rather than starting a
+// thread per file.
+class BackgroundWriter {
+ public:
+  // Waits for the thread to finish.
+  // REQUIRES: the files created for the writer have been deleted.
+  virtual ~BackgroundWriter();
+};
+
+// Return a new writer with a thread of its own.
+extern BackgroundWriter* NewBackgroundWriter(Env* env);
+
+// Return a file that hands the data appended to it to "writer", which
+// appends it to "base".  Append() and Flush() only block while a bounded
+// amount of data is waiting to be written by "writer".  Sync() and
+// Close() wait until all data has been handed to "base".  An error from
+// "base" is returned by the next call.  The result takes ownership of
+// "base".
+extern WritableFile* NewBackgroundWriterFile(WritableFile* base,
+                                             BackgroundWriter* writer);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_COMPACTION_PIPELINE_H_
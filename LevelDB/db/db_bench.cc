@@ -8,10 +8,14 @@
 #include "db/db_impl.h"
 #include "db/version_set.h"
 #include "leveldb/cache.h"
+#include "leveldb/compressor.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -34,7 +38,14 @@
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
 //      crc32c        -- repeated crc32c of 4K of data
+//      blockscan     -- iterate over 1G of 4K table blocks holding values
+//                       of --value_size bytes, in --block_format_version;
+//                       blockreverse likewise, in reverse order
 //      acquireload   -- load N*1000 times
+//      snappycomp    -- compress 1G of 4K blocks with snappy; likewise
+//                       zlibcomp, lz4comp and zstdcomp
+//      snappyuncomp  -- uncompress 1G of 4K blocks compressed with snappy;
+//                       likewise zlibuncomp, lz4uncomp and zstduncomp
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
@@ -94,6 +105,51 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// Compaction style: 0 for leveled, 1 for universal compaction
+// (initialized to default value by "main")
+static int FLAGS_compaction_style = 0;
+
+// Size ratio and sorted run limit for universal compaction
+// (initialized to default values by "main")
+static int FLAGS_universal_size_ratio = 0;
+static int FLAGS_universal_max_sorted_runs = 0;
+
+// File picked by leveled compaction: 0 for round robin, 1 for the least
+// overlapping file, 2 for the oldest data.  Compare the write-amp that
+// the write benchmarks report.
+// (initialized to default value by "main")
+static int FLAGS_compaction_pri = 0;
+
+// If true, compactions read, merge and write in separate threads
+static bool FLAGS_pipelined_compaction = false;
+
+// Number of threads that compress the blocks of each table written.
+// (initialized to default value by "main")
+static int FLAGS_compression_threads = 0;
+
+// Values of at least this many bytes are stored in blob files; 0 disables.
+// (initialized to default value by "main")
+static int FLAGS_min_blob_size = 0;
+
+// Layout of table files: 0 for block-based, 1 for plain tables, 2 for
+// hash tables.
+static int FLAGS_table_format = 0;
+
+// Encoding of the entries of data blocks: 1 or 2.
+// (initialized to default value by "main")
+static int FLAGS_block_format_version = 0;
+
+// Codec for table blocks: none, snappy, zlib, lz4 or zstd.
+static const char* FLAGS_compression = "snappy";
+
+// If non-NULL, comma-separated codecs for the table files of each level,
+// starting at level 0, e.g. "none,none,snappy,zstd".
+static const char* FLAGS_compression_per_level = NULL;
+
+// Size of the compression dictionary of each table written by compactions;
+// 0 disables dictionaries.
+static int FLAGS_compression_dictionary_bytes = 0;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -138,6 +194,40 @@ class RandomGenerator {
   }
 };
 
+static const struct {
+  const char* name;
+  CompressionType type;
+} kCompressionNames[] = {
+  { "none", kNoCompression },
+  { "snappy", kSnappyCompression },
+  { "zlib", kZlibCompression },
+  { "lz4", kLZ4Compression },
+  { "zstd", kZstdCompression }
+};
+
+static bool ParseCompressionType(const Slice& name, CompressionType* type) {
+  const size_t count = sizeof(kCompressionNames) / sizeof(kCompressionNames[0]);
+  for (size_t i = 0; i < count; i++) {
+    if (name == Slice(kCompressionNames[i].name)) {
+      *type = kCompressionNames[i].type;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Return true if "name" is a codec name followed by "suffix", and store
+// the codec in *type.
+static bool ParseCompressionBenchmark(const Slice& name, const char* suffix,
+                                      CompressionType* type) {
+  const size_t n = strlen(suffix);
+  if (name.size() <= n || Slice(name.data() + name.size() - n, n) != suffix) {
+    return false;
+  }
+  return ParseCompressionType(Slice(name.data(), name.size() - n), type) &&
+      *type != kNoCompression;
+}
+
 static Slice TrimSpace(Slice s) {
   size_t start = 0;
   while (start < s.size() && isspace(s[start])) {
@@ -310,6 +400,7 @@ class Benchmark {
   WriteOptions write_options_;
   int reads_;
   int heap_counter_;
+  CompressionType compression_type_;  // Codec of the compression benchmarks
 
   void PrintHeader() {
     const int kKeySize = 16;
@@ -325,6 +416,23 @@ class Benchmark {
     fprintf(stdout, "FileSize:   %.1f MB (estimated)\n",
             (((kKeySize + FLAGS_value_size * FLAGS_compression_ratio) * num_)
              / 1048576.0));
+    static const char* kPriNames[] = {
+      "round-robin", "min-overlapping-ratio", "oldest-largest-seq-first"
+    };
+    if (FLAGS_compaction_style == kUniversalCompaction) {
+      fprintf(stdout, "Compaction: universal\n");
+    } else {
+      fprintf(stdout, "Compaction: level (%s)\n",
+              kPriNames[FLAGS_compaction_pri]);
+    }
+    fprintf(stdout, "Compression: %s\n",
+            FLAGS_compression_per_level != NULL ? FLAGS_compression_per_level
+                                                : FLAGS_compression);
+    fprintf(stdout, "Tables:     %s\n",
+            FLAGS_table_format == kPlainTable ? "plain"
+            : FLAGS_table_format == kHashTable ? "hash" : "block-based");
+    fprintf(stdout, "Blocks:     format version %d\n",
+            FLAGS_block_format_version);
     PrintWarnings();
     fprintf(stdout, "------------------------------------------------\n");
   }
@@ -348,6 +456,13 @@ class Benchmark {
     } else if (compressed.size() >= sizeof(text)) {
       fprintf(stdout, "WARNING: Snappy compression is not effective\n");
     }
+
+    CompressionType type;
+    if (ParseCompressionType(FLAGS_compression, &type) &&
+        type != kNoCompression && GetCompressor(type) == NULL) {
+      fprintf(stdout, "WARNING: %s compression is not available\n",
+              FLAGS_compression);
+    }
   }
 
   void PrintEnvironment() {
@@ -396,7 +511,8 @@ class Benchmark {
     value_size_(FLAGS_value_size),
     entries_per_batch_(1),
     reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
-    heap_counter_(0) {
+    heap_counter_(0),
+    compression_type_(kNoCompression) {
     std::vector<std::string> files;
     Env::Default()->GetChildren(FLAGS_db, &files);
     for (size_t i = 0; i < files.size(); i++) {
@@ -491,12 +607,18 @@ class Benchmark {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
+      } else if (name == Slice("blockscan")) {
+        method = &Benchmark::BlockScan;
+      } else if (name == Slice("blockreverse")) {
+        method = &Benchmark::BlockReverse;
       } else if (name == Slice("acquireload")) {
         method = &Benchmark::AcquireLoad;
-      } else if (name == Slice("snappycomp")) {
-        method = &Benchmark::SnappyCompress;
-      } else if (name == Slice("snappyuncomp")) {
-        method = &Benchmark::SnappyUncompress;
+      } else if (ParseCompressionBenchmark(name, "uncomp",
+                                           &compression_type_)) {
+        method = &Benchmark::Uncompress;
+      } else if (ParseCompressionBenchmark(name, "comp",
+                                           &compression_type_)) {
+        method = &Benchmark::Compress;
       } else if (name == Slice("heapprofile")) {
         HeapProfile();
       } else if (name == Slice("stats")) {
@@ -608,7 +730,8 @@ class Benchmark {
   void Crc32c(ThreadState* thread) {
     // Checksum about 500MB of data total
     const int size = 4096;
-    const char* label = "(4K per op)";
+    const char* label = crc32c::IsHardwareAccelerated()
+        ? "(4K per op, hardware)" : "(4K per op, software)";
     std::string data(size, 'x');
     int64_t bytes = 0;
     uint32_t crc = 0;
@@ -624,6 +747,66 @@ class Benchmark {
     thread->stats.AddMessage(label);
   }
 
+  void BlockScan(ThreadState* thread) {
+    ScanBlocks(thread, false);
+  }
+
+  void BlockReverse(ThreadState* thread) {
+    ScanBlocks(thread, true);
+  }
+
+  void ScanBlocks(ThreadState* thread, bool reverse) {
+    // Blocks of tables hold internal keys
+    InternalKeyComparator icmp(BytewiseComparator());
+    Options options;
+    options.comparator = &icmp;
+    options.block_format_version = FLAGS_block_format_version;
+    BlockBuilder builder(&options);
+    RandomGenerator gen;
+    char key[100];
+    std::string ikey;
+    int entries = 0;
+    while (builder.CurrentSizeEstimate() < options.block_size) {
+      snprintf(key, sizeof(key), "%016d", entries);
+      ikey.clear();
+      AppendInternalKey(&ikey, ParsedInternalKey(key, entries, kTypeValue));
+      builder.Add(ikey, gen.Generate(value_size_));
+      entries++;
+    }
+    BlockContents contents;
+    contents.data = builder.Finish();
+    contents.cachable = false;
+    contents.heap_allocated = false;
+    Block block(contents);
+
+    int64_t bytes = 0;
+    int found = 0;
+    while (bytes < 1024 * 1048576) {  // Scan 1G
+      Iterator* iter = block.NewIterator(&icmp);
+      found = 0;
+      if (reverse) {
+        for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+          found++;
+        }
+      } else {
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+          found++;
+        }
+      }
+      delete iter;
+      bytes += block.size();
+      thread->stats.FinishedSingleOp();
+    }
+    if (found != entries) {
+      fprintf(stderr, "scanned %d entries instead of %d\n", found, entries);
+      exit(1);
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d entries per block)", entries);
+    thread->stats.AddBytes(bytes);
+    thread->stats.AddMessage(msg);
+  }
+
   void AcquireLoad(ThreadState* thread) {
     int dummy;
     port::AtomicPointer ap(&dummy);
@@ -640,22 +823,27 @@ class Benchmark {
     if (ptr == NULL) exit(1); // Disable unused variable warning.
   }
 
-  void SnappyCompress(ThreadState* thread) {
+  void Compress(ThreadState* thread) {
+    const Compressor* compressor = GetCompressor(compression_type_);
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
     int64_t bytes = 0;
     int64_t produced = 0;
-    bool ok = true;
+    bool ok = (compressor != NULL);
     std::string compressed;
     while (ok && bytes < 1024 * 1048576) {  // Compress 1G
-      ok = port::Snappy_Compress(input.data(), input.size(), &compressed);
+      ok = compressor->Compress(input, &compressed);
       produced += compressed.size();
       bytes += input.size();
       thread->stats.FinishedSingleOp();
     }
 
-    if (!ok) {
-      thread->stats.AddMessage("(snappy failure)");
+    if (compressor == NULL) {
+      thread->stats.AddMessage("(codec not available)");
+    } else if (!ok) {
+      char buf[100];
+      snprintf(buf, sizeof(buf), "(%s failure)", compressor->Name());
+      thread->stats.AddMessage(buf);
     } else {
       char buf[100];
       snprintf(buf, sizeof(buf), "(output: %.1f%%)",
@@ -665,23 +853,27 @@ class Benchmark {
     }
   }
 
-  void SnappyUncompress(ThreadState* thread) {
+  void Uncompress(ThreadState* thread) {
+    const Compressor* compressor = GetCompressor(compression_type_);
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
     std::string compressed;
-    bool ok = port::Snappy_Compress(input.data(), input.size(), &compressed);
+    bool ok = (compressor != NULL && compressor->Compress(input, &compressed));
     int64_t bytes = 0;
     char* uncompressed = new char[input.size()];
     while (ok && bytes < 1024 * 1048576) {  // Compress 1G
-      ok =  port::Snappy_Uncompress(compressed.data(), compressed.size(),
-                                    uncompressed);
+      ok = compressor->Uncompress(compressed, uncompressed);
       bytes += input.size();
       thread->stats.FinishedSingleOp();
     }
     delete[] uncompressed;
 
-    if (!ok) {
-      thread->stats.AddMessage("(snappy failure)");
+    if (compressor == NULL) {
+      thread->stats.AddMessage("(codec not available)");
+    } else if (!ok) {
+      char buf[100];
+      snprintf(buf, sizeof(buf), "(%s failure)", compressor->Name());
+      thread->stats.AddMessage(buf);
     } else {
       thread->stats.AddBytes(bytes);
     }
@@ -695,6 +887,32 @@ class Benchmark {
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.compaction_style =
+        static_cast<CompactionStyle>(FLAGS_compaction_style);
+    options.universal_size_ratio = FLAGS_universal_size_ratio;
+    options.universal_max_sorted_runs = FLAGS_universal_max_sorted_runs;
+    options.compaction_pri = static_cast<CompactionPri>(FLAGS_compaction_pri);
+    options.pipelined_compaction = FLAGS_pipelined_compaction;
+    options.compression_threads = FLAGS_compression_threads;
+    options.min_blob_size = FLAGS_min_blob_size;
+    options.table_format = static_cast<TableFormat>(FLAGS_table_format);
+    options.block_format_version = FLAGS_block_format_version;
+    ParseCompressionType(FLAGS_compression, &options.compression);
+    options.compression_dictionary_bytes = FLAGS_compression_dictionary_bytes;
+    if (FLAGS_compression_per_level != NULL) {
+      Slice list = FLAGS_compression_per_level;
+      while (!list.empty()) {
+        const char* comma = strchr(list.data(), ',');
+        size_t n = (comma == NULL) ? list.size() : comma - list.data();
+        CompressionType type;
+        if (!ParseCompressionType(Slice(list.data(), n), &type)) {
+          fprintf(stderr, "unknown codec in --compression_per_level\n");
+          exit(1);
+        }
+        options.compression_per_level.push_back(type);
+        list.remove_prefix(comma == NULL ? n : n + 1);
+      }
+    }
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -738,6 +956,12 @@ class Benchmark {
       }
     }
     thread->stats.AddBytes(bytes);
+
+    // Bytes written by flushes and compactions so far, per byte written
+    std::string write_amp;
+    if (db_->GetProperty("leveldb.write-amplification", &write_amp)) {
+      thread->stats.AddMessage("(write-amp " + write_amp + ")");
+    }
   }
 
   void ReadSequential(ThreadState* thread) {
@@ -925,12 +1149,21 @@ class Benchmark {
 int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
+  FLAGS_compaction_style = leveldb::Options().compaction_style;
+  FLAGS_universal_size_ratio = leveldb::Options().universal_size_ratio;
+  FLAGS_universal_max_sorted_runs =
+      leveldb::Options().universal_max_sorted_runs;
+  FLAGS_compaction_pri = leveldb::Options().compaction_pri;
+  FLAGS_compression_threads = leveldb::Options().compression_threads;
+  FLAGS_min_blob_size = leveldb::Options().min_blob_size;
+  FLAGS_block_format_version = leveldb::Options().block_format_version;
   std::string default_db_path;
 
   for (int i = 1; i < argc; i++) {
     double d;
     int n;
     char junk;
+    leveldb::CompressionType type;
     if (leveldb::Slice(argv[i]).starts_with("--benchmarks=")) {
       FLAGS_benchmarks = argv[i] + strlen("--benchmarks=");
     } else if (sscanf(argv[i], "--compression_ratio=%lf%c", &d, &junk) == 1) {
@@ -941,6 +1174,20 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--use_existing_db=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_use_existing_db = n;
+    } else if (sscanf(argv[i], "--pipelined_compaction=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_pipelined_compaction = n;
+    } else if (sscanf(argv[i], "--compression_threads=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_compression_threads = n;
+    } else if (sscanf(argv[i], "--min_blob_size=%d%c", &n, &junk) == 1) {
+      FLAGS_min_blob_size = n;
+    } else if (sscanf(argv[i], "--table_format=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= 2) {
+      FLAGS_table_format = n;
+    } else if (sscanf(argv[i], "--block_format_version=%d%c",
+                      &n, &junk) == 1 && (n == 1 || n == 2)) {
+      FLAGS_block_format_version = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -957,6 +1204,26 @@ int main(int argc, char** argv) {
       FLAGS_bloom_bits = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--compaction_style=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_compaction_style = n;
+    } else if (sscanf(argv[i], "--universal_size_ratio=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_universal_size_ratio = n;
+    } else if (sscanf(argv[i], "--universal_max_sorted_runs=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_universal_max_sorted_runs = n;
+    } else if (sscanf(argv[i], "--compaction_pri=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= 2) {
+      FLAGS_compaction_pri = n;
+    } else if (strncmp(argv[i], "--compression=", 14) == 0 &&
+               leveldb::ParseCompressionType(argv[i] + 14, &type)) {
+      FLAGS_compression = argv[i] + 14;
+    } else if (sscanf(argv[i], "--compression_dictionary_bytes=%d%c",
+                      &n, &junk) == 1 && n >= 0) {
+      FLAGS_compression_dictionary_bytes = n;
+    } else if (strncmp(argv[i], "--compression_per_level=", 24) == 0) {
+      FLAGS_compression_per_level = argv[i] + 24;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
@@ -5,21 +5,27 @@
 #include "db/db_impl.h"
 
 #include <algorithm>
+#include <map>
 #include <set>
 #include <string>
 #include <stdint.h>
 #include <stdio.h>
 #include <vector>
+#include "db/blob_file.h"
 #include "db/builder.h"
+#include "db/compaction_pipeline.h"
 #include "db/db_iter.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/status.h"
@@ -57,30 +63,79 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // Entries with sequence numbers > largest_snapshot are not visible in
+  // any snapshot, so the compaction filter may change them.  If there are
+  // no snapshots, no entry is visible in one, and largest_snapshot is 0.
+  SequenceNumber largest_snapshot;
+  bool has_snapshots;
+
+  // Returns true if no snapshot sees entries with sequence number "seq"
+  bool HiddenFromSnapshots(SequenceNumber seq) const {
+    return !has_snapshots || seq > largest_snapshot;
+  }
+
   // Files produced by compaction
-  struct Output {
-    uint64_t number;
-    uint64_t file_size;
-    InternalKey smallest, largest;
-  };
+  typedef FileMetaData Output;
   std::vector<Output> outputs;
 
   // State kept for output being generated
   WritableFile* outfile;
   TableBuilder* builder;
 
+  // Writes all output files if options.pipelined_compaction is set
+  BackgroundWriter* writer;
+
   uint64_t total_bytes;
 
+  // Blob files produced by compaction, and the state kept for the one
+  // being generated
+  std::vector<BlobFileMetaData> blob_outputs;
+  WritableFile* blob_outfile;
+  BlobFileBuilder* blob_builder;
+
+  // Records of the input blob files that the outputs no longer reference,
+  // by blob file number
+  std::map<uint64_t, BlobFileMetaData> blob_garbage;
+
+  // User key range of the input handled by this state.  A compaction
+  // split into subcompactions has one CompactionState per range.
+  const std::string* start_key;   // NULL means beginning of key range
+  const std::string* end_key;     // NULL means end of key range (exclusive)
+  Compaction::Cursor cursor;
+
+  // Range tombstones of the input that are still needed.  Each output
+  // file gets the parts of them between its first user key and the first
+  // user key of the next output; output_begin holds the former.
+  std::vector<RangeTombstone> range_dels;
+  std::string output_begin;
+  bool has_output_begin;
+
   Output* current_output() { return &outputs[outputs.size()-1]; }
 
   explicit CompactionState(Compaction* c)
       : compaction(c),
+        has_snapshots(false),
         outfile(NULL),
         builder(NULL),
-        total_bytes(0) {
+        writer(NULL),
+        total_bytes(0),
+        blob_outfile(NULL),
+        blob_builder(NULL),
+        start_key(NULL),
+        end_key(NULL),
+        has_output_begin(false) {
   }
 };
 
+// A key range of a compaction, run by its own thread.
+struct DBImpl::Subcompaction {
+  DBImpl* db;
+  CompactionState* state;
+  port::CondVar* done_cv;   // Signalled (under mutex_) when done is set
+  bool done;
+  Status status;
+};
+
 // Fix user-supplied options to be reasonable
 template <class T,class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
@@ -93,10 +148,24 @@ Options SanitizeOptions(const std::string& dbname,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
+  result.internal_keys = true;
   result.filter_policy = (src.filter_policy != NULL) ? ipolicy : NULL;
   ClipToRange(&result.max_open_files,    64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
   ClipToRange(&result.block_size,        1<<10,                       4<<20);
+  ClipToRange(&result.compression_threads, 1,                         64);
+  ClipToRange(&result.compression_dictionary_bytes, 0,                1<<20);
+  ClipToRange(&result.blob_file_size,    64<<10,                      1<<30);
+  ClipToRange(&result.blob_gc_ratio,     0.0,                         1.0);
+  ClipToRange(&result.max_background_compactions, 1,                  64);
+  ClipToRange(&result.max_subcompactions, 1,                          64);
+  ClipToRange(&result.max_bytes_for_level_base, 64<<10,               1<<30);
+  ClipToRange(&result.max_bytes_for_level_multiplier, 2,              100);
+  ClipToRange(&result.universal_size_ratio, 0,                        1000);
+  ClipToRange(&result.universal_max_sorted_runs, 2,
+              config::kL0_SlowdownWritesTrigger - 1);
+  ClipToRange(&result.deletion_compaction_ratio, 0.0,                 1.0);
+  ClipToRange(&result.periodic_compaction_seconds, 0,                 1<<30);
   if (result.info_log == NULL) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -132,10 +201,15 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       log_(NULL),
       seed_(0),
       tmp_batch_(new WriteBatch),
-      bg_compaction_scheduled_(false),
-      manual_compaction_(NULL) {
+      bg_compaction_scheduled_(0),
+      running_compactions_(0),
+      bg_flush_active_(false),
+      manifest_writing_(false),
+      manual_compaction_(NULL),
+      user_bytes_written_(0) {
   mem_->Ref();
   has_imm_.Release_Store(NULL);
+  env_->SetBackgroundThreads(options_.max_background_compactions);
 
   // Reserve ten files or so for other uses and give the rest to TableCache.
   const int table_cache_size = options_.max_open_files - kNumNonTableCacheFiles;
@@ -149,7 +223,7 @@ DBImpl::~DBImpl() {
   // Wait for background work to finish
   mutex_.Lock();
   shutting_down_.Release_Store(this);  // Any non-NULL value is ok
-  while (bg_compaction_scheduled_) {
+  while (bg_compaction_scheduled_ > 0) {
     bg_cv_.Wait();
   }
   mutex_.Unlock();
@@ -244,6 +318,7 @@ void DBImpl::DeleteObsoleteFiles() {
           keep = (number >= versions_->ManifestFileNumber());
           break;
         case kTableFile:
+        case kBlobFile:
           keep = (live.find(number) != live.end());
           break;
         case kTempFile:
@@ -259,7 +334,7 @@ void DBImpl::DeleteObsoleteFiles() {
       }
 
       if (!keep) {
-        if (type == kTableFile) {
+        if (type == kTableFile || type == kBlobFile) {
           table_cache_->Evict(number);
         }
         Log(options_.info_log, "Delete type=%d #%lld\n",
@@ -432,7 +507,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
     }
 
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
-      status = WriteLevel0Table(mem, edit, NULL);
+      status = WriteLevel0Table(mem, edit, NULL, NULL);
       if (!status.ok()) {
         // Reflect errors immediately so that conditions like full
         // file-systems cause the DB::Open() to fail.
@@ -444,7 +519,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
   }
 
   if (status.ok() && mem != NULL) {
-    status = WriteLevel0Table(mem, edit, NULL);
+    status = WriteLevel0Table(mem, edit, NULL, NULL);
     // Reflect errors immediately so that conditions like full
     // file-systems cause the DB::Open() to fail.
   }
@@ -455,20 +530,29 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
 }
 
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                Version* base,
+                                std::vector<uint64_t>* pending_numbers) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
+  BlobFileMetaData blob_meta;
+  if (options_.min_blob_size > 0) {
+    blob_meta.number = versions_->NewFileNumber();
+    pending_outputs_.insert(blob_meta.number);
+  }
   Iterator* iter = mem->NewIterator();
+  Iterator* range_del_iter = mem->NewRangeDeletionIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long) meta.number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                   range_del_iter, &meta,
+                   (blob_meta.number != 0) ? &blob_meta : NULL);
     mutex_.Lock();
   }
 
@@ -477,7 +561,16 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long) meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
+  delete range_del_iter;
+  if (pending_numbers != NULL) {
+    pending_numbers->push_back(meta.number);
+    if (blob_meta.number != 0) {
+      pending_numbers->push_back(blob_meta.number);
+    }
+  } else {
+    pending_outputs_.erase(meta.number);
+    pending_outputs_.erase(blob_meta.number);
+  }
 
 
   // Note that if file_size is zero, the file has been deleted and
@@ -489,13 +582,16 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
     if (base != NULL) {
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
-    edit->AddFile(level, meta.number, meta.file_size,
-                  meta.smallest, meta.largest);
+    edit->AddFile(level, meta);
+    if (blob_meta.total_count > 0) {
+      edit->AddBlobFile(blob_meta.number, blob_meta.total_count,
+                        blob_meta.total_bytes);
+    }
   }
 
   CompactionStats stats;
   stats.micros = env_->NowMicros() - start_micros;
-  stats.bytes_written = meta.file_size;
+  stats.bytes_written = meta.file_size + blob_meta.total_bytes;
   stats_[level].Add(stats);
   return s;
 }
@@ -503,12 +599,24 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
   assert(imm_ != NULL);
-
-  // Save the contents of the memtable as a new Table
+  assert(!bg_flush_active_);
+  bg_flush_active_ = true;
+
+  // Save the contents of the memtable as a new Table.  When several
+  // compactions may be running, a table pushed past level-0 could land
+  // in the middle of the key range a running compaction is about to
+  // write, so the new table always goes to level-0 in that case.  The
+  // same holds for kUniversalCompaction, whose output level is not known
+  // in advance.
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  const bool level0_only =
+      (options_.max_background_compactions > 1 ||
+       options_.compaction_style == kUniversalCompaction);
+  std::vector<uint64_t> numbers;
+  Status s = WriteLevel0Table(imm_, &edit, level0_only ? NULL : base,
+                              &numbers);
   base->Unref();
 
   if (s.ok() && shutting_down_.Acquire_Load()) {
@@ -519,7 +627,10 @@ void DBImpl::CompactMemTable() {
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    s = LogAndApply(&edit);
+  }
+  for (size_t i = 0; i < numbers.size(); i++) {
+    pending_outputs_.erase(numbers[i]);
   }
 
   if (s.ok()) {
@@ -531,6 +642,7 @@ void DBImpl::CompactMemTable() {
   } else {
     RecordBackgroundError(s);
   }
+  bg_flush_active_ = false;
 }
 
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
@@ -550,6 +662,116 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   }
 }
 
+Status DBImpl::DeleteFilesInRange(const Slice* begin, const Slice* end,
+                                  bool ignore_snapshots) {
+  InternalKey begin_storage, end_storage;
+  InternalKey* begin_key = NULL;
+  InternalKey* end_key = NULL;
+  if (begin != NULL) {
+    begin_storage = InternalKey(*begin, kMaxSequenceNumber, kValueTypeForSeek);
+    begin_key = &begin_storage;
+  }
+  if (end != NULL) {
+    end_storage = InternalKey(*end, 0, static_cast<ValueType>(0));
+    end_key = &end_storage;
+  }
+
+  MutexLock l(&mutex_);
+  if (!bg_error_.ok()) {
+    return bg_error_;
+  }
+  if (!snapshots_.empty() && !ignore_snapshots) {
+    return Status::InvalidArgument(
+        "cannot delete files that live snapshots may read");
+  }
+
+  const Comparator* ucmp = user_comparator();
+  Version* base = versions_->current();
+  VersionEdit edit;
+  int deleted = 0;
+  int64_t deleted_bytes = 0;
+  std::vector<FileMetaData*> with_blobs;
+  for (int level = 1; level < config::kNumLevels; level++) {
+    std::vector<FileMetaData*> files;
+    base->GetOverlappingInputs(level, begin_key, end_key, &files);
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[i];
+      if (f->being_compacted) {
+        continue;
+      }
+      if (begin != NULL && ucmp->Compare(f->smallest.user_key(), *begin) < 0) {
+        continue;
+      }
+      if (end != NULL && ucmp->Compare(f->largest.user_key(), *end) > 0) {
+        continue;
+      }
+      edit.DeleteFile(level, f->number);
+      deleted++;
+      deleted_bytes += f->file_size;
+      if (f->oldest_blob_file != 0) {
+        with_blobs.push_back(f);
+      }
+    }
+  }
+  if (deleted == 0) {
+    return Status::OK();
+  }
+
+  // The values that the deleted files keep in blob files become garbage.
+  // Claim the files so that no compaction picks them while they are read.
+  Status s;
+  if (!with_blobs.empty()) {
+    for (size_t i = 0; i < with_blobs.size(); i++) {
+      with_blobs[i]->being_compacted = true;
+    }
+    base->Ref();
+    mutex_.Unlock();
+    std::map<uint64_t, BlobFileMetaData> garbage;
+    ReadOptions options;
+    options.fill_cache = false;
+    for (size_t i = 0; s.ok() && i < with_blobs.size(); i++) {
+      const FileMetaData* f = with_blobs[i];
+      Iterator* iter = table_cache_->NewIterator(options, f->number,
+                                                 f->file_size);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ParsedInternalKey ikey;
+        BlobIndex index;
+        if (ParseInternalKey(iter->key(), &ikey) &&
+            ikey.type == kTypeBlobIndex &&
+            index.DecodeFrom(iter->value()).ok()) {
+          BlobFileMetaData* g = &garbage[index.file_number];
+          g->garbage_count++;
+          g->garbage_bytes += BlobRecordSize(ikey.user_key.size(), index.size);
+        }
+      }
+      s = iter->status();
+      delete iter;
+    }
+    mutex_.Lock();
+    base->Unref();
+    for (size_t i = 0; i < with_blobs.size(); i++) {
+      with_blobs[i]->being_compacted = false;
+    }
+    for (std::map<uint64_t, BlobFileMetaData>::const_iterator it =
+             garbage.begin();
+         it != garbage.end(); ++it) {
+      edit.AddBlobGarbage(it->first, it->second.garbage_count,
+                          it->second.garbage_bytes);
+    }
+  }
+
+  if (s.ok()) {
+    s = LogAndApply(&edit);
+  }
+  if (s.ok()) {
+    Log(options_.info_log, "Deleted %d files in range, %lld bytes",
+        deleted, static_cast<long long>(deleted_bytes));
+    DeleteObsoleteFiles();
+    MaybeScheduleCompaction();
+  }
+  return s;
+}
+
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,const Slice* end) {
   assert(level >= 0);
   assert(level + 1 < config::kNumLevels);
@@ -611,20 +833,35 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   }
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  while (manifest_writing_) {
+    bg_cv_.Wait();
+  }
+  manifest_writing_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  manifest_writing_ = false;
+  if (s.ok() && options_.rate_limiter != NULL) {
+    options_.rate_limiter->SetCompactionPressure(versions_->CompactionScore());
+  }
+  bg_cv_.SignalAll();
+  return s;
+}
+
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (bg_compaction_scheduled_) {
-    // Already scheduled
+  if (bg_compaction_scheduled_ >= options_.max_background_compactions) {
+    // Already scheduled as many as we are allowed to run
   } else if (shutting_down_.Acquire_Load()) {
     // DB is being deleted; no more background compactions
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == NULL &&
+  } else if ((imm_ == NULL || bg_flush_active_) &&
              manual_compaction_ == NULL &&
              !versions_->NeedsCompaction()) {
     // No work to be done
   } else {
-    bg_compaction_scheduled_ = true;
+    bg_compaction_scheduled_++;
     env_->Schedule(&DBImpl::BGWork, this);
   }
 }
@@ -635,35 +872,45 @@ void DBImpl::BGWork(void* db) {
 
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(bg_compaction_scheduled_);
+  assert(bg_compaction_scheduled_ > 0);
+  bool made_progress = false;
   if (shutting_down_.Acquire_Load()) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    made_progress = BackgroundCompaction();
   }
 
-  bg_compaction_scheduled_ = false;
+  bg_compaction_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  If we could not claim
+  // any work, whatever is pending is waiting on compactions in other
+  // threads, and those reschedule when they finish.
+  if (made_progress) {
+    MaybeScheduleCompaction();
+  }
   bg_cv_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != NULL) {
+  if (imm_ != NULL && !bg_flush_active_) {
     CompactMemTable();
-    return;
+    return true;
   }
 
   Compaction* c;
   bool is_manual = (manual_compaction_ != NULL);
   InternalKey manual_end;
   if (is_manual) {
+    if (running_compactions_ > 0) {
+      // A manual compaction runs by itself, once the compactions that
+      // are already in progress have finished.
+      return false;
+    }
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == NULL);
@@ -678,6 +925,20 @@ void DBImpl::BackgroundCompaction() {
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
   } else {
     c = versions_->PickCompaction();
+    if (c == NULL) {
+      // Nothing to do, or everything that needs doing is already
+      // being done by other threads.
+      return false;
+    }
+  }
+
+  if (c != NULL) {
+    c->MarkInputsBeingCompacted(true);
+    running_compactions_++;
+    if (!is_manual) {
+      // Let another thread look for work while this one is busy.
+      MaybeScheduleCompaction();
+    }
   }
 
   Status status;
@@ -688,19 +949,19 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->DeleteFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
-                       f->smallest, f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    c->edit()->AddFile(c->output_level(), *f);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
         static_cast<unsigned long long>(f->number),
-        c->level() + 1,
+        c->output_level(),
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(),
         versions_->LevelSummary(&tmp));
+    c->MarkInputsBeingCompacted(false);
   } else {
     CompactionState* compact = new CompactionState(c);
     status = DoCompactionWork(compact);
@@ -708,9 +969,13 @@ void DBImpl::BackgroundCompaction() {
       RecordBackgroundError(status);
     }
     CleanupCompaction(compact);
+    c->MarkInputsBeingCompacted(false);
     c->ReleaseInputs();
     DeleteObsoleteFiles();
   }
+  if (c != NULL) {
+    running_compactions_--;
+  }
   delete c;
 
   if (status.ok()) {
@@ -735,6 +1000,7 @@ void DBImpl::BackgroundCompaction() {
     }
     manual_compaction_ = NULL;
   }
+  return true;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -747,10 +1013,16 @@ void DBImpl::CleanupCompaction(CompactionState* compact) {
     assert(compact->outfile == NULL);
   }
   delete compact->outfile;
+  delete compact->writer;
+  delete compact->blob_builder;
+  delete compact->blob_outfile;
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
     pending_outputs_.erase(out.number);
   }
+  for (size_t i = 0; i < compact->blob_outputs.size(); i++) {
+    pending_outputs_.erase(compact->blob_outputs[i].number);
+  }
   delete compact;
 }
 
@@ -764,8 +1036,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     pending_outputs_.insert(file_number);
     CompactionState::Output out;
     out.number = file_number;
-    out.smallest.Clear();
-    out.largest.Clear();
+    out.creation_time = env_->NowMicros() / 1000000;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -774,20 +1045,81 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    if (options_.rate_limiter != NULL) {
+      compact->outfile = NewRateLimitedFile(compact->outfile,
+                                            options_.rate_limiter,
+                                            RateLimiter::kLowPriority);
+    }
+    if (options_.pipelined_compaction) {
+      if (compact->writer == NULL) {
+        compact->writer = NewBackgroundWriter(env_);
+      }
+      compact->outfile = NewBackgroundWriterFile(compact->outfile,
+                                                 compact->writer);
+    }
+    Options table_options = options_;
+    table_options.compression =
+        CompressionForLevel(options_, compact->compaction->output_level());
+    if (options_.pipelined_compaction) {
+      // Compressing the data blocks is the largest share of the work
+      // after merging, so it is moved off the merging thread as well
+      table_options.compression_threads =
+          std::max(table_options.compression_threads, 2);
+    }
+    compact->builder = new TableBuilder(table_options, compact->outfile);
   }
   return s;
 }
 
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* next_user_key) {
   assert(compact != NULL);
   assert(compact->outfile != NULL);
   assert(compact->builder != NULL);
 
-  const uint64_t output_number = compact->current_output()->number;
+  CompactionState::Output* out = compact->current_output();
+  const uint64_t output_number = out->number;
   assert(output_number != 0);
 
+  // Add the range tombstones up to the next output, or the end of the
+  // range handled by "compact".  Their extent is part of the file's key
+  // range; the end keys are exclusive, so the largest key is made to sort
+  // before all entries for them.
+  Slice end_key;
+  if (next_user_key == NULL && compact->end_key != NULL) {
+    end_key = *compact->end_key;
+    next_user_key = &end_key;
+  }
+  Slice begin_key(compact->output_begin);
+  std::vector<RangeTombstone> pieces;
+  ClipRangeTombstones(user_comparator(), compact->range_dels,
+                      compact->has_output_begin ? &begin_key : NULL,
+                      next_user_key, &pieces);
+  for (size_t i = 0; i < pieces.size(); i++) {
+    const RangeTombstone& t = pieces[i];
+    InternalKey begin(t.begin, t.seq, kTypeRangeDeletion);
+    InternalKey end(t.end, kMaxSequenceNumber, kTypeRangeDeletion);
+    const bool empty = (compact->builder->NumEntries() == 0 &&
+                        !out->has_range_deletions);
+    if (empty || internal_comparator_.Compare(begin, out->smallest) < 0) {
+      out->smallest = begin;
+    }
+    if (empty || internal_comparator_.Compare(end, out->largest) > 0) {
+      out->largest = end;
+    }
+    compact->builder->AddRangeDeletion(begin.Encode(), t.end);
+    out->has_range_deletions = true;
+    out->num_entries++;
+    out->num_deletions++;
+    out->largest_seqno = std::max(out->largest_seqno, t.seq);
+  }
+  if (next_user_key != NULL) {
+    compact->output_begin.assign(next_user_key->data(),
+                                 next_user_key->size());
+    compact->has_output_begin = true;
+  }
+
   // Check for iterator errors
   Status s = input->status();
   const uint64_t current_entries = compact->builder->NumEntries();
@@ -812,7 +1144,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   delete compact->outfile;
   compact->outfile = NULL;
 
-  if (s.ok() && current_entries > 0) {
+  if (s.ok() && (current_entries > 0 || out->has_range_deletions)) {
     // Verify that the table is usable
     Iterator* iter = table_cache_->NewIterator(ReadOptions(),
                                                output_number,
@@ -830,26 +1162,116 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   return s;
 }
 
+Status DBImpl::OpenCompactionBlobFile(CompactionState* compact) {
+  assert(compact->blob_builder == NULL);
+  uint64_t file_number;
+  {
+    mutex_.Lock();
+    file_number = versions_->NewFileNumber();
+    pending_outputs_.insert(file_number);
+    BlobFileMetaData out;
+    out.number = file_number;
+    compact->blob_outputs.push_back(out);
+    mutex_.Unlock();
+  }
+
+  Status s = env_->NewWritableFile(BlobFileName(dbname_, file_number),
+                                   &compact->blob_outfile);
+  if (s.ok()) {
+    if (options_.rate_limiter != NULL) {
+      compact->blob_outfile = NewRateLimitedFile(compact->blob_outfile,
+                                                 options_.rate_limiter,
+                                                 RateLimiter::kLowPriority);
+    }
+    compact->blob_builder = new BlobFileBuilder(compact->blob_outfile,
+                                                file_number);
+  }
+  return s;
+}
+
+Status DBImpl::FinishCompactionBlobFile(CompactionState* compact) {
+  assert(compact->blob_builder != NULL);
+  BlobFileMetaData* out = &compact->blob_outputs.back();
+  out->total_count = compact->blob_builder->NumEntries();
+  out->total_bytes = compact->blob_builder->FileSize();
+  delete compact->blob_builder;
+  compact->blob_builder = NULL;
+
+  Status s = compact->blob_outfile->Sync();
+  if (s.ok()) {
+    s = compact->blob_outfile->Close();
+  }
+  delete compact->blob_outfile;
+  compact->blob_outfile = NULL;
+  if (s.ok()) {
+    Log(options_.info_log,
+        "Generated blob file #%llu: %lld records, %lld bytes",
+        (unsigned long long) out->number,
+        (unsigned long long) out->total_count,
+        (unsigned long long) out->total_bytes);
+  }
+  return s;
+}
+
+Status DBImpl::AddCompactionBlob(CompactionState* compact,
+                                 const Slice& user_key, const Slice& value,
+                                 std::string* blob_index) {
+  if (compact->blob_builder == NULL) {
+    Status s = OpenCompactionBlobFile(compact);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  BlobIndex index;
+  Status s = compact->blob_builder->Add(user_key, value, &index);
+  if (s.ok()) {
+    blob_index->clear();
+    index.EncodeTo(blob_index);
+    if (compact->blob_builder->FileSize() >= options_.blob_file_size) {
+      s = FinishCompactionBlobFile(compact);
+    }
+  }
+  return s;
+}
+
+void DBImpl::AddCompactionBlobGarbage(CompactionState* compact,
+                                      const Slice& user_key,
+                                      const Slice& blob_index) {
+  BlobIndex index;
+  if (index.DecodeFrom(blob_index).ok()) {
+    BlobFileMetaData* garbage = &compact->blob_garbage[index.file_number];
+    garbage->garbage_count++;
+    garbage->garbage_bytes += BlobRecordSize(user_key.size(), index.size);
+  }
+}
 
 Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
+  Compaction* c = compact->compaction;
   Log(options_.info_log,  "Compacted %d@%d + %d@%d files => %lld bytes",
-      compact->compaction->num_input_files(0),
-      compact->compaction->level(),
-      compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1,
+      c->num_input_files(0),
+      c->level(),
+      c->num_input_files(c->num_input_levels() - 1),
+      c->output_level(),
       static_cast<long long>(compact->total_bytes));
 
   // Add compaction outputs
-  compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  c->AddInputDeletions(c->edit());
+  const int level = c->output_level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
-    const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(
-        level + 1,
-        out.number, out.file_size, out.smallest, out.largest);
+    c->edit()->AddFile(level, compact->outputs[i]);
+  }
+  for (size_t i = 0; i < compact->blob_outputs.size(); i++) {
+    const BlobFileMetaData& b = compact->blob_outputs[i];
+    c->edit()->AddBlobFile(b.number, b.total_count, b.total_bytes);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  for (std::map<uint64_t, BlobFileMetaData>::const_iterator it =
+           compact->blob_garbage.begin();
+       it != compact->blob_garbage.end(); ++it) {
+    c->edit()->AddBlobGarbage(it->first, it->second.garbage_count,
+                              it->second.garbage_bytes);
+  }
+  return LogAndApply(c->edit());
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
@@ -859,49 +1281,452 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   Log(options_.info_log,  "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0),
       compact->compaction->level(),
-      compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+      compact->compaction->num_input_files(
+          compact->compaction->num_input_levels() - 1),
+      compact->compaction->output_level());
 
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == NULL);
   assert(compact->outfile == NULL);
   if (snapshots_.empty()) {
     compact->smallest_snapshot = versions_->LastSequence();
+    compact->largest_snapshot = 0;
+    compact->has_snapshots = false;
   } else {
     compact->smallest_snapshot = snapshots_.oldest()->number_;
+    compact->largest_snapshot = snapshots_.newest()->number_;
+    compact->has_snapshots = true;
   }
 
+  std::vector<std::string> boundaries;
+  compact->compaction->GetSubcompactionBoundaries(options_.max_subcompactions,
+                                                  &boundaries);
+
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
-  input->SeekToFirst();
   Status status;
+  if (boundaries.empty()) {
+    status = DoCompactionRange(compact, &imm_micros);
+  } else {
+    status = DoSubcompactions(compact, boundaries, &imm_micros);
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  for (int which = 0; which < compact->compaction->num_input_levels();
+       which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+  for (size_t i = 0; i < compact->blob_outputs.size(); i++) {
+    stats.bytes_written += compact->blob_outputs[i].total_bytes;
+  }
+
+  mutex_.Lock();
+  stats_[compact->compaction->output_level()].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log,
+      "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+Status DBImpl::DoSubcompactions(CompactionState* compact,
+                                const std::vector<std::string>& boundaries,
+                                int64_t* imm_micros) {
+  // Range i covers [boundaries[i-1], boundaries[i]).
+  const size_t n = boundaries.size() + 1;
+  std::vector<CompactionState*> states(n);
+  for (size_t i = 0; i < n; i++) {
+    states[i] = new CompactionState(compact->compaction);
+    states[i]->smallest_snapshot = compact->smallest_snapshot;
+    states[i]->largest_snapshot = compact->largest_snapshot;
+    states[i]->has_snapshots = compact->has_snapshots;
+    states[i]->start_key = (i == 0 ? NULL : &boundaries[i-1]);
+    states[i]->end_key = (i == n - 1 ? NULL : &boundaries[i]);
+  }
+  Log(options_.info_log, "Compaction split into %d subcompactions",
+      static_cast<int>(n));
+
+  // Ranges other than the first run in threads of their own; the first
+  // one runs in this thread, which also keeps servicing imm_.
+  port::CondVar done_cv(&mutex_);
+  std::vector<Subcompaction> jobs(n);
+  for (size_t i = 1; i < n; i++) {
+    jobs[i].db = this;
+    jobs[i].state = states[i];
+    jobs[i].done_cv = &done_cv;
+    jobs[i].done = false;
+    env_->StartThread(&DBImpl::SubcompactionWork, &jobs[i]);
+  }
+  Status status = DoCompactionRange(states[0], imm_micros);
+
+  mutex_.Lock();
+  for (size_t i = 1; i < n; i++) {
+    while (!jobs[i].done) {
+      done_cv.Wait();
+    }
+    if (status.ok()) {
+      status = jobs[i].status;
+    }
+  }
+  mutex_.Unlock();
+
+  // Gather all outputs, in key order, into *compact so that they are
+  // installed in a single edit (or cleaned up together on failure).
+  for (size_t i = 0; i < n; i++) {
+    CompactionState* sub = states[i];
+    if (sub->builder != NULL) {
+      sub->builder->Abandon();
+      delete sub->builder;
+    }
+    delete sub->outfile;
+    delete sub->writer;
+    delete sub->blob_builder;
+    delete sub->blob_outfile;
+    compact->outputs.insert(compact->outputs.end(),
+                            sub->outputs.begin(), sub->outputs.end());
+    compact->total_bytes += sub->total_bytes;
+    compact->blob_outputs.insert(compact->blob_outputs.end(),
+                                 sub->blob_outputs.begin(),
+                                 sub->blob_outputs.end());
+    for (std::map<uint64_t, BlobFileMetaData>::const_iterator it =
+             sub->blob_garbage.begin();
+         it != sub->blob_garbage.end(); ++it) {
+      BlobFileMetaData* garbage = &compact->blob_garbage[it->first];
+      garbage->garbage_count += it->second.garbage_count;
+      garbage->garbage_bytes += it->second.garbage_bytes;
+    }
+    delete sub;
+  }
+  return status;
+}
+
+void DBImpl::SubcompactionWork(void* arg) {
+  Subcompaction* job = reinterpret_cast<Subcompaction*>(arg);
+  DBImpl* db = job->db;
+  Status s = db->DoCompactionRange(job->state, NULL);
+  MutexLock l(&db->mutex_);
+  job->status = s;
+  job->done = true;
+  job->done_cv->SignalAll();
+}
+
+// Options for the blob files read by compactions
+static ReadOptions CompactionReadOptions(const Options& options) {
+  ReadOptions result;
+  result.verify_checksums = options.paranoid_checks;
+  result.fill_cache = false;
+  return result;
+}
+
+Status DBImpl::AddCompactionOutput(CompactionState* compact,
+                                   Slice key, Slice value,
+                                   bool* close_output) {
+  // Open output file if necessary
+  if (compact->builder == NULL) {
+    Status s = OpenCompactionOutputFile(compact);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+
+  // Move large values to a blob file, and the values still referenced in
+  // blob files with much garbage to a new one
+  std::string blob_key, blob_index;
+  uint64_t blob_file = 0;
+  const ValueType type = ExtractValueType(key);
+  if (type == kTypeValue && options_.min_blob_size > 0 &&
+      value.size() >= options_.min_blob_size) {
+    Status s = AddCompactionBlob(compact, ExtractUserKey(key), value,
+                                 &blob_index);
+    if (!s.ok()) {
+      return s;
+    }
+    AppendInternalKey(&blob_key, ParsedInternalKey(ExtractUserKey(key),
+                                                   ExtractSequence(key),
+                                                   kTypeBlobIndex));
+    blob_file = compact->blob_outputs.back().number;
+  } else if (type == kTypeBlobIndex) {
+    BlobIndex index;
+    Status s = index.DecodeFrom(value);
+    if (!s.ok()) {
+      return s;
+    }
+    blob_file = index.file_number;
+    if (compact->compaction->BlobFileNeedsGC(index.file_number)) {
+      std::string blob_value;
+      s = ReadBlob(CompactionReadOptions(options_), ExtractUserKey(key),
+                   value, &blob_value);
+      if (s.ok()) {
+        s = AddCompactionBlob(compact, ExtractUserKey(key), blob_value,
+                              &blob_index);
+      }
+      if (!s.ok()) {
+        return s;
+      }
+      AddCompactionBlobGarbage(compact, ExtractUserKey(key), value);
+      blob_key = key.ToString();
+      blob_file = compact->blob_outputs.back().number;
+    }
+  }
+  if (!blob_index.empty()) {
+    key = blob_key;
+    value = blob_index;
+  }
+  CompactionState::Output* out = compact->current_output();
+  if (blob_file != 0 &&
+      (out->oldest_blob_file == 0 || blob_file < out->oldest_blob_file)) {
+    out->oldest_blob_file = blob_file;
+  }
+
+  if (compact->builder->NumEntries() == 0) {
+    compact->current_output()->smallest.DecodeFrom(key);
+  }
+  compact->current_output()->largest.DecodeFrom(key);
+  compact->builder->Add(key, value);
+  compact->current_output()->num_entries++;
+  if (ExtractValueType(key) == kTypeDeletion) {
+    compact->current_output()->num_deletions++;
+  }
+  compact->current_output()->largest_seqno = std::max(
+      compact->current_output()->largest_seqno, ExtractSequence(key));
+
+  // Close output file if it is big enough
+  if (compact->builder->FileSize() >=
+      compact->compaction->MaxOutputFileSize()) {
+    *close_output = true;
+  }
+  return Status::OK();
+}
+
+// Entries for a key may only be combined if no snapshot lies between
+// them.  We only know the oldest and newest snapshots, so this holds for
+// entries that are all newer than every snapshot or all older than
+// every snapshot.  Without snapshots, every entry is older than
+// smallest_snapshot, including those whose sequence number is zero.
+static int SnapshotStripe(SequenceNumber seq,
+                          SequenceNumber smallest_snapshot,
+                          SequenceNumber largest_snapshot) {
+  if (seq <= smallest_snapshot) {
+    return 0;
+  } else if (seq > largest_snapshot) {
+    return 1;
+  } else {
+    return -1;
+  }
+}
+
+Status DBImpl::MergeCompactionOperands(CompactionState* compact,
+                                       Iterator* input,
+                                       RangeDelAggregator* range_del,
+                                       RangeDelAggregator* newest_range_del,
+                                       const Slice& user_key,
+                                       SequenceNumber* last_sequence,
+                                       bool* close_output) {
+  const MergeOperator* merge_operator = options_.merge_operator;
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(input->key(), &ikey)) {
+    return Status::Corruption("corrupted merge operand for ", user_key);
+  }
+  const int stripe = SnapshotStripe(ikey.sequence, compact->smallest_snapshot,
+                                    compact->largest_snapshot);
+  // An older entry must not be combined with the operands if a tombstone
+  // newer than it hides it.  Such a tombstone lies in the same stripe, so
+  // for operands newer than every snapshot all tombstones count.
+  RangeDelAggregator* stripe_range_del =
+      (stripe == 1) ? newest_range_del : range_del;
+  std::vector<std::string> operands;        // Newest first
+  std::vector<SequenceNumber> sequences;
+  operands.push_back(input->value().ToString());
+  sequences.push_back(ikey.sequence);
+  *last_sequence = ikey.sequence;
+  input->Next();
+
+  // Look for older operands, and the value or deletion under them
+  bool has_base = false;
+  std::string base_value;
+  bool base_is_value = false;
+  bool older_entries = false;   // Entries for the key left in the input
+  while (stripe >= 0 && input->Valid()) {
+    if (!ParseInternalKey(input->key(), &ikey)) {
+      older_entries = true;
+      break;
+    }
+    if (user_comparator()->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    if (SnapshotStripe(ikey.sequence, compact->smallest_snapshot,
+                       compact->largest_snapshot) != stripe) {
+      older_entries = true;
+      break;
+    }
+    if (ikey.type == kTypeDeletion ||
+        stripe_range_del->ShouldDelete(ikey.user_key, ikey.sequence)) {
+      // Left for the caller, which drops it if it can
+      has_base = true;
+      older_entries = true;
+      break;
+    }
+    if (ikey.type == kTypeValue) {
+      has_base = true;
+      base_is_value = true;
+      base_value = input->value().ToString();
+    } else if (ikey.type == kTypeBlobIndex) {
+      // The merge result replaces the value in the blob file
+      Status s = ReadBlob(CompactionReadOptions(options_), user_key,
+                        input->value(), &base_value);
+      if (!s.ok()) {
+        return s;
+      }
+      AddCompactionBlobGarbage(compact, user_key, input->value());
+      has_base = true;
+      base_is_value = true;
+    } else {
+      operands.push_back(input->value().ToString());
+      sequences.push_back(ikey.sequence);
+    }
+    *last_sequence = ikey.sequence;
+    input->Next();
+    if (base_is_value) {
+      break;
+    }
+  }
+  if (stripe < 0) {
+    older_entries = true;
+  }
+  if (!has_base && !older_entries &&
+      compact->compaction->IsBaseLevelForKey(user_key, &compact->cursor)) {
+    // No older entries for the key exist
+    has_base = true;
+  }
+
+  std::string key;
+  if (has_base) {
+    // Replace the operands by the value they produce
+    Slice existing(base_value);
+    std::string value;
+    Status s = FullMerge(merge_operator, user_key,
+                         base_is_value ? &existing : NULL, operands, &value);
+    if (!s.ok()) {
+      return s;
+    }
+    AppendInternalKey(&key, ParsedInternalKey(user_key, sequences[0],
+                                              kTypeValue));
+    return AddCompactionOutput(compact, key, value, close_output);
+  }
+
+  PartialMerge(merge_operator, user_key, &operands, &sequences);
+  for (size_t i = 0; i < operands.size(); i++) {
+    key.clear();
+    AppendInternalKey(&key, ParsedInternalKey(user_key, sequences[i],
+                                              kTypeMerge));
+    Status s = AddCompactionOutput(compact, key, operands[i], close_output);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+Status DBImpl::DoCompactionRange(CompactionState* compact,
+                                 int64_t* imm_micros) {
+  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  if (compact->start_key != NULL) {
+    InternalKey start(*compact->start_key, kMaxSequenceNumber,
+                      kValueTypeForSeek);
+    input->Seek(start.Encode());
+  } else {
+    input->SeekToFirst();
+  }
+  if (options_.pipelined_compaction) {
+    input = NewPrefetchingIterator(input, env_);
+  }
+
+  // Entries hidden from every snapshot by a range tombstone are dropped.
+  // Tombstones are dropped once nothing they hide can remain below.
+  RangeDelAggregator range_del(user_comparator(), compact->smallest_snapshot);
+  RangeDelAggregator newest_range_del(user_comparator(), kMaxSequenceNumber);
+  Status status = versions_->AddRangeDeletions(compact->compaction,
+                                               &range_del);
+  for (size_t i = 0; i < range_del.tombstones().size(); i++) {
+    const RangeTombstone& t = range_del.tombstones()[i];
+    if (compact->has_snapshots && options_.merge_operator != NULL) {
+      newest_range_del.AddTombstone(t);
+    }
+    if (t.seq > compact->smallest_snapshot ||
+        !compact->compaction->IsBaseLevelForRange(t.begin, t.end)) {
+      compact->range_dels.push_back(t);
+    }
+  }
+  if (compact->start_key != NULL) {
+    compact->output_begin = *compact->start_key;
+    compact->has_output_begin = true;
+  }
+
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
-  for (; input->Valid() && !shutting_down_.Acquire_Load(); ) {
+  const CompactionFilter* filter = options_.compaction_filter;
+  bool merge_operands = false;
+  std::string filtered_key;
+  std::string filtered_value;
+  std::string blob_value;
+  std::string zeroed_key;
+  // The current output is to be closed before the next user key, so that
+  // all entries for a user key (and the tombstones covering it) end up in
+  // the same file.
+  bool close_output = false;
+  for (; status.ok() && input->Valid() && !shutting_down_.Acquire_Load(); ) {
     // Prioritize immutable compaction work
-    if (has_imm_.NoBarrier_Load() != NULL) {
+    if (imm_micros != NULL && has_imm_.NoBarrier_Load() != NULL) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != NULL) {
+      if (imm_ != NULL && !bg_flush_active_) {
         CompactMemTable();
         bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      *imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    Slice value = input->value();
+    if (compact->end_key != NULL &&
+        user_comparator()->Compare(ExtractUserKey(key),
+                                   *compact->end_key) >= 0) {
+      // Reached the range handled by the next subcompaction
+      break;
+    }
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
         compact->builder != NULL) {
-      status = FinishCompactionOutputFile(compact, input);
+      close_output = true;
+    }
+    if (close_output && compact->builder != NULL &&
+        user_comparator()->Compare(
+            ExtractUserKey(key),
+            compact->current_output()->largest.user_key()) != 0) {
+      Slice next_user_key = ExtractUserKey(key);
+      status = FinishCompactionOutputFile(compact, input, &next_user_key);
       if (!status.ok()) {
         break;
       }
     }
+    if (compact->builder == NULL) {
+      close_output = false;
+    }
 
     // Handle key/value, add to state, etc.
     bool drop = false;
@@ -923,9 +1748,13 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;    // (A)
+      } else if (range_del.ShouldDelete(ikey.user_key, ikey.sequence)) {
+        // Hidden by a range tombstone that every snapshot can see
+        drop = true;
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                        &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -934,9 +1763,70 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (filter != NULL &&
+                 (ikey.type == kTypeValue || ikey.type == kTypeBlobIndex) &&
+                 last_sequence_for_key == kMaxSequenceNumber &&
+                 compact->HiddenFromSnapshots(ikey.sequence)) {
+        // Newest value of the key, and no snapshot can see it
+        CompactionFilter::Context context;
+        context.level = compact->compaction->output_level();
+        context.is_bottommost_level =
+            compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                   &compact->cursor);
+        Slice existing = value;
+        if (ikey.type == kTypeBlobIndex) {
+          status = ReadBlob(CompactionReadOptions(options_), ikey.user_key,
+                            value, &blob_value);
+          if (!status.ok()) {
+            break;
+          }
+          existing = blob_value;
+        }
+        switch (filter->Filter(context, ikey.user_key, existing,
+                               &filtered_value)) {
+          case CompactionFilter::kKeep:
+            break;
+          case CompactionFilter::kChangeValue:
+            if (ikey.type == kTypeBlobIndex) {
+              AddCompactionBlobGarbage(compact, ikey.user_key, value);
+              filtered_key.clear();
+              AppendInternalKey(&filtered_key,
+                                ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                                  kTypeValue));
+              key = filtered_key;
+            }
+            value = filtered_value;
+            break;
+          case CompactionFilter::kRemove:
+            if (context.is_bottommost_level &&
+                ikey.sequence <= compact->smallest_snapshot) {
+              // Same reasoning as for deletion markers above
+              drop = true;
+            } else {
+              // Older values of the key may exist, so leave a deletion
+              // marker in place of the value.
+              if (ikey.type == kTypeBlobIndex) {
+                AddCompactionBlobGarbage(compact, ikey.user_key, value);
+              }
+              filtered_key.clear();
+              AppendInternalKey(&filtered_key,
+                                ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                                  kTypeDeletion));
+              key = filtered_key;
+              value = Slice();
+            }
+            break;
+        }
+      }
+
+      if (drop && ikey.type == kTypeBlobIndex) {
+        // The value in the blob file is no longer referenced
+        AddCompactionBlobGarbage(compact, ikey.user_key, value);
       }
 
       last_sequence_for_key = ikey.sequence;
+      merge_operands = (!drop && ikey.type == kTypeMerge &&
+                        options_.merge_operator != NULL);
     }
 #if 0
     Log(options_.info_log,
@@ -944,31 +1834,41 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                               &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
-    if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == NULL) {
-        status = OpenCompactionOutputFile(compact);
-        if (!status.ok()) {
-          break;
-        }
-      }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
+    if (merge_operands) {
+      // Consumes the operand and the entries combined with it
+      merge_operands = false;
+      status = MergeCompactionOperands(compact, input, &range_del,
+                                       &newest_range_del, current_user_key,
+                                       &last_sequence_for_key, &close_output);
+      continue;
+    }
+
+    if (!drop && has_current_user_key && ikey.sequence != 0 &&
+        ikey.sequence <= compact->smallest_snapshot) {
+      // Every snapshot sees this entry, so if no level below holds the
+      // key and no tombstone covers it, its sequence number is no longer
+      // needed.  Zero it so that key trailers compress away.
+      const ValueType type = ExtractValueType(key);
+      if ((type == kTypeValue || type == kTypeBlobIndex) &&
+          compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                 &compact->cursor) &&
+          !range_del.ShouldDelete(ikey.user_key, 0)) {
+        zeroed_key.clear();
+        AppendInternalKey(&zeroed_key,
+                          ParsedInternalKey(ikey.user_key, 0, type));
+        key = zeroed_key;
       }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
+    }
 
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+    if (!drop) {
+      status = AddCompactionOutput(compact, key, value, &close_output);
+      if (!status.ok()) {
+        break;
       }
     }
 
@@ -978,38 +1878,33 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.Acquire_Load()) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  if (status.ok() && compact->builder == NULL &&
+      !compact->range_dels.empty()) {
+    // Tombstones after the last entry still need a file of their own
+    Slice begin_key(compact->output_begin);
+    Slice end_key;
+    if (compact->end_key != NULL) {
+      end_key = *compact->end_key;
+    }
+    std::vector<RangeTombstone> pieces;
+    ClipRangeTombstones(user_comparator(), compact->range_dels,
+                        compact->has_output_begin ? &begin_key : NULL,
+                        compact->end_key != NULL ? &end_key : NULL, &pieces);
+    if (!pieces.empty()) {
+      status = OpenCompactionOutputFile(compact);
+    }
+  }
   if (status.ok() && compact->builder != NULL) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, NULL);
+  }
+  if (status.ok() && compact->blob_builder != NULL) {
+    status = FinishCompactionBlobFile(compact);
   }
   if (status.ok()) {
     status = input->status();
   }
   delete input;
   input = NULL;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log,
-      "compacted to: %s", versions_->LevelSummary(&tmp));
   return status;
 }
 
@@ -1034,7 +1929,8 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
+                                      uint32_t* seed,
+                                      RangeDelAggregator** range_del) {
   IterState* cleanup = new IterState;
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
@@ -1060,6 +1956,38 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
 
   *seed = ++seed_;
   mutex_.Unlock();
+
+  if (range_del != NULL) {
+    // The references taken above keep the sources alive
+    const SequenceNumber snapshot =
+        (options.snapshot != NULL
+         ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
+         : *latest_snapshot);
+    RangeDelAggregator* result =
+        new RangeDelAggregator(user_comparator(), snapshot);
+    Iterator* iter = cleanup->mem->NewRangeDeletionIterator();
+    Status s = result->AddTombstones(iter);
+    delete iter;
+    if (s.ok() && cleanup->imm != NULL) {
+      iter = cleanup->imm->NewRangeDeletionIterator();
+      s = result->AddTombstones(iter);
+      delete iter;
+    }
+    if (s.ok()) {
+      s = cleanup->version->AddRangeDeletions(result);
+    }
+    if (!s.ok()) {
+      delete result;
+      delete internal_iter;
+      *range_del = NULL;
+      return NewErrorIterator(s);
+    }
+    if (result->empty()) {
+      delete result;
+      result = NULL;
+    }
+    *range_del = result;
+  }
   return internal_iter;
 }
 
@@ -1101,12 +2029,15 @@ Status DBImpl::Get(const ReadOptions& options,
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
+    std::vector<std::string> operands;  // Merge operands, newest first
+    if (mem->Get(lkey, value, &s, options_.merge_operator, &operands)) {
       // Done
-    } else if (imm != NULL && imm->Get(lkey, value, &s)) {
+    } else if (imm != NULL &&
+               imm->Get(lkey, value, &s, options_.merge_operator,
+                        &operands)) {
       // Done
     } else {
-      s = current->Get(options, lkey, value, &stats);
+      s = current->Get(options, lkey, value, &stats, &operands);
       have_stat_update = true;
     }
     mutex_.Lock();
@@ -1114,6 +2045,8 @@ Status DBImpl::Get(const ReadOptions& options,
 
   if (have_stat_update && current->UpdateStats(stats)) {
     MaybeScheduleCompaction();
+  } else if (versions_->PeriodicCompactionDue()) {
+    MaybeScheduleCompaction();
   }
   mem->Unref();
   if (imm != NULL) imm->Unref();
@@ -1124,13 +2057,20 @@ Status DBImpl::Get(const ReadOptions& options,
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  RangeDelAggregator* range_del;
+  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed,
+                                       &range_del);
   return NewDBIterator(
-      this, user_comparator(), iter,
+      this, options, user_comparator(), options_.merge_operator, iter,
       (options.snapshot != NULL
        ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
        : latest_snapshot),
-      seed);
+      range_del, seed);
+}
+
+Status DBImpl::ReadBlob(const ReadOptions& options, const Slice& user_key,
+                        const Slice& blob_index, std::string* value) {
+  return table_cache_->GetBlob(options, user_key, blob_index, value);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1159,6 +2099,25 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::DeleteRange(const WriteOptions& options,
+                           const Slice& begin, const Slice& end) {
+  const int r = user_comparator()->Compare(begin, end);
+  if (r > 0) {
+    return Status::InvalidArgument("DeleteRange begin is after end");
+  } else if (r == 0) {
+    return Status::OK();  // Empty range
+  }
+  return DB::DeleteRange(options, begin, end);
+}
+
+Status DBImpl::Merge(const WriteOptions& options,
+                     const Slice& key, const Slice& value) {
+  if (options_.merge_operator == NULL) {
+    return Status::NotSupported("Merge requires a merge_operator");
+  }
+  return DB::Merge(options, key, value);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
   Writer w(&mutex_);
   w.batch = my_batch;
@@ -1207,10 +2166,16 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
         // So we force the DB into a mode where all future writes fail.
         RecordBackgroundError(status);
       }
+      if (status.ok()) {
+        user_bytes_written_ += WriteBatchInternal::ByteSize(updates);
+      }
     }
     if (updates == tmp_batch_) tmp_batch_->Clear();
 
     versions_->SetLastSequence(last_sequence);
+    if (versions_->PeriodicCompactionDue()) {
+      MaybeScheduleCompaction();
+    }
   }
 
   while (true) {
@@ -1395,6 +2360,20 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
+  } else if (in == "blob-stats") {
+    versions_->GetBlobStats(value);
+    return true;
+  } else if (in == "write-amplification") {
+    int64_t bytes_written = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      bytes_written += stats_[level].bytes_written;
+    }
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%.2f",
+             (user_bytes_written_ == 0) ? 0.0 :
+             static_cast<double>(bytes_written) / user_bytes_written_);
+    *value = buf;
+    return true;
   }
 
   return false;
@@ -1426,6 +2405,23 @@ void DBImpl::GetApproximateSizes(
   }
 }
 
+Status DBImpl::GetPropertiesOfAllTables(TablePropertiesCollection* props) {
+  Version* v;
+  {
+    MutexLock l(&mutex_);
+    versions_->current()->Ref();
+    v = versions_->current();
+  }
+
+  Status s = versions_->GetPropertiesOfAllTables(v, props);
+
+  {
+    MutexLock l(&mutex_);
+    v->Unref();
+  }
+  return s;
+}
+
 // Default implementations of convenience methods that subclasses of DB
 // can call if they wish
 Status DB::Put(const WriteOptions& opt, const Slice& key, const Slice& value) {
@@ -1440,6 +2436,25 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt,
+                       const Slice& begin, const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt,
+                 const Slice& key, const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::DeleteFilesInRange(const Slice* begin, const Slice* end,
+                              bool ignore_snapshots) {
+  return Status::NotSupported("DeleteFilesInRange");
+}
+
 DB::~DB() { }
 
 Status DB::Open(const Options& options, const std::string& dbname,
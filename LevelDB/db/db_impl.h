@@ -7,6 +7,8 @@
 
 #include <deque>
 #include <set>
+#include <string>
+#include <vector>
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
@@ -18,6 +20,7 @@
 namespace leveldb {
 
 class MemTable;
+class RangeDelAggregator;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -31,6 +34,10 @@ class DBImpl : public DB {
   // Implementations of the DB interface
   virtual Status Put(const WriteOptions&, const Slice& key, const Slice& value);
   virtual Status Delete(const WriteOptions&, const Slice& key);
+  virtual Status DeleteRange(const WriteOptions&,
+                             const Slice& begin, const Slice& end);
+  virtual Status Merge(const WriteOptions&, const Slice& key,
+                       const Slice& value);
   virtual Status Write(const WriteOptions& options, WriteBatch* updates);
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
@@ -41,6 +48,9 @@ class DBImpl : public DB {
   virtual bool GetProperty(const Slice& property, std::string* value);
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
   virtual void CompactRange(const Slice* begin, const Slice* end);
+  virtual Status DeleteFilesInRange(const Slice* begin, const Slice* end,
+                                    bool ignore_snapshots);
+  virtual Status GetPropertiesOfAllTables(TablePropertiesCollection* props);
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -64,14 +74,23 @@ class DBImpl : public DB {
   // bytes.
   void RecordReadSample(Slice key);
 
+  // Store in *value the value of "user_key" that the encoded BlobIndex
+  // "blob_index" points to.
+  Status ReadBlob(const ReadOptions& options, const Slice& user_key,
+                  const Slice& blob_index, std::string* value);
+
  private:
   friend class DB;
   struct CompactionState;
+  struct Subcompaction;
   struct Writer;
 
+  // If "range_del" is non-NULL, also stores in *range_del the range
+  // tombstones visible to the read, or NULL if there are none.
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                RangeDelAggregator** range_del = NULL);
 
   Status NewDB();
 
@@ -95,7 +114,12 @@ class DBImpl : public DB {
                         SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // If pending_numbers is non-NULL the new table and blob file are left
+  // in pending_outputs_ and their numbers are appended there; the caller
+  // must erase them once *edit has been applied, since other background
+  // threads may delete obsolete files in the meantime.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
+                          std::vector<uint64_t>* pending_numbers)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
@@ -104,17 +128,69 @@ class DBImpl : public DB {
 
   void RecordBackgroundError(const Status& s);
 
+  // Apply *edit to the current version.  Background threads may finish
+  // their work concurrently, so writes to the MANIFEST are serialized here.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
   void BackgroundCall();
-  void  BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Returns false if there was no work this thread could claim.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Merge the part of the compaction input inside the key range of
+  // *compact into new output files.  Memtable compactions are done along
+  // the way iff imm_micros is non-NULL; their time is added to it.
+  // REQUIRES: mutex_ is not held
+  Status DoCompactionRange(CompactionState* compact, int64_t* imm_micros);
+
+  // Split the compaction at "boundaries" and run the resulting key ranges
+  // in parallel.  All outputs are collected in *compact.
+  // REQUIRES: mutex_ is not held
+  Status DoSubcompactions(CompactionState* compact,
+                          const std::vector<std::string>& boundaries,
+                          int64_t* imm_micros);
+  static void SubcompactionWork(void* arg);
+
+  // Add an entry to the output of *compact, opening an output file if
+  // necessary.  Sets *close_output once the file is big enough.  Large
+  // values are moved to a blob file.
+  Status AddCompactionOutput(CompactionState* compact, Slice key,
+                             Slice value, bool* close_output);
+
+  // Append "value" to the blob file being written by *compact, opening
+  // one if necessary, and store the encoded BlobIndex in *blob_index.
+  Status AddCompactionBlob(CompactionState* compact, const Slice& user_key,
+                           const Slice& value, std::string* blob_index);
+
+  // Record that the output of *compact no longer references the blob
+  // record "blob_index" of "user_key".
+  void AddCompactionBlobGarbage(CompactionState* compact,
+                                const Slice& user_key,
+                                const Slice& blob_index);
+
+  // Called with "input" at a merge operand of "user_key" that is kept.
+  // Combines it with the older entries for the key that no snapshot can
+  // tell apart from it, adds the result to the output, and leaves "input"
+  // at the first entry not combined.  *last_sequence is set to the
+  // sequence number of the last entry consumed.  "range_del" holds the
+  // tombstones every snapshot can see, "newest_range_del" all of them.
+  Status MergeCompactionOperands(CompactionState* compact, Iterator* input,
+                                 RangeDelAggregator* range_del,
+                                 RangeDelAggregator* newest_range_del,
+                                 const Slice& user_key,
+                                 SequenceNumber* last_sequence,
+                                 bool* close_output);
+
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  Status OpenCompactionBlobFile(CompactionState* compact);
+  Status FinishCompactionBlobFile(CompactionState* compact);
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* next_user_key);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -155,8 +231,19 @@ class DBImpl : public DB {
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_;
 
-  // Has a background compaction been scheduled or is running?
-  bool bg_compaction_scheduled_;
+  // Number of background calls that are scheduled or running.  At most
+  // options_.max_background_compactions.
+  int bg_compaction_scheduled_;
+
+  // Number of compactions (not counting memtable flushes) that are
+  // currently running in background threads.
+  int running_compactions_;
+
+  // Is a background thread currently flushing imm_?
+  bool bg_flush_active_;
+
+  // Is a thread currently writing to the MANIFEST?
+  bool manifest_writing_;
 
   // Information for a manual compaction
   struct ManualCompaction {
@@ -190,6 +277,9 @@ class DBImpl : public DB {
   };
   CompactionStats stats_[config::kNumLevels];
 
+  // Bytes of write batches applied since the DB was opened.
+  uint64_t user_bytes_written_;
+
   // No copying allowed
   DBImpl(const DBImpl&);
   void operator=(const DBImpl&);
@@ -4,9 +4,13 @@
 
 #include "db/db_iter.h"
 
+#include <algorithm>
+#include <vector>
 #include "db/filename.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
+#include "db/merge_helper.h"
+#include "db/range_del.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -40,7 +44,12 @@ class DBIter: public Iterator {
  public:
   // Which direction is the iterator currently moving?
   // (1) When moving forward, the internal iterator is positioned at
-  //     the exact entry that yields this->key(), this->value()
+  //     the exact entry that yields this->key(), this->value(), unless
+  //     that entry is the result of merge operands.  Then the internal
+  //     iterator is positioned after the operands and the entry they
+  //     apply to, and the result is in saved_key_ and saved_value_.
+  //     The value of an entry kept in a blob file is read into
+  //     saved_value_ as well.
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
   enum Direction {
@@ -48,28 +57,37 @@ class DBIter: public Iterator {
     kReverse
   };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+  DBIter(DBImpl* db, const ReadOptions& options, const Comparator* cmp,
+         const MergeOperator* merge, Iterator* iter, SequenceNumber s,
+         RangeDelAggregator* range_del, uint32_t seed)
       : db_(db),
+        options_(options),
         user_comparator_(cmp),
+        merge_operator_(merge),
         iter_(iter),
         sequence_(s),
+        range_del_(range_del),
         direction_(kForward),
         valid_(false),
+        current_entry_is_merged_(false),
+        current_entry_is_blob_(false),
         rnd_(seed),
         bytes_counter_(RandomPeriod()) {
   }
   virtual ~DBIter() {
     delete iter_;
+    delete range_del_;
   }
   virtual bool Valid() const { return valid_; }
   virtual Slice key() const {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !current_entry_is_merged_) ?
+        ExtractUserKey(iter_->key()) : saved_key_;
   }
   virtual Slice value() const {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !current_entry_is_merged_ &&
+            !current_entry_is_blob_) ? iter_->value() : saved_value_;
   }
   virtual Status status() const {
     if (status_.ok()) {
@@ -88,8 +106,25 @@ class DBIter: public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  void MergeValuesNewToOld();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Replace the BlobIndex of "user_key" in saved_value_ by the value it
+  // points to.  Returns false and sets status_ on failure.
+  bool ReadBlobValue(const Slice& user_key);
+
+  // Values and merge operands hidden by a range tombstone are treated as
+  // deletions.
+  inline ValueType EntryType(const ParsedInternalKey& ikey) {
+    if ((ikey.type == kTypeValue || ikey.type == kTypeMerge ||
+         ikey.type == kTypeBlobIndex) &&
+        range_del_ != NULL &&
+        range_del_->ShouldDelete(ikey.user_key, ikey.sequence)) {
+      return kTypeDeletion;
+    }
+    return ikey.type;
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -109,15 +144,21 @@ class DBIter: public Iterator {
   }
 
   DBImpl* db_;
+  const ReadOptions options_;   // For reads of blob files
   const Comparator* const user_comparator_;
+  const MergeOperator* const merge_operator_;
   Iterator* const iter_;
   SequenceNumber const sequence_;
+  RangeDelAggregator* const range_del_;  // NULL if there are no tombstones
 
   Status status_;
   std::string saved_key_;     // == current key when direction_==kReverse
   std::string saved_value_;   // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool current_entry_is_merged_;  // See (1) above
+  bool current_entry_is_blob_;    // See (1) above
+  std::vector<std::string> operands_;  // Merge operands being collected
 
   Random rnd_;
   ssize_t bytes_counter_;
@@ -143,6 +184,16 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
   }
 }
 
+bool DBIter::ReadBlobValue(const Slice& user_key) {
+  const std::string blob_index = saved_value_;
+  Status s = db_->ReadBlob(options_, user_key, blob_index, &saved_value_);
+  if (!s.ok()) {
+    status_ = s;
+    return false;
+  }
+  return true;
+}
+
 void DBIter::Next() {
   assert(valid_);
 
@@ -162,6 +213,14 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (current_entry_is_merged_) {
+    // iter_ is already past the operands for this->key(), which is kept
+    // in saved_key_.
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -174,10 +233,12 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  current_entry_is_merged_ = false;
+  current_entry_is_blob_ = false;
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-      switch (ikey.type) {
+      switch (EntryType(ikey)) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
           // they are hidden by this deletion.
@@ -185,15 +246,32 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           skipping = true;
           break;
         case kTypeValue:
+        case kTypeMerge:
+        case kTypeBlobIndex:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
+          } else if (ikey.type == kTypeMerge) {
+            MergeValuesNewToOld();
+            return;
           } else {
-            valid_ = true;
             saved_key_.clear();
+            if (ikey.type == kTypeBlobIndex) {
+              saved_value_.assign(iter_->value().data(),
+                                  iter_->value().size());
+              if (!ReadBlobValue(ikey.user_key)) {
+                valid_ = false;
+                return;
+              }
+              current_entry_is_blob_ = true;
+            }
+            valid_ = true;
             return;
           }
           break;
+        case kTypeRangeDeletion:
+          // Range tombstones are not stored among the entries
+          break;
       }
     }
     iter_->Next();
@@ -202,14 +280,80 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+void DBIter::MergeValuesNewToOld() {
+  // Collect the operands for the user key down to the value or deletion
+  // they apply to, and skip the older entries
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  operands_.clear();
+  operands_.push_back(iter_->value().ToString());
+  bool found_base = false;
+  bool has_value = false;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey)) {
+      continue;
+    }
+    if (user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (found_base) {
+      continue;
+    }
+    switch (EntryType(ikey)) {
+      case kTypeDeletion:
+        found_base = true;
+        break;
+      case kTypeValue:
+      case kTypeBlobIndex:
+        found_base = true;
+        has_value = true;
+        saved_value_.assign(iter_->value().data(), iter_->value().size());
+        if (ikey.type == kTypeBlobIndex && !ReadBlobValue(saved_key_)) {
+          valid_ = false;
+          saved_key_.clear();
+          ClearSavedValue();
+          operands_.clear();
+          return;
+        }
+        break;
+      case kTypeMerge:
+        operands_.push_back(iter_->value().ToString());
+        break;
+      case kTypeRangeDeletion:
+        break;
+    }
+  }
+
+  Slice existing(saved_value_);
+  Status s = FullMerge(merge_operator_, saved_key_,
+                       has_value ? &existing : NULL, operands_, &saved_value_);
+  operands_.clear();
+  if (!s.ok()) {
+    status_ = s;
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+    return;
+  }
+  valid_ = true;
+  current_entry_is_merged_ = true;
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
   if (direction_ == kForward) {  // Switch directions?
-    // iter_ is pointing at the current entry.  Scan backwards until
-    // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    // iter_ is pointing at the current entry, or past it if it is the
+    // result of merge operands.  Scan backwards until the key changes so
+    // we can use the normal reverse scanning code.
+    if (current_entry_is_merged_) {
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
       iter_->Prev();
       if (!iter_->Valid()) {
@@ -231,35 +375,80 @@ void DBIter::Prev() {
 
 void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
+  current_entry_is_merged_ = false;
+  current_entry_is_blob_ = false;
 
+  // value_type describes the entry under the merge operands collected
+  // in operands_, oldest first, if any; saved_value_ holds a BlobIndex
+  // instead of the value if value_is_blob is set.
   ValueType value_type = kTypeDeletion;
+  bool value_is_blob = false;
+  operands_.clear();
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
       if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
-        if ((value_type != kTypeDeletion) &&
+        if ((value_type != kTypeDeletion || !operands_.empty()) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
-        value_type = ikey.type;
-        if (value_type == kTypeDeletion) {
-          saved_key_.clear();
-          ClearSavedValue();
-        } else {
-          Slice raw_value = iter_->value();
-          if (saved_value_.capacity() > raw_value.size() + 1048576) {
-            std::string empty;
-            swap(empty, saved_value_);
+        switch (EntryType(ikey)) {
+          case kTypeDeletion:
+            value_type = kTypeDeletion;
+            value_is_blob = false;
+            operands_.clear();
+            saved_key_.clear();
+            ClearSavedValue();
+            break;
+          case kTypeValue:
+          case kTypeBlobIndex: {
+            value_type = kTypeValue;
+            value_is_blob = (ikey.type == kTypeBlobIndex);
+            operands_.clear();
+            Slice raw_value = iter_->value();
+            if (saved_value_.capacity() > raw_value.size() + 1048576) {
+              std::string empty;
+              swap(empty, saved_value_);
+            }
+            SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+            saved_value_.assign(raw_value.data(), raw_value.size());
+            break;
           }
-          SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
-          saved_value_.assign(raw_value.data(), raw_value.size());
+          case kTypeMerge:
+            operands_.push_back(iter_->value().ToString());
+            SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+            break;
+          case kTypeRangeDeletion:
+            // Range tombstones are not stored among the entries
+            break;
         }
       }
       iter_->Prev();
     } while (iter_->Valid());
   }
 
+  if (value_type == kTypeValue && value_is_blob &&
+      !ReadBlobValue(saved_key_)) {
+    value_type = kTypeDeletion;
+    operands_.clear();
+  }
+
+  if (!operands_.empty()) {
+    std::reverse(operands_.begin(), operands_.end());
+    Slice existing(saved_value_);
+    Status s = FullMerge(merge_operator_, saved_key_,
+                         value_type == kTypeValue ? &existing : NULL,
+                         operands_, &saved_value_);
+    operands_.clear();
+    if (s.ok()) {
+      value_type = kTypeValue;
+    } else {
+      status_ = s;
+      value_type = kTypeDeletion;
+    }
+  }
+
   if (value_type == kTypeDeletion) {
     // End
     valid_ = false;
@@ -307,11 +496,15 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(
     DBImpl* db,
+    const ReadOptions& options,
     const Comparator* user_key_comparator,
+    const MergeOperator* merge_operator,
     Iterator* internal_iter,
     SequenceNumber sequence,
+    RangeDelAggregator* range_del,
     uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+  return new DBIter(db, options, user_key_comparator, merge_operator,
+                    internal_iter, sequence, range_del, seed);
 }
 
 }  // namespace leveldb
@@ -12,15 +12,23 @@
 namespace leveldb {
 
 class DBImpl;
+class MergeOperator;
+class RangeDelAggregator;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Entries hidden by the tombstones in
+// "*range_del" (which may be NULL) are skipped.  Merge operands are
+// applied with "merge_operator", and values kept in blob files are read
+// with "options".  Takes ownership of "*internal_iter" and "*range_del".
 extern Iterator* NewDBIterator(
     DBImpl* db,
+    const ReadOptions& options,
     const Comparator* user_key_comparator,
+    const MergeOperator* merge_operator,
     Iterator* internal_iter,
     SequenceNumber sequence,
+    RangeDelAggregator* range_del,
     uint32_t seed);
 
 }  // namespace leveldb
@@ -3,7 +3,11 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "leveldb/db.h"
+#include "leveldb/compaction_filter.h"
+#include "leveldb/compressor.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/rate_limiter.h"
 #include "db/db_impl.h"
 #include "db/filename.h"
 #include "db/version_set.h"
@@ -189,17 +193,51 @@ class SpecialEnv : public EnvWrapper {
 class DBTest {
  private:
   const FilterPolicy* filter_policy_;
+  RateLimiter* rate_limiter_;
 
   // Sequence of option configurations to try
   enum OptionConfig {
     kDefault,
     kFilter,
     kUncompressed,
+    kPipelined,
+    kParallelCompression,
+    kPlainTables,
+    kHashTables,
+    kBlockFormat2,
+    kConcurrentCompactions,
+    kSubcompactions,
+    kUniversal,
+    kDynamicLevelBytes,
+    kRateLimited,
+    kMarkedCompactions,
+    kOverlapPriority,
+    kPerLevelCompression,
+    kDictionaryCompression,
+    kBlobFiles,
     kEnd
   };
   int option_config_;
 
  public:
+  // Option configurations a test can ask ChangeOptions() to skip
+  enum OptionSkip {
+    kNoSkip = 0,
+    // Configurations that always place memtable flushes in level-0
+    kSkipFlushPlacement = 1,
+    // Configurations that split even small compactions into several
+    // output files
+    kSkipSplitOutputs = 2,
+    // Configurations that compact level-0 into a level below level-1
+    kSkipBaseLevel = 4,
+    // Configurations that compact files the level sizes do not call for
+    kSkipMarkedFiles = 8,
+    // Configurations that compress the random strings tests write
+    kSkipRandomCompression = 16,
+    // Configurations that move values out of the table files
+    kSkipBlobValues = 32
+  };
+
   std::string dbname_;
   SpecialEnv* env_;
   DB* db_;
@@ -209,6 +247,7 @@ class DBTest {
   DBTest() : option_config_(kDefault),
              env_(new SpecialEnv(Env::Default())) {
     filter_policy_ = NewBloomFilterPolicy(10);
+    rate_limiter_ = NewRateLimiter(100 << 20, false);
     dbname_ = test::TmpDir() + "/db_test";
     DestroyDB(dbname_, Options());
     db_ = NULL;
@@ -219,13 +258,17 @@ class DBTest {
     delete db_;
     DestroyDB(dbname_, Options());
     delete env_;
+    delete rate_limiter_;
     delete filter_policy_;
   }
 
   // Switch to a fresh database with the next option configuration to
-  // test.  Return false if there are no more configurations to test.
-  bool ChangeOptions() {
-    option_config_++;
+  // test, passing over the configurations named in skip_mask.  Return
+  // false if there are no more configurations to test.
+  bool ChangeOptions(int skip_mask = kNoSkip) {
+    do {
+      option_config_++;
+    } while (option_config_ < kEnd && ShouldSkip(skip_mask));
     if (option_config_ >= kEnd) {
       return false;
     } else {
@@ -234,6 +277,35 @@ class DBTest {
     }
   }
 
+  bool ShouldSkip(int skip_mask) {
+    if ((skip_mask & kSkipFlushPlacement) != 0 &&
+        (option_config_ == kConcurrentCompactions ||
+         option_config_ == kUniversal)) {
+      return true;
+    }
+    if ((skip_mask & kSkipSplitOutputs) != 0 &&
+        option_config_ == kSubcompactions) {
+      return true;
+    }
+    if ((skip_mask & kSkipBaseLevel) != 0 &&
+        option_config_ == kDynamicLevelBytes) {
+      return true;
+    }
+    if ((skip_mask & kSkipMarkedFiles) != 0 &&
+        option_config_ == kMarkedCompactions) {
+      return true;
+    }
+    if ((skip_mask & kSkipRandomCompression) != 0 &&
+        option_config_ == kDictionaryCompression) {
+      return true;
+    }
+    if ((skip_mask & kSkipBlobValues) != 0 &&
+        option_config_ == kBlobFiles) {
+      return true;
+    }
+    return false;
+  }
+
   // Return the current option configuration.
   Options CurrentOptions() {
     Options options;
@@ -244,6 +316,55 @@ class DBTest {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelined:
+        options.pipelined_compaction = true;
+        break;
+      case kParallelCompression:
+        options.filter_policy = filter_policy_;
+        options.compression_threads = 4;
+        break;
+      case kPlainTables:
+        options.table_format = kPlainTable;
+        break;
+      case kHashTables:
+        options.table_format = kHashTable;
+        break;
+      case kBlockFormat2:
+        options.block_format_version = 2;
+        break;
+      case kConcurrentCompactions:
+        options.max_background_compactions = 4;
+        break;
+      case kSubcompactions:
+        options.max_subcompactions = 4;
+        break;
+      case kUniversal:
+        options.compaction_style = kUniversalCompaction;
+        break;
+      case kDynamicLevelBytes:
+        options.dynamic_level_bytes = true;
+        break;
+      case kRateLimited:
+        options.rate_limiter = rate_limiter_;
+        break;
+      case kMarkedCompactions:
+        options.deletion_compaction_ratio = 0.1;
+        options.periodic_compaction_seconds = 1;
+        break;
+      case kOverlapPriority:
+        options.compaction_pri = kMinOverlappingRatio;
+        break;
+      case kPerLevelCompression:
+        options.compression_per_level.push_back(kNoCompression);
+        options.compression_per_level.push_back(options.compression);
+        break;
+      case kDictionaryCompression:
+        options.compression = kZlibCompression;
+        options.compression_dictionary_bytes = 1024;
+        break;
+      case kBlobFiles:
+        options.min_blob_size = 4;
+        break;
       default:
         break;
     }
@@ -293,6 +414,14 @@ class DBTest {
     return db_->Delete(WriteOptions(), k);
   }
 
+  Status DeleteRange(const std::string& begin, const std::string& end) {
+    return db_->DeleteRange(WriteOptions(), begin, end);
+  }
+
+  Status Merge(const std::string& k, const std::string& v) {
+    return db_->Merge(WriteOptions(), k, v);
+  }
+
   std::string Get(const std::string& k, const Snapshot* snapshot = NULL) {
     ReadOptions options;
     options.snapshot = snapshot;
@@ -362,6 +491,15 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeRangeDeletion:
+              result += "RANGEDEL";
+              break;
+            case kTypeMerge:
+              result += "MERGE(" + iter->value().ToString() + ")";
+              break;
+            case kTypeBlobIndex:
+              result += "BLOB";
+              break;
           }
         }
         iter->Next();
@@ -414,6 +552,20 @@ class DBTest {
     return static_cast<int>(files.size());
   }
 
+  int CountBlobFiles() {
+    std::vector<std::string> files;
+    env_->GetChildren(dbname_, &files);
+    int result = 0;
+    uint64_t number;
+    FileType type;
+    for (size_t i = 0; i < files.size(); i++) {
+      if (ParseFileName(files[i], &number, &type) && type == kBlobFile) {
+        result++;
+      }
+    }
+    return result;
+  }
+
   uint64_t Size(const Slice& start, const Slice& limit) {
     Range r(start, limit);
     uint64_t size;
@@ -654,7 +806,8 @@ TEST(DBTest, GetEncountersEmptyLevel) {
     DelayMilliseconds(1000);
 
     ASSERT_EQ(NumTableFilesAtLevel(0), 0);
-  } while (ChangeOptions());
+  } while (ChangeOptions(kSkipFlushPlacement | kSkipSplitOutputs |
+                         kSkipBaseLevel));
 }
 
 TEST(DBTest, IterEmpty) {
@@ -1103,7 +1256,8 @@ TEST(DBTest, ApproximateSizes) {
       ASSERT_EQ(NumTableFilesAtLevel(0), 0);
       ASSERT_GT(NumTableFilesAtLevel(1), 0);
     }
-  } while (ChangeOptions());
+  } while (ChangeOptions(kSkipBaseLevel | kSkipMarkedFiles |
+                         kSkipBlobValues));
 }
 
 TEST(DBTest, ApproximateSizes_MixOfSmallAndLarge) {
@@ -1141,7 +1295,7 @@ TEST(DBTest, ApproximateSizes_MixOfSmallAndLarge) {
 
       dbfull()->TEST_CompactRange(0, NULL, NULL);
     }
-  } while (ChangeOptions());
+  } while (ChangeOptions(kSkipBlobValues));
 }
 
 TEST(DBTest, IteratorPinsRef) {
@@ -1199,6 +1353,9 @@ TEST(DBTest, HiddenValuesAreRemoved) {
   do {
     Random rnd(301);
     FillLevels("a", "z");
+    // Settle the level-0 files now, so that no automatic compaction can
+    // pick up the new table below while the snapshot is held
+    dbfull()->TEST_CompactRange(0, NULL, NULL);
 
     std::string big = RandomString(&rnd, 50000);
     Put("foo", big);
@@ -1223,7 +1380,9 @@ TEST(DBTest, HiddenValuesAreRemoved) {
     ASSERT_EQ(AllEntriesFor("foo"), "[ tiny ]");
 
     ASSERT_TRUE(Between(Size("", "pastfoo"), 0, 1000));
-  } while (ChangeOptions());
+  } while (ChangeOptions(kSkipSplitOutputs | kSkipBaseLevel |
+                         kSkipMarkedFiles | kSkipRandomCompression |
+                         kSkipBlobValues));
 }
 
 TEST(DBTest, DeletionMarkers1) {
@@ -1255,6 +1414,384 @@ TEST(DBTest, DeletionMarkers1) {
   ASSERT_EQ(AllEntriesFor("foo"), "[ v2 ]");
 }
 
+TEST(DBTest, DeleteRange) {
+  do {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("b", "vb"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(Put("d", "vd"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(DeleteRange("b", "d"));
+    ASSERT_OK(Put("c", "vc2"));
+    ASSERT_TRUE(!DeleteRange("d", "b").ok());
+
+    for (int i = 0; i < 3; i++) {
+      ASSERT_EQ("va", Get("a"));
+      ASSERT_EQ("NOT_FOUND", Get("b"));
+      ASSERT_EQ("vc2", Get("c"));
+      ASSERT_EQ("vd", Get("d"));
+      ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+      ASSERT_EQ("vb", Get("b", snapshot));
+      ASSERT_EQ("vc", Get("c", snapshot));
+
+      if (i == 0) {
+        ASSERT_OK(dbfull()->TEST_CompactMemTable());
+      } else {
+        db_->CompactRange(NULL, NULL);
+      }
+    }
+    ASSERT_EQ("[ vb ]", AllEntriesFor("b"));   // Still seen by snapshot
+
+    // Push everything to the last level, where the tombstone and the data
+    // it hides are dropped
+    db_->ReleaseSnapshot(snapshot);
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      dbfull()->TEST_CompactRange(level, NULL, NULL);
+    }
+    ASSERT_EQ("[ ]", AllEntriesFor("b"));
+    ASSERT_EQ("[ vc2 ]", AllEntriesFor("c"));
+
+    // A range tombstone on its own also survives flushes and reopening
+    ASSERT_OK(DeleteRange("a", "c"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    Reopen();
+    ASSERT_EQ("NOT_FOUND", Get("a"));
+    ASSERT_EQ("(c->vc2)(d->vd)", Contents());
+    ASSERT_OK(Put("a", "va2"));
+    ASSERT_EQ("va2", Get("a"));
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ("(a->va2)(c->vc2)(d->vd)", Contents());
+  } while (ChangeOptions(kSkipBaseLevel | kSkipMarkedFiles));
+}
+
+namespace {
+// Appends operands to the value, separated by commas.  Adjacent operands
+// are only combined ahead of the value if "partial" is set.  The operand
+// "fail" cannot be applied.
+class AppendOperator : public MergeOperator {
+ public:
+  explicit AppendOperator(bool partial) : partial_(partial) { }
+  virtual const char* Name() const { return "AppendOperator"; }
+  virtual bool FullMerge(const Slice& key,
+                         const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const {
+    new_value->clear();
+    if (existing_value != NULL) {
+      new_value->assign(existing_value->data(), existing_value->size());
+    }
+    for (size_t i = 0; i < operands.size(); i++) {
+      if (operands[i] == "fail") {
+        return false;
+      }
+      if (existing_value != NULL || i > 0) {
+        new_value->push_back(',');
+      }
+      new_value->append(operands[i].data(), operands[i].size());
+    }
+    return true;
+  }
+  virtual bool PartialMerge(const Slice& key,
+                            const Slice& left_operand,
+                            const Slice& right_operand,
+                            std::string* new_value) const {
+    if (!partial_ || left_operand == "fail" || right_operand == "fail") {
+      return false;
+    }
+    *new_value = left_operand.ToString() + "," + right_operand.ToString();
+    return true;
+  }
+
+ private:
+  bool partial_;
+};
+}  // namespace
+
+TEST(DBTest, Merge) {
+  ASSERT_TRUE(!Merge("a", "1").ok());   // No merge_operator
+
+  AppendOperator append(false);
+  do {
+    Options options = CurrentOptions();
+    options.merge_operator = &append;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    ASSERT_OK(Merge("a", "1"));
+    ASSERT_OK(Put("b", "v"));
+    ASSERT_OK(Merge("b", "1"));
+    ASSERT_OK(Put("c", "v"));
+    ASSERT_OK(Delete("c"));
+    ASSERT_OK(Merge("c", "1"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(Merge("a", "2"));
+    ASSERT_OK(Merge("b", "2"));
+    ASSERT_OK(DeleteRange("c", "d"));
+    ASSERT_OK(Merge("c", "2"));
+
+    // Operands apply to the value under them wherever each is stored
+    for (int i = 0; i < 3; i++) {
+      ASSERT_EQ("1,2", Get("a"));
+      ASSERT_EQ("v,1,2", Get("b"));
+      ASSERT_EQ("2", Get("c"));
+      ASSERT_EQ("(a->1,2)(b->v,1,2)(c->2)", Contents());
+      ASSERT_EQ("1", Get("a", snapshot));
+      ASSERT_EQ("v,1", Get("b", snapshot));
+      ASSERT_EQ("1", Get("c", snapshot));
+
+      if (i == 0) {
+        ASSERT_OK(dbfull()->TEST_CompactMemTable());
+      } else {
+        db_->CompactRange(NULL, NULL);
+      }
+    }
+    ASSERT_OK(Merge("b", "3"));
+    ASSERT_EQ("v,1,2,3", Get("b"));
+    ASSERT_EQ("(a->1,2)(b->v,1,2,3)(c->2)", Contents());
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    iter->Seek("b");
+    ASSERT_EQ("b->v,1,2,3", IterStatus(iter));
+    iter->Prev();
+    ASSERT_EQ("a->1,2", IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ("b->v,1,2,3", IterStatus(iter));
+    iter->Next();
+    ASSERT_EQ("c->2", IterStatus(iter));
+    iter->Prev();
+    ASSERT_EQ("b->v,1,2,3", IterStatus(iter));
+    delete iter;
+
+    // Once no snapshot needs them, compactions replace operands by values
+    db_->ReleaseSnapshot(snapshot);
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ("[ 1,2 ]", AllEntriesFor("a"));
+    ASSERT_EQ("[ v,1,2,3 ]", AllEntriesFor("b"));
+    ASSERT_EQ("(a->1,2)(b->v,1,2,3)(c->2)", Contents());
+
+    // Operands that cannot be applied fail the reads that need them
+    ASSERT_OK(Merge("d", "fail"));
+    std::string value;
+    ASSERT_TRUE(!db_->Get(ReadOptions(), "d", &value).ok());
+    iter = db_->NewIterator(ReadOptions());
+    iter->Seek("d");
+    ASSERT_TRUE(!iter->Valid());
+    ASSERT_TRUE(!iter->status().ok());
+    delete iter;
+  } while (ChangeOptions(kSkipBlobValues));
+}
+
+TEST(DBTest, PartialMerge) {
+  for (int partial = 0; partial < 2; partial++) {
+    AppendOperator append(partial != 0);
+    Options options = CurrentOptions();
+    options.merge_operator = &append;
+    options.max_background_compactions = 2;  // Keep flushed tables in level-0
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    ASSERT_OK(Put("k", "v"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    dbfull()->TEST_CompactRange(0, NULL, NULL);
+    dbfull()->TEST_CompactRange(1, NULL, NULL);
+    ASSERT_EQ("0,0,1", FilesPerLevel());
+
+    // The value is two levels below the operands, so compacting them into
+    // level-1 can only combine them with each other
+    ASSERT_OK(Merge("k", "1"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_OK(Merge("k", "2"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    dbfull()->TEST_CompactRange(0, NULL, NULL);
+    ASSERT_EQ("0,1,1", FilesPerLevel());
+    if (partial) {
+      ASSERT_EQ("[ MERGE(1,2), v ]", AllEntriesFor("k"));
+    } else {
+      ASSERT_EQ("[ MERGE(2), MERGE(1), v ]", AllEntriesFor("k"));
+    }
+    ASSERT_EQ("v,1,2", Get("k"));
+
+    dbfull()->TEST_CompactRange(1, NULL, NULL);
+    ASSERT_EQ("[ v,1,2 ]", AllEntriesFor("k"));
+  }
+}
+
+TEST(DBTest, MergeOverDeleteRange) {
+  AppendOperator append(false);
+  do {
+    Options options = CurrentOptions();
+    options.merge_operator = &append;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    ASSERT_OK(Put("a", "va"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(Put("k", "old"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_OK(DeleteRange("j", "l"));
+    ASSERT_OK(Merge("k", "m1"));
+    ASSERT_EQ("m1", Get("k"));
+
+    // The operand and the value are newer than the snapshot, but the
+    // tombstone between them hides the value from the operand
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ("m1", Get("k"));
+    ASSERT_EQ("NOT_FOUND", Get("k", snapshot));
+    db_->ReleaseSnapshot(snapshot);
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ("m1", Get("k"));
+    ASSERT_EQ("va", Get("a"));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, DeleteFilesInRange) {
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("c", "vc"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("x", "vx"));
+  ASSERT_OK(Put("z", "vz"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,2", FilesPerLevel());
+
+  // Refused while a snapshot may still read the files
+  Slice a("a"), d("d"), y("y");
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_TRUE(!db_->DeleteFilesInRange(&a, &d, false).ok());
+  ASSERT_EQ("0,0,2", FilesPerLevel());
+  db_->ReleaseSnapshot(snapshot);
+
+  const int num_files = CountFiles();
+  ASSERT_OK(db_->DeleteFilesInRange(&a, &d, false));
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ(num_files - 1, CountFiles());
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("(x->vx)(z->vz)", Contents());
+
+  // Files that extend beyond the range are kept
+  ASSERT_OK(db_->DeleteFilesInRange(&y, NULL, false));
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // So is data that is not in a table file yet
+  ASSERT_OK(Put("b", "vb"));
+  snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->DeleteFilesInRange(NULL, NULL, true));
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_EQ("", FilesPerLevel());
+  ASSERT_EQ("(b->vb)", Contents());
+
+  Reopen();
+  ASSERT_EQ("(b->vb)", Contents());
+}
+
+TEST(DBTest, GetPropertiesOfAllTables) {
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_OK(Delete("c"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("x", "vx"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(2, TotalTableFiles());
+
+  for (int i = 0; i < 2; i++) {
+    TablePropertiesCollection props;
+    ASSERT_OK(db_->GetPropertiesOfAllTables(&props));
+    ASSERT_EQ(2u, props.size());
+    uint64_t entries = 0, deletions = 0, value_size = 0;
+    uint64_t smallest_seqno = kMaxSequenceNumber, largest_seqno = 0;
+    for (TablePropertiesCollection::const_iterator it = props.begin();
+         it != props.end(); ++it) {
+      uint64_t number;
+      FileType type;
+      ASSERT_TRUE(ParseFileName(it->first.substr(dbname_.size() + 1),
+                                &number, &type));
+      ASSERT_EQ(kTableFile, type);
+      entries += it->second.num_entries;
+      deletions += it->second.num_deletions;
+      value_size += it->second.raw_value_size;
+      smallest_seqno = std::min(smallest_seqno, it->second.smallest_seqno);
+      largest_seqno = std::max(largest_seqno, it->second.largest_seqno);
+    }
+    ASSERT_EQ(4u, entries);
+    ASSERT_EQ(1u, deletions);
+    ASSERT_EQ(6u, value_size);
+    ASSERT_EQ(1u, smallest_seqno);
+    ASSERT_EQ(4u, largest_seqno);
+
+    // The properties are read back from the files
+    Reopen();
+  }
+}
+
+TEST(DBTest, ZeroSequenceNumbersAtBottom) {
+  struct Local {
+    // Returns the sequence numbers of the entries of "user_key"
+    static std::string Sequences(DBImpl* db, const Slice& user_key) {
+      Iterator* iter = db->TEST_NewInternalIterator();
+      InternalKey target(user_key, kMaxSequenceNumber, kValueTypeForSeek);
+      std::string result;
+      for (iter->Seek(target.Encode()); iter->Valid(); iter->Next()) {
+        if (ExtractUserKey(iter->key()) != user_key) {
+          break;
+        }
+        if (!result.empty()) {
+          result += ",";
+        }
+        AppendNumberTo(&result, ExtractSequence(iter->key()));
+      }
+      delete iter;
+      return result;
+    }
+
+    // Compacts the memtable and all files down to level "last"
+    static void CompactTo(DBImpl* db, int last) {
+      ASSERT_OK(db->TEST_CompactMemTable());
+      for (int level = 0; level < last; level++) {
+        db->TEST_CompactRange(level, NULL, NULL);
+      }
+    }
+  };
+  const int kLastLevel = config::kNumLevels - 1;
+
+  do {
+    ASSERT_OK(Put("a", "va1"));
+    ASSERT_OK(Put("b", "vb1"));
+    ASSERT_OK(Put("c", "vc1"));
+    ASSERT_OK(DeleteRange("c", "d"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("1", Local::Sequences(dbfull(), "a"));
+
+    // No snapshot needs the sequence numbers of the last level
+    Local::CompactTo(dbfull(), kLastLevel);
+    ASSERT_EQ("0", Local::Sequences(dbfull(), "a"));
+    ASSERT_EQ("0", Local::Sequences(dbfull(), "b"));
+    ASSERT_EQ("", Local::Sequences(dbfull(), "c"));
+
+    // Entries that a snapshot may not see keep theirs
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(Put("a", "va2"));
+    Local::CompactTo(dbfull(), kLastLevel);
+    ASSERT_EQ("5,0", Local::Sequences(dbfull(), "a"));
+    ASSERT_EQ("va1", Get("a", snapshot));
+    ASSERT_EQ("va2", Get("a"));
+    db_->ReleaseSnapshot(snapshot);
+    ASSERT_OK(Put("a", "va3"));
+    Local::CompactTo(dbfull(), kLastLevel);
+    ASSERT_EQ("0", Local::Sequences(dbfull(), "a"));
+    ASSERT_EQ("va3", Get("a"));
+
+    // Entries above other entries for their key keep theirs
+    ASSERT_OK(Put("b", "vb2"));
+    Local::CompactTo(dbfull(), kLastLevel - 1);
+    ASSERT_EQ(1, NumTableFilesAtLevel(kLastLevel - 1));
+    ASSERT_EQ("7,0", Local::Sequences(dbfull(), "b"));
+    ASSERT_EQ("vb2", Get("b"));
+
+    Reopen();
+    ASSERT_EQ("va3", Get("a"));
+    ASSERT_EQ("vb2", Get("b"));
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+  } while (ChangeOptions(kSkipBaseLevel | kSkipMarkedFiles));
+}
+
 TEST(DBTest, DeletionMarkers2) {
   Put("foo", "v1");
   ASSERT_OK(dbfull()->TEST_CompactMemTable());
@@ -1319,7 +1856,8 @@ TEST(DBTest, OverlapInLevel0) {
     dbfull()->TEST_CompactMemTable();
     ASSERT_EQ("3", FilesPerLevel());
     ASSERT_EQ("NOT_FOUND", Get("600"));
-  } while (ChangeOptions());
+  } while (ChangeOptions(kSkipFlushPlacement | kSkipBaseLevel |
+                         kSkipMarkedFiles));
 }
 
 TEST(DBTest, L0_CompactionBug_Issue44_a) {
@@ -1843,6 +2381,14 @@ class ModelDB: public DB {
   virtual Status Delete(const WriteOptions& o, const Slice& key) {
     return DB::Delete(o, key);
   }
+  virtual Status DeleteRange(const WriteOptions& o,
+                             const Slice& begin, const Slice& end) {
+    return DB::DeleteRange(o, begin, end);
+  }
+  virtual Status Merge(const WriteOptions& o,
+                       const Slice& key, const Slice& value) {
+    return DB::Merge(o, key, value);
+  }
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) {
     assert(false);      // Not implemented
@@ -1872,15 +2418,33 @@ class ModelDB: public DB {
     class Handler : public WriteBatch::Handler {
      public:
       KVMap* map_;
+      const MergeOperator* merge_operator_;
       virtual void Put(const Slice& key, const Slice& value) {
         (*map_)[key.ToString()] = value.ToString();
       }
       virtual void Delete(const Slice& key) {
         map_->erase(key.ToString());
       }
+      virtual void DeleteRange(const Slice& begin, const Slice& end) {
+        map_->erase(map_->lower_bound(begin.ToString()),
+                    map_->lower_bound(end.ToString()));
+      }
+      virtual void Merge(const Slice& key, const Slice& value) {
+        KVMap::iterator it = map_->find(key.ToString());
+        Slice existing;
+        if (it != map_->end()) {
+          existing = it->second;
+        }
+        std::vector<Slice> operands(1, value);
+        std::string result;
+        merge_operator_->FullMerge(key, it != map_->end() ? &existing : NULL,
+                                   operands, &result);
+        (*map_)[key.ToString()] = result;
+      }
     };
     Handler handler;
     handler.map_ = &map_;
+    handler.merge_operator_ = options_.merge_operator;
     return batch->Iterate(&handler);
   }
 
@@ -1894,6 +2458,10 @@ class ModelDB: public DB {
   }
   virtual void CompactRange(const Slice* start, const Slice* end) {
   }
+  virtual Status GetPropertiesOfAllTables(TablePropertiesCollection* props) {
+    props->clear();
+    return Status::OK();
+  }
 
  private:
   class ModelIter: public Iterator {
@@ -2056,6 +2624,958 @@ TEST(DBTest, Randomized) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, RandomizedDeleteRange) {
+  Random rnd(test::RandomSeed());
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10000;   // Many small files
+  Reopen(&options);
+  ModelDB model(options);
+  const Snapshot* model_snap = NULL;
+  const Snapshot* db_snap = NULL;
+  std::string k, k2, v;
+  for (int step = 0; step < 5000; step++) {
+    int p = rnd.Uniform(100);
+    if (p < 80) {
+      k = RandomKey(&rnd);
+      v = RandomString(&rnd, rnd.Uniform(100));
+      ASSERT_OK(model.Put(WriteOptions(), k, v));
+      ASSERT_OK(db_->Put(WriteOptions(), k, v));
+    } else if (p < 90) {
+      k = RandomKey(&rnd);
+      ASSERT_OK(model.Delete(WriteOptions(), k));
+      ASSERT_OK(db_->Delete(WriteOptions(), k));
+    } else {
+      k = RandomKey(&rnd);
+      k2 = RandomKey(&rnd);
+      if (k2 < k) std::swap(k, k2);
+      ASSERT_OK(model.DeleteRange(WriteOptions(), k, k2));
+      ASSERT_OK(db_->DeleteRange(WriteOptions(), k, k2));
+    }
+
+    if ((step % 250) == 0) {
+      ASSERT_TRUE(CompareIterators(step, &model, db_, NULL, NULL));
+      ASSERT_TRUE(CompareIterators(step, &model, db_, model_snap, db_snap));
+      Iterator* iter = model.NewIterator(ReadOptions());
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ASSERT_EQ(iter->value().ToString(), Get(iter->key().ToString()));
+      }
+      delete iter;
+      if (model_snap != NULL) model.ReleaseSnapshot(model_snap);
+      if (db_snap != NULL) db_->ReleaseSnapshot(db_snap);
+
+      if (rnd.OneIn(3)) {
+        db_->CompactRange(NULL, NULL);
+      } else if (rnd.OneIn(2)) {
+        Reopen(&options);
+      }
+      ASSERT_TRUE(CompareIterators(step, &model, db_, NULL, NULL));
+
+      model_snap = model.GetSnapshot();
+      db_snap = db_->GetSnapshot();
+    }
+  }
+  if (model_snap != NULL) model.ReleaseSnapshot(model_snap);
+  if (db_snap != NULL) db_->ReleaseSnapshot(db_snap);
+}
+
+TEST(DBTest, RandomizedMerge) {
+  Random rnd(test::RandomSeed());
+  AppendOperator append(true);
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10000;   // Many small files
+  options.merge_operator = &append;
+  Reopen(&options);
+  ModelDB model(options);
+  const Snapshot* model_snap = NULL;
+  const Snapshot* db_snap = NULL;
+  std::string k, k2, v;
+  for (int step = 0; step < 5000; step++) {
+    int p = rnd.Uniform(100);
+    k = RandomKey(&rnd);
+    v = RandomString(&rnd, 1 + rnd.Uniform(20));
+    if (p < 30) {
+      ASSERT_OK(model.Put(WriteOptions(), k, v));
+      ASSERT_OK(db_->Put(WriteOptions(), k, v));
+    } else if (p < 90) {
+      ASSERT_OK(model.Merge(WriteOptions(), k, v));
+      ASSERT_OK(db_->Merge(WriteOptions(), k, v));
+    } else if (p < 95) {
+      ASSERT_OK(model.Delete(WriteOptions(), k));
+      ASSERT_OK(db_->Delete(WriteOptions(), k));
+    } else {
+      k2 = RandomKey(&rnd);
+      if (k2 < k) std::swap(k, k2);
+      ASSERT_OK(model.DeleteRange(WriteOptions(), k, k2));
+      ASSERT_OK(db_->DeleteRange(WriteOptions(), k, k2));
+    }
+
+    if ((step % 250) == 0) {
+      ASSERT_TRUE(CompareIterators(step, &model, db_, NULL, NULL));
+      ASSERT_TRUE(CompareIterators(step, &model, db_, model_snap, db_snap));
+      Iterator* iter = model.NewIterator(ReadOptions());
+      std::string expected;
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ASSERT_EQ(iter->value().ToString(), Get(iter->key().ToString()));
+        expected += "(" + IterStatus(iter) + ")";
+      }
+      delete iter;
+      // Also checks that moving backwards applies the operands the same way
+      ASSERT_EQ(expected, Contents());
+      if (model_snap != NULL) model.ReleaseSnapshot(model_snap);
+      if (db_snap != NULL) db_->ReleaseSnapshot(db_snap);
+
+      if (rnd.OneIn(3)) {
+        db_->CompactRange(NULL, NULL);
+      } else if (rnd.OneIn(2)) {
+        Reopen(&options);
+      }
+      ASSERT_TRUE(CompareIterators(step, &model, db_, NULL, NULL));
+
+      model_snap = model.GetSnapshot();
+      db_snap = db_->GetSnapshot();
+    }
+  }
+  if (model_snap != NULL) model.ReleaseSnapshot(model_snap);
+  if (db_snap != NULL) db_->ReleaseSnapshot(db_snap);
+}
+
+// Runs late since it grows the background thread pool of Env::Default(),
+// which changes the timing of background work for the tests after it.
+TEST(DBTest, ParallelCompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_background_compactions = 4;
+  Reopen(&options);
+
+  // Overwrite a key space much larger than a single memtable several
+  // times so that flushes and compactions at several levels overlap.
+  Random rnd(301);
+  const int kNumKeys = 5000;
+  std::vector<std::string> values(kNumKeys);
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      const int k = (i * 7919) % kNumKeys;
+      values[k] = RandomString(&rnd, 100);
+      ASSERT_OK(Put(Key(k), values[k]));
+    }
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_GT(TotalTableFiles(), 1);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+
+  Reopen(&options);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.max_subcompactions = 4;
+  options.max_background_compactions = 2;  // Keep flushed tables in level-0
+  Reopen(&options);
+
+  // Build a few overlapping level-0 files
+  Random rnd(301);
+  const int kNumKeys = 3000;
+  std::vector<std::string> values(kNumKeys);
+  for (int file = 0; file < 3; file++) {
+    for (int i = file; i < kNumKeys; i += 2) {
+      values[i] = RandomString(&rnd, 100);
+      ASSERT_OK(Put(Key(i), values[i]));
+    }
+    ASSERT_OK(Delete(Key(file * 1000)));
+    values[file * 1000] = "NOT_FOUND";
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ(NumTableFilesAtLevel(0), 3);
+
+  // Every key range writes output files of its own
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_GE(NumTableFilesAtLevel(1), 2);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+
+  Reopen(&options);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST(DBTest, UniversalCompaction) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.compaction_style = kUniversalCompaction;
+  options.universal_max_sorted_runs = 3;
+  Reopen(&options);
+
+  Random rnd(301);
+  const int kNumKeys = 2000;
+  std::vector<std::string> values(kNumKeys);
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      const int k = (i * 7919) % kNumKeys;
+      values[k] = RandomString(&rnd, 100);
+      ASSERT_OK(Put(Key(k), values[k]));
+    }
+    ASSERT_OK(Delete(Key(round)));
+    values[round] = "NOT_FOUND";
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+
+  // Once compactions are done, at most the allowed number of sorted
+  // runs are left; each level-0 file and each deeper level is one run.
+  int runs = 0;
+  for (int i = 0; i < 1000; i++) {
+    runs = NumTableFilesAtLevel(0);
+    for (int level = 1; level < config::kNumLevels; level++) {
+      if (NumTableFilesAtLevel(level) > 0) {
+        runs++;
+      }
+    }
+    if (runs <= 3) {
+      break;
+    }
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_GT(runs, 0);
+  ASSERT_LE(runs, 3);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+
+  std::string write_amp;
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-amplification", &write_amp));
+  ASSERT_GT(atof(write_amp.c_str()), 0.5);
+
+  Reopen(&options);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST(DBTest, DynamicLevelBytes) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_bytes_for_level_base = 100000;
+  options.dynamic_level_bytes = true;
+  Reopen(&options);
+
+  Random rnd(301);
+  const int kNumKeys = 10000;
+  std::vector<std::string> values(kNumKeys);
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      const int k = (i * 7919) % kNumKeys;
+      values[k] = RandomString(&rnd, 100);
+      ASSERT_OK(Put(Key(k), values[k]));
+    }
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+
+  // About 1MB of data puts the base level three levels above the last
+  // level, so the upper levels are never used.
+  ASSERT_GT(NumTableFilesAtLevel(config::kNumLevels - 1), 0);
+  for (int level = 1; level < config::kNumLevels - 3; level++) {
+    ASSERT_EQ(NumTableFilesAtLevel(level), 0) << level;
+  }
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+
+  Reopen(&options);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+namespace {
+// Removes "expire*" keys and rewrites the values of "change*" keys
+class TestCompactionFilter : public CompactionFilter {
+ public:
+  virtual const char* Name() const { return "TestCompactionFilter"; }
+  virtual Decision Filter(const Context& context,
+                          const Slice& user_key,
+                          const Slice& value,
+                          std::string* new_value) const {
+    if (user_key.starts_with("expire")) {
+      return kRemove;
+    } else if (user_key.starts_with("change")) {
+      *new_value = "changed";
+      return kChangeValue;
+    }
+    return kKeep;
+  }
+};
+}  // namespace
+
+TEST(DBTest, CompactionFilter) {
+  TestCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  options.max_background_compactions = 2;  // Keep flushed tables in level-0
+  Reopen(&options);
+
+  // Values visible in a snapshot are left alone
+  ASSERT_OK(Put("change", "v1"));
+  ASSERT_OK(Put("expire", "v1"));
+  ASSERT_OK(Put("keep", "v1"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ(NumTableFilesAtLevel(2), 1);
+  ASSERT_EQ("v1", Get("change"));
+  ASSERT_EQ("v1", Get("expire"));
+  db_->ReleaseSnapshot(snapshot);
+
+  // A removed value is replaced by a deletion marker while older values
+  // of the key may exist in deeper levels
+  ASSERT_OK(Put("change", "v2"));
+  ASSERT_OK(Put("expire", "v2"));
+  ASSERT_OK(Put("keep", "v2"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  ASSERT_EQ(NumTableFilesAtLevel(1), 1);
+  ASSERT_EQ("changed", Get("change"));
+  ASSERT_EQ("NOT_FOUND", Get("expire"));
+  ASSERT_EQ("v2", Get("keep"));
+  ASSERT_EQ("[ DEL, v1 ]", AllEntriesFor("expire"));
+
+  // At the bottom of the tree the key disappears altogether
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("[ ]", AllEntriesFor("expire"));
+  ASSERT_EQ("[ changed ]", AllEntriesFor("change"));
+  ASSERT_EQ("[ v2 ]", AllEntriesFor("keep"));
+}
+
+TEST(DBTest, RateLimiter) {
+  Options options = CurrentOptions();
+  options.rate_limiter = NewRateLimiter(1000000, false);
+  Reopen(&options);
+
+  Random rnd(301);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  const uint64_t flushed =
+      options.rate_limiter->GetTotalBytes(RateLimiter::kHighPriority);
+  ASSERT_GT(flushed, 100000u);
+  ASSERT_EQ(0u, options.rate_limiter->GetTotalBytes(RateLimiter::kLowPriority));
+
+  for (int i = 0; i < 100; i += 2) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  const uint64_t start = env_->NowMicros();
+  db_->CompactRange(NULL, NULL);
+  const uint64_t compacted =
+      options.rate_limiter->GetTotalBytes(RateLimiter::kLowPriority);
+  ASSERT_GT(compacted, 100000u);
+
+  // The flushes used up the initial burst, so the compaction has to wait
+  ASSERT_GT(options.rate_limiter->GetThrottledMicros(RateLimiter::kLowPriority),
+            0u);
+  ASSERT_GE(env_->NowMicros() - start, compacted / 2);
+
+  Close();
+  delete options.rate_limiter;
+}
+
+TEST(DBTest, DeletionRatioCompaction) {
+  for (int ratio = 0; ratio < 2; ratio++) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.deletion_compaction_ratio = ratio * 0.5;
+    DestroyAndReopen(&options);
+
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Put(Key(i), "v"));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("0,0,1", FilesPerLevel());
+
+    // A file of deletions lands in level-1, which is below its size limit
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Delete(Key(i)));
+    }
+    ASSERT_OK(Put(Key(200), "v"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+
+    std::string files;
+    for (int i = 0; i < 1000; i++) {
+      files = FilesPerLevel();
+      if (ratio == 0 || files == "0,0,1") {
+        break;
+      }
+      env_->SleepForMicroseconds(10000);
+    }
+    if (ratio == 0) {
+      ASSERT_EQ("0,1,1", files);
+      ASSERT_EQ("[ DEL, v ]", AllEntriesFor(Key(0)));
+    } else {
+      // Compacted into the last level with data, where the deleted
+      // entries are dropped
+      ASSERT_EQ("0,0,1", files);
+      ASSERT_EQ("[ ]", AllEntriesFor(Key(0)));
+    }
+    ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+    ASSERT_EQ("v", Get(Key(200)));
+  }
+}
+
+TEST(DBTest, PeriodicCompaction) {
+  Options options = CurrentOptions();
+  options.periodic_compaction_seconds = 1;
+  Reopen(&options);
+
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // Reads notice that the file has come due and it is pushed down
+  std::string files;
+  for (int i = 0; i < 500; i++) {
+    ASSERT_EQ("va", Get("a"));
+    files = FilesPerLevel();
+    if (files != "0,0,1") {
+      break;
+    }
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_NE("0,0,1", files);
+  ASSERT_EQ(1, TotalTableFiles());
+  ASSERT_EQ("(a->va)(b->vb)", Contents());
+}
+
+TEST(DBTest, CompactionPri) {
+  // The level-1 file expected to be compacted first, for each CompactionPri
+  const int kFirstCompacted[] = { 0, 1000, 1000 };
+  for (int pri = 0; pri < 3; pri++) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.max_bytes_for_level_base = 64 << 10;
+    options.compaction_pri = static_cast<CompactionPri>(pri);
+    DestroyAndReopen(&options);
+    Random rnd(301);
+
+    // Level-2 holds large files at keys 0.. and 2000.., and a small one
+    // at keys 1000..
+    for (int i = 0; i < 40; i++) {
+      ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_OK(Put(Key(1000), "v"));
+    ASSERT_OK(Put(Key(1024), "v"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    for (int i = 2000; i < 2040; i++) {
+      ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    ASSERT_EQ("0,0,3", FilesPerLevel());
+
+    // Three files that overlap them land in level-1, oldest data first,
+    // and push it over its limit.  Only one of them has to move down.
+    const int kStarts[] = { 1000, 0, 2000 };
+    for (int f = 0; f < 3; f++) {
+      for (int i = kStarts[f]; i < kStarts[f] + 25; i++) {
+        ASSERT_OK(Put(Key(i), RandomString(&rnd, 1000)));
+      }
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    }
+    std::string files;
+    for (int i = 0; i < 1000; i++) {
+      files = FilesPerLevel();
+      if (files == "0,2,3") {
+        break;
+      }
+      env_->SleepForMicroseconds(10000);
+    }
+    ASSERT_EQ("0,2,3", files);
+
+    std::string sstables;
+    ASSERT_TRUE(db_->GetProperty("leveldb.sstables", &sstables));
+    const std::string level1 = sstables.substr(
+        sstables.find("--- level 1 ---"),
+        sstables.find("--- level 2 ---") - sstables.find("--- level 1 ---"));
+    for (int f = 0; f < 3; f++) {
+      const bool compacted = (kStarts[f] == kFirstCompacted[pri]);
+      ASSERT_EQ(!compacted,
+                level1.find(Key(kStarts[f])) != std::string::npos);
+    }
+  }
+}
+
+namespace {
+// Holds up compactions into level-0 while block[0] is set, and those into
+// deeper levels while block[1] is set
+class BlockingCompactionFilter : public CompactionFilter {
+ public:
+  port::AtomicPointer block[2];
+  mutable port::AtomicPointer blocked[2];  // Set once one has been held up
+
+  BlockingCompactionFilter() {
+    for (int i = 0; i < 2; i++) {
+      block[i].Release_Store(NULL);
+      blocked[i].Release_Store(NULL);
+    }
+  }
+  virtual const char* Name() const { return "BlockingCompactionFilter"; }
+  virtual Decision Filter(const Context& context,
+                          const Slice& user_key,
+                          const Slice& value,
+                          std::string* new_value) const {
+    const int i = (context.level > 0) ? 1 : 0;
+    while (block[i].Acquire_Load() != NULL) {
+      blocked[i].Release_Store(const_cast<BlockingCompactionFilter*>(this));
+      DelayMilliseconds(10);
+    }
+    return kKeep;
+  }
+
+  bool WaitUntilBlocked(int i) {
+    for (int n = 0; n < 1000 && blocked[i].Acquire_Load() == NULL; n++) {
+      DelayMilliseconds(10);
+    }
+    return blocked[i].Acquire_Load() != NULL;
+  }
+};
+}  // namespace
+
+TEST(DBTest, IntraL0Compaction) {
+  BlockingCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  // Keep flushed tables in level-0, and leave a thread for flushes while
+  // two compactions are held up
+  options.max_background_compactions = 3;
+  Reopen(&options);
+
+  // Hold up the compaction of the first level-0 files into level-1
+  filter.block[1].Release_Store(&filter);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_OK(Put("a", "va" + NumberToString(i)));
+    ASSERT_OK(Put("z", "vz" + NumberToString(i)));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_TRUE(filter.WaitUntilBlocked(1));
+
+  // The files flushed meanwhile are merged with each other in level-0.
+  // A file flushed during that merge holds newer data than its result,
+  // even though the result gets the larger file number.
+  filter.block[0].Release_Store(&filter);
+  for (int i = 4; i < 8; i++) {
+    ASSERT_OK(Put("a", "va" + NumberToString(i)));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_TRUE(filter.WaitUntilBlocked(0));
+  ASSERT_OK(Put("a", "va8"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("9", FilesPerLevel());
+  filter.block[0].Release_Store(NULL);
+
+  std::string files;
+  for (int i = 0; i < 1000; i++) {
+    files = FilesPerLevel();
+    if (files == "6") {
+      break;
+    }
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_EQ("6", files);
+  ASSERT_EQ("va8", Get("a"));
+  ASSERT_EQ("vz3", Get("z"));
+
+  filter.block[1].Release_Store(NULL);
+  for (int i = 0; i < 1000; i++) {
+    files = FilesPerLevel();
+    if (files == "2,1") {
+      break;
+    }
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_EQ("2,1", files);
+  ASSERT_EQ("(a->va8)(z->vz3)", Contents());
+
+  Reopen(&options);
+  ASSERT_EQ("(a->va8)(z->vz3)", Contents());
+}
+
+TEST(DBTest, PipelinedCompaction) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.pipelined_compaction = true;
+  Reopen(&options);
+
+  // Enough data for many batches and output chunks to be handed between
+  // the threads of each compaction
+  Random rnd(301);
+  const int kNumKeys = 4000;
+  std::vector<std::string> values(kNumKeys);
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      values[i] = RandomString(&rnd, 500);
+      ASSERT_OK(Put(Key(i), values[i]));
+    }
+  }
+  ASSERT_OK(Delete(Key(17)));
+  values[17] = "NOT_FOUND";
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(17)));
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+
+  Reopen(&options);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+// Counts the blocks it is asked to compress and leaves them uncompressed
+class CountingCompressor : public Compressor {
+ public:
+  CountingCompressor() : count_(0) { }
+
+  int count() {
+    MutexLock l(&mu_);
+    return count_;
+  }
+
+  virtual const char* Name() const { return "test.Counting"; }
+
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    MutexLock l(&mu_);
+    count_++;
+    return false;
+  }
+
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* length) const {
+    return false;
+  }
+
+  virtual bool Uncompress(const Slice& input, char* output) const {
+    return false;
+  }
+
+ private:
+  mutable port::Mutex mu_;
+  mutable int count_;
+};
+
+TEST(DBTest, CompressionPerLevel) {
+  static CountingCompressor first_codec;
+  static CountingCompressor last_codec;
+  const CompressionType kFirstType = static_cast<CompressionType>(0x81);
+  const CompressionType kLastType = static_cast<CompressionType>(0x82);
+  RegisterCompressor(kFirstType, &first_codec);
+  RegisterCompressor(kLastType, &last_codec);
+
+  Options options = CurrentOptions();
+  options.compression_per_level.push_back(kFirstType);
+  options.compression_per_level.push_back(kNoCompression);
+  options.compression_per_level.push_back(kLastType);
+  Reopen(&options);
+
+  // Memtable flushes use the codec of level 0
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("z", "vz"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_GT(first_codec.count(), 0);
+  ASSERT_EQ(0, last_codec.count());
+
+  // Compactions into level 2 and beyond use the last codec
+  const int first_count = first_codec.count();
+  ASSERT_OK(Put("m", "vm"));
+  dbfull()->TEST_CompactMemTable();
+  db_->CompactRange(NULL, NULL);
+  ASSERT_GT(first_codec.count(), first_count);
+  ASSERT_GT(last_codec.count(), 0);
+
+  Reopen(&options);
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("vm", Get("m"));
+  ASSERT_EQ("vz", Get("z"));
+}
+
+TEST(DBTest, CompressionDictionary) {
+  if (GetCompressor(kZlibCompression) == NULL) {
+    fprintf(stderr, "skipping dictionary compression tests\n");
+    return;
+  }
+
+  // Small documents with much in common, and little within a block
+  Random rnd(301);
+  const std::string common = RandomString(&rnd, 300);
+  const int kNumKeys = 2000;
+  std::vector<std::string> values(kNumKeys);
+  for (int i = 0; i < kNumKeys; i++) {
+    values[i] = common + RandomString(&rnd, 20);
+  }
+
+  uint64_t sizes[2];
+  for (int i = 0; i < 2; i++) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.block_size = 1024;
+    options.compression = kZlibCompression;
+    options.compression_dictionary_bytes = (i == 0) ? 0 : 4096;
+    options.compression_threads = (i == 0) ? 1 : 4;
+    DestroyAndReopen(&options);
+    for (int k = 0; k < kNumKeys; k++) {
+      ASSERT_OK(Put(Key(k), values[k]));
+    }
+    // Flushes do not use a dictionary, so rewrite the table by compactions
+    dbfull()->TEST_CompactMemTable();
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      dbfull()->TEST_CompactRange(level, NULL, NULL);
+    }
+    for (int k = 0; k < kNumKeys; k++) {
+      ASSERT_EQ(values[k], Get(Key(k)));
+    }
+    sizes[i] = Size("", Key(kNumKeys));
+
+    Reopen(&options);
+    for (int k = 0; k < kNumKeys; k += 7) {
+      ASSERT_EQ(values[k], Get(Key(k)));
+    }
+  }
+  ASSERT_LT(sizes[1] * 2, sizes[0]);
+}
+
+TEST(DBTest, BlobFiles) {
+  Options options = CurrentOptions();
+  options.min_blob_size = 100;
+  Reopen(&options);
+
+  const std::string big1(1000, 'a'), big2(2000, 'b');
+  ASSERT_OK(Put("a", "small"));
+  ASSERT_OK(Put("b", big1));
+  ASSERT_OK(Put("c", big2));
+  ASSERT_EQ(0, CountBlobFiles());
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, CountBlobFiles());
+  ASSERT_EQ("[ small ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ BLOB ]", AllEntriesFor("b"));
+  ASSERT_EQ("small", Get("a"));
+  ASSERT_EQ(big1, Get("b"));
+  ASSERT_EQ(big2, Get("c"));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  ASSERT_EQ("a->small", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("b->" + big1, IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("c->" + big2, IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("b->" + big1, IterStatus(iter));
+  iter->SeekToLast();
+  ASSERT_EQ("c->" + big2, IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("b->" + big1, IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("a->small", IterStatus(iter));
+  delete iter;
+
+  // Compactions leave the values in place, also for snapshots
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("b", big2));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ(2, CountBlobFiles());
+  ASSERT_EQ("[ BLOB, BLOB ]", AllEntriesFor("b"));
+  ASSERT_EQ(big1, Get("b", snapshot));
+  ASSERT_EQ(big2, Get("b"));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Values written while the option was off are moved by compactions
+  options.min_blob_size = 0;
+  Reopen(&options);
+  ASSERT_OK(Put("bb", big1));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("[ " + big1 + " ]", AllEntriesFor("bb"));
+  options.min_blob_size = 100;
+  Reopen(&options);
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("[ BLOB ]", AllEntriesFor("bb"));
+  ASSERT_EQ(big2, Get("b"));
+  ASSERT_EQ(big2, Get("c"));
+  ASSERT_EQ(big1, Get("bb"));
+}
+
+TEST(DBTest, BlobGarbageCollection) {
+  Options options = CurrentOptions();
+  options.min_blob_size = 100;
+  Reopen(&options);
+
+  Random rnd(301);
+  std::vector<std::string> values(100);
+  for (int i = 0; i < 100; i++) {
+    values[i] = RandomString(&rnd, 1000);
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, CountBlobFiles());
+
+  // A blob file is deleted once all of its values are overwritten
+  for (int i = 0; i < 100; i++) {
+    values[i] = RandomString(&rnd, 1000);
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(2, CountBlobFiles());
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ(1, CountBlobFiles());
+
+  // Once most of them are, the rest are moved to a new blob file
+  for (int i = 0; i < 60; i++) {
+    values[i] = RandomString(&rnd, 1000);
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  db_->CompactRange(NULL, NULL);
+  std::string stats;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(db_->GetProperty("leveldb.blob-stats", &stats));
+    if (stats.find("Garbage: 0 ") != std::string::npos) {
+      break;
+    }
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_TRUE(stats.find("Files: 2\n") != std::string::npos) << stats;
+  ASSERT_TRUE(stats.find("Records: 100 ") != std::string::npos) << stats;
+  ASSERT_TRUE(stats.find("Garbage: 0 ") != std::string::npos) << stats;
+  ASSERT_EQ(2, CountBlobFiles());
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+
+  // Deleting the files of a range turns their values into garbage
+  const std::string begin_key = Key(0), end_key = Key(100);
+  const Slice begin = begin_key, end = end_key;
+  ASSERT_OK(db_->DeleteFilesInRange(&begin, &end, false));
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+  ASSERT_EQ(0, CountBlobFiles());
+}
+
+TEST(DBTest, BlobMergeAndFilter) {
+  AppendOperator merge_operator(false);
+  TestCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.min_blob_size = 100;
+  options.merge_operator = &merge_operator;
+  options.compaction_filter = &filter;
+  Reopen(&options);
+
+  const std::string big(1000, 'x');
+  ASSERT_OK(Put("change", big));
+  ASSERT_OK(Put("expire", big));
+  ASSERT_OK(Put("keep", big));
+  ASSERT_OK(Put("merge", big));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Merge("merge", "y"));
+  ASSERT_EQ(big + ",y", Get("merge"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(big + ",y", Get("merge"));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("merge");
+  ASSERT_EQ("merge->" + big + ",y", IterStatus(iter));
+  iter->SeekToLast();
+  ASSERT_EQ("merge->" + big + ",y", IterStatus(iter));
+  delete iter;
+
+  db_->CompactRange(NULL, NULL);
+  ASSERT_EQ("[ BLOB ]", AllEntriesFor("merge"));
+  ASSERT_EQ(big + ",y", Get("merge"));
+  ASSERT_EQ("changed", Get("change"));
+  ASSERT_EQ("NOT_FOUND", Get("expire"));
+  ASSERT_EQ(big, Get("keep"));
+}
+
+TEST(DBTest, SwitchTableFormat) {
+  Options options = CurrentOptions();
+  options.table_format = kBlockBasedTable;
+  Reopen(&options);
+  for (int i = 0; i < 100; i += 2) {
+    ASSERT_OK(Put(Key(i), "block" + Key(i)));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+
+  // Tables of both formats are read together and merged by compactions
+  options.table_format = kPlainTable;
+  Reopen(&options);
+  for (int i = 1; i < 100; i += 2) {
+    ASSERT_OK(Put(Key(i), "plain" + Key(i)));
+  }
+  ASSERT_OK(Delete(Key(50)));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_EQ(i == 50 ? "NOT_FOUND"
+                : (i % 2 == 0 ? "block" : "plain") + Key(i), Get(Key(i)));
+    }
+    ASSERT_EQ("NOT_FOUND", Get("missing"));
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int count = 0;
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      count++;
+    }
+    ASSERT_EQ(99, count);
+    delete iter;
+    db_->CompactRange(NULL, NULL);
+  }
+}
+
+TEST(DBTest, HashTableGet) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.table_format = kHashTable;
+  Reopen(&options);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), "old" + Key(i)));
+  }
+  Compact("a", "z");
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < N; i += 2) {
+    ASSERT_OK(Put(Key(i), "new" + Key(i)));
+  }
+  Compact("a", "z");
+  ASSERT_EQ(1, TotalTableFiles());
+
+  // Open the table first
+  ASSERT_EQ("NOT_FOUND", Get("missing"));
+
+  // Each lookup reads the one bucket of its key
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ((i % 2 == 0 ? "new" : "old") + Key(i), Get(Key(i)));
+    ASSERT_EQ("old" + Key(i), Get(Key(i), snapshot));
+  }
+  ASSERT_EQ(2 * N, env_->random_read_counter_.Read());
+
+  // Iteration reads the whole table and sorts it
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->Seek(Key(N / 2)); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(N / 2 + count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(N / 2, count);
+  delete iter;
+  db_->ReleaseSnapshot(snapshot);
+}
+
 std::string MakeKey(unsigned int num) {
   char buf[30];
   snprintf(buf, sizeof(buf), "%016u", num);
@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <stdio.h>
+#include "db/blob_file.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
@@ -85,6 +86,22 @@ class WriteBatchItemPrinter : public WriteBatch::Handler {
     r += "'\n";
     dst_->Append(r);
   }
+  virtual void DeleteRange(const Slice& begin, const Slice& end) {
+    std::string r = "  delrange '";
+    AppendEscapedStringTo(&r, begin);
+    r += "' '";
+    AppendEscapedStringTo(&r, end);
+    r += "'\n";
+    dst_->Append(r);
+  }
+  virtual void Merge(const Slice& key, const Slice& value) {
+    std::string r = "  merge '";
+    AppendEscapedStringTo(&r, key);
+    r += "' '";
+    AppendEscapedStringTo(&r, value);
+    r += "'\n";
+    dst_->Append(r);
+  }
 };
 
 
@@ -185,12 +202,27 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
         r += "del";
       } else if (key.type == kTypeValue) {
         r += "val";
+      } else if (key.type == kTypeMerge) {
+        r += "merge";
+      } else if (key.type == kTypeBlobIndex) {
+        r += "blob";
       } else {
         AppendNumberTo(&r, key.type);
       }
-      r += " => '";
-      AppendEscapedStringTo(&r, iter->value());
-      r += "'\n";
+      BlobIndex index;
+      if (key.type == kTypeBlobIndex && index.DecodeFrom(iter->value()).ok()) {
+        r += " => #";
+        AppendNumberTo(&r, index.file_number);
+        r += " offset ";
+        AppendNumberTo(&r, index.offset);
+        r += " size ";
+        AppendNumberTo(&r, index.size);
+        r += "\n";
+      } else {
+        r += " => '";
+        AppendEscapedStringTo(&r, iter->value());
+        r += "'\n";
+      }
       dst->Append(r);
     }
   }
@@ -24,7 +24,8 @@ enum FileType {
   kDescriptorFile,
   kCurrentFile,
   kTempFile,
-  kInfoLogFile  // Either the current one, or an old one
+  kInfoLogFile,  // Either the current one, or an old one
+  kBlobFile
 };
 
 // Return the name of the log file with the specified number
@@ -42,6 +43,11 @@ extern std::string TableFileName(const std::string& dbname, uint64_t number);
 // "dbname".
 extern std::string SSTTableFileName(const std::string& dbname, uint64_t number);
 
+// Return the name of the blob file with the specified number
+// in the db named by "dbname".  The result will be prefixed with
+// "dbname".
+extern std::string BlobFileName(const std::string& dbname, uint64_t number);
+
 // Return the name of the descriptor file for the db named by
 // "dbname" and the specified incarnation number.  The result will be
 // prefixed with "dbname".
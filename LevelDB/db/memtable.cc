@@ -4,6 +4,8 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/merge_helper.h"
+#include "db/range_del.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -21,7 +23,8 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 MemTable::MemTable(const InternalKeyComparator& cmp)
     : comparator_(cmp),
       refs_(0),
-      table_(comparator_, &arena_) {
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_) {
 }
 
 MemTable::~MemTable() {
@@ -79,6 +82,10 @@ Iterator* MemTable::NewIterator() {
   return new MemTableIterator(&table_);
 }
 
+Iterator* MemTable::NewRangeDeletionIterator() {
+  return new MemTableIterator(&range_del_table_);
+}
+
 void MemTable::Add(SequenceNumber s, ValueType type,
                    const Slice& key,
                    const Slice& value) {
@@ -102,14 +109,31 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   p = EncodeVarint32(p, val_size);
   memcpy(p, value.data(), val_size);
   assert((p + val_size) - buf == encoded_len);
-  table_.Insert(buf);
+  if (type == kTypeRangeDeletion) {
+    range_del_table_.Insert(buf);
+  } else {
+    table_.Insert(buf);
+  }
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   const MergeOperator* merge_operator,
+                   std::vector<std::string>* operands) {
+  // Entries written to this memtable are newer than everything in older
+  // memtables and tables, so a covering tombstone hides those entirely.
+  SequenceNumber covering = 0;
+  {
+    MemTableIterator range_dels(&range_del_table_);
+    covering = MaxCoveringTombstone(
+        &range_dels, comparator_.comparator.user_comparator(),
+        key.user_key(), key.sequence());
+  }
+
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  // Visit the entries for the user key from the newest one the lookup can
+  // see; only merge operands make us look past the first.
+  for (iter.Seek(memkey.data()); iter.Valid(); iter.Next()) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -124,20 +148,50 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
             Slice(key_ptr, key_length - 8),
-            key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+            key.user_key()) != 0) {
+      break;
+    }
+    // Correct user key
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    if ((tag >> 8) < covering) {
+      break;
+    }
+    switch (static_cast<ValueType>(tag & 0xff)) {
+      case kTypeValue: {
+        Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+        if (operands->empty()) {
           value->assign(v.data(), v.size());
-          return true;
+        } else {
+          *s = FullMerge(merge_operator, key.user_key(), &v, *operands,
+                         value);
         }
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
+        return true;
       }
+      case kTypeDeletion:
+      case kTypeRangeDeletion:
+        if (operands->empty()) {
+          *s = Status::NotFound(Slice());
+        } else {
+          *s = FullMerge(merge_operator, key.user_key(), NULL, *operands,
+                         value);
+        }
+        return true;
+      case kTypeMerge:
+        operands->push_back(
+            GetLengthPrefixedSlice(key_ptr + key_length).ToString());
+        break;
+      case kTypeBlobIndex:
+        // Only written to tables
+        break;
+    }
+  }
+  if (covering > 0) {
+    if (operands->empty()) {
+      *s = Status::NotFound(Slice());
+    } else {
+      *s = FullMerge(merge_operator, key.user_key(), NULL, *operands, value);
     }
+    return true;
   }
   return false;
 }
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
 #include <string>
+#include <vector>
 #include "leveldb/db.h"
 #include "db/dbformat.h"
 #include "db/skiplist.h"
@@ -14,6 +15,7 @@
 namespace leveldb {
 
 class InternalKeyComparator;
+class MergeOperator;
 class Mutex;
 class MemTableIterator;
 
@@ -50,18 +52,32 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones in the memtable.  Its
+  // keys are internal keys of the begin keys and its values are the end
+  // keys.  The same liveness requirements as for NewIterator() apply.
+  Iterator* NewRangeDeletionIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  For
+  // type==kTypeRangeDeletion, key and value are the begin and end of
+  // the deleted range.
   void Add(SequenceNumber seq, ValueType type,
            const Slice& key,
            const Slice& value);
 
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
+  // If memtable contains a deletion for key, or a range tombstone that
+  // hides all of its older values, store a NotFound() error in *status
+  // and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  //
+  // Merge operands for key are appended to *operands, newest first.  If a
+  // value or deletion is found under them, they are applied to it with
+  // merge_operator and the result is returned as above.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           const MergeOperator* merge_operator,
+           std::vector<std::string>* operands);
 
  private:
   ~MemTable();  // Private since only Unref() should be used to delete it
@@ -80,6 +96,7 @@ class MemTable {
   int refs_;
   Arena arena_;
   Table table_;
+  Table range_del_table_;
 
   // No copying allowed
   MemTable(const MemTable&);
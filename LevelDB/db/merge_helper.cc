@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_helper.h"
+
+#include <assert.h>
+#include "leveldb/merge_operator.h"
+
+namespace leveldb {
+
+Status FullMerge(const MergeOperator* merge_operator,
+                 const Slice& user_key,
+                 const Slice* existing_value,
+                 const std::vector<std::string>& operands,
+                 std::string* value) {
+  if (merge_operator == NULL) {
+    return Status::NotSupported("merge operand found but no merge_operator "
+                                "is configured");
+  }
+  std::vector<Slice> oldest_first;
+  oldest_first.reserve(operands.size());
+  for (size_t i = operands.size(); i > 0; i--) {
+    oldest_first.push_back(operands[i - 1]);
+  }
+  std::string result;
+  if (!merge_operator->FullMerge(user_key, existing_value, oldest_first,
+                                 &result)) {
+    return Status::Corruption("merge failed for key ", user_key);
+  }
+  value->swap(result);
+  return Status::OK();
+}
+
+void PartialMerge(const MergeOperator* merge_operator,
+                  const Slice& user_key,
+                  std::vector<std::string>* operands,
+                  std::vector<SequenceNumber>* sequences) {
+  assert(operands->size() == sequences->size());
+  if (operands->size() < 2) {
+    return;
+  }
+
+  // Fold from the oldest operand up, keeping the results oldest first
+  std::vector<std::string> merged;
+  std::vector<SequenceNumber> merged_sequences;
+  std::string tmp;
+  for (size_t i = operands->size(); i > 0; i--) {
+    std::string* operand = &(*operands)[i - 1];
+    if (!merged.empty() &&
+        merge_operator->PartialMerge(user_key, merged.back(), *operand,
+                                     &tmp)) {
+      merged.back().swap(tmp);
+      merged_sequences.back() = (*sequences)[i - 1];
+    } else {
+      merged.push_back(std::string());
+      merged.back().swap(*operand);
+      merged_sequences.push_back((*sequences)[i - 1]);
+    }
+    tmp.clear();
+  }
+
+  operands->clear();
+  sequences->clear();
+  for (size_t i = merged.size(); i > 0; i--) {
+    operands->push_back(std::string());
+    operands->back().swap(merged[i - 1]);
+    sequences->push_back(merged_sequences[i - 1]);
+  }
+}
+
+}  // namespace leveldb
@@ -0,0 +1,39 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Merge operands are written by DB::Merge() as entries of type kTypeMerge.
+// Reads collect the operands of a key from the newest entry down to the
+// value or deletion they apply to, and then apply them all at once.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+#define STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class MergeOperator;
+
+// Apply "operands", newest first, to *existing_value and store the result
+// in *value.  existing_value is NULL if the key has no value.
+extern Status FullMerge(const MergeOperator* merge_operator,
+                        const Slice& user_key,
+                        const Slice* existing_value,
+                        const std::vector<std::string>& operands,
+                        std::string* value);
+
+// Combine adjacent "operands", newest first, as far as the operator's
+// PartialMerge() allows.  "sequences" holds the sequence number of each
+// operand; a combined operand gets the one of the newest operand in it.
+extern void PartialMerge(const MergeOperator* merge_operator,
+                         const Slice& user_key,
+                         std::vector<std::string>* operands,
+                         std::vector<SequenceNumber>* sequences);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_HELPER_H_
@@ -0,0 +1,183 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <algorithm>
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+namespace {
+struct UserKeyLess {
+  const Comparator* ucmp;
+  explicit UserKeyLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+};
+
+// Orders tombstones like the internal keys of their begin keys.
+struct TombstoneLess {
+  const Comparator* ucmp;
+  explicit TombstoneLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const RangeTombstone& a, const RangeTombstone& b) const {
+    int r = ucmp->Compare(a.begin, b.begin);
+    return (r != 0) ? (r < 0) : (a.seq > b.seq);
+  }
+};
+}  // namespace
+
+SequenceNumber MaxCoveringTombstone(Iterator* iter,
+                                    const Comparator* ucmp,
+                                    const Slice& user_key,
+                                    SequenceNumber snapshot) {
+  SequenceNumber result = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey begin;
+    if (!ParseInternalKey(iter->key(), &begin)) {
+      continue;
+    }
+    if (ucmp->Compare(begin.user_key, user_key) > 0) {
+      // Tombstones are ordered by begin key, so none of the rest apply
+      break;
+    }
+    if (begin.sequence <= snapshot && begin.sequence > result &&
+        ucmp->Compare(user_key, iter->value()) < 0) {
+      result = begin.sequence;
+    }
+  }
+  return result;
+}
+
+void ClipRangeTombstones(const Comparator* ucmp,
+                         const std::vector<RangeTombstone>& tombstones,
+                         const Slice* lower,
+                         const Slice* upper,
+                         std::vector<RangeTombstone>* pieces) {
+  pieces->clear();
+  for (size_t i = 0; i < tombstones.size(); i++) {
+    const RangeTombstone& t = tombstones[i];
+    RangeTombstone piece;
+    piece.begin = (lower != NULL && ucmp->Compare(t.begin, *lower) < 0)
+                  ? lower->ToString() : t.begin;
+    piece.end = (upper != NULL && ucmp->Compare(*upper, t.end) < 0)
+                ? upper->ToString() : t.end;
+    piece.seq = t.seq;
+    if (ucmp->Compare(piece.begin, piece.end) < 0) {
+      pieces->push_back(piece);
+    }
+  }
+  std::sort(pieces->begin(), pieces->end(), TombstoneLess(ucmp));
+
+  // The same tombstone may have been read from several files
+  size_t n = 0;
+  for (size_t i = 0; i < pieces->size(); i++) {
+    RangeTombstone& t = (*pieces)[i];
+    if (n > 0 && (*pieces)[n-1].seq == t.seq &&
+        ucmp->Compare((*pieces)[n-1].begin, t.begin) == 0) {
+      if (ucmp->Compare((*pieces)[n-1].end, t.end) < 0) {
+        (*pieces)[n-1].end.swap(t.end);
+      }
+    } else {
+      if (n != i) {
+        (*pieces)[n] = t;
+      }
+      n++;
+    }
+  }
+  pieces->resize(n);
+}
+
+RangeDelAggregator::RangeDelAggregator(const Comparator* ucmp,
+                                       SequenceNumber snapshot)
+    : ucmp_(ucmp),
+      snapshot_(snapshot),
+      built_(false) {
+}
+
+Status RangeDelAggregator::AddTombstones(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey begin;
+    if (!ParseInternalKey(iter->key(), &begin)) {
+      return Status::Corruption("corrupted range deletion key");
+    }
+    RangeTombstone t;
+    t.begin = begin.user_key.ToString();
+    t.end = iter->value().ToString();
+    t.seq = begin.sequence;
+    tombstones_.push_back(t);
+  }
+  built_ = false;
+  return iter->status();
+}
+
+void RangeDelAggregator::AddTombstone(const RangeTombstone& t) {
+  tombstones_.push_back(t);
+  built_ = false;
+}
+
+void RangeDelAggregator::BuildFragments() {
+  points_.clear();
+  seqs_.clear();
+  for (size_t i = 0; i < tombstones_.size(); i++) {
+    if (tombstones_[i].seq <= snapshot_) {
+      points_.push_back(tombstones_[i].begin);
+      points_.push_back(tombstones_[i].end);
+    }
+  }
+  UserKeyLess less(ucmp_);
+  std::sort(points_.begin(), points_.end(), less);
+  size_t n = 0;
+  for (size_t i = 0; i < points_.size(); i++) {
+    if (n == 0 || less(points_[n-1], points_[i])) {
+      if (n != i) {
+        points_[n].swap(points_[i]);
+      }
+      n++;
+    }
+  }
+  points_.resize(n);
+  seqs_.resize(n, 0);
+
+  for (size_t i = 0; i < tombstones_.size(); i++) {
+    const RangeTombstone& t = tombstones_[i];
+    if (t.seq > snapshot_) {
+      continue;
+    }
+    size_t first = std::lower_bound(points_.begin(), points_.end(),
+                                    t.begin, less) - points_.begin();
+    size_t limit = std::lower_bound(points_.begin(), points_.end(),
+                                    t.end, less) - points_.begin();
+    for (size_t j = first; j < limit; j++) {
+      seqs_[j] = std::max(seqs_[j], t.seq);
+    }
+  }
+  built_ = true;
+}
+
+bool RangeDelAggregator::ShouldDelete(const Slice& user_key,
+                                      SequenceNumber seq) {
+  if (tombstones_.empty()) {
+    return false;
+  }
+  if (!built_) {
+    BuildFragments();
+  }
+  // Find the last fragment starting at or before user_key
+  size_t left = 0;
+  size_t right = points_.size();
+  while (left < right) {
+    size_t mid = (left + right) / 2;
+    if (ucmp_->Compare(points_[mid], user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  return left > 0 && seqs_[left - 1] > seq;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,94 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Range tombstones are written by DB::DeleteRange().  A tombstone with
+// sequence number "seq" hides every entry for a user key in [begin, end)
+// whose sequence number is smaller than "seq".
+//
+// Memtables and tables keep their tombstones apart from the point entries,
+// as (internal key of begin, end) pairs ordered by internal key.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_DEL_H_
+#define STORAGE_LEVELDB_DB_RANGE_DEL_H_
+
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Comparator;
+class Iterator;
+
+struct RangeTombstone {
+  std::string begin;
+  std::string end;
+  SequenceNumber seq;
+};
+
+// Returns the largest sequence number, not greater than "snapshot", of
+// the tombstones yielded by "iter" that cover "user_key".  Returns zero
+// if no such tombstone exists.  Errors are reported by iter->status().
+extern SequenceNumber MaxCoveringTombstone(Iterator* iter,
+                                           const Comparator* ucmp,
+                                           const Slice& user_key,
+                                           SequenceNumber snapshot);
+
+// Stores in *pieces the parts of "tombstones" that lie within
+// [*lower, *upper), ordered by internal key of their begin keys and
+// without duplicates.  A NULL bound means the range is unbounded on that
+// side.
+extern void ClipRangeTombstones(const Comparator* ucmp,
+                                const std::vector<RangeTombstone>& tombstones,
+                                const Slice* lower,
+                                const Slice* upper,
+                                std::vector<RangeTombstone>* pieces);
+
+// Collects the tombstones of several memtables and tables and answers
+// whether an entry is hidden by any of them.  Not thread-safe.
+class RangeDelAggregator {
+ public:
+  // Only tombstones with sequence numbers <= snapshot are taken into
+  // account by ShouldDelete().
+  RangeDelAggregator(const Comparator* ucmp, SequenceNumber snapshot);
+
+  // Add all tombstones yielded by "iter".
+  Status AddTombstones(Iterator* iter);
+
+  // Add tombstone "t".
+  void AddTombstone(const RangeTombstone& t);
+
+  // Return true if no tombstones have been added.
+  bool empty() const { return tombstones_.empty(); }
+
+  // Return true if the entry for "user_key" at sequence number "seq" is
+  // hidden by a tombstone.
+  bool ShouldDelete(const Slice& user_key, SequenceNumber seq);
+
+  // All tombstones added so far, regardless of the snapshot.
+  const std::vector<RangeTombstone>& tombstones() const { return tombstones_; }
+
+ private:
+  void BuildFragments();
+
+  const Comparator* const ucmp_;
+  const SequenceNumber snapshot_;
+  std::vector<RangeTombstone> tombstones_;
+
+  // The visible tombstones cut into non-overlapping fragments:
+  // [points_[i], points_[i+1]) is hidden below seqs_[i] (0 for nothing).
+  // Built on the first call to ShouldDelete().
+  bool built_;
+  std::vector<std::string> points_;
+  std::vector<SequenceNumber> seqs_;
+
+  // No copying allowed
+  RangeDelAggregator(const RangeDelAggregator&);
+  void operator=(const RangeDelAggregator&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_DEL_H_
@@ -14,6 +14,8 @@
 //        all tables (see 2c)
 //      - compaction pointers are cleared
 //      - every table file is added at level 0
+//      - every blob file referenced by a table is added, and the records
+//        that no table references are counted as its garbage
 //
 // Possible optimization 1:
 //   (a) Compute total size and use to pick appropriate max-level M
@@ -24,6 +26,8 @@
 //   Store per-table metadata (smallest, largest, largest-seq#, ...)
 //   in the table's meta section to speed up ScanTable.
 
+#include <map>
+#include "db/blob_file.h"
 #include "db/builder.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
@@ -92,9 +96,14 @@ class Repairer {
   }
 
  private:
+  // Records referenced in a blob file, counted in total_count and
+  // total_bytes
+  typedef std::map<uint64_t, BlobFileMetaData> BlobRefs;
+
   struct TableInfo {
     FileMetaData meta;
     SequenceNumber max_sequence;
+    BlobRefs blob_refs;
   };
 
   std::string const dbname_;
@@ -110,6 +119,7 @@ class Repairer {
   std::vector<std::string> manifests_;
   std::vector<uint64_t> table_numbers_;
   std::vector<uint64_t> logs_;
+  std::vector<uint64_t> blob_numbers_;
   std::vector<TableInfo> tables_;
   uint64_t next_file_number_;
 
@@ -137,6 +147,8 @@ class Repairer {
             logs_.push_back(number);
           } else if (type == kTableFile) {
             table_numbers_.push_back(number);
+          } else if (type == kBlobFile) {
+            blob_numbers_.push_back(number);
           } else {
             // Ignore other files
           }
@@ -224,8 +236,11 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeDeletionIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta, NULL);
     delete iter;
+    delete range_del_iter;
     mem->Unref();
     mem = NULL;
     if (status.ok()) {
@@ -293,6 +308,21 @@ class Repairer {
       }
 
       counter++;
+      if (parsed.type == kTypeDeletion) {
+        t.meta.num_deletions++;
+      }
+      BlobIndex index;
+      if (parsed.type == kTypeBlobIndex &&
+          index.DecodeFrom(iter->value()).ok()) {
+        BlobFileMetaData* refs = &t.blob_refs[index.file_number];
+        refs->total_count++;
+        refs->total_bytes += BlobRecordSize(parsed.user_key.size(),
+                                            index.size);
+        if (t.meta.oldest_blob_file == 0 ||
+            index.file_number < t.meta.oldest_blob_file) {
+          t.meta.oldest_blob_file = index.file_number;
+        }
+      }
       if (empty) {
         empty = false;
         t.meta.smallest.DecodeFrom(key);
@@ -306,6 +336,42 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+
+    // The key range of the table also covers its range tombstones
+    iter = table_cache_->NewRangeDeletionIterator(t.meta.number,
+                                                  t.meta.file_size);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      Slice key = iter->key();
+      if (!ParseInternalKey(key, &parsed)) {
+        Log(options_.info_log, "Table #%llu: unparsable range deletion %s",
+            (unsigned long long) t.meta.number,
+            EscapeString(key).c_str());
+        continue;
+      }
+
+      counter++;
+      InternalKey begin, end(iter->value(), kMaxSequenceNumber,
+                             kTypeRangeDeletion);
+      begin.DecodeFrom(key);
+      if (empty || icmp_.Compare(begin, t.meta.smallest) < 0) {
+        t.meta.smallest = begin;
+      }
+      if (empty || icmp_.Compare(end, t.meta.largest) > 0) {
+        t.meta.largest = end;
+      }
+      empty = false;
+      t.meta.has_range_deletions = true;
+      t.meta.num_deletions++;
+      if (parsed.sequence > t.max_sequence) {
+        t.max_sequence = parsed.sequence;
+      }
+    }
+    if (status.ok() && !iter->status().ok()) {
+      status = iter->status();
+    }
+    delete iter;
+    t.meta.num_entries = counter;
+    t.meta.largest_seqno = t.max_sequence;
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long) t.meta.number,
         counter,
@@ -329,7 +395,10 @@ class Repairer {
     if (!s.ok()) {
       return;
     }
-    TableBuilder* builder = new TableBuilder(options_, file);
+    // Repaired tables are all placed in level 0
+    Options table_options = options_;
+    table_options.compression = CompressionForLevel(options_, 0);
+    TableBuilder* builder = new TableBuilder(table_options, file);
 
     // Copy data.
     Iterator* iter = NewTableIterator(t.meta);
@@ -339,6 +408,13 @@ class Repairer {
       counter++;
     }
     delete iter;
+    iter = table_cache_->NewRangeDeletionIterator(t.meta.number,
+                                                  t.meta.file_size);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      builder->AddRangeDeletion(iter->key(), iter->value());
+      counter++;
+    }
+    delete iter;
 
     ArchiveFile(src);
     if (counter == 0) {
@@ -392,12 +468,18 @@ class Repairer {
     edit_.SetNextFile(next_file_number_);
     edit_.SetLastSequence(max_sequence);
 
+    BlobRefs blob_refs;
     for (size_t i = 0; i < tables_.size(); i++) {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size,
-                    t.meta.smallest, t.meta.largest);
+      edit_.AddFile(0, t.meta);
+      for (BlobRefs::const_iterator it = t.blob_refs.begin();
+           it != t.blob_refs.end(); ++it) {
+        blob_refs[it->first].total_count += it->second.total_count;
+        blob_refs[it->first].total_bytes += it->second.total_bytes;
+      }
     }
+    AddBlobFiles(blob_refs);
 
     //fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
     {
@@ -431,6 +513,45 @@ class Repairer {
     return status;
   }
 
+  // Add the blob files that some table references to edit_.  Files that
+  // no table references are left to be deleted when the DB is opened.
+  void AddBlobFiles(const BlobRefs& refs) {
+    for (size_t i = 0; i < blob_numbers_.size(); i++) {
+      const uint64_t number = blob_numbers_[i];
+      BlobRefs::const_iterator it = refs.find(number);
+      if (it == refs.end()) {
+        continue;
+      }
+      std::string fname = BlobFileName(dbname_, number);
+      uint64_t file_size = 0, count = 0, bytes = 0;
+      SequentialFile* file;
+      Status s = env_->GetFileSize(fname, &file_size);
+      if (s.ok()) {
+        s = env_->NewSequentialFile(fname, &file);
+      }
+      if (s.ok()) {
+        s = ScanBlobFile(file, file_size, &count, &bytes);
+        delete file;
+      }
+      Log(options_.info_log,
+          "Blob file #%llu: %llu records, %llu referenced %s",
+          (unsigned long long) number,
+          (unsigned long long) count,
+          (unsigned long long) it->second.total_count,
+          s.ToString().c_str());
+      if (!s.ok() || count == 0) {
+        continue;
+      }
+      edit_.AddBlobFile(number, count, bytes);
+      const BlobFileMetaData& referenced = it->second;
+      if (count > referenced.total_count) {
+        edit_.AddBlobGarbage(number, count - referenced.total_count,
+                             (bytes > referenced.total_bytes) ?
+                             bytes - referenced.total_bytes : 0);
+      }
+    }
+  }
+
   void ArchiveFile(const std::string& fname) {
     // Move into another directory.  E.g., for
     //    dir/foo
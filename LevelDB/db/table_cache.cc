@@ -4,9 +4,11 @@
 
 #include "db/table_cache.h"
 
+#include "db/blob_file.h"
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
+#include "leveldb/table_properties.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -23,6 +25,11 @@ static void DeleteEntry(const Slice& key, void* value) {
   delete tf;
 }
 
+static void DeleteBlobFile(const Slice& key, void* value) {
+  RandomAccessFile* file = reinterpret_cast<RandomAccessFile*>(value);
+  delete file;
+}
+
 static void UnrefEntry(void* arg1, void* arg2) {
   Cache* cache = reinterpret_cast<Cache*>(arg1);
   Cache::Handle* h = reinterpret_cast<Cache::Handle*>(arg2);
@@ -79,6 +86,23 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
   return s;
 }
 
+Status TableCache::FindBlobFile(uint64_t file_number,
+                                Cache::Handle** handle) {
+  Status s;
+  char buf[sizeof(file_number)];
+  EncodeFixed64(buf, file_number);
+  Slice key(buf, sizeof(buf));
+  *handle = cache_->Lookup(key);
+  if (*handle == NULL) {
+    RandomAccessFile* file = NULL;
+    s = env_->NewRandomAccessFile(BlobFileName(dbname_, file_number), &file);
+    if (s.ok()) {
+      *handle = cache_->Insert(key, file, 1, &DeleteBlobFile);
+    }
+  }
+  return s;
+}
+
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number,
                                   uint64_t file_size,
@@ -102,6 +126,38 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Iterator* TableCache::NewRangeDeletionIterator(uint64_t file_number,
+                                               uint64_t file_size) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+
+  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  Iterator* result = table->NewRangeDeletionIterator();
+  result->RegisterCleanup(&UnrefEntry, cache_, handle);
+  return result;
+}
+
+Status TableCache::GetProperties(uint64_t file_number,
+                                 uint64_t file_size,
+                                 TableProperties* props,
+                                 bool* found) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    const TableProperties* stored = t->GetProperties();
+    *found = (stored != NULL);
+    if (*found) {
+      *props = *stored;
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
 Status TableCache::Get(const ReadOptions& options,
                        uint64_t file_number,
                        uint64_t file_size,
@@ -118,6 +174,25 @@ Status TableCache::Get(const ReadOptions& options,
   return s;
 }
 
+Status TableCache::GetBlob(const ReadOptions& options,
+                           const Slice& user_key,
+                           const Slice& blob_index,
+                           std::string* value) {
+  BlobIndex index;
+  Status s = index.DecodeFrom(blob_index);
+  Cache::Handle* handle = NULL;
+  if (s.ok()) {
+    s = FindBlobFile(index.file_number, &handle);
+  }
+  if (s.ok()) {
+    RandomAccessFile* file =
+        reinterpret_cast<RandomAccessFile*>(cache_->Value(handle));
+    s = ReadBlobValue(file, index, user_key, options.verify_checksums, value);
+    cache_->Release(handle);
+  }
+  return s;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
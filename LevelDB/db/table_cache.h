@@ -17,6 +17,7 @@
 namespace leveldb {
 
 class Env;
+struct TableProperties;
 
 class TableCache {
  public:
@@ -44,7 +45,28 @@ class TableCache {
              void* arg,
              void (*handle_result)(void*, const Slice&, const Slice&));
 
-  // Evict any entry for the specified file number
+  // Return an iterator over the range deletion entries of the specified
+  // file.  See Table::NewRangeDeletionIterator().
+  Iterator* NewRangeDeletionIterator(uint64_t file_number,
+                                     uint64_t file_size);
+
+  // Store in *props the properties stored in the specified file, and set
+  // *found to whether it has any.  Only the meta blocks of the file are
+  // read, once, when it enters the cache.
+  Status GetProperties(uint64_t file_number,
+                       uint64_t file_size,
+                       TableProperties* props,
+                       bool* found);
+
+  // Store in *value the value that the encoded BlobIndex "blob_index"
+  // points to, which was written for "user_key".  Blob files share the
+  // cache with the tables.
+  Status GetBlob(const ReadOptions& options,
+                 const Slice& user_key,
+                 const Slice& blob_index,
+                 std::string* value);
+
+  // Evict any entry for the specified table or blob file number
   void Evict(uint64_t file_number);
 
  private:
@@ -54,6 +76,7 @@ class TableCache {
   Cache* cache_;
 
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  Status FindBlobFile(uint64_t file_number, Cache::Handle**);
 };
 
 }  // namespace leveldb
@@ -20,7 +20,20 @@ enum Tag {
   kDeletedFile          = 6,
   kNewFile              = 7,
   // 8 was used for large value refs
-  kPrevLogNumber        = 9
+  kPrevLogNumber        = 9,
+  kNewFile2             = 10,  // kNewFile followed by file flags
+  kNewBlobFile          = 11,
+  kBlobFileGarbage      = 12
+};
+
+// Flags of a kNewFile2 entry.  The fields announced by the flags follow
+// them in this order.
+enum FileFlag {
+  kFileHasRangeDeletions = 0x1,
+  kFileHasStats          = 0x2,   // varint64 entries, varint64 deletions
+  kFileHasCreationTime   = 0x4,   // varint64 seconds since the epoch
+  kFileHasLargestSeqno   = 0x8,   // varint64 sequence number
+  kFileHasBlobs          = 0x10   // varint64 oldest blob file number
 };
 
 void VersionEdit::Clear() {
@@ -36,6 +49,8 @@ void VersionEdit::Clear() {
   has_last_sequence_ = false;
   deleted_files_.clear();
   new_files_.clear();
+  new_blob_files_.clear();
+  blob_garbage_.clear();
 }
 
 void VersionEdit::EncodeTo(std::string* dst) const {
@@ -76,12 +91,63 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    // Only entries without any flags use the old kNewFile encoding.  New
+    // tables always carry their entry counts and creation time, so they are
+    // written as kNewFile2, which releases before it cannot read.
+    uint32_t flags = 0;
+    if (f.has_range_deletions) {
+      flags |= kFileHasRangeDeletions;
+    }
+    if (f.num_entries != 0) {
+      flags |= kFileHasStats;
+    }
+    if (f.creation_time != 0) {
+      flags |= kFileHasCreationTime;
+    }
+    if (f.largest_seqno != 0) {
+      flags |= kFileHasLargestSeqno;
+    }
+    if (f.oldest_blob_file != 0) {
+      flags |= kFileHasBlobs;
+    }
+    PutVarint32(dst, (flags != 0) ? kNewFile2 : kNewFile);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (flags != 0) {
+      PutVarint32(dst, flags);
+    }
+    if (flags & kFileHasStats) {
+      PutVarint64(dst, f.num_entries);
+      PutVarint64(dst, f.num_deletions);
+    }
+    if (flags & kFileHasCreationTime) {
+      PutVarint64(dst, f.creation_time);
+    }
+    if (flags & kFileHasLargestSeqno) {
+      PutVarint64(dst, f.largest_seqno);
+    }
+    if (flags & kFileHasBlobs) {
+      PutVarint64(dst, f.oldest_blob_file);
+    }
+  }
+
+  for (size_t i = 0; i < new_blob_files_.size(); i++) {
+    const BlobFileMetaData& b = new_blob_files_[i];
+    PutVarint32(dst, kNewBlobFile);
+    PutVarint64(dst, b.number);
+    PutVarint64(dst, b.total_count);
+    PutVarint64(dst, b.total_bytes);
+  }
+
+  for (size_t i = 0; i < blob_garbage_.size(); i++) {
+    const BlobFileMetaData& b = blob_garbage_[i];
+    PutVarint32(dst, kBlobFileGarbage);
+    PutVarint64(dst, b.number);
+    PutVarint64(dst, b.garbage_count);
+    PutVarint64(dst, b.garbage_bytes);
   }
 }
 
@@ -115,7 +181,9 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
   // Temporary storage for parsing
   int level;
   uint64_t number;
+  uint32_t flags;
   FileMetaData f;
+  BlobFileMetaData b;
   Slice str;
   InternalKey key;
 
@@ -181,6 +249,7 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+        f = FileMetaData();
         if (GetLevel(&input, &level) &&
             GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
@@ -192,6 +261,52 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         }
         break;
 
+      case kNewFile2:
+        f = FileMetaData();
+        if (GetLevel(&input, &level) &&
+            GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint32(&input, &flags) &&
+            (!(flags & kFileHasStats) ||
+             (GetVarint64(&input, &f.num_entries) &&
+              GetVarint64(&input, &f.num_deletions))) &&
+            (!(flags & kFileHasCreationTime) ||
+             GetVarint64(&input, &f.creation_time)) &&
+            (!(flags & kFileHasLargestSeqno) ||
+             GetVarint64(&input, &f.largest_seqno)) &&
+            (!(flags & kFileHasBlobs) ||
+             GetVarint64(&input, &f.oldest_blob_file))) {
+          f.has_range_deletions = (flags & kFileHasRangeDeletions) != 0;
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "new-file2 entry";
+        }
+        break;
+
+      case kNewBlobFile:
+        b = BlobFileMetaData();
+        if (GetVarint64(&input, &b.number) &&
+            GetVarint64(&input, &b.total_count) &&
+            GetVarint64(&input, &b.total_bytes)) {
+          new_blob_files_.push_back(b);
+        } else {
+          msg = "new-blob-file entry";
+        }
+        break;
+
+      case kBlobFileGarbage:
+        b = BlobFileMetaData();
+        if (GetVarint64(&input, &b.number) &&
+            GetVarint64(&input, &b.garbage_count) &&
+            GetVarint64(&input, &b.garbage_bytes)) {
+          blob_garbage_.push_back(b);
+        } else {
+          msg = "blob-file-garbage entry";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -258,6 +373,45 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.has_range_deletions) {
+      r.append(" (range deletions)");
+    }
+    if (f.num_entries != 0) {
+      r.append(" entries ");
+      AppendNumberTo(&r, f.num_entries);
+      r.append(" deletions ");
+      AppendNumberTo(&r, f.num_deletions);
+    }
+    if (f.creation_time != 0) {
+      r.append(" created ");
+      AppendNumberTo(&r, f.creation_time);
+    }
+    if (f.largest_seqno != 0) {
+      r.append(" seqno ");
+      AppendNumberTo(&r, f.largest_seqno);
+    }
+    if (f.oldest_blob_file != 0) {
+      r.append(" blobs ");
+      AppendNumberTo(&r, f.oldest_blob_file);
+    }
+  }
+  for (size_t i = 0; i < new_blob_files_.size(); i++) {
+    const BlobFileMetaData& b = new_blob_files_[i];
+    r.append("\n  AddBlobFile: ");
+    AppendNumberTo(&r, b.number);
+    r.append(" ");
+    AppendNumberTo(&r, b.total_count);
+    r.append(" ");
+    AppendNumberTo(&r, b.total_bytes);
+  }
+  for (size_t i = 0; i < blob_garbage_.size(); i++) {
+    const BlobFileMetaData& b = blob_garbage_[i];
+    r.append("\n  BlobGarbage: ");
+    AppendNumberTo(&r, b.number);
+    r.append(" ");
+    AppendNumberTo(&r, b.garbage_count);
+    r.append(" ");
+    AppendNumberTo(&r, b.garbage_bytes);
   }
   r.append("\n}\n");
   return r;
@@ -21,8 +21,36 @@ struct FileMetaData {
   uint64_t file_size;         // File size in bytes
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
+  bool being_compacted;       // Claimed as input by a running compaction
+  bool has_range_deletions;   // Table holds range tombstones
+  uint64_t num_entries;       // Entries and range tombstones; 0 if unknown
+  uint64_t num_deletions;     // Deletion markers and range tombstones
+  uint64_t creation_time;     // Seconds since the epoch; 0 if unknown
+  SequenceNumber largest_seqno;  // Of the newest entry; 0 if unknown
+  uint64_t oldest_blob_file;  // Oldest blob file referenced; 0 if none
+
+  FileMetaData()
+      : refs(0), allowed_seeks(1 << 30), number(0), file_size(0),
+        being_compacted(false), has_range_deletions(false), num_entries(0),
+        num_deletions(0), creation_time(0), largest_seqno(0),
+        oldest_blob_file(0) {
+  }
+};
 
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) { }
+// Tracks how much of a blob file is still referenced by the tables.  The
+// file is deleted once all of its records have become garbage.
+struct BlobFileMetaData {
+  int refs;
+  uint64_t number;
+  uint64_t total_count;       // Records written to the file
+  uint64_t total_bytes;       // Bytes of those records
+  uint64_t garbage_count;     // Records no longer referenced
+  uint64_t garbage_bytes;     // Bytes of those records
+
+  BlobFileMetaData()
+      : refs(0), number(0), total_count(0), total_bytes(0),
+        garbage_count(0), garbage_bytes(0) {
+  }
 };
 
 class VersionEdit {
@@ -58,19 +86,58 @@ class VersionEdit {
 
   // Add the specified file at the specified number.
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
-  // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
+  // REQUIRES: "smallest" and "largest" are smallest and largest keys in file,
+  // including the ranges of its range tombstones
   void AddFile(int level, uint64_t file,
                uint64_t file_size,
                const InternalKey& smallest,
-               const InternalKey& largest) {
+               const InternalKey& largest,
+               bool has_range_deletions = false) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.has_range_deletions = has_range_deletions;
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // Add the file described by "meta", including its statistics.
+  void AddFile(int level, const FileMetaData& meta) {
+    FileMetaData f;
+    f.number = meta.number;
+    f.file_size = meta.file_size;
+    f.smallest = meta.smallest;
+    f.largest = meta.largest;
+    f.has_range_deletions = meta.has_range_deletions;
+    f.num_entries = meta.num_entries;
+    f.num_deletions = meta.num_deletions;
+    f.creation_time = meta.creation_time;
+    f.largest_seqno = meta.largest_seqno;
+    f.oldest_blob_file = meta.oldest_blob_file;
+    new_files_.push_back(std::make_pair(level, f));
+  }
+
+  // Add the blob file "number" holding "count" records of "bytes" bytes.
+  void AddBlobFile(uint64_t number, uint64_t count, uint64_t bytes) {
+    BlobFileMetaData b;
+    b.number = number;
+    b.total_count = count;
+    b.total_bytes = bytes;
+    new_blob_files_.push_back(b);
+  }
+
+  // Record that "count" records of "bytes" bytes in the blob file
+  // "number" are no longer referenced.  Applied after any AddBlobFile()
+  // of the same edit.
+  void AddBlobGarbage(uint64_t number, uint64_t count, uint64_t bytes) {
+    BlobFileMetaData b;
+    b.number = number;
+    b.garbage_count = count;
+    b.garbage_bytes = bytes;
+    blob_garbage_.push_back(b);
+  }
+
   // Delete the specified "file" from the specified "level".
   void DeleteFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
@@ -100,6 +167,8 @@ class VersionEdit {
   std::vector< std::pair<int, InternalKey> > compact_pointers_;
   DeletedFileSet deleted_files_;
   std::vector< std::pair<int, FileMetaData> > new_files_;
+  std::vector<BlobFileMetaData> new_blob_files_;
+  std::vector<BlobFileMetaData> blob_garbage_;
 };
 
 }  // namespace leveldb
@@ -27,7 +27,21 @@ TEST(VersionEditTest, EncodeDecode) {
     TestEncodeDecode(edit);
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
-                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion),
+                 (i % 2) == 1);
+    FileMetaData f;
+    f.number = kBig + 800 + i;
+    f.file_size = kBig + 810 + i;
+    f.smallest = InternalKey("bar", kBig + 820 + i, kTypeValue);
+    f.largest = InternalKey("baz", kBig + 830 + i, kTypeValue);
+    f.num_entries = (i > 0) ? kBig + 840 + i : 0;
+    f.num_deletions = i;
+    f.creation_time = (i % 2 == 0) ? kBig + 850 + i : 0;
+    f.largest_seqno = (i < 2) ? kBig + 860 + i : 0;
+    f.oldest_blob_file = (i % 2 == 1) ? kBig + 870 + i : 0;
+    edit.AddFile(5, f);
+    edit.AddBlobFile(kBig + 870 + i, kBig + 880 + i, kBig + 890 + i);
+    edit.AddBlobGarbage(kBig + 870 + i, i, kBig + 895 + i);
     edit.DeleteFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
   }
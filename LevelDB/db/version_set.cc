@@ -10,6 +10,8 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -31,17 +33,6 @@ static const int64_t kMaxGrandParentOverlapBytes = 10 * kTargetFileSize;
 // total compaction cover more than this many bytes.
 static const int64_t kExpandedCompactionByteSizeLimit = 25 * kTargetFileSize;
 
-static double MaxBytesForLevel(int level) {
-  // Note: the result for level zero is not really used since we set
-  // the level-0 compaction threshold based on number of files.
-  double result = 10 * 1048576.0;  // Result for both level-0 and level-1
-  while (level > 1) {
-    result *= 10;
-    level--;
-  }
-  return result;
-}
-
 static uint64_t MaxFileSizeForLevel(int level) {
   return kTargetFileSize;  // We could vary per level to reduce number of files?
 }
@@ -54,6 +45,15 @@ static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
   return sum;
 }
 
+static bool AnyBeingCompacted(const std::vector<FileMetaData*>& files) {
+  for (size_t i = 0; i < files.size(); i++) {
+    if (files[i]->being_compacted) {
+      return true;
+    }
+  }
+  return false;
+}
+
 Version::~Version() {
   assert(refs_ == 0);
 
@@ -72,6 +72,15 @@ Version::~Version() {
       }
     }
   }
+  for (BlobFileMap::iterator it = blob_files_.begin();
+       it != blob_files_.end(); ++it) {
+    BlobFileMetaData* b = it->second;
+    assert(b->refs > 0);
+    b->refs--;
+    if (b->refs <= 0) {
+      delete b;
+    }
+  }
 }
 
 int FindFile(const InternalKeyComparator& icmp,
@@ -241,6 +250,22 @@ void Version::AddIterators(const ReadOptions& options,
   }
 }
 
+Status Version::AddRangeDeletions(RangeDelAggregator* range_del) {
+  Status s;
+  for (int level = 0; level < config::kNumLevels && s.ok(); level++) {
+    for (size_t i = 0; i < files_[level].size() && s.ok(); i++) {
+      const FileMetaData* f = files_[level][i];
+      if (f->has_range_deletions) {
+        Iterator* iter = vset_->table_cache_->NewRangeDeletionIterator(
+            f->number, f->file_size);
+        s = range_del->AddTombstones(iter);
+        delete iter;
+      }
+    }
+  }
+  return s;
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -248,12 +273,17 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMerge,     // Found a merge operand; older entries may follow
 };
 struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  SequenceNumber sequence;  // Of the entry found
+  SequenceNumber covering;  // Entries older than this are deleted
+  std::vector<std::string>* operands;
+  bool is_blob_index;       // *value holds a BlobIndex, not the value
 };
 }
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -263,15 +293,31 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
+      s->sequence = parsed_key.sequence;
+      if (parsed_key.sequence < s->covering) {
+        s->state = kDeleted;
+      } else if (parsed_key.type == kTypeValue ||
+                 parsed_key.type == kTypeBlobIndex) {
+        s->state = kFound;
         s->value->assign(v.data(), v.size());
+        s->is_blob_index = (parsed_key.type == kTypeBlobIndex);
+      } else if (parsed_key.type == kTypeMerge) {
+        s->state = kMerge;
+        s->operands->push_back(v.ToString());
+      } else {
+        s->state = kDeleted;
       }
     }
   }
 }
 
+// Order level-0 files by the age of their data.  A level-0 compaction
+// gives older data a newer file number, so the sequence numbers decide;
+// files written by older releases lack them and predate all others.
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
+  if (a->largest_seqno != b->largest_seqno) {
+    return a->largest_seqno > b->largest_seqno;
+  }
   return a->number > b->number;
 }
 
@@ -323,7 +369,8 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
                     std::string* value,
-                    GetStats* stats) {
+                    GetStats* stats,
+                    std::vector<std::string>* operands) {
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
   const Comparator* ucmp = vset_->icmp_.user_comparator();
@@ -391,22 +438,79 @@ Status Version::Get(const ReadOptions& options,
       last_file_read = f;
       last_file_read_level = level;
 
+      // Entries for user_key in later files are older than the range
+      // tombstones of this one, so a covering tombstone ends the search.
+      SequenceNumber covering = 0;
+      if (f->has_range_deletions) {
+        Iterator* range_dels = vset_->table_cache_->NewRangeDeletionIterator(
+            f->number, f->file_size);
+        covering = MaxCoveringTombstone(range_dels, ucmp, user_key,
+                                        k.sequence());
+        s = range_dels->status();
+        delete range_dels;
+        if (!s.ok()) {
+          return s;
+        }
+      }
+
       Saver saver;
       saver.state = kNotFound;
       saver.ucmp = ucmp;
       saver.user_key = user_key;
       saver.value = value;
+      saver.sequence = 0;
+      saver.covering = covering;
+      saver.operands = operands;
+      saver.is_blob_index = false;
       s = vset_->table_cache_->Get(options, f->number, f->file_size,
                                    ikey, &saver, SaveValue);
+      if (s.ok() && saver.state == kMerge) {
+        // Collect the entries under the operand up to a value or deletion
+        Iterator* iter = vset_->table_cache_->NewIterator(options, f->number,
+                                                          f->file_size);
+        iter->Seek(ikey);
+        if (iter->Valid()) {
+          for (iter->Next(); saver.state == kMerge && iter->Valid();
+               iter->Next()) {
+            saver.state = kNotFound;
+            SaveValue(&saver, iter->key(), iter->value());
+          }
+        }
+        if (saver.state == kMerge) {
+          saver.state = kNotFound;
+        }
+        s = iter->status();
+        delete iter;
+      }
       if (!s.ok()) {
         return s;
       }
+      if (covering > 0 && saver.state == kNotFound) {
+        saver.state = kDeleted;
+      }
       switch (saver.state) {
         case kNotFound:
+        case kMerge:
           break;      // Keep searching in other files
         case kFound:
+          if (saver.is_blob_index) {
+            const std::string index = *value;
+            s = vset_->table_cache_->GetBlob(options, user_key, index, value);
+            if (!s.ok()) {
+              return s;
+            }
+          }
+          if (!operands->empty()) {
+            Slice existing = *value;
+            s = FullMerge(vset_->options_->merge_operator, user_key,
+                          &existing, *operands, value);
+          }
           return s;
         case kDeleted:
+          if (!operands->empty()) {
+            return FullMerge(vset_->options_->merge_operator, user_key,
+                             NULL, *operands, value);
+          }
           s = Status::NotFound(Slice());  // Use empty error message for speed
           return s;
         case kCorrupt:
@@ -416,6 +520,10 @@ Status Version::Get(const ReadOptions& options,
     }
   }
 
+  if (!operands->empty()) {
+    return FullMerge(vset_->options_->merge_operator, user_key, NULL,
+                     *operands, value);
+  }
   return Status::NotFound(Slice());  // Use an empty error message for speed
 }
 
@@ -470,6 +578,17 @@ bool Version::RecordReadSample(Slice internal_key) {
   return false;
 }
 
+bool Version::BlobFileNeedsGC(uint64_t number) const {
+  const double ratio = vset_->options_->blob_gc_ratio;
+  BlobFileMap::const_iterator it = blob_files_.find(number);
+  if (ratio <= 0 || it == blob_files_.end()) {
+    return false;
+  }
+  const BlobFileMetaData* b = it->second;
+  return b->garbage_count > 0 &&
+      b->garbage_bytes >= ratio * static_cast<double>(b->total_bytes);
+}
+
 void Version::Ref() {
   ++refs_;
 }
@@ -501,6 +620,10 @@ int Version::PickLevelForMemTableOutput(
     InternalKey limit(largest_user_key, 0, static_cast<ValueType>(0));
     std::vector<FileMetaData*> overlaps;
     while (level < config::kMaxMemCompactLevel) {
+      if (level + 1 < base_level_) {
+        // Levels above the base level are kept empty
+        break;
+      }
       if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
         break;
       }
@@ -585,6 +708,27 @@ std::string Version::DebugString() const {
       r.append("]\n");
     }
   }
+  if (!blob_files_.empty()) {
+    // E.g.,
+    //   --- blob files ---
+    //   12:100/4096 garbage 40/1638
+    r.append("--- blob files ---\n");
+    for (BlobFileMap::const_iterator it = blob_files_.begin();
+         it != blob_files_.end(); ++it) {
+      const BlobFileMetaData* b = it->second;
+      r.push_back(' ');
+      AppendNumberTo(&r, b->number);
+      r.push_back(':');
+      AppendNumberTo(&r, b->total_count);
+      r.push_back('/');
+      AppendNumberTo(&r, b->total_bytes);
+      r.append(" garbage ");
+      AppendNumberTo(&r, b->garbage_count);
+      r.push_back('/');
+      AppendNumberTo(&r, b->garbage_bytes);
+      r.push_back('\n');
+    }
+  }
   return r;
 }
 
@@ -618,6 +762,27 @@ class VersionSet::Builder {
   Version* base_;
   LevelState levels_[config::kNumLevels];
 
+  // Blob files added or changed by the edits applied so far
+  std::map<uint64_t, BlobFileMetaData> changed_blob_files_;
+
+  // Returns the state of blob file "number" for modification, or NULL if
+  // the file is unknown (e.g. it has been dropped already).
+  BlobFileMetaData* MutableBlobFile(uint64_t number) {
+    std::map<uint64_t, BlobFileMetaData>::iterator it =
+        changed_blob_files_.find(number);
+    if (it != changed_blob_files_.end()) {
+      return &it->second;
+    }
+    Version::BlobFileMap::const_iterator base = base_->blob_files_.find(number);
+    if (base == base_->blob_files_.end()) {
+      return NULL;
+    }
+    BlobFileMetaData* b = &changed_blob_files_[number];
+    *b = *base->second;
+    b->refs = 0;
+    return b;
+  }
+
  public:
   // Initialize a builder with the files from *base and other info from *vset
   Builder(VersionSet* vset, Version* base)
@@ -696,6 +861,21 @@ class VersionSet::Builder {
       levels_[level].deleted_files.erase(f->number);
       levels_[level].added_files->insert(f);
     }
+
+    // Add new blob files, then account for the records that are no
+    // longer referenced
+    for (size_t i = 0; i < edit->new_blob_files_.size(); i++) {
+      const BlobFileMetaData& b = edit->new_blob_files_[i];
+      changed_blob_files_[b.number] = b;
+    }
+    for (size_t i = 0; i < edit->blob_garbage_.size(); i++) {
+      const BlobFileMetaData& g = edit->blob_garbage_[i];
+      BlobFileMetaData* b = MutableBlobFile(g.number);
+      if (b != NULL) {
+        b->garbage_count += g.garbage_count;
+        b->garbage_bytes += g.garbage_bytes;
+      }
+    }
   }
 
   // Save the current state in *v.
@@ -745,6 +925,25 @@ class VersionSet::Builder {
       }
 #endif
     }
+
+    // Unchanged blob files are shared with the base version; a file is
+    // dropped once none of its records are referenced any more.
+    for (Version::BlobFileMap::const_iterator it = base_->blob_files_.begin();
+         it != base_->blob_files_.end(); ++it) {
+      if (changed_blob_files_.count(it->first) == 0) {
+        it->second->refs++;
+        v->blob_files_.insert(*it);
+      }
+    }
+    for (std::map<uint64_t, BlobFileMetaData>::const_iterator it =
+             changed_blob_files_.begin();
+         it != changed_blob_files_.end(); ++it) {
+      if (it->second.garbage_count < it->second.total_count) {
+        BlobFileMetaData* b = new BlobFileMetaData(it->second);
+        b->refs = 1;
+        v->blob_files_.insert(std::make_pair(it->first, b));
+      }
+    }
   }
 
   void MaybeAddFile(Version* v, int level, FileMetaData* f) {
@@ -1015,6 +1214,24 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
 }
 
 void VersionSet::Finalize(Version* v) {
+  if (options_->compaction_style == kUniversalCompaction) {
+    // Every level-0 file and every non-empty deeper level is a sorted
+    // run, and the score measures their number against the limit.
+    int runs = v->files_[0].size();
+    for (int level = 1; level < config::kNumLevels; level++) {
+      if (!v->files_[level].empty()) {
+        runs++;
+      }
+    }
+    v->compaction_level_ = 0;
+    v->compaction_score_ =
+        runs / static_cast<double>(options_->universal_max_sorted_runs + 1);
+    return;
+  }
+
+  ComputeLevelTargets(v);
+  ComputeFilesMarkedForCompaction(v);
+
   // Precomputed best level for next compaction
   int best_level = -1;
   double best_score = -1;
@@ -1038,9 +1255,10 @@ void VersionSet::Finalize(Version* v) {
     } else {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-      score = static_cast<double>(level_bytes) / MaxBytesForLevel(level);
+      score = static_cast<double>(level_bytes) / v->max_bytes_[level];
     }
 
+    v->level_scores_[level] = score;
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -1051,6 +1269,127 @@ void VersionSet::Finalize(Version* v) {
   v->compaction_score_ = best_score;
 }
 
+namespace {
+struct MoreDeletedFirst {
+  bool operator()(const std::pair<double, std::pair<int, FileMetaData*> >& a,
+                  const std::pair<double, std::pair<int, FileMetaData*> >& b)
+      const {
+    if (a.first != b.first) {
+      return a.first > b.first;
+    }
+    return a.second.second->number < b.second.second->number;
+  }
+};
+}  // namespace
+
+void VersionSet::ComputeFilesMarkedForCompaction(Version* v) {
+  v->files_marked_for_compaction_.clear();
+  v->periodic_compaction_due_ = 0;
+
+  // Files in the last level are left alone: their deletions are only
+  // still there because snapshots needed them, and a rewrite would not
+  // drop them before the snapshots are released.
+  const double ratio = options_->deletion_compaction_ratio;
+  if (ratio > 0) {
+    std::vector<std::pair<double, std::pair<int, FileMetaData*> > > marked;
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      for (size_t i = 0; i < v->files_[level].size(); i++) {
+        FileMetaData* f = v->files_[level][i];
+        if (f->num_entries == 0) {
+          continue;
+        }
+        const double r =
+            static_cast<double>(f->num_deletions) / f->num_entries;
+        if (r > ratio) {
+          marked.push_back(std::make_pair(r, std::make_pair(level, f)));
+        }
+      }
+    }
+    std::sort(marked.begin(), marked.end(), MoreDeletedFirst());
+    for (size_t i = 0; i < marked.size(); i++) {
+      v->files_marked_for_compaction_.push_back(marked[i].second);
+    }
+  }
+
+  // Rewriting the files that reference a blob file with much garbage
+  // moves their records out of it, so that it can be deleted.  Files in
+  // the last level are rewritten in place.
+  if (options_->blob_gc_ratio > 0 && !v->blob_files_.empty()) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      for (size_t i = 0; i < v->files_[level].size(); i++) {
+        FileMetaData* f = v->files_[level][i];
+        if (f->oldest_blob_file != 0 &&
+            v->BlobFileNeedsGC(f->oldest_blob_file)) {
+          v->files_marked_for_compaction_.push_back(std::make_pair(level, f));
+        }
+      }
+    }
+  }
+
+  const uint64_t period = options_->periodic_compaction_seconds;
+  if (period > 0) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      for (size_t i = 0; i < v->files_[level].size(); i++) {
+        const FileMetaData* f = v->files_[level][i];
+        if (f->creation_time == 0) {
+          continue;   // Written by an older release; age unknown
+        }
+        const uint64_t due = f->creation_time + period;
+        if (v->periodic_compaction_due_ == 0 ||
+            due < v->periodic_compaction_due_) {
+          v->periodic_compaction_due_ = due;
+        }
+      }
+    }
+  }
+}
+
+void VersionSet::ComputeLevelTargets(Version* v) {
+  // Note: the limit for level zero is not used since we set the level-0
+  // compaction threshold based on number of files.
+  const double base = options_->max_bytes_for_level_base;
+  const double multiplier = options_->max_bytes_for_level_multiplier;
+  if (!options_->dynamic_level_bytes) {
+    double limit = base;
+    for (int level = 1; level < config::kNumLevels; level++) {
+      v->max_bytes_[level] = limit;
+      limit *= multiplier;
+    }
+    v->base_level_ = 1;
+    return;
+  }
+
+  // Derive the limits backwards from the largest level, making each level
+  // "multiplier" times smaller than the one below it.  Level-0 files are
+  // compacted straight into the deepest level whose limit is within the
+  // base size, and the levels above it stay empty.  The last level thus
+  // holds about multiplier/(multiplier-1) of the live data.
+  int64_t largest_bytes = 0;
+  int first_non_empty = config::kNumLevels;
+  for (int level = config::kNumLevels - 1; level >= 1; level--) {
+    const int64_t level_bytes = TotalFileSize(v->files_[level]);
+    if (level_bytes > 0) {
+      largest_bytes = std::max(largest_bytes, level_bytes);
+      first_non_empty = level;
+    }
+  }
+  double limit = std::max(static_cast<double>(largest_bytes), base);
+  int base_level = 0;
+  for (int level = config::kNumLevels - 1; level >= 1; level--) {
+    v->max_bytes_[level] = limit;
+    if (base_level == 0 && limit <= base) {
+      base_level = level;
+    }
+    limit /= multiplier;
+  }
+  if (base_level == 0) {
+    base_level = 1;
+  }
+  // Data left above the base level (e.g. written in the static mode) gets
+  // a tiny limit and is moved down; until then level-0 must stay above it.
+  v->base_level_ = std::min(base_level, first_non_empty);
+}
+
 Status VersionSet::WriteSnapshot(log::Writer* log) {
   // TODO: Break up into multiple records to reduce memory usage on recovery?
 
@@ -1071,8 +1410,17 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
   for (int level = 0; level < config::kNumLevels; level++) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
-      const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, *files[i]);
+    }
+  }
+
+  // Save blob files
+  for (Version::BlobFileMap::const_iterator it = current_->blob_files_.begin();
+       it != current_->blob_files_.end(); ++it) {
+    const BlobFileMetaData* b = it->second;
+    edit.AddBlobFile(b->number, b->total_count, b->total_bytes);
+    if (b->garbage_count > 0) {
+      edit.AddBlobGarbage(b->number, b->garbage_count, b->garbage_bytes);
     }
   }
 
@@ -1102,6 +1450,28 @@ const char* VersionSet::LevelSummary(LevelSummaryStorage* scratch) const {
   return scratch->buffer;
 }
 
+void VersionSet::GetBlobStats(std::string* value) const {
+  uint64_t count = 0, bytes = 0, garbage_count = 0, garbage_bytes = 0;
+  for (Version::BlobFileMap::const_iterator it = current_->blob_files_.begin();
+       it != current_->blob_files_.end(); ++it) {
+    const BlobFileMetaData* b = it->second;
+    count += b->total_count;
+    bytes += b->total_bytes;
+    garbage_count += b->garbage_count;
+    garbage_bytes += b->garbage_bytes;
+  }
+  char buf[200];
+  snprintf(buf, sizeof(buf),
+           "Files: %d\n"
+           "Records: %llu (%.1f MB)\n"
+           "Garbage: %llu (%.1f MB)\n",
+           static_cast<int>(current_->blob_files_.size()),
+           static_cast<unsigned long long>(count), bytes / 1048576.0,
+           static_cast<unsigned long long>(garbage_count),
+           garbage_bytes / 1048576.0);
+  value->append(buf);
+}
+
 uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
   uint64_t result = 0;
   for (int level = 0; level < config::kNumLevels; level++) {
@@ -1134,6 +1504,32 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
   return result;
 }
 
+Status VersionSet::GetPropertiesOfAllTables(Version* v,
+                                            TablePropertiesCollection* props) {
+  props->clear();
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = v->files_[level];
+    for (size_t i = 0; i < files.size(); i++) {
+      const FileMetaData* f = files[i];
+      TableProperties p;
+      bool found;
+      Status s = table_cache_->GetProperties(f->number, f->file_size, &p,
+                                             &found);
+      if (!s.ok()) {
+        return s;
+      }
+      if (!found) {
+        // Fall back on what the manifest knows about the file
+        p.num_entries = f->num_entries;
+        p.num_deletions = f->num_deletions;
+        p.largest_seqno = f->largest_seqno;
+      }
+      (*props)[TableFileName(dbname_, f->number)] = p;
+    }
+  }
+  return Status::OK();
+}
+
 void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
   for (Version* v = dummy_versions_.next_;
        v != &dummy_versions_;
@@ -1144,6 +1540,10 @@ void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
         live->insert(files[i]->number);
       }
     }
+    for (Version::BlobFileMap::const_iterator it = v->blob_files_.begin();
+         it != v->blob_files_.end(); ++it) {
+      live->insert(it->first);
+    }
   }
 }
 
@@ -1215,10 +1615,11 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
   // TODO(opt): use concatenating iterator for level-0 if there is no overlap
-  const int space = (c->level() == 0 ? c->inputs_[0].size() + 1 : 2);
+  const int space = (c->level() == 0 ? c->inputs_[0].size() : 1) +
+                    c->num_input_levels() - 1;
   Iterator** list = new Iterator*[space];
   int num = 0;
-  for (int which = 0; which < 2; which++) {
+  for (int which = 0; which < c->num_input_levels(); which++) {
     if (!c->inputs_[which].empty()) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
@@ -1240,43 +1641,322 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
+Status VersionSet::AddRangeDeletions(Compaction* c,
+                                     RangeDelAggregator* range_del) {
+  Status s;
+  for (int which = 0; which < c->num_input_levels() && s.ok(); which++) {
+    for (size_t i = 0; i < c->inputs_[which].size() && s.ok(); i++) {
+      const FileMetaData* f = c->inputs_[which][i];
+      if (f->has_range_deletions) {
+        Iterator* iter = table_cache_->NewRangeDeletionIterator(
+            f->number, f->file_size);
+        s = range_del->AddTombstones(iter);
+        delete iter;
+      }
+    }
+  }
+  return s;
+}
+
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+  if (options_->compaction_style == kUniversalCompaction) {
+    return PickUniversalCompaction();
+  }
+
+  Compaction* c = NULL;
 
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != NULL);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level+1 < config::kNumLevels);
-    c = new Compaction(level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
+  // the compactions triggered by seeks.  Levels are tried in order of
+  // decreasing score, so that a level whose files are all tied up in
+  // compactions run by other threads does not hold up the rest.
+  int levels[config::kNumLevels - 1];
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    int i = level;
+    while (i > 0 &&
+           current_->level_scores_[levels[i-1]] <
+           current_->level_scores_[level]) {
+      levels[i] = levels[i-1];
+      i--;
+    }
+    levels[i] = level;
+  }
+  for (int i = 0; c == NULL && i < config::kNumLevels - 1; i++) {
+    const int level = levels[i];
+    if (current_->level_scores_[level] < 1) {
+      break;
+    }
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    // Level-0 files may overlap each other, so only one compaction may
+    // move level-0 files down at a time.
+    if (level > 0 || !AnyBeingCompacted(files)) {
+      std::vector<FileMetaData*> ordered;
+      if (options_->compaction_pri != kRoundRobin) {
+        OrderFilesByCompactionPri(level, &ordered);
+      } else {
+        // Start with the first file that comes after compact_pointer_[level],
+        // wrapping around to the beginning of the key space.
+        size_t start = 0;
+        while (start < files.size() &&
+               !compact_pointer_[level].empty() &&
+               icmp_.Compare(files[start]->largest.Encode(),
+                             compact_pointer_[level]) <= 0) {
+          start++;
+        }
+        for (size_t n = 0; n < files.size(); n++) {
+          ordered.push_back(files[(start + n) % files.size()]);
+        }
+      }
+      // Skip the files that cannot be compacted right now
+      for (size_t n = 0; c == NULL && n < ordered.size(); n++) {
+        if (!ordered[n]->being_compacted) {
+          c = NewCompactionFrom(level, ordered[n]);
+        }
+      }
+    }
+    if (c == NULL && level == 0) {
+      // Level-0 cannot be compacted into the base level right now.  Merge
+      // the newest level-0 files with each other instead, so that their
+      // number does not stop writes and reads have fewer files to check.
+      c = PickIntraL0Compaction();
+    }
+  }
+
+  if (c == NULL && current_->file_to_compact_ != NULL &&
+      !current_->file_to_compact_->being_compacted) {
+    c = NewCompactionFrom(current_->file_to_compact_level_,
+                          current_->file_to_compact_);
+  }
+
+  // Then the files with many deletions, and finally old files
+  const std::vector<std::pair<int, FileMetaData*> >& marked =
+      current_->files_marked_for_compaction_;
+  for (size_t i = 0; c == NULL && i < marked.size(); i++) {
+    const int level = marked[i].first;
+    FileMetaData* f = marked[i].second;
+    if (!f->being_compacted &&
+        !(level == 0 && AnyBeingCompacted(current_->files_[0]))) {
+      c = NewRewriteCompaction(level, f);
+    }
+  }
+  if (c == NULL && PeriodicCompactionDue()) {
+    c = PickPeriodicCompaction();
+  }
+
+  return c;
+}
+
+void VersionSet::OrderFilesByCompactionPri(
+    int level, std::vector<FileMetaData*>* files) {
+  const Comparator* ucmp = icmp_.user_comparator();
+  const std::vector<FileMetaData*>& inputs = current_->files_[level];
+  const std::vector<FileMetaData*>& next =
+      current_->files_[(level == 0) ? current_->base_level_ : level + 1];
+
+  // Pairs of (priority, index into "inputs"); ties go to the smaller keys
+  std::vector<std::pair<uint64_t, size_t> > order;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    const FileMetaData* f = inputs[i];
+    uint64_t priority;
+    if (options_->compaction_pri == kOldestLargestSeqFirst) {
+      priority = f->largest_seqno;
+    } else {
+      // Bytes rewritten in the next level per KB of "f"
+      InternalKey start(f->smallest.user_key(), kMaxSequenceNumber,
+                        kValueTypeForSeek);
+      uint64_t overlapping = 0;
+      for (size_t j = FindFile(icmp_, next, start.Encode());
+           j < next.size() &&
+           ucmp->Compare(next[j]->smallest.user_key(),
+                         f->largest.user_key()) <= 0;
+           j++) {
+        overlapping += next[j]->file_size;
+      }
+      priority = overlapping * 1024 / std::max<uint64_t>(f->file_size, 1);
+    }
+    order.push_back(std::make_pair(priority, i));
+  }
+  std::sort(order.begin(), order.end());
+
+  files->clear();
+  for (size_t i = 0; i < order.size(); i++) {
+    files->push_back(inputs[order[i].second]);
+  }
+}
+
+Compaction* VersionSet::PickIntraL0Compaction() {
+  std::vector<FileMetaData*> level0 = current_->files_[0];
+  std::sort(level0.begin(), level0.end(), NewestFirst);
+
+  // Take the newest files, up to the first one that is being compacted.
+  // The result must be newer than all other level-0 files to keep them in
+  // order.  Stop before a file that would raise the number of bytes
+  // rewritten per file removed, i.e. one much larger than the others.
+  size_t n = 0;
+  uint64_t bytes = 0;
+  uint64_t bytes_per_removed = ~static_cast<uint64_t>(0);
+  while (n < level0.size() && !level0[n]->being_compacted) {
+    const uint64_t new_bytes = bytes + level0[n]->file_size;
+    if (n > 0) {
+      if (new_bytes / n > bytes_per_removed) {
         break;
       }
+      bytes_per_removed = new_bytes / n;
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+    bytes = new_bytes;
+    n++;
+  }
+  if (n < static_cast<size_t>(config::kL0_IntraCompactionMinFiles)) {
+    return NULL;
+  }
+
+  Compaction* c = new Compaction(0, 0);
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  c->inputs_[0].assign(level0.begin(), level0.begin() + n);
+  c->allow_trivial_move_ = false;
+  // Write a single file, which then stays in order with the others
+  c->max_output_file_size_ = ~static_cast<uint64_t>(0);
+  Log(options_->info_log, "Intra level-0 compaction of %d files, %lld bytes",
+      static_cast<int>(n), static_cast<long long>(bytes));
+  return c;
+}
+
+bool VersionSet::PeriodicCompactionDue() const {
+  const uint64_t due = current_->periodic_compaction_due_;
+  return due != 0 && env_->NowMicros() / 1000000 >= due;
+}
+
+Compaction* VersionSet::PickPeriodicCompaction() {
+  const uint64_t now = env_->NowMicros() / 1000000;
+  const uint64_t period = options_->periodic_compaction_seconds;
+  int oldest_level = -1;
+  FileMetaData* oldest = NULL;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    if (level == 0 && AnyBeingCompacted(current_->files_[0])) {
+      continue;
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
+    for (size_t i = 0; i < current_->files_[level].size(); i++) {
+      FileMetaData* f = current_->files_[level][i];
+      if (f->creation_time != 0 && f->creation_time + period <= now &&
+          !f->being_compacted &&
+          (oldest == NULL || f->creation_time < oldest->creation_time)) {
+        oldest_level = level;
+        oldest = f;
+      }
+    }
+  }
+  return (oldest == NULL) ? NULL : NewRewriteCompaction(oldest_level, oldest);
+}
+
+namespace {
+// A sorted run for kUniversalCompaction: either a single level-0 file,
+// or all files of a deeper level.
+struct SortedRun {
+  int level;
+  FileMetaData* file;   // NULL for a level > 0
+  uint64_t size;
+};
+}  // namespace
+
+Compaction* VersionSet::PickUniversalCompaction() {
+  if (current_->compaction_score_ < 1) {
     return NULL;
   }
+  // Merged runs must be neighbours in age, so only one merge can be in
+  // progress at a time.
+  for (int level = 0; level < config::kNumLevels; level++) {
+    if (AnyBeingCompacted(current_->files_[level])) {
+      return NULL;
+    }
+  }
 
+  // List the sorted runs from newest to oldest.  Level-0 files come
+  // first, newest files first, followed by the deeper levels in order.
+  std::vector<FileMetaData*> level0 = current_->files_[0];
+  std::sort(level0.begin(), level0.end(), NewestFirst);
+  std::vector<SortedRun> runs;
+  for (size_t i = 0; i < level0.size(); i++) {
+    SortedRun run = { 0, level0[i], level0[i]->file_size };
+    runs.push_back(run);
+  }
+  for (int level = 1; level < config::kNumLevels; level++) {
+    if (!current_->files_[level].empty()) {
+      SortedRun run = { level, NULL,
+                        static_cast<uint64_t>(
+                            TotalFileSize(current_->files_[level])) };
+      runs.push_back(run);
+    }
+  }
+  const size_t num_level0 = level0.size();
+
+  // Find the newest run that can be merged with the runs following it
+  // because their sizes are similar.  The merge result is written below
+  // level-0, so a merge that involves level-0 files has to include the
+  // oldest level-0 file too; otherwise an older level-0 file would be
+  // read before the newer data that was moved down.
+  size_t start = 0;
+  size_t limit = 0;
+  const double ratio = (100 + options_->universal_size_ratio) / 100.0;
+  for (size_t i = 0; limit == 0 && i + 1 < runs.size(); i++) {
+    double candidate_size = runs[i].size;
+    size_t j = i + 1;
+    while (j < runs.size() && runs[j].size <= candidate_size * ratio) {
+      candidate_size += runs[j].size;
+      j++;
+    }
+    if (j - i >= 2 && (i >= num_level0 || j >= num_level0)) {
+      start = i;
+      limit = j;
+    }
+  }
+  if (limit == 0) {
+    // Nothing of similar size: merge the newest runs, as many as it
+    // takes to get back to the allowed number of runs.
+    start = 0;
+    limit = runs.size() - options_->universal_max_sorted_runs + 1;
+    if (limit < num_level0) {
+      limit = num_level0;
+    }
+  }
+  assert(limit - start >= 2);
+
+  // The result replaces the oldest run that is merged.  If that run is
+  // a level-0 file, use the empty level just above the next older run,
+  // or merge that run as well if there is no such level.
+  int output_level = runs[limit - 1].level;
+  if (output_level == 0) {
+    const int next_level =
+        (limit < runs.size() ? runs[limit].level : config::kNumLevels);
+    if (next_level > 1) {
+      output_level = next_level - 1;
+    } else {
+      output_level = next_level;
+      limit++;
+    }
+  }
+
+  const int level = runs[start].level;
+  Compaction* c = new Compaction(level, output_level);
   c->input_version_ = current_;
   c->input_version_->Ref();
+  for (size_t i = start; i < limit; i++) {
+    if (runs[i].level == 0) {
+      c->inputs_[0].push_back(runs[i].file);
+    } else {
+      c->inputs_[runs[i].level - level] = current_->files_[runs[i].level];
+    }
+  }
+  Log(options_->info_log, "Universal compaction of %d sorted runs to level-%d",
+      static_cast<int>(limit - start), output_level);
+  return c;
+}
+
+Compaction* VersionSet::NewCompactionFrom(int level, FileMetaData* seed) {
+  Compaction* c = new Compaction(
+      level, (level == 0) ? current_->base_level_ : level + 1);
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  c->inputs_[0].push_back(seed);
 
   // Files in level 0 may overlap each other, so pick up all overlapping ones
   if (level == 0) {
@@ -1289,43 +1969,72 @@ Compaction* VersionSet::PickCompaction() {
     assert(!c->inputs_[0].empty());
   }
 
-  SetupOtherInputs(c);
+  if (!SetupOtherInputs(c)) {
+    delete c;
+    return NULL;
+  }
+  return c;
+}
 
+Compaction* VersionSet::NewRewriteCompaction(int level, FileMetaData* f) {
+  Compaction* c;
+  if (level < config::kNumLevels - 1) {
+    c = NewCompactionFrom(level, f);
+  } else if (f->being_compacted) {
+    c = NULL;
+  } else {
+    // There is nothing to merge with in the last level
+    c = new Compaction(level, level);
+    c->input_version_ = current_;
+    c->input_version_->Ref();
+    c->inputs_[0].push_back(f);
+  }
+  if (c != NULL) {
+    c->allow_trivial_move_ = false;
+  }
   return c;
 }
 
-void VersionSet::SetupOtherInputs(Compaction* c) {
+bool VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
+  const int output_level = c->output_level();
+  // Levels between "level" and "output_level" are empty.
+  std::vector<FileMetaData*>* parents = &c->inputs_[output_level - level];
   InternalKey smallest, largest;
   GetRange(c->inputs_[0], &smallest, &largest);
 
-  current_->GetOverlappingInputs(level+1, &smallest, &largest, &c->inputs_[1]);
+  current_->GetOverlappingInputs(output_level, &smallest, &largest, parents);
+  if (AnyBeingCompacted(c->inputs_[0]) || AnyBeingCompacted(*parents)) {
+    return false;
+  }
 
   // Get entire range covered by compaction
   InternalKey all_start, all_limit;
-  GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+  GetRange2(c->inputs_[0], *parents, &all_start, &all_limit);
 
   // See if we can grow the number of inputs in "level" without
-  // changing the number of "level+1" files we pick up.
-  if (!c->inputs_[1].empty()) {
+  // changing the number of "output_level" files we pick up.
+  if (!parents->empty()) {
     std::vector<FileMetaData*> expanded0;
     current_->GetOverlappingInputs(level, &all_start, &all_limit, &expanded0);
     const int64_t inputs0_size = TotalFileSize(c->inputs_[0]);
-    const int64_t inputs1_size = TotalFileSize(c->inputs_[1]);
+    const int64_t inputs1_size = TotalFileSize(*parents);
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
-        inputs1_size + expanded0_size < kExpandedCompactionByteSizeLimit) {
+        inputs1_size + expanded0_size < kExpandedCompactionByteSizeLimit &&
+        !AnyBeingCompacted(expanded0)) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
-      current_->GetOverlappingInputs(level+1, &new_start, &new_limit,
+      current_->GetOverlappingInputs(output_level, &new_start, &new_limit,
                                      &expanded1);
-      if (expanded1.size() == c->inputs_[1].size()) {
+      if (expanded1.size() == parents->size() &&
+          !AnyBeingCompacted(expanded1)) {
         Log(options_->info_log,
             "Expanding@%d %d+%d (%ld+%ld bytes) to %d+%d (%ld+%ld bytes)\n",
             level,
             int(c->inputs_[0].size()),
-            int(c->inputs_[1].size()),
+            int(parents->size()),
             long(inputs0_size), long(inputs1_size),
             int(expanded0.size()),
             int(expanded1.size()),
@@ -1333,16 +2042,16 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
         smallest = new_start;
         largest = new_limit;
         c->inputs_[0] = expanded0;
-        c->inputs_[1] = expanded1;
-        GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
+        *parents = expanded1;
+        GetRange2(c->inputs_[0], *parents, &all_start, &all_limit);
       }
     }
   }
 
   // Compute the set of grandparent files that overlap this compaction
-  // (parent == level+1; grandparent == level+2)
-  if (level + 2 < config::kNumLevels) {
-    current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
+  // (parent == output_level; grandparent == output_level+1)
+  if (output_level + 1 < config::kNumLevels) {
+    current_->GetOverlappingInputs(output_level + 1, &all_start, &all_limit,
                                    &c->grandparents_);
   }
 
@@ -1359,6 +2068,7 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   // key range next time.
   compact_pointer_[level] = largest.Encode().ToString();
   c->edit_.SetCompactPointer(level, largest);
+  return true;
 }
 
 Compaction* VersionSet::CompactRange(
@@ -1388,23 +2098,33 @@ Compaction* VersionSet::CompactRange(
     }
   }
 
-  Compaction* c = new Compaction(level);
+  Compaction* c = new Compaction(
+      level, (level == 0) ? current_->base_level_ : level + 1);
   c->input_version_ = current_;
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
-  SetupOtherInputs(c);
+  // Manual compactions only run while no other compaction is in
+  // progress, so none of the inputs can be busy.
+  const bool ok = SetupOtherInputs(c);
+  assert(ok);
+  (void) ok;
   return c;
 }
 
-Compaction::Compaction(int level)
+Compaction::Compaction(int level, int output_level)
     : level_(level),
+      output_level_(output_level),
       max_output_file_size_(MaxFileSizeForLevel(level)),
-      input_version_(NULL),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
+      allow_trivial_move_(true),
+      input_version_(NULL) {
+}
+
+Compaction::Cursor::Cursor()
+    : grandparent_index(0),
+      seen_key(false),
+      overlapped_bytes(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
+    level_ptrs[i] = 0;
   }
 }
 
@@ -1418,26 +2138,40 @@ bool Compaction::IsTrivialMove() const {
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
-  return (num_input_files(0) == 1 &&
-          num_input_files(1) == 0 &&
-          TotalFileSize(grandparents_) <= kMaxGrandParentOverlapBytes);
+  if (!allow_trivial_move_ || num_input_files(0) != 1) {
+    return false;
+  }
+  for (int which = 1; which < num_input_levels(); which++) {
+    if (num_input_files(which) != 0) {
+      return false;
+    }
+  }
+  return TotalFileSize(grandparents_) <= kMaxGrandParentOverlapBytes;
 }
 
 void Compaction::AddInputDeletions(VersionEdit* edit) {
-  for (int which = 0; which < 2; which++) {
+  for (int which = 0; which < num_input_levels(); which++) {
     for (size_t i = 0; i < inputs_[which].size(); i++) {
       edit->DeleteFile(level_ + which, inputs_[which][i]->number);
     }
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   Cursor* cursor) const {
+  if (output_level_ == 0) {
+    // Older level-0 files that are not part of the compaction may hold
+    // the key as well
+    return false;
+  }
+
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  size_t* level_ptrs = cursor->level_ptrs;
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    for (; level_ptrs_[lvl] < files.size(); ) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    for (; level_ptrs[lvl] < files.size(); ) {
+      FileMetaData* f = files[level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1446,34 +2180,104 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      level_ptrs[lvl]++;
+    }
+  }
+  return true;
+}
+
+bool Compaction::IsBaseLevelForRange(const Slice& begin,
+                                     const Slice& end) const {
+  if (output_level_ == 0) {
+    return false;
+  }
+  // OverlapInLevel() treats "end" as inclusive, which is conservative.
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  Cursor* cursor) const {
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &input_version_->vset_->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
+  while (cursor->grandparent_index < grandparents_.size() &&
       icmp->Compare(internal_key,
-                    grandparents_[grandparent_index_]->largest.Encode()) > 0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+          grandparents_[cursor->grandparent_index]->largest.Encode()) > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > kMaxGrandParentOverlapBytes) {
+  if (cursor->overlapped_bytes > kMaxGrandParentOverlapBytes) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
   }
 }
 
+namespace {
+struct UserKeyLess {
+  const Comparator* ucmp;
+  bool operator()(const Slice& a, const Slice& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+};
+struct UserKeyEqual {
+  const Comparator* ucmp;
+  bool operator()(const Slice& a, const Slice& b) const {
+    return ucmp->Compare(a, b) == 0;
+  }
+};
+}  // namespace
+
+void Compaction::GetSubcompactionBoundaries(
+    int n, std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  if (n <= 1) {
+    return;
+  }
+
+  // Every input file boundary is a candidate split point.  All versions
+  // of a user key end up on the same side of a split since we split on
+  // user keys.
+  const Comparator* ucmp = input_version_->vset_->icmp_.user_comparator();
+  std::vector<Slice> keys;
+  for (int which = 0; which < num_input_levels(); which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      keys.push_back(inputs_[which][i]->smallest.user_key());
+      keys.push_back(inputs_[which][i]->largest.user_key());
+    }
+  }
+  UserKeyLess less;
+  less.ucmp = ucmp;
+  UserKeyEqual equal;
+  equal.ucmp = ucmp;
+  std::sort(keys.begin(), keys.end(), less);
+  keys.erase(std::unique(keys.begin(), keys.end(), equal), keys.end());
+
+  // Nothing sorts before the smallest key, so it cannot start a range.
+  if (keys.size() < 2) {
+    return;
+  }
+  const size_t candidates = keys.size() - 1;
+  const size_t ranges = std::min(static_cast<size_t>(n), candidates + 1);
+  for (size_t i = 1; i < ranges; i++) {
+    const Slice& key = keys[1 + (i * candidates) / ranges];
+    if (boundaries->empty() || ucmp->Compare(key, boundaries->back()) > 0) {
+      boundaries->push_back(key.ToString());
+    }
+  }
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != NULL) {
     input_version_->Unref();
@@ -1481,4 +2285,13 @@ void Compaction::ReleaseInputs() {
   }
 }
 
+void Compaction::MarkInputsBeingCompacted(bool value) {
+  for (int which = 0; which < num_input_levels(); which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      assert(inputs_[which][i]->being_compacted != value);
+      inputs_[which][i]->being_compacted = value;
+    }
+  }
+}
+
 }  // namespace leveldb
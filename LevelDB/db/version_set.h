@@ -30,6 +30,7 @@ namespace log { class Writer; }
 class Compaction;
 class Iterator;
 class MemTable;
+class RangeDelAggregator;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -63,15 +64,22 @@ class Version {
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Add the range tombstones of every file of this Version to *range_del.
+  // REQUIRES: lock is not held
+  Status AddRangeDeletions(RangeDelAggregator* range_del);
+
   // Lookup the value for key.  If found, store it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
+  // *operands holds the merge operands for key found in the memtables,
+  // newest first; operands found in the files are appended to it, and
+  // all of them are applied to the value found.
   // REQUIRES: lock is not held
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
   };
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             GetStats* stats, std::vector<std::string>* operands);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -110,6 +118,11 @@ class Version {
 
   int NumFiles(int level) const { return files_[level].size(); }
 
+  // Returns true iff at least Options::blob_gc_ratio of the blob file
+  // "number" is garbage, so that compactions should move the records
+  // still referenced out of it.
+  bool BlobFileNeedsGC(uint64_t number) const;
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
 
@@ -137,6 +150,10 @@ class Version {
   // List of files per level
   std::vector<FileMetaData*> files_[config::kNumLevels];
 
+  // Blob files referenced by the files above, by file number
+  typedef std::map<uint64_t, BlobFileMetaData*> BlobFileMap;
+  BlobFileMap blob_files_;
+
   // Next file to compact based on seek stats.
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
@@ -147,12 +164,36 @@ class Version {
   double compaction_score_;
   int compaction_level_;
 
+  // Compaction score of every level, also filled in by Finalize().  When
+  // the best level is busy with another compaction we fall back to the
+  // next best one.
+  double level_scores_[config::kNumLevels];
+
+  // Size limit of every level > 0, and the level that level-0 files are
+  // compacted into; levels in between are kept empty.  Both are set by
+  // Finalize().
+  double max_bytes_[config::kNumLevels];
+  int base_level_;
+
+  // Files whose share of deletions exceeds the configured ratio, paired
+  // with their levels, most deleted first; and the time in seconds at
+  // which the oldest file becomes due for a periodic compaction, or 0.
+  // Both are set by Finalize().
+  std::vector<std::pair<int, FileMetaData*> > files_marked_for_compaction_;
+  uint64_t periodic_compaction_due_;
+
   explicit Version(VersionSet* vset)
       : vset_(vset), next_(this), prev_(this), refs_(0),
         file_to_compact_(NULL),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {
+        compaction_level_(-1),
+        base_level_(1),
+        periodic_compaction_due_(0) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      level_scores_[level] = -1;
+      max_bytes_[level] = 0;
+    }
   }
 
   ~Version();
@@ -225,7 +266,9 @@ class VersionSet {
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
   // Pick level and inputs for a new compaction.
-  // Returns NULL if there is no compaction to be done.
+  // Returns NULL if there is no compaction to be done, or if every
+  // compaction that is needed would read a file that is already being
+  // compacted (see FileMetaData::being_compacted).
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
   Compaction* PickCompaction();
@@ -247,20 +290,43 @@ class VersionSet {
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
+  // Add the range tombstones of the compaction inputs for "*c" to
+  // *range_del.
+  Status AddRangeDeletions(Compaction* c, RangeDelAggregator* range_del);
+
+  // Returns the compaction score of the level most in need of compaction.
+  double CompactionScore() const { return current_->compaction_score_; }
+
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != NULL);
+    return (v->compaction_score_ >= 1) ||
+        ((v->file_to_compact_ != NULL ||
+          !v->files_marked_for_compaction_.empty()) &&
+         options_->compaction_style == kLevelCompaction) ||
+        PeriodicCompactionDue();
   }
 
-  // Add all files listed in any live version to *live.
-  // May also mutate some internal state.
+  // Returns true iff some file is older than
+  // Options::periodic_compaction_seconds.
+  bool PeriodicCompactionDue() const;
+
+  // Add all files, including blob files, listed in any live version to
+  // *live.  May also mutate some internal state.
   void AddLiveFiles(std::set<uint64_t>* live);
 
   // Return the approximate offset in the database of the data for
   // "key" as of version "v".
   uint64_t ApproximateOffsetOf(Version* v, const InternalKey& key);
 
+  // Store in *props the properties of the tables of version "v", keyed by
+  // file name.  See DB::GetPropertiesOfAllTables().
+  Status GetPropertiesOfAllTables(Version* v, TablePropertiesCollection* props);
+
+  // Store in *value a human-readable summary of the blob files of the
+  // current version.
+  void GetBlobStats(std::string* value) const;
+
   // Return a human-readable short (single-line) summary of the number
   // of files per level.  Uses *scratch as backing store.
   struct LevelSummaryStorage {
@@ -276,6 +342,13 @@ class VersionSet {
 
   void Finalize(Version* v);
 
+  // Set the size limit of each level of "*v" and its base level.
+  void ComputeLevelTargets(Version* v);
+
+  // Find the files of "*v" that are due for a compaction because of
+  // their deletions, the garbage in their blob files or their age.
+  void ComputeFilesMarkedForCompaction(Version* v);
+
   void GetRange(const std::vector<FileMetaData*>& inputs,
                 InternalKey* smallest,
                 InternalKey* largest);
@@ -285,7 +358,33 @@ class VersionSet {
                  InternalKey* smallest,
                  InternalKey* largest);
 
-  void SetupOtherInputs(Compaction* c);
+  // Pick a merge of neighbouring sorted runs for kUniversalCompaction.
+  Compaction* PickUniversalCompaction();
+
+  // Merge the newest level-0 files into a single level-0 file, for when
+  // level-0 cannot be compacted into the base level.  Returns NULL if too
+  // few files are available.
+  Compaction* PickIntraL0Compaction();
+
+  // Store the files of "level" in *files in the order kMinOverlappingRatio
+  // or kOldestLargestSeqFirst would have them compacted.
+  void OrderFilesByCompactionPri(int level, std::vector<FileMetaData*>* files);
+
+  // Start a compaction of "seed" at "level" and pick up the other files
+  // it needs.  Returns NULL if any of those files is being compacted.
+  Compaction* NewCompactionFrom(int level, FileMetaData* seed);
+
+  // Like NewCompactionFrom(), but the compaction always rewrites "f"
+  // instead of moving it, and a file in the last level is rewritten
+  // into the same level.
+  Compaction* NewRewriteCompaction(int level, FileMetaData* f);
+
+  // Pick the oldest file that is due for a periodic compaction.
+  Compaction* PickPeriodicCompaction();
+
+  // Returns false, leaving the compaction pointers untouched, if any of
+  // the inputs is already being compacted.
+  bool SetupOtherInputs(Compaction* c);
 
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
@@ -324,17 +423,28 @@ class Compaction {
   ~Compaction();
 
   // Return the level that is being compacted.  Inputs from "level"
-  // and "level+1" will be merged to produce a set of "level+1" files.
+  // through "output_level" will be merged to produce a set of
+  // "output_level" files.
   int level() const { return level_; }
 
+  // Return the level the compaction writes to.  This is "level+1",
+  // except for level-0 compactions with Options::dynamic_level_bytes,
+  // which go to the base level, kUniversalCompaction, which may merge
+  // several levels, and compactions that rewrite files in place, e.g.
+  // merging level-0 files with each other.
+  int output_level() const { return output_level_; }
+
+  // Number of levels the inputs are taken from.
+  int num_input_levels() const { return output_level_ - level_ + 1; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
 
-  // "which" must be either 0 or 1
+  // "which" must be in [0, num_input_levels())
   int num_input_files(int which) const { return inputs_[which].size(); }
 
-  // Return the ith input file at "level()+which" ("which" must be 0 or 1).
+  // Return the ith input file at "level()+which".
   FileMetaData* input(int which, int i) const { return inputs_[which][i]; }
 
   // Maximum size of files to build during this compaction.
@@ -347,48 +457,80 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Position of a walk over the compaction input in key order, as needed
+  // by IsBaseLevelForKey() and ShouldStopBefore().  Every thread that
+  // processes the input (or a key range of it) keeps its own Cursor.
+  struct Cursor {
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L > output_level_).
+    size_t level_ptrs[config::kNumLevels];
+
+    Cursor();
+  };
+
   // Returns true if the information we have available guarantees that
-  // the compaction is producing data in "level+1" for which no data exists
-  // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  // the compaction is producing data in "output_level" for which no data
+  // exists in levels greater than "output_level".
+  // REQUIRES: keys passed with the same *cursor are in increasing order.
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) const;
+
+  // Like IsBaseLevelForKey(), for all user keys in [begin, end).
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end) const;
+
+  // Returns true iff the records the compaction output still references
+  // in blob file "number" should be copied to a new blob file.
+  bool BlobFileNeedsGC(uint64_t number) const {
+    return input_version_->BlobFileNeedsGC(number);
+  }
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  // REQUIRES: keys passed with the same *cursor are in increasing order.
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor) const;
+
+  // Store in *boundaries up to "n-1" sorted user keys, taken from the
+  // boundaries of the input files, that split the input into at most "n"
+  // key ranges which can be compacted independently.  Stores nothing if
+  // the input cannot be split.
+  void GetSubcompactionBoundaries(int n,
+                                  std::vector<std::string>* boundaries) const;
 
   // Release the input version for the compaction, once the compaction
   // is successful.
   void ReleaseInputs();
 
+  // Claim (or give back) all inputs of this compaction so that compactions
+  // picked concurrently by other threads do not touch the same files.
+  // REQUIRES: lock is held
+  void MarkInputsBeingCompacted(bool value);
+
  private:
   friend class Version;
   friend class VersionSet;
 
-  explicit Compaction(int level);
+  Compaction(int level, int output_level);
 
   int level_;
+  int output_level_;
   uint64_t max_output_file_size_;
+  bool allow_trivial_move_;   // False if the inputs must be rewritten
   Version* input_version_;
   VersionEdit edit_;
 
-  // Each compaction reads inputs from "level_" and "level_+1"
-  std::vector<FileMetaData*> inputs_[2];      // The two sets of inputs
+  // Each compaction reads inputs from "level_" through "output_level_";
+  // inputs_[i] holds the files taken from "level_+i".
+  std::vector<FileMetaData*> inputs_[config::kNumLevels];
 
   // State used to check for number of of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace leveldb
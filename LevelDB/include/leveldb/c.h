@@ -89,6 +89,13 @@ extern void leveldb_delete(
     const char* key, size_t keylen,
     char** errptr);
 
+extern void leveldb_delete_range(
+    leveldb_t* db,
+    const leveldb_writeoptions_t* options,
+    const char* begin_key, size_t begin_keylen,
+    const char* end_key, size_t end_keylen,
+    char** errptr);
+
 extern void leveldb_write(
     leveldb_t* db,
     const leveldb_writeoptions_t* options,
@@ -133,6 +140,13 @@ extern void leveldb_compact_range(
     const char* start_key, size_t start_key_len,
     const char* limit_key, size_t limit_key_len);
 
+extern void leveldb_delete_files_in_range(
+    leveldb_t* db,
+    const char* start_key, size_t start_key_len,
+    const char* limit_key, size_t limit_key_len,
+    unsigned char ignore_snapshots,
+    char** errptr);
+
 /* Management operations */
 
 extern void leveldb_destroy_db(
@@ -170,6 +184,10 @@ extern void leveldb_writebatch_put(
 extern void leveldb_writebatch_delete(
     leveldb_writebatch_t*,
     const char* key, size_t klen);
+extern void leveldb_writebatch_delete_range(
+    leveldb_writebatch_t*,
+    const char* begin_key, size_t begin_klen,
+    const char* end_key, size_t end_klen);
 extern void leveldb_writebatch_iterate(
     leveldb_writebatch_t*,
     void* state,
@@ -202,7 +220,10 @@ extern void leveldb_options_set_block_restart_interval(leveldb_options_t*, int);
 
 enum {
   leveldb_no_compression = 0,
-  leveldb_snappy_compression = 1
+  leveldb_snappy_compression = 1,
+  leveldb_zlib_compression = 2,
+  leveldb_lz4_compression = 3,
+  leveldb_zstd_compression = 4
 };
 extern void leveldb_options_set_compression(leveldb_options_t*, int);
 
@@ -0,0 +1,58 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a custom CompactionFilter object.
+// The filter is shown the entries that background compactions rewrite
+// and may drop them or replace their values, e.g. to expire data
+// without issuing a Delete for every key.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <string>
+
+namespace leveldb {
+
+class Slice;
+
+class CompactionFilter {
+ public:
+  virtual ~CompactionFilter();
+
+  // What should happen to an entry.
+  enum Decision {
+    kKeep,          // Write the entry unchanged
+    kRemove,        // Remove the key, as if it had been deleted
+    kChangeValue    // Write the entry with the value stored in *new_value
+  };
+
+  // Describes where an entry is being written to.
+  struct Context {
+    // Level the compaction writes to.
+    int level;
+
+    // True if no older data for the key can exist below "level", so that
+    // a removed key is dropped for good instead of being replaced by a
+    // deletion marker.
+    bool is_bottommost_level;
+  };
+
+  // Return the name of this filter.  Used for logging only.
+  virtual const char* Name() const = 0;
+
+  // Called for the newest value of "user_key" in a compaction, when no
+  // snapshot can see that value.  Entries written by memtable flushes,
+  // deletion markers, merge operands and values that are still visible
+  // in a snapshot are not passed to the filter.
+  //
+  // This method may be called concurrently from several threads.
+  virtual Decision Filter(const Context& context,
+                          const Slice& user_key,
+                          const Slice& value,
+                          std::string* new_value) const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
@@ -0,0 +1,84 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Compressor turns the contents of a table block into a smaller form
+// and back.  Each block records the CompressionType it was stored with
+// in its trailer, and readers look up the Compressor registered for that
+// type to restore it.  leveldb registers the built-in codecs that were
+// available when it was compiled; applications may register their own
+// codecs under other type values.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPRESSOR_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPRESSOR_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+class Slice;
+
+class Compressor {
+ public:
+  virtual ~Compressor();
+
+  // Return the name of this codec.  Used by db_bench and for logging.
+  virtual const char* Name() const = 0;
+
+  // Store the compressed form of "input" in *output and return true.
+  // Return false if the codec is not usable, in which case the block
+  // is stored uncompressed.
+  virtual bool Compress(const Slice& input, std::string* output) const = 0;
+
+  // Store in *length the size "input" has once uncompressed.  Return
+  // false if "input" is not a valid compressed block.
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* length) const = 0;
+
+  // Uncompress "input" into output[0,n-1], where n is the length
+  // reported by GetUncompressedLength().  Return false if "input" is
+  // not a valid compressed block.
+  virtual bool Uncompress(const Slice& input, char* output) const = 0;
+
+  // Store in *dictionary at most "max_bytes" of data that helps to
+  // compress blocks like "samples", and return true.  Return false if
+  // the codec cannot use dictionaries.
+  //
+  // The default implementation returns false.
+  virtual bool TrainDictionary(const std::vector<Slice>& samples,
+                               size_t max_bytes,
+                               std::string* dictionary) const;
+
+  // Like Compress() and Uncompress(), for blocks compressed with a
+  // dictionary returned by TrainDictionary().  Blocks compressed with a
+  // dictionary can only be uncompressed with the same dictionary.
+  //
+  // The default implementations return false.
+  virtual bool CompressWithDictionary(const Slice& dictionary,
+                                      const Slice& input,
+                                      std::string* output) const;
+  virtual bool UncompressWithDictionary(const Slice& dictionary,
+                                        const Slice& input,
+                                        char* output) const;
+};
+
+// Use "compressor" for blocks whose trailer records "type", replacing
+// any codec registered for it before.  The caller keeps ownership of
+// "compressor", which must live until the process exits.  Types other
+// than those listed in CompressionType are free for applications to
+// use; kNoCompression cannot be registered.
+//
+// REQUIRES: no database is open while this is called.
+extern void RegisterCompressor(CompressionType type,
+                               const Compressor* compressor);
+
+// Return the codec registered for "type", or NULL if none is.  NULL is
+// returned for codecs that were not available when leveldb was built.
+extern const Compressor* GetCompressor(CompressionType type);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPRESSOR_H_
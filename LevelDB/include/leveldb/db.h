@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/table_properties.h"
 
 namespace leveldb {
 
@@ -68,6 +69,22 @@ class DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for all keys in ["begin", "end"),
+  // as ordered by the comparator.  The cost of this call does not depend
+  // on the number of keys in the range.  Returns OK on success, and a
+  // non-OK status on error.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin, const Slice& end) = 0;
+
+  // Record "value" as a merge operand for "key", to be applied to the
+  // current value of "key" by options.merge_operator when it is read.
+  // Returns OK on success, and a non-OK status on error, including when
+  // the database has no merge_operator.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options,
+                       const Slice& key, const Slice& value) = 0;
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -115,6 +132,12 @@ class DB {
   //     about the internal operation of the DB.
   //  "leveldb.sstables" - returns a multi-line string that describes all
   //     of the sstables that make up the db contents.
+  //  "leveldb.write-amplification" - returns the number of bytes written
+  //     to table files by flushes and compactions for every byte written
+  //     to the DB since it was opened.
+  //  "leveldb.blob-stats" - returns a multi-line string with the number
+  //     of blob files and how many of their records are garbage (see
+  //     Options::min_blob_size).
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -140,6 +163,37 @@ class DB {
   //    db->CompactRange(NULL, NULL);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
 
+  // Remove every table file outside level-0 whose keys all lie within
+  // [*begin,*end], in a single change to the set of files.  No data is
+  // rewritten, so the space is reclaimed much faster than by deleting the
+  // keys and compacting them away.  Files that a running compaction is
+  // reading are left alone.
+  //
+  // This is not a logical deletion: keys in the range that live in
+  // level-0, in the memtable or in files that extend beyond the range
+  // are kept, and older values of a removed key may become visible
+  // again.  Callers that need the range to be empty should follow up
+  // with DeleteRange() over the same keys.
+  //
+  // Removed files would also vanish from any snapshot that can still see
+  // them, so an error is returned while snapshots exist unless
+  // "ignore_snapshots" is true.
+  //
+  // begin==NULL is treated as a key before all keys in the database.
+  // end==NULL is treated as a key after all keys in the database.
+  //
+  // The default implementation returns a NotSupported error.
+  virtual Status DeleteFilesInRange(const Slice* begin, const Slice* end,
+                                    bool ignore_snapshots);
+
+  // Store in *props the properties of every table file of the database,
+  // keyed by file name.  Only the meta blocks of the tables are read.
+  // Tables written by releases that did not store properties report the
+  // entry and deletion counts and the largest sequence number recorded
+  // for them in the manifest, with range deletions counted among both
+  // entries and deletions.
+  virtual Status GetPropertiesOfAllTables(TablePropertiesCollection* props) = 0;
+
  private:
   // No copying allowed
   DB(const DB&);
@@ -125,6 +125,12 @@ class Env {
       void (*function)(void* arg),
       void* arg) = 0;
 
+  // Allow up to "number" background threads to run Schedule()d work
+  // concurrently.  The pool never shrinks: a request for fewer threads
+  // than are already allowed is ignored.  The default implementation
+  // does nothing, which leaves the degree of parallelism up to the Env.
+  virtual void SetBackgroundThreads(int number) { }
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -309,6 +315,9 @@ class EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) {
     return target_->Schedule(f, a);
   }
+  void SetBackgroundThreads(int number) {
+    return target_->SetBackgroundThreads(number);
+  }
   void StartThread(void (*f)(void*), void* a) {
     return target_->StartThread(f, a);
   }
@@ -0,0 +1,58 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a custom MergeOperator object.
+// DB::Merge() records an operand for a key without reading its current
+// value, e.g. an amount to add to a counter or an item to append to a
+// list.  The operator applies the operands to the value they modify when
+// the key is read, and background compactions combine them so that they
+// do not pile up.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include <vector>
+
+namespace leveldb {
+
+class Slice;
+
+class MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // Return the name of this operator.  Used for logging only.
+  virtual const char* Name() const = 0;
+
+  // Store in *new_value the result of applying "operands", oldest first,
+  // to *existing_value, and return true.  existing_value is NULL if the
+  // key has no value, because it was never written or it was deleted.
+  // Return false if the operands cannot be applied; the read or
+  // compaction that needed the result fails with a Corruption error.
+  //
+  // This method may be called concurrently from several threads.
+  virtual bool FullMerge(const Slice& key,
+                         const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const = 0;
+
+  // Store in *new_value a single operand with the same effect as applying
+  // "left_operand" and then "right_operand", and return true.  Return
+  // false if the two cannot be combined without the value they apply to;
+  // they are then kept as they are.  Compactions use this to shrink runs
+  // of operands whose value lies in another level.
+  //
+  // The default implementation returns false.
+  //
+  // This method may be called concurrently from several threads.
+  virtual bool PartialMerge(const Slice& key,
+                            const Slice& left_operand,
+                            const Slice& right_operand,
+                            std::string* new_value) const;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
@@ -6,14 +6,18 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <vector>
 
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
+class RateLimiter;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -24,7 +28,63 @@ enum CompressionType {
   // NOTE: do not change the values of existing entries, as these are
   // part of the persistent format on disk.
   kNoCompression     = 0x0,
-  kSnappyCompression = 0x1
+  kSnappyCompression = 0x1,
+  kZlibCompression   = 0x2,
+  kLZ4Compression    = 0x3,
+  kZstdCompression   = 0x4
+};
+
+// How table files are merged in the background.
+enum CompactionStyle {
+  // Each level is kept 10 times larger than the one before it, and a
+  // file is merged into the overlapping files of the next level.  Reads
+  // and space usage are cheap, writes are rewritten many times.
+  kLevelCompaction     = 0x0,
+
+  // Each level-0 file and each deeper level is a sorted run, and
+  // neighbouring runs of similar size are merged together.  Data is
+  // rewritten far less often, at the cost of more runs to read.
+  kUniversalCompaction = 0x1
+};
+
+// Which file of a level kLevelCompaction merges into the next level.
+enum CompactionPri {
+  // Files are picked in turn, each after the key range of the last one.
+  kRoundRobin            = 0x0,
+
+  // The file with the fewest bytes overlapping it in the next level
+  // relative to its own size, so that the least data is rewritten per
+  // byte moved down.
+  kMinOverlappingRatio   = 0x1,
+
+  // The file whose newest entry is the oldest, so that data which is no
+  // longer written to moves down first.
+  kOldestLargestSeqFirst = 0x2
+};
+
+// Layout of table files.  Tables of either format can be read whatever
+// format the database writes.
+enum TableFormat {
+  // Sorted, optionally compressed blocks found through an index block
+  // and kept in the block cache once read.
+  kBlockBasedTable = 0x0,
+
+  // Uncompressed records one after another, with a hash index over their
+  // user keys.  Reads decode records in place, without copies, block
+  // decoding or cache lookups.  Meant for data that stays in memory, e.g.
+  // on tmpfs, with an Env whose RandomAccessFiles map the file into
+  // memory; other Envs load the whole file when the table is opened.
+  // block_size, block_cache, compression and filter_policy do not apply.
+  // A table file must stay below 4GB.
+  kPlainTable = 0x1,
+
+  // Uncompressed records grouped into buckets by a hash of their user
+  // keys.  Only the bucket offsets stay in memory, and a Get reads the
+  // one bucket of its key, without searching an index block or a data
+  // block.  Iterators read and sort the whole table, so this is meant
+  // for data that is read by Get only.  block_cache, compression and
+  // filter_policy do not apply.  A table file must stay below 4GB.
+  kHashTable = 0x2
 };
 
 // Options to control the behavior of a database (passed to DB::Open)
@@ -89,6 +149,101 @@ struct Options {
   // Default: 1000
   int max_open_files;
 
+  // Maximum number of compactions that may run concurrently in the
+  // background.  Memtable flushes and compactions of non-overlapping
+  // key ranges are then allowed to proceed in parallel.  The DB asks
+  // "env" for at least this many background threads.
+  //
+  // Default: 1
+  int max_background_compactions;
+
+  // Maximum number of threads a single compaction is split across.  If
+  // larger than 1, the input of a compaction is cut into this many key
+  // ranges at input file boundaries, each range is merged and written by
+  // its own thread, and all outputs are installed together.
+  //
+  // Default: 1
+  int max_subcompactions;
+
+  // If true, each compaction reads its input and writes its output in
+  // threads of their own, so that reading and decompressing input blocks,
+  // merging, compressing output blocks and writing output files overlap
+  // instead of taking turns.  Output blocks are compressed by
+  // max(compression_threads, 2) threads.  Up to about 1MB per compaction
+  // is buffered between the threads.
+  //
+  // Default: false
+  bool pipelined_compaction;
+
+  // Size limit of level-1.  Each following level may hold
+  // "max_bytes_for_level_multiplier" times as much as the one before.
+  //
+  // Default: 10MB
+  size_t max_bytes_for_level_base;
+
+  // Default: 10
+  int max_bytes_for_level_multiplier;
+
+  // If true, level size limits are derived backwards from the size of
+  // the largest level instead of growing forward from
+  // max_bytes_for_level_base, so that the largest level holds most of the
+  // data whatever the size of the DB.  Level-0 files are then compacted
+  // into the deepest level whose limit is within max_bytes_for_level_base
+  // (the base level), and the levels above it are left empty.  Space
+  // amplification stays close to 1 + 1/max_bytes_for_level_multiplier.
+  //
+  // Default: false
+  bool dynamic_level_bytes;
+
+  // Strategy used to pick background compactions.
+  //
+  // Default: kLevelCompaction
+  CompactionStyle compaction_style;
+
+  // With kUniversalCompaction, a sorted run is merged together with the
+  // older runs that follow it as long as the next run is at most this
+  // many percent larger than the runs collected so far.
+  //
+  // Default: 1
+  int universal_size_ratio;
+
+  // With kUniversalCompaction, a compaction starts once there are more
+  // than this many sorted runs.  Runs that are not similar in size are
+  // then merged as well, starting with the newest ones.  Values at or
+  // above the number of level-0 files that slows down writes are clipped.
+  //
+  // Default: 4
+  int universal_max_sorted_runs;
+
+  // With kLevelCompaction, how the file that a compaction starts from is
+  // picked among the files of a level that has grown too large.
+  //
+  // Default: kRoundRobin
+  CompactionPri compaction_pri;
+
+  // With kLevelCompaction, a table file outside the last level in which
+  // deletion markers and range tombstones make up more than this fraction
+  // of the entries is compacted even if its level is within its size
+  // limit.  The space of deleted data is then reclaimed without waiting
+  // for new writes to its key range.  Zero disables this.
+  //
+  // Default: 0
+  double deletion_compaction_ratio;
+
+  // With kLevelCompaction, table files written more than this many
+  // seconds ago are compacted even if nothing else would compact them,
+  // e.g. so that the compaction filter sees all data regularly.  Files in
+  // the last level are rewritten in place.  Ages are checked whenever the
+  // set of files changes and on reads and writes.  Zero disables this.
+  //
+  // Default: 0
+  int periodic_compaction_seconds;
+
+  // Layout of the table files written by memtable flushes and compactions.
+  //
+  // Default: kBlockBasedTable
+  TableFormat table_format;
+
   // Control over blocks (user data is stored in a set of blocks, and
   // a block is the unit of reading from disk).
 
@@ -112,6 +267,28 @@ struct Options {
   // Default: 16
   int block_restart_interval;
 
+  // Encoding of the entries of data blocks.  Version 1 is the original
+  // encoding.  Version 2 stores the sequence number and type of each
+  // key of the database as a delta from those of the previous key, and
+  // leaves out the value lengths of blocks whose values all have the
+  // same size.  Blocks of either version can be read whatever the
+  // setting, but releases before version 2 was added cannot read tables
+  // written with it.
+  //
+  // Default: 1
+  int block_format_version;
+
+  // Whether the keys of the tables being built are internal keys of a
+  // database, whose last eight bytes pack a sequence number and a value
+  // type.  Tables of such keys record their sequence numbers and
+  // deletions in the table properties, leave the eight bytes out of the
+  // hashes of kPlainTable and kHashTable tables, and delta-encode them in
+  // version 2 blocks.  The database sets this for the tables it writes;
+  // other users of TableBuilder should leave it alone.
+  //
+  // Default: false
+  bool internal_keys;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -126,8 +303,73 @@ struct Options {
   // worth switching to kNoCompression.  Even if the input data is
   // incompressible, the kSnappyCompression implementation will
   // efficiently detect that and will switch to uncompressed mode.
+  //
+  // Blocks are stored uncompressed if no codec is registered for the
+  // type (see leveldb/compressor.h), e.g. because zlib, LZ4 or zstd was
+  // not available when leveldb was built.
   CompressionType compression;
 
+  // If non-empty, the table files written to level L are compressed with
+  // compression_per_level[L] instead of "compression", and levels beyond
+  // the end of the vector use its last entry.  For example, {kNoCompression,
+  // kNoCompression, kSnappyCompression, kZstdCompression} leaves the
+  // busiest levels cheap to write and makes the largest ones small.
+  // Memtable flushes use the entry for level 0.
+  //
+  // Default: empty
+  std::vector<CompressionType> compression_per_level;
+
+  // If non-zero, each table file written by a compaction holds back its
+  // first data blocks as samples, builds a compression dictionary of up
+  // to this many bytes from them, and compresses all of its data blocks
+  // with it.  The dictionary is stored in the file.  This helps when
+  // values have much in common with each other but little within one
+  // block, e.g. small JSON documents.  Only codecs that support
+  // dictionaries (zlib and zstd) use it, and files too small to fill the
+  // samples are compressed without one.  Memtable flushes never use a
+  // dictionary.
+  //
+  // Default: 0
+  size_t compression_dictionary_bytes;
+
+  // Number of threads that compress the data blocks of each table file
+  // being written, by memtable flushes, compactions and other users of
+  // TableBuilder.  With 1, blocks are compressed by the thread building
+  // the table.  With more, finished blocks are handed to a pool of
+  // threads shared by all tables being written in the process, which
+  // grows to the largest compression_threads in use, and up to 4 blocks
+  // per thread are held in memory until they have been compressed and
+  // written in order.  The file contents are the same either way.
+  //
+  // Default: 1
+  int compression_threads;
+
+  // If non-zero, memtable flushes and compactions store values of at
+  // least this many bytes in separate blob files, and the table files
+  // only hold small references to them.  Compactions then no longer
+  // rewrite large values, which lowers write amplification for
+  // databases with large values, at the cost of an extra read for each
+  // such value.  Changing the setting only affects data written later.
+  //
+  // Default: 0
+  size_t min_blob_size;
+
+  // Blob files written by compactions are closed once they reach this
+  // many bytes.
+  //
+  // Default: 256MB
+  size_t blob_file_size;
+
+  // Once this fraction of the bytes of a blob file belong to values that
+  // were overwritten or deleted, the table files that reference the
+  // blob file are compacted, and the compactions copy the values that
+  // are still live to new blob files.  The blob file is deleted when
+  // none of its values are referenced any more.  Zero disables this, so
+  // that blob files are only deleted once all of their values are gone.
+  //
+  // Default: 0.5
+  double blob_gc_ratio;
+
   // If non-NULL, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
@@ -135,6 +377,27 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // If non-NULL, compactions pass the entries they rewrite through the
+  // specified filter, which may drop them or change their values.
+  //
+  // Default: NULL
+  const CompactionFilter* compaction_filter;
+
+  // If non-NULL, DB::Merge() may be used, and reads and compactions
+  // apply the merge operands it records with the specified operator.
+  // A database that holds merge operands must be opened with an
+  // operator that understands them.
+  //
+  // Default: NULL
+  const MergeOperator* merge_operator;
+
+  // If non-NULL, memtable flushes and compactions ask the specified
+  // limiter for permission before writing to table files, with flushes
+  // served first.  Writes to the log are not limited.
+  //
+  // Default: NULL
+  RateLimiter* rate_limiter;
+
   // Create an Options object with default values for all fields.
   Options();
 };
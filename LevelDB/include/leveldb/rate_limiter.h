@@ -0,0 +1,74 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a RateLimiter object that bounds the
+// rate at which memtable flushes and compactions write table files, so
+// that background work leaves disk bandwidth for foreground reads.
+//
+// A single RateLimiter may be shared by several databases to bound their
+// combined background writes.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <stdint.h>
+
+namespace leveldb {
+
+class Env;
+
+class RateLimiter {
+ public:
+  virtual ~RateLimiter();
+
+  enum Priority {
+    kLowPriority = 0,   // Compactions
+    kHighPriority = 1   // Memtable flushes
+  };
+
+  // Block until "bytes" more bytes may be written.  Waiting requests
+  // with kHighPriority are granted before any waiting kLowPriority ones.
+  // May be called concurrently from several threads.
+  virtual void Request(int64_t bytes, Priority priority) = 0;
+
+  // Change the budget to "bytes_per_second".  REQUIRES: bytes_per_second > 0
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) = 0;
+
+  // Return the rate currently enforced, which auto-tuned limiters derive
+  // from the configured budget and the reported compaction pressure.
+  virtual int64_t GetBytesPerSecond() const = 0;
+
+  // Called by the database whenever its set of files changes, with the
+  // compaction score of the level most in need of compaction.  A score
+  // of 1 or more means compactions are due; 2 means they have fallen far
+  // enough behind to slow down writes.
+  virtual void SetCompactionPressure(double pressure) = 0;
+
+  // Return the total number of microseconds requests with "priority"
+  // have spent waiting.
+  virtual uint64_t GetThrottledMicros(Priority priority) const = 0;
+
+  // Return the total number of bytes requested with "priority".
+  virtual uint64_t GetTotalBytes(Priority priority) const = 0;
+};
+
+// Return a new rate limiter that lets background writes proceed at
+// "bytes_per_second" on average, with bursts of up to a tenth of a
+// second's worth.
+//
+// If "auto_tuned" is true, "bytes_per_second" is the upper bound of the
+// rate, which then follows the reported compaction pressure: a quarter
+// of the bound while there is little compaction work to do, rising to
+// the full bound as the pressure reaches 2.
+extern RateLimiter* NewRateLimiter(int64_t bytes_per_second, bool auto_tuned);
+
+// Like NewRateLimiter(), but reads the time from and sleeps through "env"
+// rather than Env::Default().  "env" must remain live while the returned
+// rate limiter is in use.
+extern RateLimiter* NewRateLimiter(Env* env, int64_t bytes_per_second,
+                                   bool auto_tuned);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
@@ -17,6 +17,7 @@ struct Options;
 class RandomAccessFile;
 struct ReadOptions;
 class TableCache;
+struct TableProperties;
 
 // A Table is a sorted map from strings to strings.  Tables are
 // immutable and persistent.  A Table may be safely accessed from
@@ -55,6 +56,11 @@ class Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Returns the properties stored in the table, or NULL if it has none
+  // because it was written by an older release or is a plain or hash
+  // table.
+  const TableProperties* GetProperties() const;
+
  private:
   struct Rep;
   Rep* rep_;
@@ -71,9 +77,14 @@ class Table {
       void* arg,
       void (*handle_result)(void* arg, const Slice& k, const Slice& v));
 
+  // Returns a new iterator over the range deletion entries of the table.
+  Iterator* NewRangeDeletionIterator() const;
 
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadRangeDeletions(const Slice& handle_value);
+  void ReadDictionary(const Slice& handle_value);
+  void ReadProperties(const Slice& handle_value);
 
   // No copying allowed
   Table(const Table&);
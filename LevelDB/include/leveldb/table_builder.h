@@ -21,6 +21,7 @@ namespace leveldb {
 
 class BlockBuilder;
 class BlockHandle;
+struct TableProperties;
 class WritableFile;
 
 class TableBuilder {
@@ -46,6 +47,14 @@ class TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Add a range deletion entry to the table being constructed.  These
+  // entries are kept in a meta block of their own and are not returned
+  // by the table's iterators.
+  // REQUIRES: key is after any previously added range deletion key
+  // according to comparator.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddRangeDeletion(const Slice& key, const Slice& value);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -70,6 +79,11 @@ class TableBuilder {
   // Number of calls to Add() so far.
   uint64_t NumEntries() const;
 
+  // Properties of the entries added so far.  After a successful Finish()
+  // call, the properties stored in the table, which are only stored in
+  // tables in the kBlockBasedTable format.
+  const TableProperties& GetProperties() const;
+
   // Size of the file generated so far.  If invoked after a successful
   // Finish() call, returns the size of the final generated file.
   uint64_t FileSize() const;
@@ -77,7 +91,12 @@ class TableBuilder {
  private:
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  CompressionType ChooseCompression();
+  void RecordCompression(int result);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  void WritePendingBlocks(bool all);
+  void BuildDictionary();
+  static void CompressNextBlock(void* arg);
 
   struct Rep;
   Rep* rep_;
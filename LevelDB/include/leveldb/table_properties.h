@@ -0,0 +1,66 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// TableProperties are statistics that TableBuilder gathers about the
+// contents of a table while building it, and stores in a meta block of
+// the table.  They can be read without reading any data block.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
+#define STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+struct TableProperties {
+  // Entries added with TableBuilder::Add()
+  uint64_t num_entries;
+
+  // Deletion markers among those entries, and entries added with
+  // TableBuilder::AddRangeDeletion().  Only known for the tables of a
+  // database, which hold the internal keys the database encodes.
+  uint64_t num_deletions;
+  uint64_t num_range_deletions;
+
+  // Total size of the keys and of the values of the entries
+  uint64_t raw_key_size;
+  uint64_t raw_value_size;
+
+  // Number of data blocks, and size in the file of the data blocks, the
+  // index block and the filter block, including block trailers
+  uint64_t num_data_blocks;
+  uint64_t data_size;
+  uint64_t index_size;
+  uint64_t filter_size;
+
+  // Compression that the data blocks were written with.  Blocks that did
+  // not compress well enough are stored uncompressed.
+  CompressionType compression;
+
+  // Data blocks stored uncompressed because they did not compress well
+  // enough, and data blocks that compression was not tried on because
+  // the blocks before them did not compress well enough either
+  uint64_t num_incompressible_blocks;
+  uint64_t num_compression_skipped_blocks;
+
+  // Smallest and largest sequence number of the entries and range
+  // deletions of a database table; both 0 for other tables.
+  uint64_t smallest_seqno;
+  uint64_t largest_seqno;
+
+  TableProperties();
+
+  // Return a human-readable summary of the properties
+  std::string ToString() const;
+};
+
+// Properties of the tables of a database, keyed by file name
+typedef std::map<std::string, TableProperties> TablePropertiesCollection;
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
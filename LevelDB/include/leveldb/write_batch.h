@@ -39,6 +39,14 @@ class WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase the mappings for all keys in ["begin", "end"), as ordered by
+  // the database comparator.  Keys written after this call are not
+  // affected.
+  void DeleteRange(const Slice& begin, const Slice& end);
+
+  // Record "value" as a merge operand for "key".  See DB::Merge().
+  void Merge(const Slice& key, const Slice& value);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -48,6 +56,10 @@ class WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // The default implementation ignores range deletions.
+    virtual void DeleteRange(const Slice& begin, const Slice& end);
+    // The default implementation ignores merge operands.
+    virtual void Merge(const Slice& key, const Slice& value);
   };
   Status Iterate(Handler* handler) const;
 
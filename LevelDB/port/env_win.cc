@@ -177,7 +177,7 @@ const int iRetryCount = 30;
 
 class WinEnv : public Env {
  public:
-  WinEnv() : bgsignal_(&mu_), started_bgthread_(false) { }
+  WinEnv() : bgsignal_(&mu_), started_bgthreads_(0), max_bgthreads_(1) { }
   virtual ~WinEnv() {
     fprintf(stderr, "Destroying Env::Default()\n");
     exit(1);
@@ -353,6 +353,7 @@ class WinEnv : public Env {
   }
 
   virtual void Schedule(void (*function)(void*), void* arg);
+  virtual void SetBackgroundThreads(int number);
   virtual void StartThread(void (*function)(void* arg), void* arg);
 
   virtual Status GetTestDirectory(std::string* result) {
@@ -428,7 +429,8 @@ class WinEnv : public Env {
 
   leveldb::port::Mutex mu_;
   leveldb::port::CondVar bgsignal_;
-  bool started_bgthread_;
+  int started_bgthreads_;
+  int max_bgthreads_;    // Size the pool may grow to; see SetBackgroundThreads
 
   // Entry per Schedule() call
   struct BGItem {
@@ -442,17 +444,16 @@ class WinEnv : public Env {
 void WinEnv::Schedule(void (*function)(void*), void* arg) {
   mu_.Lock();
 
-  // Start background thread if necessary
-  if (!started_bgthread_) {
-     started_bgthread_ = true;
+  // Start background threads if necessary.  Threads are created lazily
+  // so that an Env that never runs background work costs nothing.
+  while (started_bgthreads_ < max_bgthreads_) {
+     started_bgthreads_++;
      StartThread(&WinEnv::BGThreadWrapper, this);
   }
 
-  // If the queue is currently empty, the background thread may currently be
-  // waiting.
-  if (queue_.empty()) {
-    bgsignal_.Signal();
-  }
+  // Several background threads may be waiting, so wake one of them up
+  // for every item we add.
+  bgsignal_.Signal();
 
   // Add to priority queue
   queue_.push_back(BGItem());
@@ -462,6 +463,14 @@ void WinEnv::Schedule(void (*function)(void*), void* arg) {
   mu_.Unlock();
 }
 
+void WinEnv::SetBackgroundThreads(int number) {
+  mu_.Lock();
+  if (number > max_bgthreads_) {
+    max_bgthreads_ = number;
+  }
+  mu_.Unlock();
+}
+
 void WinEnv::BGThread() {
   while (true) {
     // Wait until there is an item that is ready to run
@@ -6,6 +6,7 @@
 
 #include "table/block.h"
 
+#include <string.h>
 #include <vector>
 #include <algorithm>
 #include "leveldb/comparator.h"
@@ -17,22 +18,36 @@ namespace leveldb {
 
 inline uint32_t Block::NumRestarts() const {
   assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  return DecodeFixed32(data_ + size_ - sizeof(uint32_t)) & kBlockRestartsMask;
 }
 
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      flags_(0),
+      value_size_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
   } else {
-    size_t max_restarts_allowed = (size_-sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
+    flags_ = DecodeFixed32(data_ + size_ - sizeof(uint32_t)) &
+             ~kBlockRestartsMask;
+    size_t trailer = sizeof(uint32_t);
+    if (flags_ & kBlockFormat2) {
+      trailer += sizeof(uint32_t);
+    } else if (flags_ != 0) {
+      size_ = 0;  // Unknown format
+      return;
+    }
+    if (size_ < trailer ||
+        NumRestarts() > (size_ - trailer) / sizeof(uint32_t)) {
       // The size is too small for NumRestarts()
       size_ = 0;
     } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      restart_offset_ = size_ - trailer - NumRestarts() * sizeof(uint32_t);
+      if (flags_ & kBlockFormat2) {
+        value_size_ = DecodeFixed32(data_ + size_ - 2 * sizeof(uint32_t));
+      }
     }
   }
 }
@@ -54,20 +69,44 @@ static inline const char* DecodeEntry(const char* p, const char* limit,
                                       uint32_t* shared,
                                       uint32_t* non_shared,
                                       uint32_t* value_length) {
-  if (limit - p < 3) return NULL;
-  *shared = reinterpret_cast<const unsigned char*>(p)[0];
-  *non_shared = reinterpret_cast<const unsigned char*>(p)[1];
-  *value_length = reinterpret_cast<const unsigned char*>(p)[2];
-  if ((*shared | *non_shared | *value_length) < 128) {
-    // Fast path: all three values are encoded in one byte each
-    p += 3;
+  uint32_t header[3];
+  if ((p = GetVarint32Array(p, limit, header, 3)) == NULL) return NULL;
+  *shared = header[0];
+  *non_shared = header[1];
+  *value_length = header[2];
+
+  if (static_cast<uint32_t>(limit - p) < (*non_shared + *value_length)) {
+    return NULL;
+  }
+  return p;
+}
+
+// Like DecodeEntry() for blocks with the kBlockFormat2 flag.  Takes the
+// value length from "value_size" unless it is 0, and decodes the trailer
+// delta into "*trailer_delta" if "elided".
+static inline const char* DecodeEntry2(const char* p, const char* limit,
+                                       uint32_t value_size, bool elided,
+                                       uint32_t* shared,
+                                       uint32_t* non_shared,
+                                       uint32_t* value_length,
+                                       uint64_t* trailer_delta) {
+  uint32_t header[3];
+  if (value_size != 0) {
+    if ((p = GetVarint32Array(p, limit, header, 2)) == NULL) return NULL;
+    header[2] = value_size - 1;
   } else {
-    if ((p = GetVarint32Ptr(p, limit, shared)) == NULL) return NULL;
-    if ((p = GetVarint32Ptr(p, limit, non_shared)) == NULL) return NULL;
-    if ((p = GetVarint32Ptr(p, limit, value_length)) == NULL) return NULL;
+    if ((p = GetVarint32Array(p, limit, header, 3)) == NULL) return NULL;
+  }
+  *shared = header[0];
+  *non_shared = header[1];
+  *value_length = header[2];
+  *trailer_delta = 0;
+  if (elided && (p = GetVarint64Ptr(p, limit, trailer_delta)) == NULL) {
+    return NULL;
   }
 
-  if (static_cast<uint32_t>(limit - p) < (*non_shared + *value_length)) {
+  if (static_cast<uint64_t>(limit - p) <
+      static_cast<uint64_t>(*non_shared) + *value_length) {
     return NULL;
   }
   return p;
@@ -79,6 +118,9 @@ class Block::Iter : public Iterator {
   const char* const data_;      // underlying block contents
   uint32_t const restarts_;     // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_; // Number of uint32_t entries in restart array
+  bool const format2_;          // Entries are encoded with DecodeEntry2()
+  bool const elided_;           // Key trailers are stored as deltas
+  uint32_t const value_size_;   // Size of every value plus one, or 0
 
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
@@ -86,6 +128,23 @@ class Block::Iter : public Iterator {
   std::string key_;
   Slice value_;
   Status status_;
+  std::string restart_key_;     // Restart key being compared by Seek()
+
+  // The entries of one restart interval, decoded in a single pass by
+  // Prev() so that stepping back through the interval does not decode it
+  // again from its restart point for every entry.  The block never
+  // changes, so an entry found here by its offset is always up to date.
+  struct CachedEntry {
+    uint32_t offset;            // Offset of the entry in data_
+    uint32_t key_offset;        // Offset of its key in prev_keys_
+    uint32_t key_size;
+    uint32_t value_offset;      // Offset of its value in data_
+    uint32_t value_size;
+  };
+  std::vector<CachedEntry> prev_entries_;
+  std::string prev_keys_;
+  uint32_t prev_restart_index_; // Restart interval of prev_entries_
+  size_t prev_index_;           // Index of current_ in prev_entries_
 
   inline int Compare(const Slice& a, const Slice& b) const {
     return comparator_->Compare(a, b);
@@ -115,13 +174,20 @@ class Block::Iter : public Iterator {
   Iter(const Comparator* comparator,
        const char* data,
        uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts,
+       uint32_t flags,
+       uint32_t value_size)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        format2_((flags & kBlockFormat2) != 0),
+        elided_((flags & kBlockElidedTrailers) != 0),
+        value_size_(value_size),
         current_(restarts_),
-        restart_index_(num_restarts_) {
+        restart_index_(num_restarts_),
+        prev_restart_index_(num_restarts_),
+        prev_index_(0) {
     assert(num_restarts_ > 0);
   }
 
@@ -144,6 +210,18 @@ class Block::Iter : public Iterator {
   virtual void Prev() {
     assert(Valid());
 
+    if (prev_index_ > 0 && prev_index_ < prev_entries_.size() &&
+        prev_entries_[prev_index_].offset == current_) {
+      // The previous entry is in the same restart interval and decoded
+      prev_index_--;
+      const CachedEntry& entry = prev_entries_[prev_index_];
+      current_ = entry.offset;
+      restart_index_ = prev_restart_index_;
+      key_.assign(prev_keys_.data() + entry.key_offset, entry.key_size);
+      value_ = Slice(data_ + entry.value_offset, entry.value_size);
+      return;
+    }
+
     // Scan backwards to a restart point before current_
     const uint32_t original = current_;
     while (GetRestartPoint(restart_index_) >= original) {
@@ -156,10 +234,27 @@ class Block::Iter : public Iterator {
       restart_index_--;
     }
 
+    // Decode the interval up to the original entry, keeping every entry
+    // for the Prev() calls that follow
     SeekToRestartPoint(restart_index_);
-    do {
-      // Loop until end of current entry hits the start of original entry
-    } while (ParseNextKey() && NextEntryOffset() < original);
+    prev_entries_.clear();
+    prev_keys_.clear();
+    prev_restart_index_ = restart_index_;
+    while (ParseNextKey()) {
+      CachedEntry entry;
+      entry.offset = current_;
+      entry.key_offset = static_cast<uint32_t>(prev_keys_.size());
+      entry.key_size = static_cast<uint32_t>(key_.size());
+      entry.value_offset = static_cast<uint32_t>(value_.data() - data_);
+      entry.value_size = static_cast<uint32_t>(value_.size());
+      prev_entries_.push_back(entry);
+      prev_keys_.append(key_);
+      // Stop when the end of the current entry hits the original entry
+      if (NextEntryOffset() >= original) {
+        break;
+      }
+    }
+    prev_index_ = prev_entries_.size() - 1;
   }
 
   virtual void Seek(const Slice& target) {
@@ -171,14 +266,23 @@ class Block::Iter : public Iterator {
       uint32_t mid = (left + right + 1) / 2;
       uint32_t region_offset = GetRestartPoint(mid);
       uint32_t shared, non_shared, value_length;
-      const char* key_ptr = DecodeEntry(data_ + region_offset,
-                                        data_ + restarts_,
-                                        &shared, &non_shared, &value_length);
+      uint64_t trailer_delta;
+      const char* key_ptr =
+          format2_ ? DecodeEntry2(data_ + region_offset, data_ + restarts_,
+                                  value_size_, elided_, &shared, &non_shared,
+                                  &value_length, &trailer_delta)
+                   : DecodeEntry(data_ + region_offset, data_ + restarts_,
+                                 &shared, &non_shared, &value_length);
       if (key_ptr == NULL || (shared != 0)) {
         CorruptionError();
         return;
       }
       Slice mid_key(key_ptr, non_shared);
+      if (elided_) {
+        restart_key_.assign(key_ptr, non_shared);
+        PutFixed64(&restart_key_, DecodeTrailerDelta(trailer_delta, 0));
+        mid_key = restart_key_;
+      }
       if (Compare(mid_key, target) < 0) {
         // Key at "mid" is smaller than "target".  Therefore all
         // blocks before "mid" are uninteresting.
@@ -236,13 +340,38 @@ class Block::Iter : public Iterator {
 
     // Decode next entry
     uint32_t shared, non_shared, value_length;
-    p = DecodeEntry(p, limit, &shared, &non_shared, &value_length);
+    uint64_t trailer = 0;
+    if (!format2_) {
+      p = DecodeEntry(p, limit, &shared, &non_shared, &value_length);
+    } else {
+      uint64_t trailer_delta;
+      p = DecodeEntry2(p, limit, value_size_, elided_, &shared, &non_shared,
+                       &value_length, &trailer_delta);
+      if (elided_ && p != NULL) {
+        // The trailer is relative to that of the previous key, which ends
+        // key_, unless no bytes are shared with it
+        uint64_t base = 0;
+        if (shared > 0) {
+          if (key_.size() < shared + 8) {
+            p = NULL;
+          } else {
+            base = DecodeFixed64(key_.data() + key_.size() - 8);
+          }
+        }
+        trailer = DecodeTrailerDelta(trailer_delta, base);
+      }
+    }
     if (p == NULL || key_.size() < shared) {
       CorruptionError();
       return false;
     } else {
-      key_.resize(shared);
-      key_.append(p, non_shared);
+      // Rebuild the key in place, changing its size only once
+      key_.resize(shared + non_shared + (elided_ ? 8 : 0));
+      char* dst = &key_[0];
+      memcpy(dst + shared, p, non_shared);
+      if (elided_) {
+        EncodeFixed64(dst + shared + non_shared, trailer);
+      }
       value_ = Slice(p + non_shared, value_length);
       while (restart_index_ + 1 < num_restarts_ &&
              GetRestartPoint(restart_index_ + 1) < current_) {
@@ -261,7 +390,8 @@ Iterator* Block::NewIterator(const Comparator* cmp) {
   if (num_restarts == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(cmp, data_, restart_offset_, num_restarts);
+    return new Iter(cmp, data_, restart_offset_, num_restarts, flags_,
+                    value_size_);
   }
 }
 
@@ -30,6 +30,8 @@ class Block {
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;     // Offset in data_ of restart array
+  uint32_t flags_;              // Format flags of the restart count
+  uint32_t value_size_;         // Size of every value plus one, or 0
   bool owned_;                  // Block owns data_[]
 
   // No copying allowed
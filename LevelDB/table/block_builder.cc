@@ -25,6 +25,22 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// With options.block_format_version 2, the high bits of num_restarts
+// hold flags from table/format.h.  kBlockFormat2 marks the format and
+// adds a field ahead of num_restarts:
+//     value_size: uint32
+// which is one more than the size of every value of the block, or 0 if
+// the sizes differ.  The entries leave out value_length when it is
+// known from value_size.  kBlockElidedTrailers is set when the keys are
+// internal keys: the prefix compression then applies to the user key
+// alone, and the 8-byte sequence number and type that end each key are
+// stored after value_length as
+//     trailer_delta: varint64
+// the zigzag encoded difference from the trailer of the previous key, or
+// from zero when shared_bytes == 0, and are left out of key_delta.
+// Entries of a user key are adjacent and their sequence numbers close
+// together, so the delta usually takes one or two bytes.
 
 #include "table/block_builder.h"
 
@@ -32,6 +48,7 @@
 #include <assert.h>
 #include "leveldb/comparator.h"
 #include "leveldb/table_builder.h"
+#include "table/format.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -40,7 +57,11 @@ BlockBuilder::BlockBuilder(const Options* options)
     : options_(options),
       restarts_(),
       counter_(0),
-      finished_(false) {
+      finished_(false),
+      format2_(false),
+      elide_trailers_(false),
+      fixed_values_(false),
+      value_size_(0) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);       // First restart point is at offset 0
 }
@@ -52,11 +73,16 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  format2_ = false;
+  elide_trailers_ = false;
+  fixed_values_ = false;
+  value_size_ = 0;
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
   return (buffer_.size() +                        // Raw data buffer
           restarts_.size() * sizeof(uint32_t) +   // Restart array
+          (format2_ ? sizeof(uint32_t) : 0) +     // Value size
           sizeof(uint32_t));                      // Restart array length
 }
 
@@ -65,22 +91,80 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  uint32_t num_restarts = restarts_.size();
+  if (format2_) {
+    PutFixed32(&buffer_, fixed_values_ ? value_size_ + 1 : 0);
+    num_restarts |= kBlockFormat2;
+    if (elide_trailers_) {
+      num_restarts |= kBlockElidedTrailers;
+    }
+  }
+  PutFixed32(&buffer_, num_restarts);
   finished_ = true;
   return Slice(buffer_);
 }
 
+void BlockBuilder::ExpandValueLengths() {
+  std::string expanded;
+  expanded.reserve(buffer_.size() + buffer_.size() / 8);
+  size_t restart = 0;
+  const char* p = buffer_.data();
+  const char* limit = p + buffer_.size();
+  while (p < limit) {
+    if (restart < restarts_.size() &&
+        restarts_[restart] == static_cast<uint32_t>(p - buffer_.data())) {
+      restarts_[restart++] = expanded.size();
+    }
+    uint32_t shared, non_shared;
+    uint64_t trailer_delta = 0;
+    p = GetVarint32Ptr(p, limit, &shared);
+    p = GetVarint32Ptr(p, limit, &non_shared);
+    if (elide_trailers_) {
+      p = GetVarint64Ptr(p, limit, &trailer_delta);
+    }
+    PutVarint32(&expanded, shared);
+    PutVarint32(&expanded, non_shared);
+    PutVarint32(&expanded, value_size_);
+    if (elide_trailers_) {
+      PutVarint64(&expanded, trailer_delta);
+    }
+    expanded.append(p, non_shared + value_size_);
+    p += non_shared + value_size_;
+  }
+  assert(restart == restarts_.size());
+  buffer_.swap(expanded);
+  fixed_values_ = false;
+}
+
 void BlockBuilder::Add(const Slice& key, const Slice& value) {
   Slice last_key_piece(last_key_);
   assert(!finished_);
   assert(counter_ <= options_->block_restart_interval);
   assert(buffer_.empty() // No values yet?
          || options_->comparator->Compare(key, last_key_piece) > 0);
+  if (buffer_.empty()) {
+    format2_ = (options_->block_format_version >= 2);
+    elide_trailers_ = format2_ && options_->internal_keys;
+    fixed_values_ = format2_;
+    value_size_ = value.size();
+  } else if (fixed_values_ && value.size() != value_size_) {
+    ExpandValueLengths();
+  }
+
+  // Compress the user key alone when the trailer is stored apart
+  const size_t trailer_size = elide_trailers_ ? 8 : 0;
+  assert(key.size() >= trailer_size);
+  const Slice user_key(key.data(), key.size() - trailer_size);
+  if (elide_trailers_ && !last_key_piece.empty()) {
+    last_key_piece = Slice(last_key_.data(), last_key_.size() - trailer_size);
+  }
+
   size_t shared = 0;
   if (counter_ < options_->block_restart_interval) {
     // See how much sharing to do with previous string
-    const size_t min_length = std::min(last_key_piece.size(), key.size());
-    while ((shared < min_length) && (last_key_piece[shared] == key[shared])) {
+    const size_t min_length = std::min(last_key_piece.size(), user_key.size());
+    while ((shared < min_length) &&
+           (last_key_piece[shared] == user_key[shared])) {
       shared++;
     }
   } else {
@@ -88,20 +172,28 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
     restarts_.push_back(buffer_.size());
     counter_ = 0;
   }
-  const size_t non_shared = key.size() - shared;
+  const size_t non_shared = user_key.size() - shared;
 
   // Add "<shared><non_shared><value_size>" to buffer_
   PutVarint32(&buffer_, shared);
   PutVarint32(&buffer_, non_shared);
-  PutVarint32(&buffer_, value.size());
+  if (!fixed_values_) {
+    PutVarint32(&buffer_, value.size());
+  }
+  if (elide_trailers_) {
+    const uint64_t trailer = DecodeFixed64(key.data() + user_key.size());
+    const uint64_t base = (shared == 0) ? 0 :
+        DecodeFixed64(last_key_.data() + last_key_.size() - trailer_size);
+    PutVarint64(&buffer_, EncodeTrailerDelta(trailer, base));
+  }
 
   // Add string delta to buffer_ followed by value
-  buffer_.append(key.data() + shared, non_shared);
+  buffer_.append(user_key.data() + shared, non_shared);
   buffer_.append(value.data(), value.size());
 
   // Update state
   last_key_.resize(shared);
-  last_key_.append(key.data() + shared, non_shared);
+  last_key_.append(key.data() + shared, key.size() - shared);
   assert(Slice(last_key_) == key);
   counter_++;
 }
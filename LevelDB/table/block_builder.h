@@ -40,6 +40,9 @@ class BlockBuilder {
   }
 
  private:
+  // Insert the value lengths left out of the entries of buffer_ so far
+  void ExpandValueLengths();
+
   const Options*        options_;
   std::string           buffer_;      // Destination buffer
   std::vector<uint32_t> restarts_;    // Restart points
@@ -47,6 +50,12 @@ class BlockBuilder {
   bool                  finished_;    // Has Finish() been called?
   std::string           last_key_;
 
+  // Format of the block, set by the first Add() from options_
+  bool                  format2_;        // block_format_version 2
+  bool                  elide_trailers_; // Keys are internal keys
+  bool                  fixed_values_;   // All values have value_size_ bytes
+  uint32_t              value_size_;
+
   // No copying allowed
   BlockBuilder(const BlockBuilder&);
   void operator=(const BlockBuilder&);
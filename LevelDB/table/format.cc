@@ -4,6 +4,7 @@
 
 #include "table/format.h"
 
+#include "leveldb/compressor.h"
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "table/block.h"
@@ -36,8 +37,8 @@ void Footer::EncodeTo(std::string* dst) const {
   metaindex_handle_.EncodeTo(dst);
   index_handle_.EncodeTo(dst);
   dst->resize(2 * BlockHandle::kMaxEncodedLength);  // Padding
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
-  PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
+  PutFixed32(dst, static_cast<uint32_t>(magic_number_ & 0xffffffffu));
+  PutFixed32(dst, static_cast<uint32_t>(magic_number_ >> 32));
   assert(dst->size() == original_size + kEncodedLength);
 }
 
@@ -47,9 +48,11 @@ Status Footer::DecodeFrom(Slice* input) {
   const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
   const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) |
                           (static_cast<uint64_t>(magic_lo)));
-  if (magic != kTableMagicNumber) {
+  if (magic != kTableMagicNumber && magic != kPlainTableMagicNumber &&
+      magic != kHashTableMagicNumber) {
     return Status::Corruption("not an sstable (bad magic number)");
   }
+  magic_number_ = magic;
 
   Status result = metaindex_handle_.DecodeFrom(input);
   if (result.ok()) {
@@ -66,6 +69,7 @@ Status Footer::DecodeFrom(Slice* input) {
 Status ReadBlock(RandomAccessFile* file,
                  const ReadOptions& options,
                  const BlockHandle& handle,
+                 const Slice& dictionary,
                  BlockContents* result) {
   result->data = Slice();
   result->cachable = false;
@@ -116,14 +120,25 @@ Status ReadBlock(RandomAccessFile* file,
 
       // Ok
       break;
-    case kSnappyCompression: {
+    default: {
+      const Compressor* compressor =
+          GetCompressor(static_cast<CompressionType>(
+              static_cast<unsigned char>(data[n])));
+      if (compressor == NULL) {
+        delete[] buf;
+        return Status::Corruption("bad block type");
+      }
+      Slice compressed(data, n);
       size_t ulength = 0;
-      if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+      if (!compressor->GetUncompressedLength(compressed, &ulength)) {
         delete[] buf;
         return Status::Corruption("corrupted compressed block contents");
       }
       char* ubuf = new char[ulength];
-      if (!port::Snappy_Uncompress(data, n, ubuf)) {
+      if (!(dictionary.empty()
+            ? compressor->Uncompress(compressed, ubuf)
+            : compressor->UncompressWithDictionary(dictionary, compressed,
+                                                   ubuf))) {
         delete[] buf;
         delete[] ubuf;
         return Status::Corruption("corrupted compressed block contents");
@@ -134,9 +149,6 @@ Status ReadBlock(RandomAccessFile* file,
       result->cachable = true;
       break;
     }
-    default:
-      delete[] buf;
-      return Status::Corruption("bad block type");
   }
 
   return Status::OK();
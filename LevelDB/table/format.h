@@ -16,6 +16,7 @@ namespace leveldb {
 class Block;
 class RandomAccessFile;
 struct ReadOptions;
+struct TableProperties;
 
 // BlockHandle is a pointer to the extent of a file that stores a data
 // block or a meta block.
@@ -46,7 +47,11 @@ class BlockHandle {
 // end of every table file.
 class Footer {
  public:
-  Footer() { }
+  Footer();
+
+  // The magic number, which identifies the format of the table
+  uint64_t magic_number() const { return magic_number_; }
+  void set_magic_number(uint64_t magic) { magic_number_ = magic; }
 
   // The block handle for the metaindex block of the table
   const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
@@ -71,6 +76,7 @@ class Footer {
   };
 
  private:
+  uint64_t magic_number_;
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
 };
@@ -80,22 +86,56 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Magic number of tables in the kPlainTable format (see plain_table.h).
+static const uint64_t kPlainTableMagicNumber = 0x8242229663bf9564ull;
+
+// Magic number of tables in the kHashTable format (see hash_table.h).
+static const uint64_t kHashTableMagicNumber = 0x3d0b8c6f15a2e471ull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Flags kept in the high bits of the restart count of blocks written with
+// block_format_version 2 (see block_builder.cc).
+static const uint32_t kBlockFormat2 = 0x80000000u;
+static const uint32_t kBlockElidedTrailers = 0x40000000u;
+static const uint32_t kBlockRestartsMask = 0x3fffffffu;
+
+// Blocks with kBlockElidedTrailers store the 8-byte trailer of each
+// internal key as the difference from the trailer of the previous key,
+// zigzag encoded so that small negative differences stay small.
+inline uint64_t EncodeTrailerDelta(uint64_t trailer, uint64_t base) {
+  const uint64_t delta = trailer - base;
+  return (delta << 1) ^ (0 - (delta >> 63));
+}
+
+inline uint64_t DecodeTrailerDelta(uint64_t encoded, uint64_t base) {
+  return base + ((encoded >> 1) ^ (0 - (encoded & 1)));
+}
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
   bool heap_allocated;  // True iff caller should delete[] data.data()
 };
 
-// Read the block identified by "handle" from "file".  On failure
-// return non-OK.  On success fill *result and return OK.
+// Read the block identified by "handle" from "file", and uncompress it
+// with "dictionary" if that is non-empty.  On failure return non-OK.
+// On success fill *result and return OK.
 extern Status ReadBlock(RandomAccessFile* file,
                         const ReadOptions& options,
                         const BlockHandle& handle,
+                        const Slice& dictionary,
                         BlockContents* result);
 
+// Store in *dst the contents of the properties meta block for "props".
+extern void EncodeTableProperties(const TableProperties& props,
+                                  std::string* dst);
+
+// Parse the contents of a properties meta block into *props.
+extern Status DecodeTableProperties(const Slice& contents,
+                                    TableProperties* props);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
@@ -103,6 +143,10 @@ inline BlockHandle::BlockHandle()
       size_(~static_cast<uint64_t>(0)) {
 }
 
+inline Footer::Footer()
+    : magic_number_(kTableMagicNumber) {
+}
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_TABLE_FORMAT_H_
@@ -0,0 +1,301 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/hash_table.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <vector>
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "table/block.h"
+#include "table/format.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+// Fixed part of the index: data_crc, key_suffix, num_buckets
+static const size_t kIndexHeaderSize = 12;
+
+// Decode the record at the start of "*input" into *key and *value and
+// advance *input past it.  Returns false if the record is corrupted.
+static bool DecodeRecord(Slice* input, Slice* key, Slice* value) {
+  const char* p = input->data();
+  const char* limit = p + input->size();
+  uint32_t key_length, value_length;
+  p = GetVarint32Ptr(p, limit, &key_length);
+  if (p == NULL || static_cast<uint32_t>(limit - p) < key_length) {
+    return false;
+  }
+  *key = Slice(p, key_length);
+  p = GetVarint32Ptr(p + key_length, limit, &value_length);
+  if (p == NULL || static_cast<uint32_t>(limit - p) < value_length) {
+    return false;
+  }
+  *value = Slice(p, value_length);
+  p += value_length;
+  *input = Slice(p, limit - p);
+  return true;
+}
+
+HashTable::HashTable(const Options& options, RandomAccessFile* file)
+    : comparator_(options.comparator),
+      file_(file),
+      index_data_(NULL),
+      data_crc_(0),
+      key_suffix_(0),
+      num_buckets_(0),
+      bucket_start_(NULL),
+      sample_block_(NULL),
+      range_del_block_(NULL) {
+}
+
+HashTable::~HashTable() {
+  delete sample_block_;
+  delete range_del_block_;
+  delete[] index_data_;
+}
+
+Status HashTable::Open(const Options& options,
+                       RandomAccessFile* file,
+                       uint64_t file_size,
+                       const Footer& footer,
+                       HashTable** table) {
+  *table = NULL;
+  ReadOptions opt;
+  if (options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents index;
+  Status s = ReadBlock(file, opt, footer.index_handle(), Slice(), &index);
+  if (!s.ok()) {
+    return s;
+  }
+  HashTable* t = new HashTable(options, file);
+  if (index.heap_allocated) {
+    t->index_data_ = const_cast<char*>(index.data.data());
+  }
+
+  // Check that the index sizes add up before using any of it
+  const Slice input = index.data;
+  const uint64_t data_size = footer.index_handle().offset();
+  bool ok = input.size() >= kIndexHeaderSize;
+  if (ok) {
+    t->data_crc_ = crc32c::Unmask(DecodeFixed32(input.data()));
+    t->key_suffix_ = DecodeFixed32(input.data() + 4);
+    t->num_buckets_ = DecodeFixed32(input.data() + 8);
+    t->bucket_start_ = input.data() + kIndexHeaderSize;
+    ok = (t->num_buckets_ > 0 &&
+          input.size() >= kIndexHeaderSize + 4 * (t->num_buckets_ + 1ull) &&
+          t->BucketStart(0) == 0 &&
+          t->BucketStart(t->num_buckets_) == data_size);
+  }
+  for (uint32_t b = 0; ok && b < t->num_buckets_; b++) {
+    ok = (t->BucketStart(b) <= t->BucketStart(b + 1));
+  }
+  if (ok) {
+    const size_t samples_offset =
+        kIndexHeaderSize + 4 * (t->num_buckets_ + 1);
+    BlockContents samples;
+    samples.data = Slice(input.data() + samples_offset,
+                         input.size() - samples_offset);
+    samples.cachable = false;
+    samples.heap_allocated = false;
+    t->sample_block_ = new Block(samples);
+  } else {
+    s = Status::Corruption("bad hash table index");
+  }
+
+  if (s.ok()) {
+    BlockContents range_dels;
+    s = ReadBlock(file, opt, footer.metaindex_handle(), Slice(),
+                  &range_dels);
+    if (s.ok()) {
+      t->range_del_block_ = new Block(range_dels);
+    }
+  }
+  if (s.ok()) {
+    *table = t;
+  } else {
+    delete t;
+  }
+  return s;
+}
+
+uint32_t HashTable::BucketStart(uint32_t bucket) const {
+  return DecodeFixed32(bucket_start_ + 4 * bucket);
+}
+
+// Iterates over records read from the file and sorted in memory
+class HashTable::Iter : public Iterator {
+ public:
+  Iter(const Comparator* comparator, char* scratch)
+      : comparator_(comparator),
+        scratch_(scratch),
+        current_(0) {
+  }
+
+  virtual ~Iter() {
+    delete[] scratch_;
+  }
+
+  // Add every record of "data" and sort them.  Sets status() on
+  // corruption.
+  void Load(const Slice& data) {
+    Slice input = data;
+    Entry entry;
+    while (!input.empty()) {
+      if (!DecodeRecord(&input, &entry.key, &entry.value)) {
+        SetStatus(Status::Corruption("bad entry in hash table"));
+        return;
+      }
+      entries_.push_back(entry);
+    }
+    std::sort(entries_.begin(), entries_.end(), EntryLess(comparator_));
+    current_ = entries_.size();
+  }
+
+  void SetStatus(const Status& s) {
+    status_ = s;
+    entries_.clear();
+    current_ = 0;
+  }
+
+  virtual bool Valid() const { return current_ < entries_.size(); }
+  virtual Status status() const { return status_; }
+  virtual Slice key() const {
+    assert(Valid());
+    return entries_[current_].key;
+  }
+  virtual Slice value() const {
+    assert(Valid());
+    return entries_[current_].value;
+  }
+
+  virtual void SeekToFirst() { current_ = 0; }
+
+  virtual void SeekToLast() {
+    current_ = entries_.empty() ? 0 : entries_.size() - 1;
+  }
+
+  virtual void Seek(const Slice& target) {
+    Entry entry;
+    entry.key = target;
+    current_ = std::lower_bound(entries_.begin(), entries_.end(), entry,
+                                EntryLess(comparator_)) - entries_.begin();
+  }
+
+  virtual void Next() {
+    assert(Valid());
+    current_++;
+  }
+
+  virtual void Prev() {
+    assert(Valid());
+    current_ = (current_ == 0) ? entries_.size() : current_ - 1;
+  }
+
+ private:
+  struct Entry {
+    Slice key;
+    Slice value;
+  };
+
+  struct EntryLess {
+    const Comparator* comparator;
+    explicit EntryLess(const Comparator* c) : comparator(c) { }
+    bool operator()(const Entry& a, const Entry& b) const {
+      return comparator->Compare(a.key, b.key) < 0;
+    }
+  };
+
+  const Comparator* const comparator_;
+  char* const scratch_;        // Holds the records unless the file is mapped
+  std::vector<Entry> entries_;
+  size_t current_;             // entries_.size() if not valid
+  Status status_;
+};
+
+Iterator* HashTable::NewIterator(const ReadOptions& options) const {
+  const uint32_t data_size = BucketStart(num_buckets_);
+  char* scratch = new char[data_size];
+  Iter* iter = new Iter(comparator_, scratch);
+  Slice data;
+  Status s = file_->Read(0, data_size, &data, scratch);
+  if (s.ok() && data.size() != data_size) {
+    s = Status::Corruption("truncated hash table read");
+  }
+  if (s.ok() && options.verify_checksums &&
+      crc32c::Value(data.data(), data.size()) != data_crc_) {
+    s = Status::Corruption("hash table checksum mismatch");
+  }
+  if (s.ok()) {
+    iter->Load(data);
+  } else {
+    iter->SetStatus(s);
+  }
+  return iter;
+}
+
+Iterator* HashTable::NewRangeDeletionIterator() const {
+  return range_del_block_->NewIterator(comparator_);
+}
+
+Status HashTable::Get(const Slice& k, void* arg,
+                      void (*saver)(void*, const Slice&, const Slice&)) const {
+  if (k.size() < key_suffix_) {
+    return Status::OK();
+  }
+  const Slice hashed(k.data(), k.size() - key_suffix_);
+  const uint32_t b =
+      Hash(hashed.data(), hashed.size(), kHashTableHashSeed) % num_buckets_;
+  const uint32_t start = BucketStart(b);
+  const uint32_t size = BucketStart(b + 1) - start;
+  if (size == 0) {
+    return Status::OK();
+  }
+
+  char stack_space[512];
+  char* scratch = (size <= sizeof(stack_space)) ? stack_space
+                                                : new char[size];
+  Slice bucket;
+  Status s = file_->Read(start, size, &bucket, scratch);
+  if (s.ok() && bucket.size() != size) {
+    s = Status::Corruption("truncated hash table read");
+  }
+  while (s.ok() && !bucket.empty()) {
+    Slice key, value;
+    if (!DecodeRecord(&bucket, &key, &value)) {
+      s = Status::Corruption("bad entry in hash table");
+    } else if (key.size() >= key_suffix_ &&
+               Slice(key.data(), key.size() - key_suffix_) == hashed &&
+               comparator_->Compare(key, k) >= 0) {
+      // The entries of a key are together and sorted within the bucket
+      (*saver)(arg, key, value);
+      break;
+    }
+  }
+  if (scratch != stack_space) {
+    delete[] scratch;
+  }
+  return s;
+}
+
+uint64_t HashTable::ApproximateOffsetOf(const Slice& key) const {
+  // Use the first sample at or after "key", or the size of the records
+  // if all keys are before "key"
+  Iterator* iter = sample_block_->NewIterator(comparator_);
+  iter->Seek(key);
+  uint64_t result = BucketStart(num_buckets_);
+  if (iter->Valid()) {
+    Slice input = iter->value();
+    GetVarint64(&input, &result);
+  }
+  delete iter;
+  return result;
+}
+
+}  // namespace leveldb
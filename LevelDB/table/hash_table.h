@@ -0,0 +1,113 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Tables in the kHashTable format are laid out as:
+//
+//    [bucket 0]
+//    ...
+//    [bucket num_buckets-1]
+//    [index]                 followed by type and crc, as for blocks
+//    [range deletion block]  followed by type and crc
+//    [Footer]                magic number kHashTableMagicNumber
+//
+// Each bucket holds, uncompressed, the records of the keys that hash to
+// it in sorted order.  A record is encoded as in plain tables:
+//    key_length:   varint32
+//    key:          char[key_length]
+//    value_length: varint32
+//    value:        char[value_length]
+//
+// The index starts with fixed32 values:
+//    data_crc:     masked crc32c of all the buckets
+//    key_suffix:   bytes at the end of each key that are not hashed
+//    num_buckets
+//    bucket_start: [num_buckets + 1]
+// followed by the sample block, built by block_builder.cc, which maps
+// the first key of every block_size bytes of records in sorted order,
+// and the last key, to the number of bytes of records that sort before
+// it.
+//
+// Keys are hashed without their last key_suffix bytes, which are the
+// sequence number and type of internal keys, so that all entries of a
+// user key are in the same bucket.  Bucket b occupies bytes
+// bucket_start[b] .. bucket_start[b+1]-1 of the file.
+//
+// The footer's index handle points at the index, whose offset is the
+// size of the buckets, and its metaindex handle at the range deletion
+// block.
+
+#ifndef STORAGE_LEVELDB_TABLE_HASH_TABLE_H_
+#define STORAGE_LEVELDB_TABLE_HASH_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+class Block;
+class Footer;
+class RandomAccessFile;
+
+// Seed of the hash of the keys
+static const uint32_t kHashTableHashSeed = 0x7a3c59e1;
+
+class HashTable {
+ public:
+  // Open the table stored in bytes [0..file_size) of "file", whose footer
+  // has already been decoded into "footer".  Only the index and the range
+  // deletions are read; they stay in memory while the table is open.
+  // Checks their crcs if options.paranoid_checks is set.  On success,
+  // stores the table in *table and returns OK.
+  static Status Open(const Options& options,
+                     RandomAccessFile* file,
+                     uint64_t file_size,
+                     const Footer& footer,
+                     HashTable** table);
+
+  ~HashTable();
+
+  // Reads all the records and sorts them; expensive.  Checks the crc of
+  // the records if options.verify_checksums is set.
+  Iterator* NewIterator(const ReadOptions& options) const;
+
+  // Returns a new iterator over the range deletion entries of the table.
+  Iterator* NewRangeDeletionIterator() const;
+
+  // Calls (*saver)(arg, ...) with the first entry at or after "key" that
+  // has the same hashed part as "key", if any.  Reads the bucket of "key"
+  // from the file, unless it is empty.
+  Status Get(const Slice& key, void* arg,
+             void (*saver)(void* arg, const Slice& k, const Slice& v)) const;
+
+  // Returns the size of the records that sort before "key", rounded up
+  // to the next sampled key
+  uint64_t ApproximateOffsetOf(const Slice& key) const;
+
+ private:
+  class Iter;
+
+  HashTable(const Options& options, RandomAccessFile* file);
+
+  uint32_t BucketStart(uint32_t bucket) const;
+
+  const Comparator* comparator_;
+  RandomAccessFile* file_;
+  char* index_data_;           // Contents of the index, NULL if mapped
+  uint32_t data_crc_;
+  uint32_t key_suffix_;
+  uint32_t num_buckets_;
+  const char* bucket_start_;
+  Block* sample_block_;
+  Block* range_del_block_;
+
+  // No copying allowed
+  HashTable(const HashTable&);
+  void operator=(const HashTable&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_HASH_TABLE_H_
@@ -0,0 +1,183 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/hash_table_builder.h"
+
+#include <assert.h>
+#include <algorithm>
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "table/format.h"
+#include "table/hash_table.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+// Buckets are found by fixed32 offsets
+static const uint64_t kMaxHashTableDataSize = 0xffffffffu;
+
+// Keys of the database are internal keys, whose last 8 bytes hold the
+// sequence number and type.  These are left out of the hash so that all
+// entries of a user key land in the same bucket.
+static size_t KeySuffixLength(const Options& options) {
+  return options.internal_keys ? 8 : 0;
+}
+
+HashTableBuilder::HashTableBuilder(const Options& options,
+                                   WritableFile* file)
+    : options_(options),
+      file_(file),
+      offset_(0),
+      key_suffix_(KeySuffixLength(options)),
+      num_hashed_(0),
+      sample_block_(&options_),
+      last_sample_(0),
+      next_sample_(0),
+      range_del_block_(&options_) {
+}
+
+void HashTableBuilder::Add(const Slice& key, const Slice& value) {
+  if (!status_.ok()) return;
+  assert(key.size() >= key_suffix_);
+
+  const size_t offset = records_.size();
+  if (offset + key.size() + value.size() + 10 > kMaxHashTableDataSize) {
+    status_ = Status::InvalidArgument("hash table larger than 4GB");
+    return;
+  }
+  if (offset >= next_sample_) {
+    std::string encoding;
+    PutVarint64(&encoding, offset);
+    sample_block_.Add(key, encoding);
+    last_sample_ = offset;
+    next_sample_ = offset + options_.block_size;
+  }
+  const Slice hashed(key.data(), key.size() - key_suffix_);
+  if (offsets_.empty() || hashed != Slice(last_hashed_)) {
+    hashes_.push_back(Hash(hashed.data(), hashed.size(), kHashTableHashSeed));
+    last_hashed_.assign(hashed.data(), hashed.size());
+    num_hashed_++;
+  } else {
+    hashes_.push_back(hashes_.back());
+  }
+  offsets_.push_back(static_cast<uint32_t>(offset));
+
+  PutVarint32(&records_, static_cast<uint32_t>(key.size()));
+  records_.append(key.data(), key.size());
+  PutVarint32(&records_, static_cast<uint32_t>(value.size()));
+  records_.append(value.data(), value.size());
+}
+
+void HashTableBuilder::AddRangeDeletion(const Slice& key,
+                                        const Slice& value) {
+  if (!status_.ok()) return;
+  range_del_block_.Add(key, value);
+}
+
+void HashTableBuilder::WriteRegion(const Slice& contents,
+                                   BlockHandle* handle) {
+  handle->set_offset(offset_);
+  handle->set_size(contents.size());
+  status_ = file_->Append(contents);
+  if (status_.ok()) {
+    char trailer[kBlockTrailerSize];
+    trailer[0] = kNoCompression;
+    uint32_t crc = crc32c::Value(contents.data(), contents.size());
+    crc = crc32c::Extend(crc, trailer, 1);
+    EncodeFixed32(trailer + 1, crc32c::Mask(crc));
+    status_ = file_->Append(Slice(trailer, kBlockTrailerSize));
+    if (status_.ok()) {
+      offset_ += contents.size() + kBlockTrailerSize;
+    }
+  }
+}
+
+Status HashTableBuilder::Finish() {
+  if (!status_.ok()) return status_;
+
+  // Sample the last key too, so that only the keys after it are placed
+  // at the end of the records
+  if (!offsets_.empty() && offsets_.back() != last_sample_) {
+    Slice input(records_.data() + offsets_.back(),
+                records_.size() - offsets_.back());
+    Slice key;
+    GetLengthPrefixedSlice(&input, &key);
+    std::string encoding;
+    PutVarint64(&encoding, offsets_.back());
+    sample_block_.Add(key, encoding);
+  }
+
+  // One bucket per distinct hashed key, so that most buckets hold a
+  // single key.  Records keep their sorted order within a bucket.
+  const uint32_t num_buckets = std::max<uint32_t>(num_hashed_, 1);
+  const size_t n = offsets_.size();
+  offsets_.push_back(static_cast<uint32_t>(records_.size()));
+  std::vector<uint32_t> bucket_start(num_buckets + 1, 0);
+  std::vector<uint32_t> bucket_entries(num_buckets + 1, 0);
+  for (size_t i = 0; i < n; i++) {
+    const uint32_t b = hashes_[i] % num_buckets;
+    bucket_start[b + 1] += offsets_[i + 1] - offsets_[i];
+    bucket_entries[b + 1]++;
+  }
+  for (uint32_t b = 0; b < num_buckets; b++) {
+    bucket_start[b + 1] += bucket_start[b];
+    bucket_entries[b + 1] += bucket_entries[b];
+  }
+  std::vector<uint32_t> order(n);
+  for (size_t i = 0; i < n; i++) {
+    order[bucket_entries[hashes_[i] % num_buckets]++] =
+        static_cast<uint32_t>(i);
+  }
+
+  // Write the records bucket by bucket
+  std::string buffer;
+  uint32_t data_crc = 0;
+  for (size_t i = 0; i < n && status_.ok(); i++) {
+    const uint32_t r = order[i];
+    buffer.append(records_.data() + offsets_[r],
+                  offsets_[r + 1] - offsets_[r]);
+    if (buffer.size() >= 65536 || i + 1 == n) {
+      data_crc = crc32c::Extend(data_crc, buffer.data(), buffer.size());
+      status_ = file_->Append(buffer);
+      offset_ += buffer.size();
+      buffer.clear();
+    }
+  }
+  if (!status_.ok()) return status_;
+  assert(offset_ == records_.size());
+  std::string().swap(records_);
+
+  std::string index;
+  PutFixed32(&index, crc32c::Mask(data_crc));
+  PutFixed32(&index, static_cast<uint32_t>(key_suffix_));
+  PutFixed32(&index, num_buckets);
+  for (size_t i = 0; i < bucket_start.size(); i++) {
+    PutFixed32(&index, bucket_start[i]);
+  }
+  const Slice samples = sample_block_.Finish();
+  index.append(samples.data(), samples.size());
+
+  BlockHandle index_handle, range_del_handle;
+  WriteRegion(index, &index_handle);
+  if (status_.ok()) {
+    WriteRegion(range_del_block_.Finish(), &range_del_handle);
+  }
+  if (status_.ok()) {
+    Footer footer;
+    footer.set_magic_number(kHashTableMagicNumber);
+    footer.set_metaindex_handle(range_del_handle);
+    footer.set_index_handle(index_handle);
+    std::string footer_encoding;
+    footer.EncodeTo(&footer_encoding);
+    status_ = file_->Append(footer_encoding);
+    if (status_.ok()) {
+      offset_ += footer_encoding.size();
+    }
+  }
+  return status_;
+}
+
+}  // namespace leveldb
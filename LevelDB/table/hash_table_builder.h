@@ -0,0 +1,74 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_TABLE_HASH_TABLE_BUILDER_H_
+#define STORAGE_LEVELDB_TABLE_HASH_TABLE_BUILDER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+#include "table/block_builder.h"
+
+namespace leveldb {
+
+class BlockHandle;
+class WritableFile;
+
+// Writes a table in the kHashTable format described in hash_table.h.
+// TableBuilder hands its work to one when options.table_format is
+// kHashTable.  The records are kept in memory until Finish() since
+// their bucket is only known once all keys have been added.
+class HashTableBuilder {
+ public:
+  HashTableBuilder(const Options& options, WritableFile* file);
+
+  // REQUIRES: key is after any previously added key according to comparator.
+  void Add(const Slice& key, const Slice& value);
+
+  // REQUIRES: key is after any previously added range deletion key
+  // according to comparator.
+  void AddRangeDeletion(const Slice& key, const Slice& value);
+
+  // Write the buckets, the index, the range deletions and the footer.
+  Status Finish();
+
+  Status status() const { return status_; }
+
+  uint64_t NumEntries() const { return hashes_.size(); }
+
+  // Size of the records added so far until Finish(), then of the file
+  uint64_t FileSize() const { return offset_ + records_.size(); }
+
+ private:
+  void WriteRegion(const Slice& contents, BlockHandle* handle);
+
+  Options options_;
+  WritableFile* file_;
+  Status status_;
+  uint64_t offset_;            // Bytes written to the file
+  size_t key_suffix_;          // Bytes of each key left out of its hash
+  uint32_t num_hashed_;        // Distinct hashed parts added
+  std::string last_hashed_;    // Hashed part of the last key added
+
+  // Records in sorted order, with the offset in records_ and the hash of
+  // each one
+  std::string records_;
+  std::vector<uint32_t> offsets_;
+  std::vector<uint32_t> hashes_;
+
+  BlockBuilder sample_block_;
+  uint64_t last_sample_;       // Offset in records_ of the last sample
+  uint64_t next_sample_;       // Size of records_ at which to sample
+  BlockBuilder range_del_block_;
+
+  // No copying allowed
+  HashTableBuilder(const HashTableBuilder&);
+  void operator=(const HashTableBuilder&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_HASH_TABLE_BUILDER_H_
@@ -0,0 +1,342 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/plain_table.h"
+
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "table/block.h"
+#include "table/format.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+// Fixed part of the index: data_crc, key_suffix, num_buckets, num_sparse
+static const size_t kIndexHeaderSize = 16;
+
+// Find the part of "file" that "handle" points at, which is followed by
+// the same trailer as blocks, and check its crc if "verify" is set.
+static Status FindRegion(const Slice& file, const BlockHandle& handle,
+                         bool verify, Slice* result) {
+  const uint64_t n = handle.size();
+  if (handle.offset() > file.size() ||
+      n + kBlockTrailerSize > file.size() - handle.offset()) {
+    return Status::Corruption("plain table region out of range");
+  }
+  const char* data = file.data() + handle.offset();
+  if (data[n] != kNoCompression) {
+    return Status::Corruption("bad plain table region type");
+  }
+  if (verify) {
+    const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
+    const uint32_t actual = crc32c::Value(data, n + 1);
+    if (actual != crc) {
+      return Status::Corruption("plain table checksum mismatch");
+    }
+  }
+  *result = Slice(data, n);
+  return Status::OK();
+}
+
+PlainTable::PlainTable(const Options& options)
+    : comparator_(options.comparator),
+      file_data_(NULL),
+      key_suffix_(0),
+      num_buckets_(0),
+      num_sparse_(0),
+      bucket_start_(NULL),
+      hashed_(NULL),
+      sparse_(NULL),
+      range_del_block_(NULL) {
+}
+
+PlainTable::~PlainTable() {
+  delete range_del_block_;
+  delete[] file_data_;
+}
+
+Status PlainTable::Open(const Options& options,
+                        RandomAccessFile* file,
+                        uint64_t file_size,
+                        const Footer& footer,
+                        PlainTable** table) {
+  *table = NULL;
+  if (file_size > 0xffffffffu) {
+    return Status::Corruption("plain table too large");
+  }
+
+  // Files mapped by the Env are used in place; others are read whole
+  char* scratch = new char[file_size];
+  Slice contents;
+  Status s = file->Read(0, file_size, &contents, scratch);
+  if (s.ok() && contents.size() != file_size) {
+    s = Status::Corruption("truncated plain table read");
+  }
+  if (!s.ok()) {
+    delete[] scratch;
+    return s;
+  }
+  PlainTable* t = new PlainTable(options);
+  if (contents.data() != scratch) {
+    delete[] scratch;
+  } else {
+    t->file_data_ = scratch;
+  }
+
+  const bool verify = options.paranoid_checks;
+  Slice index;
+  s = FindRegion(contents, footer.index_handle(), verify, &index);
+  if (s.ok()) {
+    // Check that the index sizes add up before using any of it
+    uint64_t num_hashed = 0;
+    bool ok = index.size() >= kIndexHeaderSize;
+    if (ok) {
+      t->key_suffix_ = DecodeFixed32(index.data() + 4);
+      t->num_buckets_ = DecodeFixed32(index.data() + 8);
+      t->num_sparse_ = DecodeFixed32(index.data() + 12);
+      t->bucket_start_ = index.data() + kIndexHeaderSize;
+      ok = (t->num_buckets_ > 0 &&
+            index.size() >= kIndexHeaderSize + 4 * (t->num_buckets_ + 1ull));
+    }
+    if (ok) {
+      num_hashed = DecodeFixed32(t->bucket_start_ + 4 * t->num_buckets_);
+      ok = (index.size() == kIndexHeaderSize +
+                            4 * (t->num_buckets_ + 1ull + num_hashed +
+                                 t->num_sparse_));
+    }
+    for (uint32_t b = 0; ok && b < t->num_buckets_; b++) {
+      ok = (DecodeFixed32(t->bucket_start_ + 4 * b) <=
+            DecodeFixed32(t->bucket_start_ + 4 * (b + 1)));
+    }
+    if (ok) {
+      t->hashed_ = t->bucket_start_ + 4 * (t->num_buckets_ + 1);
+      t->sparse_ = t->hashed_ + 4 * num_hashed;
+      t->data_ = Slice(contents.data(), footer.index_handle().offset());
+      if (verify &&
+          crc32c::Unmask(DecodeFixed32(index.data())) !=
+          crc32c::Value(t->data_.data(), t->data_.size())) {
+        s = Status::Corruption("plain table checksum mismatch");
+      }
+    } else {
+      s = Status::Corruption("bad plain table index");
+    }
+  }
+
+  Slice range_dels;
+  if (s.ok()) {
+    s = FindRegion(contents, footer.metaindex_handle(), verify, &range_dels);
+  }
+  if (s.ok()) {
+    BlockContents block;
+    block.data = range_dels;
+    block.cachable = false;
+    block.heap_allocated = false;
+    t->range_del_block_ = new Block(block);
+    *table = t;
+  } else {
+    delete t;
+  }
+  return s;
+}
+
+bool PlainTable::DecodeRecord(uint32_t offset, Slice* key, Slice* value,
+                              uint32_t* next) const {
+  if (offset >= data_.size()) {
+    return false;
+  }
+  const char* p = data_.data() + offset;
+  const char* limit = data_.data() + data_.size();
+  uint32_t key_length, value_length;
+  p = GetVarint32Ptr(p, limit, &key_length);
+  if (p == NULL || static_cast<uint32_t>(limit - p) < key_length) {
+    return false;
+  }
+  *key = Slice(p, key_length);
+  p = GetVarint32Ptr(p + key_length, limit, &value_length);
+  if (p == NULL || static_cast<uint32_t>(limit - p) < value_length) {
+    return false;
+  }
+  *value = Slice(p, value_length);
+  *next = static_cast<uint32_t>(p + value_length - data_.data());
+  return true;
+}
+
+uint32_t PlainTable::SparseOffset(uint32_t index) const {
+  return DecodeFixed32(sparse_ + 4 * index);
+}
+
+class PlainTable::Iter : public Iterator {
+ public:
+  explicit Iter(const PlainTable* table)
+      : table_(table),
+        limit_(static_cast<uint32_t>(table->data_.size())),
+        offset_(limit_),
+        next_(limit_) {
+  }
+
+  virtual bool Valid() const { return offset_ < limit_; }
+  virtual Status status() const { return status_; }
+  virtual Slice key() const {
+    assert(Valid());
+    return key_;
+  }
+  virtual Slice value() const {
+    assert(Valid());
+    return value_;
+  }
+
+  // Offset of the current record
+  uint32_t offset() const { return offset_; }
+
+  virtual void SeekToFirst() {
+    SeekToOffset(0);
+  }
+
+  virtual void SeekToLast() {
+    if (table_->num_sparse_ == 0) {
+      offset_ = limit_;
+      return;
+    }
+    SeekToOffset(table_->SparseOffset(table_->num_sparse_ - 1));
+    while (Valid() && next_ < limit_) {
+      SeekToOffset(next_);
+    }
+  }
+
+  virtual void Seek(const Slice& target) {
+    if (table_->num_sparse_ == 0) {
+      offset_ = limit_;
+      return;
+    }
+    // Binary search for the last sparse entry with a key < target, then
+    // scan forward from it
+    uint32_t left = 0;
+    uint32_t right = table_->num_sparse_ - 1;
+    while (left < right) {
+      uint32_t mid = (left + right + 1) / 2;
+      Slice key, value;
+      uint32_t next;
+      if (!table_->DecodeRecord(table_->SparseOffset(mid), &key, &value,
+                                &next)) {
+        CorruptionError();
+        return;
+      }
+      if (table_->comparator_->Compare(key, target) < 0) {
+        left = mid;
+      } else {
+        right = mid - 1;
+      }
+    }
+    SeekToOffset(table_->SparseOffset(left));
+    while (Valid() && table_->comparator_->Compare(key_, target) < 0) {
+      SeekToOffset(next_);
+    }
+  }
+
+  virtual void Next() {
+    assert(Valid());
+    SeekToOffset(next_);
+  }
+
+  virtual void Prev() {
+    assert(Valid());
+    const uint32_t current = offset_;
+    if (current == 0) {
+      offset_ = limit_;
+      return;
+    }
+    // Scan forward from the last sparse entry before the current record
+    uint32_t left = 0;
+    uint32_t right = table_->num_sparse_ - 1;
+    while (left < right) {
+      uint32_t mid = (left + right + 1) / 2;
+      if (table_->SparseOffset(mid) < current) {
+        left = mid;
+      } else {
+        right = mid - 1;
+      }
+    }
+    SeekToOffset(table_->SparseOffset(left));
+    while (Valid() && next_ < current) {
+      SeekToOffset(next_);
+    }
+  }
+
+ private:
+  void SeekToOffset(uint32_t offset) {
+    offset_ = offset;
+    if (offset_ < limit_ &&
+        !table_->DecodeRecord(offset_, &key_, &value_, &next_)) {
+      CorruptionError();
+    }
+  }
+
+  void CorruptionError() {
+    offset_ = limit_;
+    status_ = Status::Corruption("bad entry in plain table");
+    key_.clear();
+    value_.clear();
+  }
+
+  const PlainTable* const table_;
+  const uint32_t limit_;
+  uint32_t offset_;        // Offset of the current record, limit_ if none
+  uint32_t next_;          // Offset of the record after it
+  Slice key_;
+  Slice value_;
+  Status status_;
+};
+
+Iterator* PlainTable::NewIterator() const {
+  return new Iter(this);
+}
+
+Iterator* PlainTable::NewRangeDeletionIterator() const {
+  return range_del_block_->NewIterator(comparator_);
+}
+
+Status PlainTable::Get(const Slice& k, void* arg,
+                       void (*saver)(void*, const Slice&, const Slice&)) const {
+  if (k.size() < key_suffix_) {
+    return Status::OK();
+  }
+  const Slice hashed(k.data(), k.size() - key_suffix_);
+  const uint32_t b =
+      Hash(hashed.data(), hashed.size(), kPlainTableHashSeed) % num_buckets_;
+  const uint32_t limit = DecodeFixed32(bucket_start_ + 4 * (b + 1));
+  for (uint32_t i = DecodeFixed32(bucket_start_ + 4 * b); i < limit; i++) {
+    Slice key, value;
+    uint32_t next;
+    if (!DecodeRecord(DecodeFixed32(hashed_ + 4 * i), &key, &value, &next)) {
+      return Status::Corruption("bad entry in plain table");
+    }
+    if (key.size() < key_suffix_ ||
+        Slice(key.data(), key.size() - key_suffix_) != hashed) {
+      continue;
+    }
+
+    // The first entry of the key: skip the ones that sort before "k"
+    while (comparator_->Compare(key, k) < 0) {
+      if (next >= data_.size()) {
+        return Status::OK();
+      }
+      if (!DecodeRecord(next, &key, &value, &next)) {
+        return Status::Corruption("bad entry in plain table");
+      }
+    }
+    (*saver)(arg, key, value);
+    return Status::OK();
+  }
+  return Status::OK();
+}
+
+uint64_t PlainTable::ApproximateOffsetOf(const Slice& key) const {
+  Iter iter(this);
+  iter.Seek(key);
+  return iter.Valid() ? iter.offset() : data_.size();
+}
+
+}  // namespace leveldb
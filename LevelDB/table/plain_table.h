@@ -0,0 +1,119 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Tables in the kPlainTable format are laid out as:
+//
+//    [record 1]
+//    ...
+//    [record N]
+//    [index]                 followed by type and crc, as for blocks
+//    [range deletion block]  followed by type and crc
+//    [Footer]                magic number kPlainTableMagicNumber
+//
+// Each record is stored uncompressed and in sorted order:
+//    key_length:   varint32
+//    key:          char[key_length]
+//    value_length: varint32
+//    value:        char[value_length]
+//
+// The index consists of fixed32 values:
+//    data_crc:     masked crc32c of all the records
+//    key_suffix:   bytes at the end of each key that are not hashed
+//    num_buckets
+//    num_sparse
+//    bucket_start: [num_buckets + 1]
+//    hashed:       [bucket_start[num_buckets]]
+//    sparse:       [num_sparse]
+//
+// Keys are hashed without their last key_suffix bytes, which are the
+// sequence number and type of internal keys, so that all entries of a
+// user key share one hash.  For each user key, the offset of its first
+// record is in hashed[bucket_start[b] .. bucket_start[b+1]-1], where b is
+// the hash modulo num_buckets.  sparse holds the offset of every 16th
+// record, for seeks.
+//
+// The footer's index handle points at the index, whose offset is the
+// size of the records, and its metaindex handle at the range deletion
+// block, which is built by block_builder.cc.
+
+#ifndef STORAGE_LEVELDB_TABLE_PLAIN_TABLE_H_
+#define STORAGE_LEVELDB_TABLE_PLAIN_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+class Block;
+class Footer;
+class RandomAccessFile;
+
+// Records between two entries of the sparse index
+static const int kPlainTableSparseInterval = 16;
+
+// Seed of the hash of the keys
+static const uint32_t kPlainTableHashSeed = 0xbc9f1d34;
+
+class PlainTable {
+ public:
+  // Open the table stored in bytes [0..file_size) of "file", whose footer
+  // has already been decoded into "footer".  Files that the Env maps into
+  // memory are read in place, other files are read into memory.  Checks
+  // the crc of the records and of the index if options.paranoid_checks
+  // is set.  On success, stores the table in *table and returns OK.
+  static Status Open(const Options& options,
+                     RandomAccessFile* file,
+                     uint64_t file_size,
+                     const Footer& footer,
+                     PlainTable** table);
+
+  ~PlainTable();
+
+  Iterator* NewIterator() const;
+
+  // Returns a new iterator over the range deletion entries of the table.
+  Iterator* NewRangeDeletionIterator() const;
+
+  // Calls (*saver)(arg, ...) with the first entry at or after "key" if the
+  // table holds an entry with the same hashed part as "key".
+  Status Get(const Slice& key, void* arg,
+             void (*saver)(void* arg, const Slice& k, const Slice& v)) const;
+
+  uint64_t ApproximateOffsetOf(const Slice& key) const;
+
+ private:
+  class Iter;
+
+  PlainTable(const Options& options);
+
+  // Decode the record at "offset" into *key and *value and store the
+  // offset of the next record in *next.  Returns false if the record is
+  // corrupted.
+  bool DecodeRecord(uint32_t offset, Slice* key, Slice* value,
+                    uint32_t* next) const;
+
+  // Offset of the record the sparse index entry "index" points at.
+  uint32_t SparseOffset(uint32_t index) const;
+
+  const Comparator* comparator_;
+  char* file_data_;            // Contents of the file, NULL if mapped
+  Slice data_;                 // The records
+  uint32_t key_suffix_;
+  uint32_t num_buckets_;
+  uint32_t num_sparse_;
+  const char* bucket_start_;
+  const char* hashed_;
+  const char* sparse_;
+  Block* range_del_block_;
+
+  // No copying allowed
+  PlainTable(const PlainTable&);
+  void operator=(const PlainTable&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_PLAIN_TABLE_H_
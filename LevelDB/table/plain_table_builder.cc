@@ -0,0 +1,153 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/plain_table_builder.h"
+
+#include <assert.h>
+#include <algorithm>
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "table/format.h"
+#include "table/plain_table.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+// Records are found by fixed32 offsets
+static const uint64_t kMaxPlainTableSize = 0xffffffffu;
+
+// Keys of the database are internal keys, whose last 8 bytes hold the
+// sequence number and type.  These are left out of the hash so that a
+// lookup at any sequence number finds the entries of its user key.
+static size_t KeySuffixLength(const Options& options) {
+  return options.internal_keys ? 8 : 0;
+}
+
+PlainTableBuilder::PlainTableBuilder(const Options& options,
+                                     WritableFile* file)
+    : options_(options),
+      file_(file),
+      offset_(0),
+      num_entries_(0),
+      data_crc_(0),
+      key_suffix_(KeySuffixLength(options)),
+      range_del_block_(&options_) {
+}
+
+void PlainTableBuilder::Add(const Slice& key, const Slice& value) {
+  if (!status_.ok()) return;
+  assert(key.size() >= key_suffix_);
+
+  record_.clear();
+  PutVarint32(&record_, static_cast<uint32_t>(key.size()));
+  record_.append(key.data(), key.size());
+  PutVarint32(&record_, static_cast<uint32_t>(value.size()));
+  if (offset_ + record_.size() + value.size() > kMaxPlainTableSize) {
+    status_ = Status::InvalidArgument("plain table larger than 4GB");
+    return;
+  }
+
+  const uint32_t offset = static_cast<uint32_t>(offset_);
+  if (num_entries_ % kPlainTableSparseInterval == 0) {
+    sparse_.push_back(offset);
+  }
+  const Slice hashed(key.data(), key.size() - key_suffix_);
+  if (num_entries_ == 0 || hashed != Slice(last_hashed_)) {
+    hashes_.push_back(Hash(hashed.data(), hashed.size(),
+                           kPlainTableHashSeed));
+    offsets_.push_back(offset);
+    last_hashed_.assign(hashed.data(), hashed.size());
+  }
+
+  status_ = file_->Append(record_);
+  if (status_.ok()) {
+    status_ = file_->Append(value);
+  }
+  data_crc_ = crc32c::Extend(data_crc_, record_.data(), record_.size());
+  data_crc_ = crc32c::Extend(data_crc_, value.data(), value.size());
+  offset_ += record_.size() + value.size();
+  num_entries_++;
+}
+
+void PlainTableBuilder::AddRangeDeletion(const Slice& key,
+                                         const Slice& value) {
+  if (!status_.ok()) return;
+  range_del_block_.Add(key, value);
+}
+
+void PlainTableBuilder::WriteRegion(const Slice& contents,
+                                    BlockHandle* handle) {
+  handle->set_offset(offset_);
+  handle->set_size(contents.size());
+  status_ = file_->Append(contents);
+  if (status_.ok()) {
+    char trailer[kBlockTrailerSize];
+    trailer[0] = kNoCompression;
+    uint32_t crc = crc32c::Value(contents.data(), contents.size());
+    crc = crc32c::Extend(crc, trailer, 1);
+    EncodeFixed32(trailer + 1, crc32c::Mask(crc));
+    status_ = file_->Append(Slice(trailer, kBlockTrailerSize));
+    if (status_.ok()) {
+      offset_ += contents.size() + kBlockTrailerSize;
+    }
+  }
+}
+
+Status PlainTableBuilder::Finish() {
+  if (!status_.ok()) return status_;
+
+  // Group the offsets by bucket, keeping them in file order
+  const uint32_t num_buckets =
+      std::max<uint32_t>(static_cast<uint32_t>(hashes_.size()), 1);
+  std::vector<uint32_t> bucket_start(num_buckets + 1, 0);
+  for (size_t i = 0; i < hashes_.size(); i++) {
+    bucket_start[hashes_[i] % num_buckets + 1]++;
+  }
+  for (uint32_t b = 0; b < num_buckets; b++) {
+    bucket_start[b + 1] += bucket_start[b];
+  }
+  std::vector<uint32_t> hashed(offsets_.size());
+  std::vector<uint32_t> fill(bucket_start.begin(), bucket_start.end() - 1);
+  for (size_t i = 0; i < hashes_.size(); i++) {
+    hashed[fill[hashes_[i] % num_buckets]++] = offsets_[i];
+  }
+
+  std::string index;
+  PutFixed32(&index, crc32c::Mask(data_crc_));
+  PutFixed32(&index, static_cast<uint32_t>(key_suffix_));
+  PutFixed32(&index, num_buckets);
+  PutFixed32(&index, static_cast<uint32_t>(sparse_.size()));
+  for (size_t i = 0; i < bucket_start.size(); i++) {
+    PutFixed32(&index, bucket_start[i]);
+  }
+  for (size_t i = 0; i < hashed.size(); i++) {
+    PutFixed32(&index, hashed[i]);
+  }
+  for (size_t i = 0; i < sparse_.size(); i++) {
+    PutFixed32(&index, sparse_[i]);
+  }
+
+  BlockHandle index_handle, range_del_handle;
+  WriteRegion(index, &index_handle);
+  if (status_.ok()) {
+    WriteRegion(range_del_block_.Finish(), &range_del_handle);
+  }
+  if (status_.ok()) {
+    Footer footer;
+    footer.set_magic_number(kPlainTableMagicNumber);
+    footer.set_metaindex_handle(range_del_handle);
+    footer.set_index_handle(index_handle);
+    std::string footer_encoding;
+    footer.EncodeTo(&footer_encoding);
+    status_ = file_->Append(footer_encoding);
+    if (status_.ok()) {
+      offset_ += footer_encoding.size();
+    }
+  }
+  return status_;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,70 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_TABLE_PLAIN_TABLE_BUILDER_H_
+#define STORAGE_LEVELDB_TABLE_PLAIN_TABLE_BUILDER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+#include "table/block_builder.h"
+
+namespace leveldb {
+
+class BlockHandle;
+class WritableFile;
+
+// Writes a table in the kPlainTable format described in plain_table.h.
+// TableBuilder hands its work to one when options.table_format is
+// kPlainTable.
+class PlainTableBuilder {
+ public:
+  PlainTableBuilder(const Options& options, WritableFile* file);
+
+  // REQUIRES: key is after any previously added key according to comparator.
+  void Add(const Slice& key, const Slice& value);
+
+  // REQUIRES: key is after any previously added range deletion key
+  // according to comparator.
+  void AddRangeDeletion(const Slice& key, const Slice& value);
+
+  // Write the index, the range deletions and the footer.
+  Status Finish();
+
+  Status status() const { return status_; }
+
+  uint64_t NumEntries() const { return num_entries_; }
+
+  uint64_t FileSize() const { return offset_; }
+
+ private:
+  void WriteRegion(const Slice& contents, BlockHandle* handle);
+
+  Options options_;
+  WritableFile* file_;
+  Status status_;
+  uint64_t offset_;
+  uint64_t num_entries_;
+  uint32_t data_crc_;          // Unmasked crc of the records so far
+  size_t key_suffix_;          // Bytes of each key left out of its hash
+  std::string last_hashed_;    // Hashed part of the last key added
+  std::string record_;         // Scratch space for a record header
+
+  // Hash and offset of the first record of each distinct hashed key
+  std::vector<uint32_t> hashes_;
+  std::vector<uint32_t> offsets_;
+  std::vector<uint32_t> sparse_;
+
+  BlockBuilder range_del_block_;
+
+  // No copying allowed
+  PlainTableBuilder(const PlainTableBuilder&);
+  void operator=(const PlainTableBuilder&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_TABLE_PLAIN_TABLE_BUILDER_H_
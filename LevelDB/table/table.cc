@@ -9,9 +9,12 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/table_properties.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/hash_table.h"
+#include "table/plain_table.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 
@@ -22,6 +25,9 @@ struct Table::Rep {
     delete filter;
     delete [] filter_data;
     delete index_block;
+    delete range_del_block;
+    delete plain;
+    delete hash;
   }
 
   Options options;
@@ -33,6 +39,20 @@ struct Table::Rep {
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  Block* range_del_block;  // NULL if the table has no range deletions
+
+  // Compression dictionary of the data blocks, empty if they have none.
+  // Reads of data blocks fail with dictionary_status if it was lost.
+  std::string dictionary;
+  Status dictionary_status;
+
+  TableProperties properties;
+  bool has_properties;  // Read from the properties block
+
+  // Set instead of the blocks above for tables in the kPlainTable and
+  // kHashTable formats
+  PlainTable* plain;
+  HashTable* hash;
 };
 
 Status Table::Open(const Options& options,
@@ -54,6 +74,32 @@ Status Table::Open(const Options& options,
   s = footer.DecodeFrom(&footer_input);
   if (!s.ok()) return s;
 
+  if (footer.magic_number() == kPlainTableMagicNumber ||
+      footer.magic_number() == kHashTableMagicNumber) {
+    PlainTable* plain = NULL;
+    HashTable* hash = NULL;
+    if (footer.magic_number() == kPlainTableMagicNumber) {
+      s = PlainTable::Open(options, file, size, footer, &plain);
+    } else {
+      s = HashTable::Open(options, file, size, footer, &hash);
+    }
+    if (s.ok()) {
+      Rep* rep = new Table::Rep;
+      rep->options = options;
+      rep->file = file;
+      rep->index_block = NULL;
+      rep->cache_id = 0;
+      rep->filter_data = NULL;
+      rep->filter = NULL;
+      rep->range_del_block = NULL;
+      rep->has_properties = false;
+      rep->plain = plain;
+      rep->hash = hash;
+      *table = new Table(rep);
+    }
+    return s;
+  }
+
   // Read the index block
   BlockContents contents;
   Block* index_block = NULL;
@@ -62,7 +108,7 @@ Status Table::Open(const Options& options,
     if (options.paranoid_checks) {
       opt.verify_checksums = true;
     }
-    s = ReadBlock(file, opt, footer.index_handle(), &contents);
+    s = ReadBlock(file, opt, footer.index_handle(), Slice(), &contents);
     if (s.ok()) {
       index_block = new Block(contents);
     }
@@ -79,6 +125,10 @@ Status Table::Open(const Options& options,
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = NULL;
     rep->filter = NULL;
+    rep->range_del_block = NULL;
+    rep->has_properties = false;
+    rep->plain = NULL;
+    rep->hash = NULL;
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   } else {
@@ -89,10 +139,6 @@ Status Table::Open(const Options& options,
 }
 
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == NULL) {
-    return;  // Do not need any metadata
-  }
-
   // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
   // it is an empty block.
   ReadOptions opt;
@@ -100,18 +146,36 @@ void Table::ReadMeta(const Footer& footer) {
     opt.verify_checksums = true;
   }
   BlockContents contents;
-  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
-    // Do not propagate errors since meta info is not needed for operation
+  Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), Slice(),
+                       &contents);
+  if (!s.ok()) {
+    // Do not propagate errors since meta info is not needed for reading
+    // the table's entries.  Remember it for NewRangeDeletionIterator().
+    rep_->status = s;
     return;
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  iter->Seek("compression.dictionary");
+  if (iter->Valid() && iter->key() == Slice("compression.dictionary")) {
+    ReadDictionary(iter->value());
+  }
+  if (rep_->options.filter_policy != NULL) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value());
+    }
+  }
+  iter->Seek("properties");
+  if (iter->Valid() && iter->key() == Slice("properties")) {
+    ReadProperties(iter->value());
+  }
+  iter->Seek("rangedel");
+  if (iter->Valid() && iter->key() == Slice("rangedel")) {
+    ReadRangeDeletions(iter->value());
   }
   delete iter;
   delete meta;
@@ -131,7 +195,7 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
     opt.verify_checksums = true;
   }
   BlockContents block;
-  if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
+  if (!ReadBlock(rep_->file, opt, filter_handle, Slice(), &block).ok()) {
     return;
   }
   if (block.heap_allocated) {
@@ -140,6 +204,92 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
+void Table::ReadRangeDeletions(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  if (!handle.DecodeFrom(&v).ok()) {
+    rep_->status = Status::Corruption("bad range deletion block handle");
+    return;
+  }
+
+  // Unlike the filter, range deletions are needed for correct results,
+  // so a failure to read them is remembered and reported by iterators.
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents contents;
+  Status s = ReadBlock(rep_->file, opt, handle, Slice(), &contents);
+  if (s.ok()) {
+    rep_->range_del_block = new Block(contents);
+  } else {
+    rep_->status = s;
+  }
+}
+
+void Table::ReadDictionary(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  Status s = handle.DecodeFrom(&v);
+  BlockContents contents;
+  if (s.ok()) {
+    ReadOptions opt;
+    if (rep_->options.paranoid_checks) {
+      opt.verify_checksums = true;
+    }
+    s = ReadBlock(rep_->file, opt, handle, Slice(), &contents);
+  }
+  if (s.ok()) {
+    rep_->dictionary = contents.data.ToString();
+    if (contents.heap_allocated) {
+      delete[] contents.data.data();
+    }
+  } else {
+    rep_->dictionary_status = s;
+  }
+}
+
+void Table::ReadProperties(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  if (!handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  // Like the filter, properties are not needed to read the table, so
+  // they are left out if they cannot be read
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents contents;
+  if (!ReadBlock(rep_->file, opt, handle, Slice(), &contents).ok()) {
+    return;
+  }
+  rep_->has_properties =
+      DecodeTableProperties(contents.data, &rep_->properties).ok();
+  if (contents.heap_allocated) {
+    delete[] contents.data.data();
+  }
+}
+
+const TableProperties* Table::GetProperties() const {
+  return rep_->has_properties ? &rep_->properties : NULL;
+}
+
+Iterator* Table::NewRangeDeletionIterator() const {
+  if (rep_->plain != NULL) {
+    return rep_->plain->NewRangeDeletionIterator();
+  } else if (rep_->hash != NULL) {
+    return rep_->hash->NewRangeDeletionIterator();
+  } else if (!rep_->status.ok()) {
+    return NewErrorIterator(rep_->status);
+  } else if (rep_->range_del_block == NULL) {
+    return NewEmptyIterator();
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
+}
+
 Table::~Table() {
   delete rep_;
 }
@@ -174,6 +324,9 @@ Iterator* Table::BlockReader(void* arg,
   Status s = handle.DecodeFrom(&input);
   // We intentionally allow extra stuff in index_value so that we
   // can add more features in the future.
+  if (s.ok()) {
+    s = table->rep_->dictionary_status;
+  }
 
   if (s.ok()) {
     BlockContents contents;
@@ -186,7 +339,8 @@ Iterator* Table::BlockReader(void* arg,
       if (cache_handle != NULL) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadBlock(table->rep_->file, options, handle,
+                      table->rep_->dictionary, &contents);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
@@ -196,7 +350,8 @@ Iterator* Table::BlockReader(void* arg,
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(table->rep_->file, options, handle,
+                    table->rep_->dictionary, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -218,6 +373,11 @@ Iterator* Table::BlockReader(void* arg,
 }
 
 Iterator* Table::NewIterator(const ReadOptions& options) const {
+  if (rep_->plain != NULL) {
+    return rep_->plain->NewIterator();
+  } else if (rep_->hash != NULL) {
+    return rep_->hash->NewIterator(options);
+  }
   return NewTwoLevelIterator(
       rep_->index_block->NewIterator(rep_->options.comparator),
       &Table::BlockReader, const_cast<Table*>(this), options);
@@ -226,6 +386,11 @@ Iterator* Table::NewIterator(const ReadOptions& options) const {
 Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void* arg,
                           void (*saver)(void*, const Slice&, const Slice&)) {
+  if (rep_->plain != NULL) {
+    return rep_->plain->Get(k, arg, saver);
+  } else if (rep_->hash != NULL) {
+    return rep_->hash->Get(k, arg, saver);
+  }
   Status s;
   Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
   iiter->Seek(k);
@@ -256,6 +421,11 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
 
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
+  if (rep_->plain != NULL) {
+    return rep_->plain->ApproximateOffsetOf(key);
+  } else if (rep_->hash != NULL) {
+    return rep_->hash->ApproximateOffsetOf(key);
+  }
   Iterator* index_iter =
       rep_->index_block->NewIterator(rep_->options.comparator);
   index_iter->Seek(key);
@@ -5,18 +5,183 @@
 #include "leveldb/table_builder.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
 #include "leveldb/comparator.h"
+#include "leveldb/compressor.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/table_properties.h"
+#include "db/dbformat.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
+#include "table/hash_table_builder.h"
+#include "table/plain_table_builder.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
+// Compress "raw" with *type, and "dictionary" if it is non-empty, into
+// *output.  Sets *type to kNoCompression if the block is to be stored
+// uncompressed, and returns the contents to store.
+static Slice CompressBlock(const Slice& raw, const Slice& dictionary,
+                           CompressionType* type, std::string* output) {
+  const Compressor* compressor = GetCompressor(*type);
+  if (compressor != NULL &&
+      (dictionary.empty()
+       ? compressor->Compress(raw, output)
+       : compressor->CompressWithDictionary(dictionary, raw, output)) &&
+      output->size() < raw.size() - (raw.size() / 8u)) {
+    return *output;
+  }
+  // Codec not available, or compressed less than 12.5%, so just store
+  // uncompressed form
+  *type = kNoCompression;
+  return raw;
+}
+
+// Record the sequence number of internal key "key" in *props, which has
+// no sequence number yet if "first" is set.
+static void AddSequence(const Slice& key, bool first, TableProperties* props) {
+  if (key.size() < 8) return;
+  const SequenceNumber seq = ExtractSequence(key);
+  if (first || seq < props->smallest_seqno) {
+    props->smallest_seqno = seq;
+  }
+  if (first || seq > props->largest_seqno) {
+    props->largest_seqno = seq;
+  }
+}
+
+// Blocks in flight per compression thread before Add() waits for the
+// oldest one to be written.
+static const size_t kPendingBlocksPerThread = 4;
+
+// Bytes of data blocks sampled per byte of compression dictionary
+static const size_t kDictionarySampleRatio = 8;
+
+// After this many data blocks in a row compressed too little to be
+// stored compressed, compression is only tried on one block out of 2,
+// then out of 4 after one more failure, and so on up to one out of
+// 1 << kMaxCompressionSkipShift.  A block that compresses well enough
+// ends the backoff.
+static const int kCompressionFailuresBeforeSkipping = 2;
+static const int kMaxCompressionSkipShift = 6;
+
+// Whether a data block is compressed only depends on the results of the
+// blocks at least this many blocks before it, so that it does not depend
+// on how far compression threads have come.
+static const uint64_t kCompressionResultDelay = 8;
+
+// Result of compressing a data block
+enum CompressionResult {
+  kCompressionNotTried,
+  kCompressionSaved,           // Stored compressed
+  kCompressionFailed           // Compressed too little, stored uncompressed
+};
+
+static CompressionResult GetCompressionResult(bool tried,
+                                              CompressionType type) {
+  if (!tried) {
+    return kCompressionNotTried;
+  }
+  return type == kNoCompression ? kCompressionFailed : kCompressionSaved;
+}
+
+// Limit on the threads of the compression pool
+static const int kMaxCompressionThreads = 64;
+
+// Threads that compress data blocks for all TableBuilders of the process,
+// so that building a table does not start threads of its own.  Threads
+// are started as builders ask for them, up to the largest
+// options.compression_threads in use, and run until the process exits.
+class CompressionPool {
+ public:
+  CompressionPool() : cv_(&mu_), num_threads_(0) { }
+
+  // Start threads with "env" until there are at least "n"
+  void Reserve(Env* env, int n) {
+    MutexLock l(&mu_);
+    n = std::min(n, kMaxCompressionThreads);
+    while (num_threads_ < n) {
+      num_threads_++;
+      env->StartThread(&CompressionPool::Run, this);
+    }
+  }
+
+  // Arrange to run "(*function)(arg)" once in a pool thread
+  void Schedule(void (*function)(void*), void* arg) {
+    MutexLock l(&mu_);
+    Job job = { function, arg };
+    queue_.push_back(job);
+    cv_.Signal();
+  }
+
+ private:
+  struct Job {
+    void (*function)(void*);
+    void* arg;
+  };
+
+  static void Run(void* arg) {
+    CompressionPool* pool = reinterpret_cast<CompressionPool*>(arg);
+    while (true) {
+      Job job;
+      {
+        MutexLock l(&pool->mu_);
+        while (pool->queue_.empty()) {
+          pool->cv_.Wait();
+        }
+        job = pool->queue_.front();
+        pool->queue_.pop_front();
+      }
+      (*job.function)(job.arg);
+    }
+  }
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  std::deque<Job> queue_;
+  int num_threads_;
+};
+
+static port::OnceType compression_pool_once = LEVELDB_ONCE_INIT;
+static CompressionPool* compression_pool;
+
+static void InitCompressionPool() {
+  compression_pool = new CompressionPool;
+}
+
+static CompressionPool* GetCompressionPool() {
+  port::InitOnce(&compression_pool_once, &InitCompressionPool);
+  return compression_pool;
+}
+
+// A data block held back until it has been compressed
+struct PendingBlock {
+  std::string raw;             // Uncompressed contents
+  CompressionType type;        // Compression to apply, then applied
+  bool tried;                  // Compression is to be tried
+  std::string compressed;      // Set by a compression thread
+  bool done;                   // Compression has finished
+
+  // Keys of the block, for the filter block
+  std::string keys;
+  std::vector<size_t> key_sizes;
+
+  // Index block key of the block, once the next block's first key is known
+  std::string index_key;
+  bool has_index_key;
+
+  PendingBlock() : tried(false), done(false), has_index_key(false) { }
+};
+
 struct TableBuilder::Rep {
   Options options;
   Options index_block_options;
@@ -25,6 +190,7 @@ struct TableBuilder::Rep {
   Status status;
   BlockBuilder data_block;
   BlockBuilder index_block;
+  BlockBuilder range_del_block;
   std::string last_key;
   int64_t num_entries;
   bool closed;          // Either Finish() or Abandon() has been called.
@@ -44,6 +210,56 @@ struct TableBuilder::Rep {
 
   std::string compressed_output;
 
+  // With options.compression_threads > 1, data blocks are compressed by
+  // the threads of the compression pool.  Blocks are written in order
+  // once compressed, and only then get their handles and their filters.
+  // Keys of the data block being built are kept in block_keys for the
+  // filter until then.
+  std::deque<PendingBlock*> pending;  // Not yet written, in file order
+  uint64_t pending_bytes;             // Raw size of the pending blocks
+  std::string block_keys;
+  std::vector<size_t> block_key_sizes;
+
+  // State shared with the compression pool, which runs CompressNextBlock()
+  // once for each block in to_compress
+  port::Mutex mu;
+  port::CondVar cv;
+  std::deque<PendingBlock*> to_compress;
+  int num_threads;                    // Compression threads asked for, or 0
+  int num_scheduled;                  // CompressNextBlock() runs not finished
+  bool stop;                          // Skip compressing the blocks left
+
+  // With options.compression_dictionary_bytes > 0, the first data blocks
+  // are held back in "pending" as samples, without being compressed,
+  // until there are enough of them to build the dictionary with which
+  // all data blocks are compressed.
+  bool sampling;
+  std::string dictionary;
+
+  // True while data blocks go through "pending" rather than straight to
+  // the file
+  bool defer_blocks() const { return num_threads > 0 || sampling; }
+
+  // Data blocks whose compression has been decided, and written.  The
+  // results of the blocks before results_applied have been accounted
+  // for in compression_failures; "results" holds those of the blocks
+  // from results_applied to num_blocks_written, if any.
+  uint64_t num_blocks;
+  uint64_t num_blocks_written;
+  uint64_t results_applied;
+  std::deque<CompressionResult> results;
+  int compression_failures;          // Failed in a row, of those applied
+  uint64_t last_compression_try;     // Last block compression was tried on
+
+  // Build the table instead if options.table_format is kPlainTable or
+  // kHashTable
+  PlainTableBuilder* plain;
+  HashTableBuilder* hash;
+
+  // Stored in the properties meta block; the sequence numbers and
+  // deletions are only counted if options.internal_keys is set
+  TableProperties props;
+
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
         index_block_options(opt),
@@ -51,12 +267,32 @@ struct TableBuilder::Rep {
         offset(0),
         data_block(&options),
         index_block(&index_block_options),
+        range_del_block(&options),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == NULL ? NULL
+        filter_block(opt.filter_policy == NULL ||
+                     opt.table_format != kBlockBasedTable ? NULL
                      : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+        pending_index_entry(false),
+        pending_bytes(0),
+        cv(&mu),
+        num_threads(0),
+        num_scheduled(0),
+        stop(false),
+        sampling(opt.compression_dictionary_bytes > 0 &&
+                 opt.table_format == kBlockBasedTable &&
+                 GetCompressor(opt.compression) != NULL),
+        num_blocks(0),
+        num_blocks_written(0),
+        results_applied(0),
+        compression_failures(0),
+        last_compression_try(0),
+        plain(opt.table_format == kPlainTable
+              ? new PlainTableBuilder(opt, f) : NULL),
+        hash(opt.table_format == kHashTable
+             ? new HashTableBuilder(opt, f) : NULL) {
     index_block_options.block_restart_interval = 1;
+    index_block_options.block_format_version = 1;
   }
 };
 
@@ -65,14 +301,55 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
   if (rep_->filter_block != NULL) {
     rep_->filter_block->StartBlock(0);
   }
+  if (options.compression_threads > 1 &&
+      options.table_format == kBlockBasedTable) {
+    rep_->num_threads = options.compression_threads;
+    GetCompressionPool()->Reserve(options.env, options.compression_threads);
+  }
 }
 
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
+  {
+    MutexLock l(&rep_->mu);
+    rep_->stop = true;
+    while (rep_->num_scheduled > 0) {
+      rep_->cv.Wait();
+    }
+  }
+  for (size_t i = 0; i < rep_->pending.size(); i++) {
+    delete rep_->pending[i];
+  }
   delete rep_->filter_block;
+  delete rep_->plain;
+  delete rep_->hash;
   delete rep_;
 }
 
+// Compress the contents of "b" with its codec and "dictionary".
+static void CompressPendingBlock(const Slice& dictionary, PendingBlock* b) {
+  if (CompressBlock(b->raw, dictionary, &b->type,
+                    &b->compressed).data() == b->raw.data()) {
+    b->compressed.clear();
+  }
+}
+
+void TableBuilder::CompressNextBlock(void* arg) {
+  Rep* r = reinterpret_cast<Rep*>(arg);
+  MutexLock l(&r->mu);
+  assert(!r->to_compress.empty());
+  PendingBlock* b = r->to_compress.front();
+  r->to_compress.pop_front();
+  if (!r->stop) {
+    r->mu.Unlock();
+    CompressPendingBlock(r->dictionary, b);
+    r->mu.Lock();
+  }
+  b->done = true;
+  r->num_scheduled--;
+  r->cv.SignalAll();
+}
+
 Status TableBuilder::ChangeOptions(const Options& options) {
   // Note: if more fields are added to Options, update
   // this function to catch changes that should not be allowed to
@@ -80,12 +357,17 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.internal_keys != rep_->options.internal_keys) {
+    return Status::InvalidArgument(
+        "changing internal_keys while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
   rep_->options = options;
   rep_->index_block_options = options;
   rep_->index_block_options.block_restart_interval = 1;
+  rep_->index_block_options.block_format_version = 1;
   return Status::OK();
 }
 
@@ -93,6 +375,23 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   Rep* r = rep_;
   assert(!r->closed);
   if (!ok()) return;
+  if (r->options.internal_keys) {
+    AddSequence(key, r->props.num_entries + r->props.num_range_deletions == 0,
+                &r->props);
+    if (key.size() >= 8 && ExtractValueType(key) == kTypeDeletion) {
+      r->props.num_deletions++;
+    }
+  }
+  r->props.num_entries++;
+  r->props.raw_key_size += key.size();
+  r->props.raw_value_size += value.size();
+  if (r->plain != NULL) {
+    r->plain->Add(key, value);
+    return;
+  } else if (r->hash != NULL) {
+    r->hash->Add(key, value);
+    return;
+  }
   if (r->num_entries > 0) {
     assert(r->options.comparator->Compare(key, Slice(r->last_key)) > 0);
   }
@@ -100,14 +399,25 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->pending_index_entry) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
-    r->pending_handle.EncodeTo(&handle_encoding);
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
+    if (!r->pending.empty()) {
+      // The previous block has not been written yet
+      r->pending.back()->index_key = r->last_key;
+      r->pending.back()->has_index_key = true;
+    } else {
+      std::string handle_encoding;
+      r->pending_handle.EncodeTo(&handle_encoding);
+      r->index_block.Add(r->last_key, Slice(handle_encoding));
+    }
     r->pending_index_entry = false;
   }
 
   if (r->filter_block != NULL) {
-    r->filter_block->AddKey(key);
+    if (r->defer_blocks()) {
+      r->block_keys.append(key.data(), key.size());
+      r->block_key_sizes.push_back(key.size());
+    } else {
+      r->filter_block->AddKey(key);
+    }
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -120,14 +430,61 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeDeletion(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  if (r->options.internal_keys) {
+    AddSequence(key, r->props.num_entries + r->props.num_range_deletions == 0,
+                &r->props);
+  }
+  r->props.num_range_deletions++;
+  if (r->plain != NULL) {
+    r->plain->AddRangeDeletion(key, value);
+    return;
+  } else if (r->hash != NULL) {
+    r->hash->AddRangeDeletion(key, value);
+    return;
+  }
+  r->range_del_block.Add(key, value);
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
   if (!ok()) return;
-  if (r->data_block.empty()) return;
+  if (r->plain != NULL || r->hash != NULL || r->data_block.empty()) return;
   assert(!r->pending_index_entry);
+  if (r->defer_blocks()) {
+    PendingBlock* b = new PendingBlock;
+    b->raw = r->data_block.Finish().ToString();
+    b->type = ChooseCompression();
+    b->tried = (GetCompressor(b->type) != NULL);
+    b->keys.swap(r->block_keys);
+    b->key_sizes.swap(r->block_key_sizes);
+    r->data_block.Reset();
+    r->pending.push_back(b);
+    r->pending_bytes += b->raw.size();
+    r->pending_index_entry = true;
+    if (r->sampling) {
+      if (r->pending_bytes < r->options.compression_dictionary_bytes *
+                             kDictionarySampleRatio) {
+        return;
+      }
+      BuildDictionary();
+    } else {
+      MutexLock l(&r->mu);
+      r->to_compress.push_back(b);
+      r->num_scheduled++;
+      GetCompressionPool()->Schedule(&TableBuilder::CompressNextBlock, r);
+    }
+    WritePendingBlocks(false);
+    return;
+  }
   WriteBlock(&r->data_block, &r->pending_handle);
   if (ok()) {
+    r->props.num_data_blocks++;
+    r->props.data_size += r->pending_handle.size() + kBlockTrailerSize;
     r->pending_index_entry = true;
     r->status = r->file->Flush();
   }
@@ -136,6 +493,93 @@ void TableBuilder::Flush() {
   }
 }
 
+// Build the dictionary from the blocks sampled so far, if there are
+// enough of them, and hand those blocks over for compression.
+void TableBuilder::BuildDictionary() {
+  Rep* r = rep_;
+  assert(r->sampling);
+  r->sampling = false;
+  const size_t max_bytes = r->options.compression_dictionary_bytes;
+  if (r->pending_bytes >= max_bytes * kDictionarySampleRatio) {
+    std::vector<Slice> samples;
+    for (size_t i = 0; i < r->pending.size(); i++) {
+      samples.push_back(r->pending[i]->raw);
+    }
+    const Compressor* compressor = GetCompressor(r->options.compression);
+    if (!compressor->TrainDictionary(samples, max_bytes, &r->dictionary)) {
+      r->dictionary.clear();  // The codec does not use dictionaries
+    }
+  }
+
+  if (r->num_threads > 0) {
+    MutexLock l(&r->mu);
+    for (size_t i = 0; i < r->pending.size(); i++) {
+      r->to_compress.push_back(r->pending[i]);
+      r->num_scheduled++;
+      GetCompressionPool()->Schedule(&TableBuilder::CompressNextBlock, r);
+    }
+  } else {
+    for (size_t i = 0; i < r->pending.size(); i++) {
+      CompressPendingBlock(r->dictionary, r->pending[i]);
+      r->pending[i]->done = true;
+    }
+  }
+}
+
+// Write the blocks at the front of rep_->pending that have been
+// compressed.  Waits for all of them if "all" is set, and otherwise only
+// while too many blocks are pending.
+void TableBuilder::WritePendingBlocks(bool all) {
+  Rep* r = rep_;
+  const size_t max_pending = kPendingBlocksPerThread * r->num_threads;
+  while (!r->pending.empty()) {
+    PendingBlock* b = r->pending.front();
+    {
+      MutexLock l(&r->mu);
+      while (!b->done && (all || r->pending.size() > max_pending)) {
+        r->cv.Wait();
+      }
+      if (!b->done) {
+        break;
+      }
+    }
+    r->pending.pop_front();
+    r->pending_bytes -= b->raw.size();
+
+    if (ok()) {
+      if (r->filter_block != NULL) {
+        size_t pos = 0;
+        for (size_t i = 0; i < b->key_sizes.size(); i++) {
+          r->filter_block->AddKey(Slice(b->keys.data() + pos,
+                                        b->key_sizes[i]));
+          pos += b->key_sizes[i];
+        }
+      }
+      BlockHandle handle;
+      WriteRawBlock(b->type == kNoCompression ? b->raw : b->compressed,
+                    b->type, &handle);
+      RecordCompression(GetCompressionResult(b->tried, b->type));
+      if (ok()) {
+        r->props.num_data_blocks++;
+        r->props.data_size += handle.size() + kBlockTrailerSize;
+        r->status = r->file->Flush();
+      }
+      if (b->has_index_key) {
+        std::string handle_encoding;
+        handle.EncodeTo(&handle_encoding);
+        r->index_block.Add(b->index_key, Slice(handle_encoding));
+      } else {
+        // The last block so far; its index entry is added later
+        r->pending_handle = handle;
+      }
+      if (r->filter_block != NULL) {
+        r->filter_block->StartBlock(r->offset);
+      }
+    }
+    delete b;
+  }
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
@@ -145,33 +589,87 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   Rep* r = rep_;
   Slice raw = block->Finish();
 
-  Slice block_contents;
+  // Only data blocks use the dictionary: the others are read before it.
+  // They may also skip compression.
+  const bool data = (block == &r->data_block);
+  Slice dictionary;
   CompressionType type = r->options.compression;
-  // TODO(postrelease): Support more compression options: zlib?
-  switch (type) {
-    case kNoCompression:
-      block_contents = raw;
-      break;
-
-    case kSnappyCompression: {
-      std::string* compressed = &r->compressed_output;
-      if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
-          compressed->size() < raw.size() - (raw.size() / 8u)) {
-        block_contents = *compressed;
-      } else {
-        // Snappy not supported, or compressed less than 12.5%, so just
-        // store uncompressed form
-        block_contents = raw;
-        type = kNoCompression;
-      }
-      break;
-    }
+  if (data) {
+    dictionary = r->dictionary;
+    type = ChooseCompression();
   }
+  const bool tried = (GetCompressor(type) != NULL);
+  Slice block_contents = CompressBlock(raw, dictionary, &type,
+                                       &r->compressed_output);
   WriteRawBlock(block_contents, type, handle);
+  if (data) {
+    RecordCompression(GetCompressionResult(tried, type));
+  }
   r->compressed_output.clear();
   block->Reset();
 }
 
+// Return the compression for the next data block: options.compression,
+// or kNoCompression while backing off after blocks that did not compress.
+CompressionType TableBuilder::ChooseCompression() {
+  Rep* r = rep_;
+  const uint64_t block = r->num_blocks++;
+  const CompressionType type = r->options.compression;
+  if (GetCompressor(type) == NULL) {
+    return type;
+  }
+
+  // Blocks held back to build the dictionary have no results yet
+  if (!r->sampling) {
+    while (r->results_applied + kCompressionResultDelay <= block) {
+      CompressionResult result;
+      if (r->results_applied < r->num_blocks_written) {
+        result = r->results.front();
+        r->results.pop_front();
+      } else {
+        // Not written yet; wait for a compression thread to be done
+        PendingBlock* b =
+            r->pending[r->results_applied - r->num_blocks_written];
+        MutexLock l(&r->mu);
+        while (!b->done) {
+          r->cv.Wait();
+        }
+        result = GetCompressionResult(b->tried, b->type);
+      }
+      r->results_applied++;
+      if (result == kCompressionSaved) {
+        r->compression_failures = 0;
+      } else if (result == kCompressionFailed) {
+        r->compression_failures++;
+      }
+    }
+  }
+
+  if (r->compression_failures >= kCompressionFailuresBeforeSkipping) {
+    const int shift = std::min(
+        r->compression_failures - kCompressionFailuresBeforeSkipping + 1,
+        kMaxCompressionSkipShift);
+    if (block - r->last_compression_try < (1u << shift)) {
+      r->props.num_compression_skipped_blocks++;
+      return kNoCompression;
+    }
+  }
+  r->last_compression_try = block;
+  return type;
+}
+
+// Record the result of compressing the data block just written.
+void TableBuilder::RecordCompression(int result) {
+  Rep* r = rep_;
+  if (r->num_blocks_written >= r->results_applied) {
+    r->results.push_back(static_cast<CompressionResult>(result));
+  }
+  r->num_blocks_written++;
+  if (result == kCompressionFailed) {
+    r->props.num_incompressible_blocks++;
+  }
+}
+
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
                                  CompressionType type,
                                  BlockHandle* handle) {
@@ -193,26 +691,84 @@ void TableBuilder::WriteRawBlock(const Slice& block_contents,
 }
 
 Status TableBuilder::status() const {
+  if (rep_->plain != NULL) {
+    return rep_->plain->status();
+  } else if (rep_->hash != NULL) {
+    return rep_->hash->status();
+  }
   return rep_->status;
 }
 
 Status TableBuilder::Finish() {
   Rep* r = rep_;
+  if (r->plain != NULL || r->hash != NULL) {
+    assert(!r->closed);
+    r->closed = true;
+    return r->plain != NULL ? r->plain->Finish() : r->hash->Finish();
+  }
   Flush();
+  if (r->sampling) {
+    BuildDictionary();
+  }
+  WritePendingBlocks(true);
   assert(!r->closed);
   r->closed = true;
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle range_del_block_handle, dictionary_block_handle;
+  BlockHandle properties_block_handle;
+
+  // Write compression dictionary block
+  const bool has_dictionary = !r->dictionary.empty();
+  if (ok() && has_dictionary) {
+    WriteRawBlock(r->dictionary, kNoCompression, &dictionary_block_handle);
+  }
 
   // Write filter block
   if (ok() && r->filter_block != NULL) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
+    r->props.filter_size = filter_block_handle.size() + kBlockTrailerSize;
+  }
+
+  // Write range deletion block
+  const bool has_range_dels = !r->range_del_block.empty();
+  if (ok() && has_range_dels) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
+  }
+
+  // Write index block, ahead of the properties that record its size
+  if (ok()) {
+    if (r->pending_index_entry) {
+      r->options.comparator->FindShortSuccessor(&r->last_key);
+      std::string handle_encoding;
+      r->pending_handle.EncodeTo(&handle_encoding);
+      r->index_block.Add(r->last_key, Slice(handle_encoding));
+      r->pending_index_entry = false;
+    }
+    WriteBlock(&r->index_block, &index_block_handle);
+    r->props.index_size = index_block_handle.size() + kBlockTrailerSize;
+  }
+
+  // Write properties block
+  if (ok()) {
+    r->props.compression = r->options.compression;
+    std::string contents;
+    EncodeTableProperties(r->props, &contents);
+    WriteRawBlock(contents, kNoCompression, &properties_block_handle);
   }
 
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
+    // Meta block names are ordered bytewise, whatever the table comparator
+    Options meta_index_options = r->options;
+    meta_index_options.comparator = BytewiseComparator();
+    BlockBuilder meta_index_block(&meta_index_options);
+    if (has_dictionary) {
+      std::string handle_encoding;
+      dictionary_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("compression.dictionary", handle_encoding);
+    }
     if (r->filter_block != NULL) {
       // Add mapping from "filter.Name" to location of filter data
       std::string key = "filter.";
@@ -221,21 +777,18 @@ Status TableBuilder::Finish() {
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
-
-    // TODO(postrelease): Add stats and other meta blocks
-    WriteBlock(&meta_index_block, &metaindex_block_handle);
-  }
-
-  // Write index block
-  if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
+    {
       std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
+      properties_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("properties", handle_encoding);
     }
-    WriteBlock(&r->index_block, &index_block_handle);
+    if (has_range_dels) {
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("rangedel", handle_encoding);
+    }
+
+    WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
 
   // Write footer
@@ -260,11 +813,25 @@ void TableBuilder::Abandon() {
 }
 
 uint64_t TableBuilder::NumEntries() const {
+  if (rep_->plain != NULL) {
+    return rep_->plain->NumEntries();
+  } else if (rep_->hash != NULL) {
+    return rep_->hash->NumEntries();
+  }
   return rep_->num_entries;
 }
 
+const TableProperties& TableBuilder::GetProperties() const {
+  return rep_->props;
+}
+
 uint64_t TableBuilder::FileSize() const {
-  return rep_->offset;
+  if (rep_->plain != NULL) {
+    return rep_->plain->FileSize();
+  } else if (rep_->hash != NULL) {
+    return rep_->hash->FileSize();
+  }
+  return rep_->offset + rep_->pending_bytes;
 }
 
 }  // namespace leveldb
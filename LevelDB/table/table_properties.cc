@@ -0,0 +1,146 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/table_properties.h"
+
+#include <stdio.h>
+#include "leveldb/comparator.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+TableProperties::TableProperties()
+    : num_entries(0),
+      num_deletions(0),
+      num_range_deletions(0),
+      raw_key_size(0),
+      raw_value_size(0),
+      num_data_blocks(0),
+      data_size(0),
+      index_size(0),
+      filter_size(0),
+      compression(kNoCompression),
+      num_incompressible_blocks(0),
+      num_compression_skipped_blocks(0),
+      smallest_seqno(0),
+      largest_seqno(0) {
+}
+
+std::string TableProperties::ToString() const {
+  char buf[500];
+  snprintf(buf, sizeof(buf),
+           "entries: %llu deletions: %llu range deletions: %llu "
+           "raw key size: %llu raw value size: %llu "
+           "data blocks: %llu data size: %llu index size: %llu "
+           "filter size: %llu compression: %d "
+           "incompressible blocks: %llu compression skipped blocks: %llu "
+           "seqnos: %llu..%llu",
+           static_cast<unsigned long long>(num_entries),
+           static_cast<unsigned long long>(num_deletions),
+           static_cast<unsigned long long>(num_range_deletions),
+           static_cast<unsigned long long>(raw_key_size),
+           static_cast<unsigned long long>(raw_value_size),
+           static_cast<unsigned long long>(num_data_blocks),
+           static_cast<unsigned long long>(data_size),
+           static_cast<unsigned long long>(index_size),
+           static_cast<unsigned long long>(filter_size),
+           static_cast<int>(compression),
+           static_cast<unsigned long long>(num_incompressible_blocks),
+           static_cast<unsigned long long>(num_compression_skipped_blocks),
+           static_cast<unsigned long long>(smallest_seqno),
+           static_cast<unsigned long long>(largest_seqno));
+  return buf;
+}
+
+static void AddProperty(BlockBuilder* block, const char* name,
+                        uint64_t value) {
+  std::string encoding;
+  PutVarint64(&encoding, value);
+  block->Add(name, encoding);
+}
+
+void EncodeTableProperties(const TableProperties& props, std::string* dst) {
+  Options options;
+  options.comparator = BytewiseComparator();
+  BlockBuilder block(&options);
+  // Names must be added in bytewise order
+  AddProperty(&block, "leveldb.compression", props.compression);
+  AddProperty(&block, "leveldb.compression.incompressible",
+              props.num_incompressible_blocks);
+  AddProperty(&block, "leveldb.compression.skipped",
+              props.num_compression_skipped_blocks);
+  AddProperty(&block, "leveldb.data.blocks", props.num_data_blocks);
+  AddProperty(&block, "leveldb.data.size", props.data_size);
+  AddProperty(&block, "leveldb.deletions", props.num_deletions);
+  AddProperty(&block, "leveldb.entries", props.num_entries);
+  AddProperty(&block, "leveldb.filter.size", props.filter_size);
+  AddProperty(&block, "leveldb.index.size", props.index_size);
+  AddProperty(&block, "leveldb.range-deletions", props.num_range_deletions);
+  AddProperty(&block, "leveldb.raw.key.size", props.raw_key_size);
+  AddProperty(&block, "leveldb.raw.value.size", props.raw_value_size);
+  AddProperty(&block, "leveldb.seqno.largest", props.largest_seqno);
+  AddProperty(&block, "leveldb.seqno.smallest", props.smallest_seqno);
+  Slice contents = block.Finish();
+  dst->assign(contents.data(), contents.size());
+}
+
+Status DecodeTableProperties(const Slice& contents, TableProperties* props) {
+  *props = TableProperties();
+  BlockContents block_contents;
+  block_contents.data = contents;
+  block_contents.cachable = false;
+  block_contents.heap_allocated = false;
+  Block block(block_contents);
+  Iterator* iter = block.NewIterator(BytewiseComparator());
+  Status s;
+  for (iter->SeekToFirst(); s.ok() && iter->Valid(); iter->Next()) {
+    Slice input = iter->value();
+    uint64_t value;
+    if (!GetVarint64(&input, &value)) {
+      s = Status::Corruption("bad table property", iter->key());
+      break;
+    }
+    // Properties added by later releases are skipped
+    const Slice name = iter->key();
+    if (name == "leveldb.compression") {
+      props->compression = static_cast<CompressionType>(value);
+    } else if (name == "leveldb.compression.incompressible") {
+      props->num_incompressible_blocks = value;
+    } else if (name == "leveldb.compression.skipped") {
+      props->num_compression_skipped_blocks = value;
+    } else if (name == "leveldb.data.blocks") {
+      props->num_data_blocks = value;
+    } else if (name == "leveldb.data.size") {
+      props->data_size = value;
+    } else if (name == "leveldb.deletions") {
+      props->num_deletions = value;
+    } else if (name == "leveldb.entries") {
+      props->num_entries = value;
+    } else if (name == "leveldb.filter.size") {
+      props->filter_size = value;
+    } else if (name == "leveldb.index.size") {
+      props->index_size = value;
+    } else if (name == "leveldb.range-deletions") {
+      props->num_range_deletions = value;
+    } else if (name == "leveldb.raw.key.size") {
+      props->raw_key_size = value;
+    } else if (name == "leveldb.raw.value.size") {
+      props->raw_value_size = value;
+    } else if (name == "leveldb.seqno.largest") {
+      props->largest_seqno = value;
+    } else if (name == "leveldb.seqno.smallest") {
+      props->smallest_seqno = value;
+    }
+  }
+  if (s.ok()) {
+    s = iter->status();
+  }
+  delete iter;
+  return s;
+}
+
+}  // namespace leveldb
@@ -9,13 +9,17 @@
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/compressor.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
 #include "leveldb/table_builder.h"
+#include "leveldb/table_properties.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "util/coding.h"
 #include "util/random.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
@@ -398,6 +402,8 @@ class DBConstructor: public Constructor {
 
 enum TestType {
   TABLE_TEST,
+  PLAIN_TABLE_TEST,
+  HASH_TABLE_TEST,
   BLOCK_TEST,
   MEMTABLE_TEST,
   DB_TEST
@@ -407,30 +413,42 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  int block_format_version;
 };
 
 static const TestArgs kTestArgList[] = {
-  { TABLE_TEST, false, 16 },
-  { TABLE_TEST, false, 1 },
-  { TABLE_TEST, false, 1024 },
-  { TABLE_TEST, true, 16 },
-  { TABLE_TEST, true, 1 },
-  { TABLE_TEST, true, 1024 },
-
-  { BLOCK_TEST, false, 16 },
-  { BLOCK_TEST, false, 1 },
-  { BLOCK_TEST, false, 1024 },
-  { BLOCK_TEST, true, 16 },
-  { BLOCK_TEST, true, 1 },
-  { BLOCK_TEST, true, 1024 },
+  { TABLE_TEST, false, 16, 1 },
+  { TABLE_TEST, false, 1, 1 },
+  { TABLE_TEST, false, 1024, 1 },
+  { TABLE_TEST, true, 16, 1 },
+  { TABLE_TEST, true, 1, 1 },
+  { TABLE_TEST, true, 1024, 1 },
+  { TABLE_TEST, false, 16, 2 },
+  { TABLE_TEST, true, 1, 2 },
+
+  // Plain and hash tables have no blocks
+  { PLAIN_TABLE_TEST, false, 16, 1 },
+  { PLAIN_TABLE_TEST, true, 16, 1 },
+  { HASH_TABLE_TEST, false, 16, 1 },
+  { HASH_TABLE_TEST, true, 16, 1 },
+
+  { BLOCK_TEST, false, 16, 1 },
+  { BLOCK_TEST, false, 1, 1 },
+  { BLOCK_TEST, false, 1024, 1 },
+  { BLOCK_TEST, true, 16, 1 },
+  { BLOCK_TEST, true, 1, 1 },
+  { BLOCK_TEST, true, 1024, 1 },
+  { BLOCK_TEST, false, 16, 2 },
+  { BLOCK_TEST, true, 1, 2 },
+  { BLOCK_TEST, false, 1024, 2 },
 
   // Restart interval does not matter for memtables
-  { MEMTABLE_TEST, false, 16 },
-  { MEMTABLE_TEST, true, 16 },
+  { MEMTABLE_TEST, false, 16, 1 },
+  { MEMTABLE_TEST, true, 16, 1 },
 
   // Do not bother with restart interval variations for DB
-  { DB_TEST, false, 16 },
-  { DB_TEST, true, 16 },
+  { DB_TEST, false, 16, 1 },
+  { DB_TEST, true, 16, 1 },
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
@@ -444,6 +462,7 @@ class Harness {
     options_ = Options();
 
     options_.block_restart_interval = args.restart_interval;
+    options_.block_format_version = args.block_format_version;
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
@@ -454,6 +473,14 @@ class Harness {
       case TABLE_TEST:
         constructor_ = new TableConstructor(options_.comparator);
         break;
+      case PLAIN_TABLE_TEST:
+        options_.table_format = kPlainTable;
+        constructor_ = new TableConstructor(options_.comparator);
+        break;
+      case HASH_TABLE_TEST:
+        options_.table_format = kHashTable;
+        constructor_ = new TableConstructor(options_.comparator);
+        break;
       case BLOCK_TEST:
         constructor_ = new BlockConstructor(options_.comparator);
         break;
@@ -674,6 +701,117 @@ TEST(Harness, ZeroRestartPointsInBlock) {
   delete iter;
 }
 
+// Prev() keeps the entries of a restart interval it decoded; check that
+// mixing it with Next() and Seek() still visits the right entries.
+TEST(Harness, BlockPrevWithinRestartInterval) {
+  Options options;
+  options.block_restart_interval = 4;
+  BlockBuilder builder(&options);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 10; i++) {
+    char buf[20];
+    snprintf(buf, sizeof(buf), "key%03d", i);
+    keys.push_back(buf);
+    builder.Add(keys.back(), std::string(i, 'v'));
+  }
+  BlockContents contents;
+  contents.data = builder.Finish();
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+  Iterator* iter = block.NewIterator(BytewiseComparator());
+
+  // Steps to take, +1 for Next() and -1 for Prev()
+  const int steps[] = { -1, -1, +1, -1, -1, -1, -1, +1, +1, -1, -1, -1 };
+  int index = 9;
+  iter->SeekToLast();
+  for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    if (steps[i] > 0) {
+      iter->Next();
+    } else {
+      iter->Prev();
+    }
+    index += steps[i];
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(keys[index], iter->key().ToString());
+    ASSERT_EQ(std::string(index, 'v'), iter->value().ToString());
+  }
+
+  iter->Seek("key006");
+  for (int i = 6; i >= 0; i--) {
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(keys[i], iter->key().ToString());
+    iter->Prev();
+  }
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_OK(iter->status());
+  delete iter;
+}
+
+// Blocks of internal keys written with block_format_version 2 store the
+// trailers as deltas and, while all values have one size, no value
+// lengths; check that they decode to the same entries and are smaller.
+TEST(Harness, BlockFormatVersion2) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  for (int varying = 0; varying < 2; varying++) {
+    Options options;
+    options.comparator = &cmp;
+    options.internal_keys = true;
+    options.block_restart_interval = 4;
+    BlockBuilder v1(&options);
+    Options options2 = options;
+    options2.block_format_version = 2;
+    BlockBuilder v2(&options2);
+    std::vector<std::string> keys, values;
+    for (int i = 0; i < 20; i++) {
+      char buf[20];
+      snprintf(buf, sizeof(buf), "key%03d", i);
+      for (int j = 0; j < 3; j++) {
+        const SequenceNumber seq = (i % 5 == 0) ? 0 : 1000 + i * 7 - j;
+        InternalKey key(buf, seq, j == 1 ? kTypeDeletion : kTypeValue);
+        keys.push_back(key.Encode().ToString());
+        values.push_back(std::string(varying && i == 13 ? 9 : 8, 'a' + i));
+        if (seq == 0) break;
+      }
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+      v1.Add(keys[i], values[i]);
+      v2.Add(keys[i], values[i]);
+    }
+    const Slice v1_contents = v1.Finish();
+    BlockContents contents;
+    contents.data = v2.Finish();
+    contents.cachable = false;
+    contents.heap_allocated = false;
+    ASSERT_LT(contents.data.size(), v1_contents.size() * 3 / 4);
+    Block block(contents);
+    Iterator* iter = block.NewIterator(&cmp);
+
+    iter->SeekToFirst();
+    for (size_t i = 0; i < keys.size(); i++) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(EscapeString(keys[i]), EscapeString(iter->key()));
+      ASSERT_EQ(values[i], iter->value().ToString());
+      iter->Next();
+    }
+    ASSERT_TRUE(!iter->Valid());
+    iter->SeekToLast();
+    for (size_t i = keys.size(); i > 0; i--) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(EscapeString(keys[i - 1]), EscapeString(iter->key()));
+      iter->Prev();
+    }
+    ASSERT_TRUE(!iter->Valid());
+    for (size_t i = 0; i < keys.size(); i++) {
+      iter->Seek(keys[i]);
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(EscapeString(keys[i]), EscapeString(iter->key()));
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+  }
+}
+
 // Test the empty key
 TEST(Harness, SimpleEmptyKey) {
   for (int i = 0; i < kNumTestArgs; i++) {
@@ -735,7 +873,7 @@ TEST(Harness, Randomized) {
 
 TEST(Harness, RandomizedLongDB) {
   Random rnd(test::RandomSeed());
-  TestArgs args = { DB_TEST, false, 16 };
+  TestArgs args = { DB_TEST, false, 16, 1 };
   Init(args);
   int num_entries = 100000;
   for (int e = 0; e < num_entries; e++) {
@@ -827,6 +965,64 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
 
 }
 
+TEST(TableTest, ApproximateOffsetOfPlainTable) {
+  TableConstructor c(BytewiseComparator());
+  c.Add("k01", "hello");
+  c.Add("k02", "hello2");
+  c.Add("k03", std::string(10000, 'x'));
+  c.Add("k04", std::string(200000, 'x'));
+  c.Add("k05", std::string(300000, 'x'));
+  c.Add("k06", "hello3");
+  c.Add("k07", std::string(100000, 'x'));
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.table_format = kPlainTable;
+  c.Finish(options, &keys, &kvmap);
+
+  // Offsets are exact, records being neither blocked nor compressed
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("abc"),       0,      0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k01"),       0,      0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k01a"),     10,     10));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k02"),      10,     10));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k03"),      21,     21));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k04"),   10027,  10027));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k05"),  210034, 210034));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k06"),  510041, 510041));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k07"),  510052, 510052));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"),  610059, 610059));
+}
+
+TEST(TableTest, ApproximateOffsetOfHashTable) {
+  TableConstructor c(BytewiseComparator());
+  c.Add("k01", "hello");
+  c.Add("k02", "hello2");
+  c.Add("k03", std::string(10000, 'x'));
+  c.Add("k04", std::string(200000, 'x'));
+  c.Add("k05", std::string(300000, 'x'));
+  c.Add("k06", "hello3");
+  c.Add("k07", std::string(100000, 'x'));
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.table_format = kHashTable;
+  c.Finish(options, &keys, &kvmap);
+
+  // Offsets are those of the records in sorted order, sampled every
+  // block_size bytes
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("abc"),       0,      0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k01"),       0,      0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k01a"),  10027,  10027));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k02"),   10027,  10027));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k03"),   10027,  10027));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k04"),   10027,  10027));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k05"),  210034, 210034));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k06"),  510041, 510041));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k07"),  510052, 510052));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"),  610059, 610059));
+}
+
 static bool SnappyCompressionSupported() {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
@@ -861,6 +1057,325 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"),    4000,   6000));
 }
 
+// A run-length codec for TEST(TableTest, Compressors)
+class RunLengthCompressor : public Compressor {
+ public:
+  virtual const char* Name() const { return "test.RunLength"; }
+
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    output->clear();
+    PutVarint32(output, static_cast<uint32_t>(input.size()));
+    size_t i = 0;
+    while (i < input.size()) {
+      size_t n = 1;
+      while (i + n < input.size() && n < 255 && input[i + n] == input[i]) {
+        n++;
+      }
+      output->push_back(static_cast<char>(n));
+      output->push_back(input[i]);
+      i += n;
+    }
+    return true;
+  }
+
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* length) const {
+    Slice in = input;
+    uint32_t n;
+    if (!GetVarint32(&in, &n)) return false;
+    *length = n;
+    return true;
+  }
+
+  virtual bool Uncompress(const Slice& input, char* output) const {
+    Slice in = input;
+    uint32_t length;
+    if (!GetVarint32(&in, &length) || in.size() % 2 != 0) return false;
+    size_t pos = 0;
+    for (size_t i = 0; i < in.size(); i += 2) {
+      const size_t n = static_cast<unsigned char>(in[i]);
+      if (pos + n > length) return false;
+      memset(output + pos, in[i + 1], n);
+      pos += n;
+    }
+    return pos == length;
+  }
+};
+
+TEST(TableTest, Compressors) {
+  static RunLengthCompressor run_length;
+  const CompressionType kRunLengthCompression =
+      static_cast<CompressionType>(0x80);
+  RegisterCompressor(kRunLengthCompression, &run_length);
+  ASSERT_TRUE(GetCompressor(kRunLengthCompression) == &run_length);
+  ASSERT_TRUE(GetCompressor(kNoCompression) == NULL);
+
+  const CompressionType kTypes[] = {
+    kNoCompression, kSnappyCompression, kZlibCompression, kLZ4Compression,
+    kZstdCompression, kRunLengthCompression
+  };
+  for (size_t t = 0; t < sizeof(kTypes) / sizeof(kTypes[0]); t++) {
+    // Codecs that were not built store their blocks uncompressed
+    const Compressor* compressor = GetCompressor(kTypes[t]);
+    std::string tmp;
+    const bool available =
+        compressor != NULL &&
+        compressor->Compress(std::string(1000, 'a'), &tmp);
+
+    TableConstructor c(BytewiseComparator());
+    for (int i = 0; i < 100; i++) {
+      char key[20];
+      snprintf(key, sizeof(key), "k%03d", i);
+      c.Add(key, std::string(1000, 'a' + i % 26));
+    }
+    std::vector<std::string> keys;
+    KVMap kvmap;
+    Options options;
+    options.block_size = 1024;
+    options.compression = kTypes[t];
+    c.Finish(options, &keys, &kvmap);
+
+    Iterator* iter = c.NewIterator();
+    KVMap::const_iterator model = kvmap.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model) {
+      ASSERT_TRUE(model != kvmap.end());
+      ASSERT_EQ(model->first, iter->key().ToString());
+      ASSERT_EQ(model->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(model == kvmap.end());
+    ASSERT_OK(iter->status());
+    delete iter;
+
+    if (available) {
+      ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 0, 20000));
+    } else {
+      ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 100000, 110000));
+    }
+  }
+}
+
+TEST(TableTest, CompressionDictionary) {
+  if (GetCompressor(kZlibCompression) == NULL) {
+    fprintf(stderr, "skipping dictionary compression tests\n");
+    return;
+  }
+
+  // Values with much in common with each other, but that each fill most
+  // of a block
+  Random rnd(301);
+  const std::string common = test::RandomKey(&rnd, 200);
+  KVMap data;
+  for (int i = 0; i < 400; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%06d", i);
+    data[key] = common + test::RandomKey(&rnd, 10);
+  }
+
+  uint64_t sizes[3];
+  for (int i = 0; i < 3; i++) {
+    TableConstructor c(BytewiseComparator());
+    for (KVMap::const_iterator it = data.begin(); it != data.end(); ++it) {
+      c.Add(it->first, it->second);
+    }
+    std::vector<std::string> keys;
+    KVMap kvmap;
+    Options options;
+    options.block_size = 256;
+    options.compression = kZlibCompression;
+    options.compression_dictionary_bytes = (i == 0) ? 0 : 4096;
+    options.compression_threads = (i == 2) ? 4 : 1;
+    c.Finish(options, &keys, &kvmap);
+
+    Iterator* iter = c.NewIterator();
+    KVMap::const_iterator model = kvmap.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model) {
+      ASSERT_TRUE(model != kvmap.end());
+      ASSERT_EQ(model->first, iter->key().ToString());
+      ASSERT_EQ(model->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(model == kvmap.end());
+    ASSERT_OK(iter->status());
+    delete iter;
+    sizes[i] = c.ApproximateOffsetOf("xyz");
+  }
+
+  // The dictionary, which is included, holds the common part of the
+  // values, so that little of each block remains to be stored
+  ASSERT_LT(sizes[1] * 2, sizes[0]);
+  ASSERT_EQ(sizes[1], sizes[2]);
+}
+
+TEST(TableTest, ParallelCompression) {
+  Random rnd(301);
+  std::string tmp;
+  KVMap data;
+  for (int i = 0; i < 2000; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%06d", i);
+    data[key] = test::CompressibleString(&rnd, (i % 3) * 0.5, 300,
+                                         &tmp).ToString();
+  }
+  const FilterPolicy* filter_policy = NewBloomFilterPolicy(10);
+
+  // The table is the same whether its blocks are compressed by the
+  // building thread or by others
+  std::string contents[2];
+  for (int i = 0; i < 2; i++) {
+    Options options;
+    options.block_size = 1024;
+    options.filter_policy = filter_policy;
+    options.compression_threads = (i == 0) ? 1 : 4;
+    StringSink sink;
+    TableBuilder builder(options, &sink);
+    for (KVMap::const_iterator it = data.begin(); it != data.end(); ++it) {
+      builder.Add(it->first, it->second);
+      ASSERT_TRUE(builder.status().ok());
+    }
+    ASSERT_OK(builder.Finish());
+    ASSERT_EQ(sink.contents().size(), builder.FileSize());
+    contents[i] = sink.contents();
+  }
+  ASSERT_TRUE(contents[0] == contents[1]);
+
+  // An abandoned table waits for the compression pool to be done with it
+  Options options;
+  options.compression_threads = 4;
+  StringSink sink;
+  TableBuilder* builder = new TableBuilder(options, &sink);
+  for (KVMap::const_iterator it = data.begin(); it != data.end(); ++it) {
+    builder->Add(it->first, it->second);
+  }
+  builder->Abandon();
+  delete builder;
+  delete filter_policy;
+}
+
+// After data blocks that do not compress, TableBuilder only tries to
+// compress a few of the next ones, the same ones whatever the number of
+// compression threads.
+TEST(TableTest, SkipIncompressibleBlocks) {
+  static RunLengthCompressor run_length;
+  const CompressionType kRunLengthCompression =
+      static_cast<CompressionType>(0x80);
+  RegisterCompressor(kRunLengthCompression, &run_length);
+
+  // Random values, which the run-length codec makes larger, followed by
+  // runs of one byte
+  Random rnd(301);
+  std::string tmp;
+  KVMap data;
+  for (int i = 0; i < 1000; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%06d", i);
+    data[key] = (i < 200) ? test::RandomString(&rnd, 300, &tmp).ToString()
+                          : std::string(300, 'a' + i % 26);
+  }
+
+  std::string contents[2];
+  TableProperties props[2];
+  for (int i = 0; i < 2; i++) {
+    Options options;
+    options.block_size = 1024;
+    options.compression = kRunLengthCompression;
+    options.compression_threads = (i == 0) ? 1 : 4;
+    StringSink sink;
+    TableBuilder builder(options, &sink);
+    for (KVMap::const_iterator it = data.begin(); it != data.end(); ++it) {
+      builder.Add(it->first, it->second);
+    }
+    ASSERT_OK(builder.Finish());
+    contents[i] = sink.contents();
+    props[i] = builder.GetProperties();
+
+    StringSource* source = new StringSource(sink.contents());
+    Table* table;
+    ASSERT_OK(Table::Open(options, source, source->Size(), &table));
+    Iterator* iter = table->NewIterator(ReadOptions());
+    KVMap::const_iterator model = data.begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model) {
+      ASSERT_TRUE(model != data.end());
+      ASSERT_EQ(model->first, iter->key().ToString());
+      ASSERT_EQ(model->second, iter->value().ToString());
+    }
+    ASSERT_TRUE(model == data.end());
+    ASSERT_OK(iter->status());
+    delete iter;
+    ASSERT_EQ(props[i].ToString(), table->GetProperties()->ToString());
+    delete table;
+    delete source;
+  }
+  ASSERT_TRUE(contents[0] == contents[1]);
+  ASSERT_EQ(props[0].ToString(), props[1].ToString());
+
+  // Most of the random blocks were not compressed at all, and the blocks
+  // of runs were compressed again
+  const TableProperties& p = props[0];
+  ASSERT_GE(p.num_incompressible_blocks, 2u);
+  ASSERT_GT(p.num_compression_skipped_blocks, 2 * p.num_incompressible_blocks);
+  ASSERT_LT(p.num_incompressible_blocks + p.num_compression_skipped_blocks,
+            p.num_data_blocks / 2);
+  ASSERT_LT(p.data_size, 1000u * 300 / 2);
+}
+
+TEST(TableTest, Properties) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  const FilterPolicy* filter_policy = NewBloomFilterPolicy(10);
+  Options options;
+  options.comparator = &icmp;
+  options.internal_keys = true;
+  options.block_size = 1024;
+  options.filter_policy = filter_policy;
+  options.compression = kNoCompression;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  uint64_t raw_key_size = 0;
+  for (int i = 0; i < 1000; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%06d", i);
+    InternalKey ikey(key, 100 + i, (i % 10 == 0) ? kTypeDeletion : kTypeValue);
+    builder.Add(ikey.Encode(), (i % 10 == 0) ? "" : "value");
+    raw_key_size += ikey.Encode().size();
+  }
+  builder.AddRangeDeletion(InternalKey("k1", 50, kTypeRangeDeletion).Encode(),
+                           "k2");
+  ASSERT_OK(builder.Finish());
+
+  StringSource* source = new StringSource(sink.contents());
+  Table* table;
+  ASSERT_OK(Table::Open(options, source, source->Size(), &table));
+  const TableProperties* props = table->GetProperties();
+  ASSERT_TRUE(props != NULL);
+  ASSERT_EQ(1000u, props->num_entries);
+  ASSERT_EQ(100u, props->num_deletions);
+  ASSERT_EQ(1u, props->num_range_deletions);
+  ASSERT_EQ(raw_key_size, props->raw_key_size);
+  ASSERT_EQ(900u * 5, props->raw_value_size);
+  ASSERT_EQ(50u, props->smallest_seqno);
+  ASSERT_EQ(1099u, props->largest_seqno);
+  ASSERT_EQ(kNoCompression, props->compression);
+  ASSERT_GT(props->num_data_blocks, 10u);
+  ASSERT_GT(props->filter_size, 0u);
+  ASSERT_GT(props->index_size, 0u);
+  ASSERT_LT(props->data_size + props->index_size + props->filter_size,
+            sink.contents().size());
+  ASSERT_EQ(builder.GetProperties().ToString(), props->ToString());
+  delete table;
+  delete source;
+
+  // Tables of other keys record neither deletions nor sequence numbers
+  options = Options();
+  StringSink sink2;
+  TableBuilder builder2(options, &sink2);
+  builder2.Add("a", "1");
+  builder2.Add("b", "22");
+  ASSERT_OK(builder2.Finish());
+  ASSERT_EQ(2u, builder2.GetProperties().num_entries);
+  ASSERT_EQ(0u, builder2.GetProperties().num_deletions);
+  ASSERT_EQ(0u, builder2.GetProperties().largest_seqno);
+  ASSERT_EQ(3u, builder2.GetProperties().raw_value_size);
+  delete filter_policy;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -140,7 +140,18 @@ bool GetVarint32(Slice* input, uint32_t* value) {
   }
 }
 
-const char* GetVarint64Ptr(const char* p, const char* limit, uint64_t* value) {
+const char* GetVarint32ArrayFallback(const char* p,
+                                     const char* limit,
+                                     uint32_t* v, int n) {
+  for (int i = 0; i < n && p != NULL; i++) {
+    p = GetVarint32Ptr(p, limit, &v[i]);
+  }
+  return p;
+}
+
+const char* GetVarint64PtrFallback(const char* p,
+                                   const char* limit,
+                                   uint64_t* value) {
   uint64_t result = 0;
   for (uint32_t shift = 0; shift <= 63 && p < limit; shift += 7) {
     uint64_t byte = *(reinterpret_cast<const unsigned char*>(p));
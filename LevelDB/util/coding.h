@@ -10,6 +10,7 @@
 #ifndef STORAGE_LEVELDB_UTIL_CODING_H_
 #define STORAGE_LEVELDB_UTIL_CODING_H_
 
+#include <assert.h>
 #include <stdint.h>
 #include <string.h>
 #include <string>
@@ -38,6 +39,13 @@ extern bool GetLengthPrefixedSlice(Slice* input, Slice* result);
 extern const char* GetVarint32Ptr(const char* p,const char* limit, uint32_t* v);
 extern const char* GetVarint64Ptr(const char* p,const char* limit, uint64_t* v);
 
+// Decodes the "n" consecutive varint32s starting at "p" into v[0..n-1].
+// Returns a pointer just past the last one, or NULL on error.  Only
+// looks at bytes in the range [p..limit-1].
+// REQUIRES: 0 < n <= 8
+extern const char* GetVarint32Array(const char* p, const char* limit,
+                                    uint32_t* v, int n);
+
 // Returns the length of the varint32 or varint64 encoding of "v"
 extern int VarintLength(uint64_t v);
 
@@ -99,6 +107,46 @@ inline const char* GetVarint32Ptr(const char* p,
   return GetVarint32PtrFallback(p, limit, value);
 }
 
+// Internal routine for use by fallback path of GetVarint64Ptr
+extern const char* GetVarint64PtrFallback(const char* p,
+                                          const char* limit,
+                                          uint64_t* value);
+inline const char* GetVarint64Ptr(const char* p,
+                                  const char* limit,
+                                  uint64_t* value) {
+  if (p < limit) {
+    uint64_t result = *(reinterpret_cast<const unsigned char*>(p));
+    if ((result & 128) == 0) {
+      *value = result;
+      return p + 1;
+    }
+  }
+  return GetVarint64PtrFallback(p, limit, value);
+}
+
+// Internal routine for use by fallback path of GetVarint32Array
+extern const char* GetVarint32ArrayFallback(const char* p,
+                                            const char* limit,
+                                            uint32_t* v, int n);
+inline const char* GetVarint32Array(const char* p,
+                                    const char* limit,
+                                    uint32_t* v, int n) {
+  assert(n > 0 && n <= 8);
+  if (limit - p >= 8) {
+    // When the n values take one byte each, decode them all from a
+    // single eight byte load
+    const uint64_t word = DecodeFixed64(p);
+    const uint64_t high_bits = 0x8080808080808080ull >> (64 - 8 * n);
+    if ((word & high_bits) == 0) {
+      for (int i = 0; i < n; i++) {
+        v[i] = static_cast<uint32_t>(word >> (8 * i)) & 0xff;
+      }
+      return p + n;
+    }
+  }
+  return GetVarint32ArrayFallback(p, limit, v, n);
+}
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_UTIL_CODING_H_
@@ -169,6 +169,55 @@ TEST(Coding, Varint64Truncation) {
   ASSERT_EQ(large_value, result);
 }
 
+TEST(Coding, Varint32Array) {
+  // Mostly one-byte values, with longer ones in between
+  std::vector<uint32_t> values;
+  for (uint32_t i = 0; i < 200; i++) {
+    values.push_back((i % 7 == 0) ? (i << (i % 25)) : (i % 128));
+  }
+  std::string s;
+  for (size_t i = 0; i < values.size(); i++) {
+    PutVarint32(&s, values[i]);
+  }
+
+  const char* limit = s.data() + s.size();
+  for (int n = 1; n <= 8; n++) {
+    const char* p = s.data();
+    uint32_t actual[8];
+    size_t i = 0;
+    for (; i + n <= values.size(); i += n) {
+      p = GetVarint32Array(p, limit, actual, n);
+      ASSERT_TRUE(p != NULL);
+      for (int j = 0; j < n; j++) {
+        ASSERT_EQ(values[i + j], actual[j]);
+      }
+    }
+    if (i == values.size()) {
+      ASSERT_EQ(p, limit);
+    } else {
+      // Fewer than n values are left
+      ASSERT_TRUE(GetVarint32Array(p, limit, actual, n) == NULL);
+    }
+  }
+}
+
+TEST(Coding, Varint32ArrayTruncation) {
+  // Only the first three bytes are decoded, even though the following
+  // ones are part of the same eight byte load
+  std::string s("\x01\x02\x7f\x80\x80\x80\x80\x80");
+  uint32_t result[3];
+  for (size_t len = 0; len < 3; len++) {
+    ASSERT_TRUE(GetVarint32Array(s.data(), s.data() + len, result, 3) == NULL);
+  }
+  ASSERT_EQ(s.data() + 3, GetVarint32Array(s.data(), s.data() + s.size(),
+                                           result, 3));
+  ASSERT_EQ(1u, result[0]);
+  ASSERT_EQ(2u, result[1]);
+  ASSERT_EQ(127u, result[2]);
+  ASSERT_TRUE(GetVarint32Array(s.data(), s.data() + s.size(), result, 4)
+              == NULL);
+}
+
 TEST(Coding, Strings) {
   std::string s;
   PutLengthPrefixedSlice(&s, Slice(""));
@@ -0,0 +1,369 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/compressor.h"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include "leveldb/slice.h"
+#include "port/port.h"
+#include "util/coding.h"
+
+#ifdef ZLIB
+#include <zlib.h>
+#endif
+#ifdef LZ4
+#include <lz4.h>
+#endif
+#ifdef ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+namespace leveldb {
+
+Compressor::~Compressor() { }
+
+bool Compressor::TrainDictionary(const std::vector<Slice>& samples,
+                                 size_t max_bytes,
+                                 std::string* dictionary) const {
+  return false;
+}
+
+bool Compressor::CompressWithDictionary(const Slice& dictionary,
+                                        const Slice& input,
+                                        std::string* output) const {
+  return false;
+}
+
+bool Compressor::UncompressWithDictionary(const Slice& dictionary,
+                                          const Slice& input,
+                                          char* output) const {
+  return false;
+}
+
+namespace {
+
+// Build a dictionary out of whole samples picked evenly from "samples",
+// so that it holds complete records rather than fragments of them.  This
+// is all that codecs like zlib can use: they look for matches of the
+// data they compress in the dictionary as if it preceded the data.
+static void SampleDictionary(const std::vector<Slice>& samples,
+                             size_t max_bytes,
+                             std::string* dictionary) {
+  dictionary->clear();
+  size_t total = 0;
+  for (size_t i = 0; i < samples.size(); i++) {
+    total += samples[i].size();
+  }
+  if (total == 0 || max_bytes == 0) {
+    return;
+  }
+  const size_t step = std::max<size_t>(1, total / max_bytes);
+  for (size_t i = 0; i < samples.size() && dictionary->size() < max_bytes;
+       i += step) {
+    const Slice& sample = samples[i];
+    dictionary->append(sample.data(),
+                       std::min(sample.size(), max_bytes - dictionary->size()));
+  }
+}
+
+class SnappyCompressor : public Compressor {
+ public:
+  virtual const char* Name() const { return "snappy"; }
+
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    return port::Snappy_Compress(input.data(), input.size(), output);
+  }
+
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* length) const {
+    return port::Snappy_GetUncompressedLength(input.data(), input.size(),
+                                              length);
+  }
+
+  virtual bool Uncompress(const Slice& input, char* output) const {
+    return port::Snappy_Uncompress(input.data(), input.size(), output);
+  }
+};
+
+// The codecs below do not record the uncompressed length themselves, so
+// their blocks start with it as a varint32.
+class LengthPrefixedCompressor : public Compressor {
+ public:
+  virtual bool GetUncompressedLength(const Slice& input,
+                                     size_t* length) const {
+    const char* p = input.data();
+    uint32_t n;
+    if (GetVarint32Ptr(p, p + input.size(), &n) == NULL) {
+      return false;
+    }
+    *length = n;
+    return true;
+  }
+
+ protected:
+  // Store the length prefix of "input" in *output and return its size.
+  static size_t StartOutput(const Slice& input, std::string* output) {
+    output->clear();
+    PutVarint32(output, static_cast<uint32_t>(input.size()));
+    return output->size();
+  }
+
+  // Return the compressed data that follows the length prefix of
+  // "input", and store the uncompressed length in *length.
+  static Slice Payload(const Slice& input, size_t* length) {
+    const char* p = input.data();
+    const char* limit = p + input.size();
+    uint32_t n = 0;
+    p = GetVarint32Ptr(p, limit, &n);
+    *length = n;
+    return (p == NULL) ? Slice() : Slice(p, limit - p);
+  }
+};
+
+#ifdef ZLIB
+class ZlibCompressor : public LengthPrefixedCompressor {
+ public:
+  virtual const char* Name() const { return "zlib"; }
+
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    return Deflate(Slice(), input, output);
+  }
+
+  virtual bool Uncompress(const Slice& input, char* output) const {
+    return Inflate(Slice(), input, output);
+  }
+
+  virtual bool TrainDictionary(const std::vector<Slice>& samples,
+                               size_t max_bytes,
+                               std::string* dictionary) const {
+    // Only the last 32KB of a dictionary are within reach of deflate
+    SampleDictionary(samples, std::min<size_t>(max_bytes, 32768), dictionary);
+    return true;
+  }
+
+  virtual bool CompressWithDictionary(const Slice& dictionary,
+                                      const Slice& input,
+                                      std::string* output) const {
+    return Deflate(dictionary, input, output);
+  }
+
+  virtual bool UncompressWithDictionary(const Slice& dictionary,
+                                        const Slice& input,
+                                        char* output) const {
+    return Inflate(dictionary, input, output);
+  }
+
+ private:
+  static bool Deflate(const Slice& dictionary, const Slice& input,
+                      std::string* output) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // Raw deflate: the block trailer already carries a checksum
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      return false;
+    }
+    if (!dictionary.empty() &&
+        deflateSetDictionary(
+            &stream, reinterpret_cast<const Bytef*>(dictionary.data()),
+            static_cast<uInt>(dictionary.size())) != Z_OK) {
+      deflateEnd(&stream);
+      return false;
+    }
+    const size_t start = StartOutput(input, output);
+    output->resize(start + deflateBound(&stream, input.size()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&(*output)[start]);
+    stream.avail_out = static_cast<uInt>(output->size() - start);
+    const bool ok = (deflate(&stream, Z_FINISH) == Z_STREAM_END);
+    output->resize(start + stream.total_out);
+    deflateEnd(&stream);
+    return ok;
+  }
+
+  static bool Inflate(const Slice& dictionary, const Slice& input,
+                      char* output) {
+    size_t length;
+    Slice payload = Payload(input, &length);
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (payload.empty() || inflateInit2(&stream, -15) != Z_OK) {
+      return false;
+    }
+    if (!dictionary.empty() &&
+        inflateSetDictionary(
+            &stream, reinterpret_cast<const Bytef*>(dictionary.data()),
+            static_cast<uInt>(dictionary.size())) != Z_OK) {
+      inflateEnd(&stream);
+      return false;
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(
+        const_cast<char*>(payload.data()));
+    stream.avail_in = static_cast<uInt>(payload.size());
+    stream.next_out = reinterpret_cast<Bytef*>(output);
+    stream.avail_out = static_cast<uInt>(length);
+    const bool ok = (inflate(&stream, Z_FINISH) == Z_STREAM_END &&
+                     stream.total_out == length);
+    inflateEnd(&stream);
+    return ok;
+  }
+};
+#endif
+
+#ifdef LZ4
+class LZ4Compressor : public LengthPrefixedCompressor {
+ public:
+  virtual const char* Name() const { return "lz4"; }
+
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    const size_t start = StartOutput(input, output);
+    const int bound = LZ4_compressBound(static_cast<int>(input.size()));
+    output->resize(start + bound);
+    const int n = LZ4_compress_default(input.data(), &(*output)[start],
+                                       static_cast<int>(input.size()), bound);
+    output->resize(start + n);
+    return n > 0;
+  }
+
+  virtual bool Uncompress(const Slice& input, char* output) const {
+    size_t length;
+    Slice payload = Payload(input, &length);
+    if (payload.empty()) {
+      return false;
+    }
+    const int n = LZ4_decompress_safe(payload.data(), output,
+                                      static_cast<int>(payload.size()),
+                                      static_cast<int>(length));
+    return n >= 0 && static_cast<size_t>(n) == length;
+  }
+};
+#endif
+
+#ifdef ZSTD
+class ZstdCompressor : public LengthPrefixedCompressor {
+ public:
+  virtual const char* Name() const { return "zstd"; }
+
+  virtual bool Compress(const Slice& input, std::string* output) const {
+    const size_t start = StartOutput(input, output);
+    output->resize(start + ZSTD_compressBound(input.size()));
+    const size_t n = ZSTD_compress(&(*output)[start], output->size() - start,
+                                   input.data(), input.size(), 3);
+    if (ZSTD_isError(n)) {
+      output->resize(start);
+      return false;
+    }
+    output->resize(start + n);
+    return true;
+  }
+
+  virtual bool Uncompress(const Slice& input, char* output) const {
+    size_t length;
+    Slice payload = Payload(input, &length);
+    if (payload.empty()) {
+      return false;
+    }
+    const size_t n = ZSTD_decompress(output, length,
+                                     payload.data(), payload.size());
+    return !ZSTD_isError(n) && n == length;
+  }
+
+  virtual bool TrainDictionary(const std::vector<Slice>& samples,
+                               size_t max_bytes,
+                               std::string* dictionary) const {
+    std::string buffer;
+    std::vector<size_t> sizes;
+    for (size_t i = 0; i < samples.size(); i++) {
+      buffer.append(samples[i].data(), samples[i].size());
+      sizes.push_back(samples[i].size());
+    }
+    dictionary->resize(max_bytes);
+    const size_t n = sizes.empty() ? 0 : ZDICT_trainFromBuffer(
+        &(*dictionary)[0], max_bytes, buffer.data(), &sizes[0],
+        static_cast<unsigned>(sizes.size()));
+    if (sizes.empty() || ZDICT_isError(n)) {
+      // Too few samples to train on; zstd can use plain content as well
+      SampleDictionary(samples, max_bytes, dictionary);
+    } else {
+      dictionary->resize(n);
+    }
+    return true;
+  }
+
+  virtual bool CompressWithDictionary(const Slice& dictionary,
+                                      const Slice& input,
+                                      std::string* output) const {
+    ZSTD_CCtx* context = ZSTD_createCCtx();
+    if (context == NULL) {
+      return false;
+    }
+    const size_t start = StartOutput(input, output);
+    output->resize(start + ZSTD_compressBound(input.size()));
+    const size_t n = ZSTD_compress_usingDict(
+        context, &(*output)[start], output->size() - start,
+        input.data(), input.size(), dictionary.data(), dictionary.size(), 3);
+    ZSTD_freeCCtx(context);
+    if (ZSTD_isError(n)) {
+      output->resize(start);
+      return false;
+    }
+    output->resize(start + n);
+    return true;
+  }
+
+  virtual bool UncompressWithDictionary(const Slice& dictionary,
+                                        const Slice& input,
+                                        char* output) const {
+    size_t length;
+    Slice payload = Payload(input, &length);
+    ZSTD_DCtx* context = payload.empty() ? NULL : ZSTD_createDCtx();
+    if (context == NULL) {
+      return false;
+    }
+    const size_t n = ZSTD_decompress_usingDict(
+        context, output, length, payload.data(), payload.size(),
+        dictionary.data(), dictionary.size());
+    ZSTD_freeDCtx(context);
+    return !ZSTD_isError(n) && n == length;
+  }
+};
+#endif
+
+}  // namespace
+
+static port::OnceType once = LEVELDB_ONCE_INIT;
+static const Compressor* compressors[256];
+
+static void InitModule() {
+  compressors[kSnappyCompression] = new SnappyCompressor;
+#ifdef ZLIB
+  compressors[kZlibCompression] = new ZlibCompressor;
+#endif
+#ifdef LZ4
+  compressors[kLZ4Compression] = new LZ4Compressor;
+#endif
+#ifdef ZSTD
+  compressors[kZstdCompression] = new ZstdCompressor;
+#endif
+}
+
+void RegisterCompressor(CompressionType type, const Compressor* compressor) {
+  assert(type > kNoCompression && type < 256);
+  port::InitOnce(&once, InitModule);
+  compressors[type] = compressor;
+}
+
+const Compressor* GetCompressor(CompressionType type) {
+  port::InitOnce(&once, InitModule);
+  if (type <= kNoCompression || type >= 256) {
+    return NULL;
+  }
+  return compressors[type];
+}
+
+}  // namespace leveldb
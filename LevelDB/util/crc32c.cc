@@ -3,13 +3,46 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 //
 // A portable implementation of crc32c, optimized to handle
-// four bytes at a time.
+// four bytes at a time, and implementations that use the crc32c
+// instructions of SSE4.2 and ARMv8 where the CPU has them.
 
 #include "util/crc32c.h"
 
 #include <stdint.h>
 #include "util/coding.h"
 
+#if defined(__x86_64__) || defined(__i386__) || \
+    defined(_M_X64) || defined(_M_IX86)
+#if defined(_MSC_VER) || defined(__clang__) || \
+    (defined(__GNUC__) && __GNUC__ >= 5)
+#define LEVELDB_CRC32C_SSE42 1
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#if defined(_MSC_VER) || defined(__clang__) || \
+    (defined(__GNUC__) && __GNUC__ >= 6)
+#define LEVELDB_CRC32C_ARM64 1
+#endif
+#endif
+
+#if defined(LEVELDB_CRC32C_SSE42)
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(LEVELDB_CRC32C_ARM64)
+#if defined(_MSC_VER)
+#include <windows.h>
+#include <arm64intr.h>
+#else
+#include <arm_acle.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#endif
+#endif
+#endif
+
 namespace leveldb {
 namespace crc32c {
 
@@ -278,12 +311,17 @@ static const uint32_t table3_[256] = {
   0x4a21617b, 0x9764cbc3, 0xf54642fa, 0x2803e842
 };
 
-// Used to fetch a naturally-aligned 32-bit word in little endian byte-order
+// Used to fetch naturally-aligned 32-bit and 64-bit words in little endian
+// byte-order
 static inline uint32_t LE_LOAD32(const uint8_t *p) {
   return DecodeFixed32(reinterpret_cast<const char*>(p));
 }
 
-uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+static inline uint64_t LE_LOAD64(const uint8_t *p) {
+  return DecodeFixed64(reinterpret_cast<const char*>(p));
+}
+
+uint32_t ExtendPortable(uint32_t crc, const char* buf, size_t size) {
   const uint8_t *p = reinterpret_cast<const uint8_t *>(buf);
   const uint8_t *e = p + size;
   uint32_t l = crc ^ 0xffffffffu;
@@ -328,5 +366,280 @@ uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
   return l ^ 0xffffffffu;
 }
 
+#if defined(LEVELDB_CRC32C_SSE42) || defined(LEVELDB_CRC32C_ARM64)
+
+// The crc instructions have a latency of three cycles but can start one
+// per cycle, so the hardware implementations checksum three streams of
+// the input at once and then combine their crcs.  Combining needs the
+// crc of a stream shifted past the zeros that stand in for the streams
+// after it, which the tables below compute a byte at a time.
+static const size_t kLongBlock = 8192;
+static const size_t kShortBlock = 256;
+static uint32_t long_shift_[4][256];
+static uint32_t short_shift_[4][256];
+
+// Multiply the 32x32 matrix over GF(2) "mat" by the vector "vec".
+static uint32_t MatrixTimes(const uint32_t* mat, uint32_t vec) {
+  uint32_t sum = 0;
+  while (vec != 0) {
+    if (vec & 1) {
+      sum ^= *mat;
+    }
+    vec >>= 1;
+    mat++;
+  }
+  return sum;
+}
+
+static void MatrixSquare(uint32_t* square, const uint32_t* mat) {
+  for (int n = 0; n < 32; n++) {
+    square[n] = MatrixTimes(mat, mat[n]);
+  }
+}
+
+// Fill "shift" so that Shift(shift, crc) is "crc" extended by "len"
+// zero bytes, without the pre and post conditioning.  "len" must be a
+// power of two.
+static void InitShift(uint32_t shift[4][256], size_t len) {
+  // Operator for one zero bit, then squared up to "len" zero bytes
+  uint32_t even[32], odd[32];
+  odd[0] = 0x82f63b78u;           // Reflected crc32c polynomial
+  for (int n = 1; n < 32; n++) {
+    odd[n] = 1u << (n - 1);
+  }
+  MatrixSquare(even, odd);        // Two zero bits
+  MatrixSquare(odd, even);        // Four zero bits
+  uint32_t* op = odd;
+  while (len != 0) {
+    MatrixSquare(even, odd);
+    op = even;
+    len >>= 1;
+    if (len == 0) {
+      break;
+    }
+    MatrixSquare(odd, even);
+    op = odd;
+    len >>= 1;
+  }
+  for (uint32_t n = 0; n < 256; n++) {
+    shift[0][n] = MatrixTimes(op, n);
+    shift[1][n] = MatrixTimes(op, n << 8);
+    shift[2][n] = MatrixTimes(op, n << 16);
+    shift[3][n] = MatrixTimes(op, n << 24);
+  }
+}
+
+static inline uint32_t Shift(const uint32_t shift[4][256], uint32_t crc) {
+  return shift[0][crc & 0xff] ^ shift[1][(crc >> 8) & 0xff] ^
+         shift[2][(crc >> 16) & 0xff] ^ shift[3][crc >> 24];
+}
+
+// Checksum buf[0,size-1] with the crc primitives of "Hw", which are
+//    Bytes(crc, p, n)       for any n
+//    Words(crc, p, n)       for n and p multiples of 8
+//    ThreeWay(crcs, p, n)   crcs[i] over p[i*n, (i+1)*n-1], n a multiple
+//                           of 8 and p aligned
+template <typename Hw>
+static uint32_t ExtendHardware(uint32_t crc, const char* buf, size_t size) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+  uint32_t l = crc ^ 0xffffffffu;
+
+  // Process bytes until p is 8-byte aligned
+  size_t n = (8 - (reinterpret_cast<uintptr_t>(p) & 7)) & 7;
+  if (n > size) {
+    n = size;
+  }
+  l = Hw::Bytes(l, p, n);
+  p += n;
+  size -= n;
+
+  // Process three streams at once, in long and then short blocks
+  uint32_t crcs[3];
+  while (size >= 3 * kLongBlock) {
+    crcs[0] = l;
+    crcs[1] = 0;
+    crcs[2] = 0;
+    Hw::ThreeWay(crcs, p, kLongBlock);
+    l = Shift(long_shift_, crcs[0]) ^ crcs[1];
+    l = Shift(long_shift_, l) ^ crcs[2];
+    p += 3 * kLongBlock;
+    size -= 3 * kLongBlock;
+  }
+  while (size >= 3 * kShortBlock) {
+    crcs[0] = l;
+    crcs[1] = 0;
+    crcs[2] = 0;
+    Hw::ThreeWay(crcs, p, kShortBlock);
+    l = Shift(short_shift_, crcs[0]) ^ crcs[1];
+    l = Shift(short_shift_, l) ^ crcs[2];
+    p += 3 * kShortBlock;
+    size -= 3 * kShortBlock;
+  }
+
+  // Process the rest 8 bytes and then one byte at a time
+  n = size & ~static_cast<size_t>(7);
+  l = Hw::Words(l, p, n);
+  l = Hw::Bytes(l, p + n, size - n);
+  return l ^ 0xffffffffu;
+}
+
+#endif
+
+#if defined(LEVELDB_CRC32C_SSE42)
+
+#if defined(_MSC_VER)
+#define LEVELDB_TARGET_CRC32C
+#else
+#define LEVELDB_TARGET_CRC32C __attribute__((target("sse4.2")))
+#endif
+
+static bool CanAccelerate() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;
+#else
+  unsigned int eax, ebx, ecx, edx;
+  return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
+}
+
+struct HardwareCRC {
+  LEVELDB_TARGET_CRC32C
+  static uint32_t Bytes(uint32_t crc, const uint8_t* p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      crc = _mm_crc32_u8(crc, p[i]);
+    }
+    return crc;
+  }
+
+#if defined(__x86_64__) || defined(_M_X64)
+  LEVELDB_TARGET_CRC32C
+  static uint32_t Words(uint32_t crc, const uint8_t* p, size_t n) {
+    uint64_t l = crc;
+    for (size_t i = 0; i < n; i += 8) {
+      l = _mm_crc32_u64(l, LE_LOAD64(p + i));
+    }
+    return static_cast<uint32_t>(l);
+  }
+
+  LEVELDB_TARGET_CRC32C
+  static void ThreeWay(uint32_t* crcs, const uint8_t* p, size_t n) {
+    uint64_t l0 = crcs[0], l1 = crcs[1], l2 = crcs[2];
+    for (size_t i = 0; i < n; i += 8) {
+      l0 = _mm_crc32_u64(l0, LE_LOAD64(p + i));
+      l1 = _mm_crc32_u64(l1, LE_LOAD64(p + n + i));
+      l2 = _mm_crc32_u64(l2, LE_LOAD64(p + 2 * n + i));
+    }
+    crcs[0] = static_cast<uint32_t>(l0);
+    crcs[1] = static_cast<uint32_t>(l1);
+    crcs[2] = static_cast<uint32_t>(l2);
+  }
+#else
+  // 32-bit x86 has no 64-bit form of the instruction
+  LEVELDB_TARGET_CRC32C
+  static uint32_t Words(uint32_t crc, const uint8_t* p, size_t n) {
+    for (size_t i = 0; i < n; i += 4) {
+      crc = _mm_crc32_u32(crc, LE_LOAD32(p + i));
+    }
+    return crc;
+  }
+
+  LEVELDB_TARGET_CRC32C
+  static void ThreeWay(uint32_t* crcs, const uint8_t* p, size_t n) {
+    uint32_t l0 = crcs[0], l1 = crcs[1], l2 = crcs[2];
+    for (size_t i = 0; i < n; i += 4) {
+      l0 = _mm_crc32_u32(l0, LE_LOAD32(p + i));
+      l1 = _mm_crc32_u32(l1, LE_LOAD32(p + n + i));
+      l2 = _mm_crc32_u32(l2, LE_LOAD32(p + 2 * n + i));
+    }
+    crcs[0] = l0;
+    crcs[1] = l1;
+    crcs[2] = l2;
+  }
+#endif
+};
+
+#elif defined(LEVELDB_CRC32C_ARM64)
+
+#if defined(_MSC_VER)
+#define LEVELDB_TARGET_CRC32C
+#elif defined(__clang__)
+#define LEVELDB_TARGET_CRC32C __attribute__((target("crc")))
+#else
+#define LEVELDB_TARGET_CRC32C __attribute__((target("+crc")))
+#endif
+
+static bool CanAccelerate() {
+#if defined(_MSC_VER)
+  return IsProcessorFeaturePresent(PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE)
+      != 0;
+#elif defined(__APPLE__)
+  return true;                    // All 64-bit Apple CPUs have them
+#elif defined(__linux__)
+  return (getauxval(AT_HWCAP) & (1 << 7)) != 0;   // HWCAP_CRC32
+#else
+  return false;
+#endif
+}
+
+struct HardwareCRC {
+  LEVELDB_TARGET_CRC32C
+  static uint32_t Bytes(uint32_t crc, const uint8_t* p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      crc = __crc32cb(crc, p[i]);
+    }
+    return crc;
+  }
+
+  LEVELDB_TARGET_CRC32C
+  static uint32_t Words(uint32_t crc, const uint8_t* p, size_t n) {
+    for (size_t i = 0; i < n; i += 8) {
+      crc = __crc32cd(crc, LE_LOAD64(p + i));
+    }
+    return crc;
+  }
+
+  LEVELDB_TARGET_CRC32C
+  static void ThreeWay(uint32_t* crcs, const uint8_t* p, size_t n) {
+    uint32_t l0 = crcs[0], l1 = crcs[1], l2 = crcs[2];
+    for (size_t i = 0; i < n; i += 8) {
+      l0 = __crc32cd(l0, LE_LOAD64(p + i));
+      l1 = __crc32cd(l1, LE_LOAD64(p + n + i));
+      l2 = __crc32cd(l2, LE_LOAD64(p + 2 * n + i));
+    }
+    crcs[0] = l0;
+    crcs[1] = l1;
+    crcs[2] = l2;
+  }
+};
+
+#endif
+
+typedef uint32_t (*ExtendFunction)(uint32_t, const char*, size_t);
+
+static ExtendFunction ChooseExtendFunction() {
+#if defined(LEVELDB_CRC32C_SSE42) || defined(LEVELDB_CRC32C_ARM64)
+  if (CanAccelerate()) {
+    InitShift(long_shift_, kLongBlock);
+    InitShift(short_shift_, kShortBlock);
+    return &ExtendHardware<HardwareCRC>;
+  }
+#endif
+  return &ExtendPortable;
+}
+
+// Chosen once, while static objects are initialized, so that Extend()
+// does not have to check on every call
+static const ExtendFunction extend_function = ChooseExtendFunction();
+
+uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+  return (*extend_function)(crc, buf, size);
+}
+
+bool IsHardwareAccelerated() {
+  return extend_function != &ExtendPortable;
+}
+
 }  // namespace crc32c
 }  // namespace leveldb
@@ -14,8 +14,15 @@ namespace crc32c {
 // Return the crc32c of concat(A, data[0,n-1]) where init_crc is the
 // crc32c of some string A.  Extend() is often used to maintain the
 // crc32c of a stream of data.
+// Uses the crc32c instructions of SSE4.2 or ARMv8 if the CPU has them.
 extern uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
 
+// Same as Extend(), but always computed in software.
+extern uint32_t ExtendPortable(uint32_t init_crc, const char* data, size_t n);
+
+// Returns true if Extend() uses crc32c instructions of the CPU.
+extern bool IsHardwareAccelerated();
+
 // Return the crc32c of data[0,n-1]
 inline uint32_t Value(const char* data, size_t n) {
   return Extend(0, data, n);
@@ -56,6 +56,25 @@ TEST(CRC, Extend) {
             Extend(Value("hello ", 6), "world", 5));
 }
 
+TEST(CRC, HardwareMatchesPortable) {
+  // Lengths around the block sizes of the hardware implementations,
+  // at every alignment
+  std::string data(3 * 8192 * 2 + 1000, '\0');
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<char>(i * 7 + (i >> 8));
+  }
+  const size_t kLengths[] = { 0, 1, 7, 8, 9, 255, 767, 768, 769, 1000,
+                              4096, 24575, 24576, 24577, 50000 };
+  for (size_t i = 0; i < sizeof(kLengths) / sizeof(kLengths[0]); i++) {
+    for (size_t offset = 0; offset < 8; offset++) {
+      const char* p = data.data() + offset;
+      const size_t n = kLengths[i];
+      ASSERT_EQ(ExtendPortable(0, p, n), Extend(0, p, n));
+      ASSERT_EQ(ExtendPortable(0x12345678, p, n), Extend(0x12345678, p, n));
+    }
+  }
+}
+
 TEST(CRC, Mask) {
   uint32_t crc = Value("foo", 3);
   ASSERT_NE(crc, Mask(crc));
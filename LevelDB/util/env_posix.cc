@@ -17,6 +17,7 @@
 #include <unistd.h>
 #include <deque>
 #include <set>
+#include <vector>
 #include "leveldb/env.h"
 #include "leveldb/slice.h"
 #include "port/port.h"
@@ -449,6 +450,8 @@ class PosixEnv : public Env {
 
   virtual void Schedule(void (*function)(void*), void* arg);
 
+  virtual void SetBackgroundThreads(int number);
+
   virtual void StartThread(void (*function)(void* arg), void* arg);
 
   virtual Status GetTestDirectory(std::string* result) {
@@ -510,8 +513,8 @@ class PosixEnv : public Env {
 
   pthread_mutex_t mu_;
   pthread_cond_t bgsignal_;
-  pthread_t bgthread_;
-  bool started_bgthread_;
+  std::vector<pthread_t> bgthreads_;
+  int max_bgthreads_;    // Size the pool may grow to; see SetBackgroundThreads
 
   // Entry per Schedule() call
   struct BGItem { void* arg; void (*function)(void*); };
@@ -522,7 +525,7 @@ class PosixEnv : public Env {
   MmapLimiter mmap_limit_;
 };
 
-PosixEnv::PosixEnv() : started_bgthread_(false) {
+PosixEnv::PosixEnv() : max_bgthreads_(1) {
   PthreadCall("mutex_init", pthread_mutex_init(&mu_, NULL));
   PthreadCall("cvar_init", pthread_cond_init(&bgsignal_, NULL));
 }
@@ -530,19 +533,19 @@ PosixEnv::PosixEnv() : started_bgthread_(false) {
 void PosixEnv::Schedule(void (*function)(void*), void* arg) {
   PthreadCall("lock", pthread_mutex_lock(&mu_));
 
-  // Start background thread if necessary
-  if (!started_bgthread_) {
-    started_bgthread_ = true;
+  // Start background threads if necessary.  Threads are created lazily
+  // so that an Env that never runs background work costs nothing.
+  while (bgthreads_.size() < static_cast<size_t>(max_bgthreads_)) {
+    pthread_t t;
     PthreadCall(
         "create thread",
-        pthread_create(&bgthread_, NULL,  &PosixEnv::BGThreadWrapper, this));
+        pthread_create(&t, NULL,  &PosixEnv::BGThreadWrapper, this));
+    bgthreads_.push_back(t);
   }
 
-  // If the queue is currently empty, the background thread may currently be
-  // waiting.
-  if (queue_.empty()) {
-    PthreadCall("signal", pthread_cond_signal(&bgsignal_));
-  }
+  // Several background threads may be waiting, so wake one of them up
+  // for every item we add.
+  PthreadCall("signal", pthread_cond_signal(&bgsignal_));
 
   // Add to priority queue
   queue_.push_back(BGItem());
@@ -552,6 +555,14 @@ void PosixEnv::Schedule(void (*function)(void*), void* arg) {
   PthreadCall("unlock", pthread_mutex_unlock(&mu_));
 }
 
+void PosixEnv::SetBackgroundThreads(int number) {
+  PthreadCall("lock", pthread_mutex_lock(&mu_));
+  if (number > max_bgthreads_) {
+    max_bgthreads_ = number;
+  }
+  PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+}
+
 void PosixEnv::BGThread() {
   while (true) {
     // Wait until there is an item that is ready to run
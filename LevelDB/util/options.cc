@@ -18,11 +18,34 @@ Options::Options()
       info_log(NULL),
       write_buffer_size(4<<20),
       max_open_files(1000),
+      max_background_compactions(1),
+      max_subcompactions(1),
+      pipelined_compaction(false),
+      max_bytes_for_level_base(10 * 1048576),
+      max_bytes_for_level_multiplier(10),
+      dynamic_level_bytes(false),
+      compaction_style(kLevelCompaction),
+      universal_size_ratio(1),
+      universal_max_sorted_runs(4),
+      compaction_pri(kRoundRobin),
+      deletion_compaction_ratio(0),
+      periodic_compaction_seconds(0),
+      table_format(kBlockBasedTable),
       block_cache(NULL),
       block_size(4096),
       block_restart_interval(16),
+      block_format_version(1),
+      internal_keys(false),
       compression(kSnappyCompression),
-      filter_policy(NULL) {
+      compression_dictionary_bytes(0),
+      compression_threads(1),
+      min_blob_size(0),
+      blob_file_size(256 << 20),
+      blob_gc_ratio(0.5),
+      filter_policy(NULL),
+      compaction_filter(NULL),
+      merge_operator(NULL),
+      rate_limiter(NULL) {
 }
 
 
@@ -0,0 +1,160 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <assert.h>
+#include <algorithm>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() { }
+
+namespace {
+
+// Shortest and longest time a throttled request sleeps before checking
+// the bucket again.
+static const int kMinWaitMicros = 1000;
+static const int kMaxWaitMicros = 100000;
+
+// Bytes allowed to accumulate while idle, in seconds' worth of budget.
+static const double kBurstSeconds = 0.1;
+
+// Share of the budget used by auto-tuned limiters without pressure.
+static const double kMinAutoTunedFraction = 0.25;
+
+// A token bucket.  Requests are granted as long as the bucket is not
+// empty, and may drive it negative; later requests then wait until the
+// debt has been paid back by the passing of time.
+class TokenBucketRateLimiter : public RateLimiter {
+ public:
+  TokenBucketRateLimiter(Env* env, int64_t bytes_per_second, bool auto_tuned)
+      : env_(env),
+        auto_tuned_(auto_tuned),
+        max_rate_(bytes_per_second),
+        pressure_(0),
+        high_waiting_(0) {
+    assert(bytes_per_second > 0);
+    for (int i = 0; i < 2; i++) {
+      throttled_micros_[i] = 0;
+      total_bytes_[i] = 0;
+    }
+    UpdateRate();
+    available_ = rate_ * kBurstSeconds;
+    last_refill_micros_ = env_->NowMicros();
+  }
+
+  virtual void Request(int64_t bytes, Priority priority) {
+    MutexLock l(&mu_);
+    total_bytes_[priority] += bytes;
+    if (priority == kHighPriority) {
+      high_waiting_++;
+    }
+    const uint64_t start_micros = env_->NowMicros();
+    bool waited = false;
+    while (true) {
+      Refill();
+      if (available_ >= 0 &&
+          (priority == kHighPriority || high_waiting_ == 0)) {
+        available_ -= bytes;
+        break;
+      }
+      // Sleep until the debt should have been paid back
+      double wait = (available_ < 0) ? -available_ * 1e6 / rate_ : 0;
+      wait = std::max(wait, static_cast<double>(kMinWaitMicros));
+      wait = std::min(wait, static_cast<double>(kMaxWaitMicros));
+      mu_.Unlock();
+      env_->SleepForMicroseconds(static_cast<int>(wait));
+      mu_.Lock();
+      waited = true;
+    }
+    if (priority == kHighPriority) {
+      high_waiting_--;
+    }
+    if (waited) {
+      throttled_micros_[priority] += env_->NowMicros() - start_micros;
+    }
+  }
+
+  virtual void SetBytesPerSecond(int64_t bytes_per_second) {
+    assert(bytes_per_second > 0);
+    MutexLock l(&mu_);
+    Refill();
+    max_rate_ = bytes_per_second;
+    UpdateRate();
+  }
+
+  virtual int64_t GetBytesPerSecond() const {
+    MutexLock l(&mu_);
+    return static_cast<int64_t>(rate_);
+  }
+
+  virtual void SetCompactionPressure(double pressure) {
+    MutexLock l(&mu_);
+    Refill();
+    pressure_ = pressure;
+    UpdateRate();
+  }
+
+  virtual uint64_t GetThrottledMicros(Priority priority) const {
+    MutexLock l(&mu_);
+    return throttled_micros_[priority];
+  }
+
+  virtual uint64_t GetTotalBytes(Priority priority) const {
+    MutexLock l(&mu_);
+    return total_bytes_[priority];
+  }
+
+ private:
+  // Credit the bucket with the budget accrued since the last refill.
+  // REQUIRES: mu_ is held
+  void Refill() {
+    const uint64_t now = env_->NowMicros();
+    if (now > last_refill_micros_) {
+      available_ += (now - last_refill_micros_) * rate_ / 1e6;
+      available_ = std::min(available_, rate_ * kBurstSeconds);
+    }
+    last_refill_micros_ = now;
+  }
+
+  // REQUIRES: mu_ is held
+  void UpdateRate() {
+    double fraction = 1.0;
+    if (auto_tuned_) {
+      fraction = std::min(1.0, std::max(kMinAutoTunedFraction,
+                                        pressure_ / 2.0));
+    }
+    rate_ = std::max(1.0, max_rate_ * fraction);
+  }
+
+  Env* const env_;
+  const bool auto_tuned_;
+
+  mutable port::Mutex mu_;
+  int64_t max_rate_;
+  double pressure_;
+  double rate_;                   // Bytes per second currently enforced
+  double available_;              // Bytes that may be written right away
+  uint64_t last_refill_micros_;
+  int high_waiting_;              // kHighPriority requests in Request()
+  uint64_t throttled_micros_[2];  // Indexed by Priority
+  uint64_t total_bytes_[2];
+};
+
+}  // namespace
+
+RateLimiter* NewRateLimiter(int64_t bytes_per_second, bool auto_tuned) {
+  return NewRateLimiter(Env::Default(), bytes_per_second, auto_tuned);
+}
+
+RateLimiter* NewRateLimiter(Env* env, int64_t bytes_per_second,
+                            bool auto_tuned) {
+  return new TokenBucketRateLimiter(env, bytes_per_second, auto_tuned);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,191 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/rate_limiter.h"
+
+#include <vector>
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+namespace {
+
+// An Env whose clock only moves when asked to.  With "auto_advance",
+// sleeping moves the clock forward by the time slept; otherwise sleepers
+// block until Advance() moves the clock past their wakeup time.
+class FakeClockEnv : public EnvWrapper {
+ public:
+  explicit FakeClockEnv(bool auto_advance)
+      : EnvWrapper(Env::Default()),
+        auto_advance_(auto_advance),
+        cv_(&mu_),
+        now_(0),
+        sleepers_(0) {
+  }
+
+  virtual uint64_t NowMicros() {
+    MutexLock l(&mu_);
+    return now_;
+  }
+
+  virtual void SleepForMicroseconds(int micros) {
+    MutexLock l(&mu_);
+    if (auto_advance_) {
+      now_ += micros;
+      return;
+    }
+    const uint64_t deadline = now_ + micros;
+    sleepers_++;
+    cv_.SignalAll();
+    while (now_ < deadline) {
+      cv_.Wait();
+    }
+    sleepers_--;
+  }
+
+  void Advance(uint64_t micros) {
+    MutexLock l(&mu_);
+    now_ += micros;
+    cv_.SignalAll();
+  }
+
+  // Wait until "n" threads are blocked in SleepForMicroseconds().
+  void WaitForSleepers(int n) {
+    MutexLock l(&mu_);
+    while (sleepers_ < n) {
+      cv_.Wait();
+    }
+  }
+
+ private:
+  const bool auto_advance_;
+  port::Mutex mu_;
+  port::CondVar cv_;
+  uint64_t now_;
+  int sleepers_;
+};
+
+}  // namespace
+
+class RateLimiterTest { };
+
+TEST(RateLimiterTest, Rate) {
+  FakeClockEnv env(true);
+  RateLimiter* limiter = NewRateLimiter(&env, 1000000, false);
+  ASSERT_EQ(1000000, limiter->GetBytesPerSecond());
+
+  // The first 100000 bytes are the initial burst and the next request
+  // runs into debt; each of the remaining 19 waits for 10000 bytes' worth
+  // of budget.
+  for (int i = 0; i < 30; i++) {
+    limiter->Request(10000, RateLimiter::kLowPriority);
+  }
+  ASSERT_EQ(190000u, env.NowMicros());
+  ASSERT_EQ(300000u, limiter->GetTotalBytes(RateLimiter::kLowPriority));
+  ASSERT_EQ(0u, limiter->GetTotalBytes(RateLimiter::kHighPriority));
+  ASSERT_EQ(190000u, limiter->GetThrottledMicros(RateLimiter::kLowPriority));
+  ASSERT_EQ(0u, limiter->GetThrottledMicros(RateLimiter::kHighPriority));
+
+  // Budget accrued while idle is capped at the burst size
+  env.Advance(1000000);
+  for (int i = 0; i < 11; i++) {
+    limiter->Request(10000, RateLimiter::kHighPriority);
+  }
+  ASSERT_EQ(1190000u, env.NowMicros());
+  limiter->Request(10000, RateLimiter::kHighPriority);
+  ASSERT_EQ(1200000u, env.NowMicros());
+  ASSERT_EQ(120000u, limiter->GetTotalBytes(RateLimiter::kHighPriority));
+  ASSERT_EQ(10000u, limiter->GetThrottledMicros(RateLimiter::kHighPriority));
+  delete limiter;
+}
+
+TEST(RateLimiterTest, AutoTuned) {
+  FakeClockEnv env(true);
+  RateLimiter* limiter = NewRateLimiter(&env, 1000000, true);
+  ASSERT_EQ(250000, limiter->GetBytesPerSecond());
+
+  // Without pressure the 25000 byte burst is paid back at 250000 bytes
+  // per second.
+  limiter->Request(50000, RateLimiter::kLowPriority);
+  limiter->Request(1, RateLimiter::kLowPriority);
+  ASSERT_EQ(100000u, limiter->GetThrottledMicros(RateLimiter::kLowPriority));
+
+  limiter->SetCompactionPressure(1.0);
+  ASSERT_EQ(500000, limiter->GetBytesPerSecond());
+  limiter->SetCompactionPressure(3.0);
+  ASSERT_EQ(1000000, limiter->GetBytesPerSecond());
+  limiter->SetBytesPerSecond(2000000);
+  ASSERT_EQ(2000000, limiter->GetBytesPerSecond());
+  limiter->SetCompactionPressure(0.1);
+  ASSERT_EQ(500000, limiter->GetBytesPerSecond());
+  delete limiter;
+}
+
+namespace {
+struct PriorityState {
+  RateLimiter* limiter;
+  port::Mutex mu;
+  std::vector<RateLimiter::Priority> order;
+};
+
+static void Request(PriorityState* state, int64_t bytes,
+                    RateLimiter::Priority priority) {
+  state->limiter->Request(bytes, priority);
+  MutexLock l(&state->mu);
+  state->order.push_back(priority);
+}
+
+static void LowPriorityRequest(void* arg) {
+  Request(reinterpret_cast<PriorityState*>(arg), 1,
+          RateLimiter::kLowPriority);
+}
+
+static void HighPriorityRequest(void* arg) {
+  Request(reinterpret_cast<PriorityState*>(arg), 200000,
+          RateLimiter::kHighPriority);
+}
+}  // namespace
+
+TEST(RateLimiterTest, FlushesGoFirst) {
+  FakeClockEnv env(false);
+  PriorityState state;
+  state.limiter = NewRateLimiter(&env, 1000000, false);
+
+  // Run a tenth of a second into debt, then queue a compaction write
+  // ahead of a flush write.  Once the debt is paid the flush write goes
+  // first and runs into debt again, so the compaction write has to wait
+  // for that too.
+  state.limiter->Request(200000, RateLimiter::kLowPriority);
+  env.StartThread(&LowPriorityRequest, &state);
+  env.WaitForSleepers(1);
+  env.StartThread(&HighPriorityRequest, &state);
+  env.WaitForSleepers(2);
+
+  while (true) {
+    {
+      MutexLock l(&state.mu);
+      if (state.order.size() == 2) {
+        break;
+      }
+    }
+    env.Advance(100000);
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+  ASSERT_EQ(RateLimiter::kHighPriority, state.order[0]);
+  ASSERT_EQ(RateLimiter::kLowPriority, state.order[1]);
+  ASSERT_GE(state.limiter->GetThrottledMicros(RateLimiter::kHighPriority),
+            100000u);
+  ASSERT_GE(state.limiter->GetThrottledMicros(RateLimiter::kLowPriority),
+            300000u);
+  delete state.limiter;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}